@@ -0,0 +1,1007 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./arith.h"
+#include "./vars.h"
+
+#define ARITH_MAX 256   /* instructions in a compiled expression */
+#define ARITH_STACK 64  /* depth of the evaluation stack */
+#define ARITH_CACHE 64  /* compiled expressions kept, a power of two */
+#define ARITH_NEST 32   /* depth of values that are expressions themselves */
+
+/* instructions; "top" is the top of the stack */
+enum {
+    A_NUM,        /* push num */
+    A_LOAD,       /* push the value of var */
+    A_LOAD_EL,    /* pop an index, push that element of var */
+    A_STORE,      /* set var to top */
+    A_STORE_EL,   /* pop a value and an index, set the element, push the value */
+    A_INC,        /* add 1 to var if arg is set, else -1, push the new value */
+    A_POSTINC,    /* the same, pushing the old value */
+    A_INC_EL,     /* A_INC on the element at a popped index */
+    A_POSTINC_EL, /* A_POSTINC on the element at a popped index */
+    A_DUP,        /* push top again */
+    A_POP,        /* drop top */
+    A_NEG,        /* unary operators on top */
+    A_NOT,
+    A_BNOT,
+    A_MUL,        /* binary operators, popping two and pushing one */
+    A_DIV,
+    A_MOD,
+    A_ADD,
+    A_SUB,
+    A_SHL,
+    A_SHR,
+    A_LT,
+    A_LE,
+    A_GT,
+    A_GE,
+    A_EQ,
+    A_NE,
+    A_BAND,
+    A_BXOR,
+    A_BOR,
+    A_POW,
+    A_JZ,         /* pop, jump to arg if zero */
+    A_JMP,        /* jump to arg */
+    A_AND,        /* pop, push 0 and jump to arg if zero */
+    A_OR,         /* pop, push 1 and jump to arg if not zero */
+    A_BOOL        /* make top 0 or 1 */
+};
+
+typedef struct arith_insn {
+    uint32_t op;
+    uint32_t arg;      /* jump target, or direction of ++ and -- */
+    union {
+        int64_t num;
+        var_t *var;
+    } u;
+} arith_insn_t;
+
+/* an expression being compiled */
+typedef struct compiler {
+    const char *text;
+    size_t len;
+    size_t i;          /* offset reached in text */
+    arith_insn_t code[ARITH_MAX];
+    uint32_t n;
+    int sp;            /* stack depth after the code so far, counting every branch */
+    int max_sp;
+    uint32_t lv;       /* the load of the variable just parsed, if it is the last instruction */
+    uint32_t lv_start; /* where the code of that variable, with its subscript, starts */
+    const char *error; /* reason compiling failed, NULL while it has not */
+} compiler_t;
+
+/* a compiled expression in the cache */
+typedef struct cached {
+    char *text;
+    size_t len;
+    uint32_t hash;
+    uint32_t n;
+    arith_insn_t *code;
+} cached_t;
+
+/* binary operators, by precedence; || and && are compiled apart */
+static const struct binop {
+    const char *s;
+    int prec;
+    uint32_t op;
+} binops[] = {
+    {"||", 1, A_OR}, {"&&", 2, A_AND}, {"|", 3, A_BOR}, {"^", 4, A_BXOR}, {"&", 5, A_BAND},
+    {"==", 6, A_EQ}, {"!=", 6, A_NE}, {"<=", 7, A_LE}, {">=", 7, A_GE}, {"<<", 8, A_SHL},
+    {">>", 8, A_SHR}, {"<", 7, A_LT}, {">", 7, A_GT}, {"+", 9, A_ADD}, {"-", 9, A_SUB},
+    {"*", 10, A_MUL}, {"/", 10, A_DIV}, {"%", 10, A_MOD},
+};
+
+/* Global Variables */
+static cached_t cache[ARITH_CACHE];
+static int nest;   /* values being evaluated as expressions */
+
+static int eval(const arith_insn_t *code, uint32_t n, int64_t *result, const char *text, size_t len);
+static void parse_comma(compiler_t *c);
+
+/* Helper Functions */
+
+/*
+ * Function: hash
+ * FNV-1a hash of the first len bytes of s.
+ */
+static uint32_t hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Function: error
+ * Reports an expression that can not be evaluated. Returns -1.
+ */
+static int error(const char *text, size_t len, const char *why)
+{
+    /* leave out blanks around the expression */
+    while (len && strchr(" \t\n", *text))
+    {
+        text++;
+        len--;
+    }
+    while (len && strchr(" \t\n", text[len - 1]))
+    {
+        len--;
+    }
+    fprintf(stderr, "ERROR : %.*s: %s.\n", (int)len, text, why);
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * Function: skip
+ * Skips blanks and line breaks. Returns the next character, 0 at the end.
+ */
+static char skip(compiler_t *c)
+{
+    while (c->i < c->len && strchr(" \t\n", c->text[c->i]))
+    {
+        c->i++;
+    }
+    return c->i < c->len ? c->text[c->i] : '\0';
+}
+
+/*
+ * Function: at
+ * Checks whether the operator s comes next.
+ */
+static int at(compiler_t *c, const char *s)
+{
+    size_t n = strlen(s);
+
+    skip(c);
+    return c->len - c->i >= n && !strncmp(c->text + c->i, s, n);
+}
+
+/*
+ * Function: emit
+ * Adds an instruction. Returns its index.
+ */
+static uint32_t emit(compiler_t *c, uint32_t op, int effect)
+{
+    /* if the expression is too long */
+    if (c->n == ARITH_MAX)
+    {
+        if (c->error == NULL)
+        {
+            c->error = "expression too long";
+        }
+        return c->n - 1;
+    }
+    memset(&c->code[c->n], 0, sizeof(arith_insn_t));
+    c->code[c->n].op = op;
+    c->sp += effect;
+    if (c->sp > c->max_sp)
+    {
+        c->max_sp = c->sp;
+    }
+    return c->n++;
+}
+
+/*
+ * Function: fail
+ * Records why compiling failed, unless it failed already.
+ */
+static void fail(compiler_t *c, const char *why)
+{
+    if (c->error == NULL)
+    {
+        c->error = why;
+    }
+}
+
+/*
+ * Function: digit
+ * Value of a digit of a number in some base: 0-9, a-z, A-Z (as 10-35, or
+ * 36-61 above base 36), @ and _. Returns -1 if c is none of these.
+ */
+static int digit(char c, int base)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c - 'A' + (base > 36 ? 36 : 10);
+    }
+    if (c == '@')
+    {
+        return 62;
+    }
+    if (c == '_')
+    {
+        return 63;
+    }
+    return -1;
+}
+
+/*
+ * Function: number
+ * Reads a number at s[*ip]: decimal, 0x hex, 0 octal or base#digits.
+ * Returns 0 on success, -1 if it is malformed.
+ */
+static int number(const char *s, size_t len, size_t *ip, int64_t *out)
+{
+    size_t i = *ip;
+    uint64_t v = 0;
+    int base = 10;
+    int d;
+
+    if (s[i] == '0' && i + 1 < len && (s[i + 1] == 'x' || s[i + 1] == 'X'))
+    {
+        base = 16;
+        i += 2;
+    }
+    else if (s[i] == '0')
+    {
+        base = 8;
+    }
+    else
+    {
+        size_t j = i;
+
+        /* if it is base#digits */
+        while (j < len && s[j] >= '0' && s[j] <= '9')
+        {
+            j++;
+        }
+        if (j < len && s[j] == '#')
+        {
+            base = atoi(s + i);
+            i = j + 1;
+            if (base < 2 || base > 64)
+            {
+                return -1;
+            }
+        }
+    }
+    while (i < len && (d = digit(s[i], base)) != -1)
+    {
+        if (d >= base)
+        {
+            return -1;
+        }
+        v = v * (uint64_t)base + (uint64_t)d;
+        i++;
+    }
+    *out = (int64_t)v;
+    *ip = i;
+    return 0;
+}
+
+/*
+ * Function: lvalue
+ * Checks that the code since start is just the load of a variable, which
+ * may be assigned to.
+ */
+static int lvalue(const compiler_t *c, uint32_t start)
+{
+    return c->n && c->lv == c->n - 1 && c->lv_start == start &&
+           (c->code[c->lv].op == A_LOAD || c->code[c->lv].op == A_LOAD_EL);
+}
+
+/*
+ * Function: parse_primary
+ * Parses a number, a variable, an element name[expr] or ( expr ).
+ */
+static void parse_primary(compiler_t *c)
+{
+    uint32_t start = c->n;
+    char ch = skip(c);
+
+    if (ch == '(')
+    {
+        c->i++;
+        parse_comma(c);
+        if (skip(c) != ')')
+        {
+            fail(c, "missing )");
+            return;
+        }
+        c->i++;
+        return;
+    }
+    if (ch >= '0' && ch <= '9')
+    {
+        int64_t v;
+
+        if (number(c->text, c->len, &c->i, &v) == -1 ||
+            (c->i < c->len && (var_name_ok(c->text + c->i, 1) || (c->text[c->i] >= '0' && c->text[c->i] <= '9'))))
+        {
+            fail(c, "invalid number");
+            return;
+        }
+        c->code[emit(c, A_NUM, 1)].u.num = v;
+        return;
+    }
+    if (var_name_ok(&ch, 1))
+    {
+        size_t s = c->i;
+        var_t *var;
+        uint32_t op = A_LOAD;
+
+        while (c->i < c->len && (var_name_ok(c->text + c->i, 1) || (c->text[c->i] >= '0' && c->text[c->i] <= '9')))
+        {
+            c->i++;
+        }
+        /* if the name can not be interned */
+        if ((var = var_intern(c->text + s, c->i - s)) == NULL)
+        {
+            fail(c, "out of memory");
+            return;
+        }
+        /* an element has its subscript computed first */
+        if (c->i < c->len && c->text[c->i] == '[')
+        {
+            c->i++;
+            parse_comma(c);
+            if (skip(c) != ']')
+            {
+                fail(c, "missing ]");
+                return;
+            }
+            c->i++;
+            op = A_LOAD_EL;
+        }
+        c->lv = emit(c, op, op == A_LOAD);
+        c->lv_start = start;
+        c->code[c->lv].u.var = var;
+        return;
+    }
+    fail(c, ch ? "operand expected" : "operand expected at end");
+}
+
+/*
+ * Function: parse_postfix
+ * Parses an operand that may be followed by ++ or --.
+ */
+static void parse_postfix(compiler_t *c)
+{
+    uint32_t start = c->n;
+
+    parse_primary(c);
+    if (at(c, "++") || at(c, "--"))
+    {
+        /* if it is not a variable */
+        if (!lvalue(c, start))
+        {
+            fail(c, "++ or -- needs a variable");
+            return;
+        }
+        c->code[c->lv].op = c->code[c->lv].op == A_LOAD ? A_POSTINC : A_POSTINC_EL;
+        c->code[c->lv].arg = c->text[c->i] == '+';
+        c->i += 2;
+        c->lv = (uint32_t)-1;
+    }
+}
+
+/*
+ * Function: parse_unary
+ * Parses - + ! ~ ++ and -- before an operand, then a power a ** b.
+ */
+static void parse_unary(compiler_t *c)
+{
+    uint32_t start = c->n;
+
+    if (at(c, "++") || at(c, "--"))
+    {
+        int up = c->text[c->i] == '+';
+
+        c->i += 2;
+        parse_unary(c);
+        /* if it is not a variable */
+        if (!lvalue(c, start))
+        {
+            fail(c, "++ or -- needs a variable");
+            return;
+        }
+        c->code[c->lv].op = c->code[c->lv].op == A_LOAD ? A_INC : A_INC_EL;
+        c->code[c->lv].arg = (uint32_t)up;
+        c->lv = (uint32_t)-1;
+        return;
+    }
+    if (at(c, "-") || at(c, "+") || at(c, "!") || at(c, "~"))
+    {
+        char op = c->text[c->i++];
+
+        parse_unary(c);
+        if (op != '+')
+        {
+            emit(c, op == '-' ? A_NEG : op == '!' ? A_NOT : A_BNOT, 0);
+        }
+        return;
+    }
+    parse_postfix(c);
+    /* ** is right associative and binds tighter than * */
+    if (at(c, "**") && !at(c, "**="))
+    {
+        c->i += 2;
+        parse_unary(c);
+        emit(c, A_POW, -1);
+    }
+}
+
+/*
+ * Function: binop
+ * Finds the binary operator that comes next, if it is not the start of an
+ * assignment like += or <<=. Returns NULL if there is none.
+ */
+static const struct binop *binop(compiler_t *c)
+{
+    for (size_t k = 0; k < sizeof(binops) / sizeof(binops[0]); k++)
+    {
+        size_t n = strlen(binops[k].s);
+
+        if (at(c, binops[k].s))
+        {
+            const char *next = c->text + c->i + n;
+            int rest = c->i + n < c->len;
+
+            /* if it starts an assignment such as += or <<=, or is the start of ++ -- ** */
+            if (rest && ((*next == '=' && binops[k].prec >= 3 && binops[k].prec != 6 && binops[k].prec != 7) ||
+                         (n == 1 && *next == binops[k].s[0] && strchr("+-*", *next))))
+            {
+                return NULL;
+            }
+            return &binops[k];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: parse_binary
+ * Parses operands joined by binary operators of precedence prec or higher.
+ */
+static void parse_binary(compiler_t *c, int prec)
+{
+    const struct binop *b;
+
+    if (prec > 10)
+    {
+        parse_unary(c);
+        return;
+    }
+    parse_binary(c, prec + 1);
+    while (c->error == NULL && (b = binop(c)) != NULL && b->prec == prec)
+    {
+        c->i += strlen(b->s);
+        if (b->op == A_AND || b->op == A_OR)
+        {
+            /* the right side only runs if the left does not decide */
+            uint32_t j = emit(c, b->op, -1);
+
+            parse_binary(c, prec + 1);
+            emit(c, A_BOOL, 0);
+            c->code[j].arg = c->n;
+            continue;
+        }
+        parse_binary(c, prec + 1);
+        emit(c, b->op, -1);
+    }
+}
+
+/*
+ * Function: parse_ternary
+ * Parses cond ? a : b.
+ */
+static void parse_ternary(compiler_t *c)
+{
+    uint32_t jz;
+    uint32_t jmp;
+
+    parse_binary(c, 1);
+    if (c->error != NULL || !at(c, "?"))
+    {
+        return;
+    }
+    c->i++;
+    jz = emit(c, A_JZ, -1);
+    parse_comma(c);
+    if (!at(c, ":"))
+    {
+        fail(c, "missing :");
+        return;
+    }
+    c->i++;
+    jmp = emit(c, A_JMP, 0);
+    c->code[jz].arg = c->n;
+    parse_ternary(c);
+    c->code[jmp].arg = c->n;
+    /* only one of the branches left a value */
+    c->sp--;
+}
+
+/*
+ * Function: parse_assign
+ * Parses an assignment, var = value or var op= value, or a ternary.
+ */
+static void parse_assign(compiler_t *c)
+{
+    static const char *ops[] = {"=", "*=", "/=", "%=", "+=", "-=", "<<=", ">>=", "&=", "^=", "|="};
+    static const uint32_t codes[] = {0, A_MUL, A_DIV, A_MOD, A_ADD, A_SUB, A_SHL, A_SHR, A_BAND, A_BXOR, A_BOR};
+    uint32_t start = c->n;
+    arith_insn_t load;
+    size_t k;
+
+    parse_ternary(c);
+    if (c->error != NULL)
+    {
+        return;
+    }
+    for (k = 0; k < sizeof(ops) / sizeof(ops[0]); k++)
+    {
+        if (at(c, ops[k]) && !(k == 0 && at(c, "==")))
+        {
+            break;
+        }
+    }
+    if (k == sizeof(ops) / sizeof(ops[0]))
+    {
+        return;
+    }
+    /* if the left side is not a variable */
+    if (!lvalue(c, start))
+    {
+        fail(c, "attempted assignment to non-variable");
+        return;
+    }
+    c->i += strlen(ops[k]);
+    load = c->code[c->lv];
+    c->lv = (uint32_t)-1;
+    if (!k)
+    {
+        /* the value replaces the load; an element keeps its index below it */
+        c->n--;
+        c->sp -= load.op == A_LOAD;
+    }
+    else if (load.op == A_LOAD_EL)
+    {
+        /* the index is needed for the load and for the store */
+        c->n--;
+        emit(c, A_DUP, 1);
+        c->code[emit(c, A_LOAD_EL, 0)] = load;
+    }
+    parse_assign(c);
+    if (k)
+    {
+        emit(c, codes[k], -1);
+    }
+    load.op = load.op == A_LOAD ? A_STORE : A_STORE_EL;
+    c->code[emit(c, load.op, load.op == A_STORE ? 0 : -1)] = load;
+}
+
+/*
+ * Function: parse_comma
+ * Parses expressions separated by commas, whose value is the last one.
+ */
+static void parse_comma(compiler_t *c)
+{
+    parse_assign(c);
+    while (c->error == NULL && at(c, ","))
+    {
+        c->i++;
+        emit(c, A_POP, -1);
+        parse_assign(c);
+    }
+}
+
+/*
+ * Function: compile
+ * Compiles text into c. Returns 0 on success, -1 after reporting an error.
+ */
+static int compile(compiler_t *c, const char *text, size_t len)
+{
+    c->text = text;
+    c->len = len;
+    c->i = 0;
+    c->n = 0;
+    c->sp = 0;
+    c->max_sp = 0;
+    c->lv = (uint32_t)-1;
+    c->error = NULL;
+    /* an empty expression is 0 */
+    if (!skip(c))
+    {
+        c->code[emit(c, A_NUM, 1)].u.num = 0;
+        return 0;
+    }
+    parse_comma(c);
+    if (c->error == NULL && skip(c))
+    {
+        fail(c, "syntax error in expression");
+    }
+    if (c->error == NULL && c->max_sp > ARITH_STACK)
+    {
+        fail(c, "expression too complex");
+    }
+    return c->error != NULL ? error(text, len, c->error) : 0;
+}
+
+/*
+ * Function: value_of
+ * Gets the integer value of a variable's text: a number, or else an
+ * expression of its own. Unset and empty values are 0.
+ */
+static int value_of(const char *v, int64_t *out)
+{
+    size_t len;
+    size_t i = 0;
+    int neg = 0;
+    int r;
+
+    if (v == NULL || !*v)
+    {
+        *out = 0;
+        return 0;
+    }
+    len = strlen(v);
+    /* the usual case, a plain decimal number */
+    if (v[0] == '-' && len > 1)
+    {
+        neg = 1;
+        i++;
+    }
+    if (v[i] >= '1' && v[i] <= '9')
+    {
+        uint64_t n = 0;
+
+        while (i < len && v[i] >= '0' && v[i] <= '9')
+        {
+            n = n * 10 + (uint64_t)(v[i++] - '0');
+        }
+        if (i == len)
+        {
+            *out = (int64_t)(neg ? 0 - n : n);
+            return 0;
+        }
+    }
+    /* if values refer to each other too deeply */
+    if (nest >= ARITH_NEST)
+    {
+        return error(v, len, "expression recursion level exceeded");
+    }
+    nest++;
+    r = arith_eval(v, len, out);
+    nest--;
+    return r;
+}
+
+/*
+ * Function: load
+ * Gets the integer value of a variable, without parsing it if arithmetic
+ * set it.
+ */
+static int load(const var_t *var, int64_t *out)
+{
+    if (var->flags & VAR_NUM)
+    {
+        *out = var->num;
+        return 0;
+    }
+    return value_of(var_value(var), out);
+}
+
+/*
+ * Function: subscript
+ * Formats an index into buf as the subscript of an element.
+ */
+static const char *subscript(int64_t i, char *buf, size_t size)
+{
+    snprintf(buf, size, "%lld", (long long)i);
+    return buf;
+}
+
+/*
+ * Function: load_el
+ * Gets the integer value of element i of var.
+ */
+static int load_el(const var_t *var, int64_t i, int64_t *out)
+{
+    char buf[24];
+
+    return value_of(var_element(var, subscript(i, buf, sizeof(buf))), out);
+}
+
+/*
+ * Function: store_el
+ * Sets element i of var to v.
+ */
+static int store_el(var_t *var, int64_t i, int64_t v, const char *text, size_t len)
+{
+    char sub[24];
+    char buf[24];
+
+    subscript(i, sub, sizeof(sub));
+    snprintf(buf, sizeof(buf), "%lld", (long long)v);
+    if (var_set_element(var, sub, buf, strlen(buf)) == -1)
+    {
+        return errno == EDOM ? error(text, len, "bad array subscript") : -1;
+    }
+    return 0;
+}
+
+/*
+ * Function: binary
+ * Applies a binary operator, with the wrapping of two's complement.
+ * Returns 0 on success, -1 on division by zero or a negative exponent.
+ */
+static int binary(uint32_t op, int64_t a, int64_t b, int64_t *out)
+{
+    uint64_t ua = (uint64_t)a;
+    uint64_t ub = (uint64_t)b;
+
+    switch (op)
+    {
+    case A_MUL:
+        *out = (int64_t)(ua * ub);
+        break;
+    case A_DIV:
+    case A_MOD:
+        if (!b)
+        {
+            return -1;
+        }
+        /* the one quotient that does not fit */
+        if (b == -1)
+        {
+            *out = op == A_DIV ? (int64_t)(0 - ua) : 0;
+        }
+        else
+        {
+            *out = op == A_DIV ? a / b : a % b;
+        }
+        break;
+    case A_ADD:
+        *out = (int64_t)(ua + ub);
+        break;
+    case A_SUB:
+        *out = (int64_t)(ua - ub);
+        break;
+    case A_SHL:
+        *out = (int64_t)(ua << (ub & 63));
+        break;
+    case A_SHR:
+        *out = a >> (ub & 63);
+        break;
+    case A_LT:
+        *out = a < b;
+        break;
+    case A_LE:
+        *out = a <= b;
+        break;
+    case A_GT:
+        *out = a > b;
+        break;
+    case A_GE:
+        *out = a >= b;
+        break;
+    case A_EQ:
+        *out = a == b;
+        break;
+    case A_NE:
+        *out = a != b;
+        break;
+    case A_BAND:
+        *out = a & b;
+        break;
+    case A_BXOR:
+        *out = a ^ b;
+        break;
+    case A_BOR:
+        *out = a | b;
+        break;
+    case A_POW:
+    {
+        uint64_t r = 1;
+
+        if (b < 0)
+        {
+            return -1;
+        }
+        /* square and multiply */
+        for (; ub; ub >>= 1, ua *= ua)
+        {
+            if (ub & 1)
+            {
+                r *= ua;
+            }
+        }
+        *out = (int64_t)r;
+        break;
+    }
+    }
+    return 0;
+}
+
+/*
+ * Function: eval
+ * Runs compiled code on a fixed stack.
+ */
+static int eval(const arith_insn_t *code, uint32_t n, int64_t *result, const char *text, size_t len)
+{
+    int64_t st[ARITH_STACK + 1];
+    int sp = 0;  /* number of values on the stack */
+    int64_t v;
+    int64_t nv;
+
+    for (uint32_t pc = 0; pc < n; pc++)
+    {
+        const arith_insn_t *in = &code[pc];
+
+        switch (in->op)
+        {
+        case A_NUM:
+            st[sp++] = in->u.num;
+            break;
+        case A_LOAD:
+            if (load(in->u.var, &st[sp++]) == -1)
+            {
+                return -1;
+            }
+            break;
+        case A_LOAD_EL:
+            if (load_el(in->u.var, st[sp - 1], &st[sp - 1]) == -1)
+            {
+                return -1;
+            }
+            break;
+        case A_STORE:
+            if (var_set_num(in->u.var, st[sp - 1]) == -1)
+            {
+                return -1;
+            }
+            break;
+        case A_STORE_EL:
+            sp--;
+            if (store_el(in->u.var, st[sp - 1], st[sp], text, len) == -1)
+            {
+                return -1;
+            }
+            st[sp - 1] = st[sp];
+            break;
+        case A_INC:
+        case A_POSTINC:
+            if (load(in->u.var, &v) == -1)
+            {
+                return -1;
+            }
+            nv = (int64_t)(in->arg ? (uint64_t)v + 1 : (uint64_t)v - 1);
+            if (var_set_num(in->u.var, nv) == -1)
+            {
+                return -1;
+            }
+            st[sp++] = in->op == A_INC ? nv : v;
+            break;
+        case A_INC_EL:
+        case A_POSTINC_EL:
+            if (load_el(in->u.var, st[sp - 1], &v) == -1)
+            {
+                return -1;
+            }
+            nv = (int64_t)(in->arg ? (uint64_t)v + 1 : (uint64_t)v - 1);
+            if (store_el(in->u.var, st[sp - 1], nv, text, len) == -1)
+            {
+                return -1;
+            }
+            st[sp - 1] = in->op == A_INC_EL ? nv : v;
+            break;
+        case A_DUP:
+            st[sp] = st[sp - 1];
+            sp++;
+            break;
+        case A_POP:
+            sp--;
+            break;
+        case A_NEG:
+            st[sp - 1] = (int64_t)(0 - (uint64_t)st[sp - 1]);
+            break;
+        case A_NOT:
+            st[sp - 1] = !st[sp - 1];
+            break;
+        case A_BNOT:
+            st[sp - 1] = ~st[sp - 1];
+            break;
+        case A_JZ:
+            if (!st[--sp])
+            {
+                pc = in->arg - 1;
+            }
+            break;
+        case A_JMP:
+            pc = in->arg - 1;
+            break;
+        case A_AND:
+        case A_OR:
+            /* if the left side decides */
+            if (!st[sp - 1] == (in->op == A_AND))
+            {
+                st[sp - 1] = in->op == A_OR;
+                pc = in->arg - 1;
+            }
+            else
+            {
+                sp--;
+            }
+            break;
+        case A_BOOL:
+            st[sp - 1] = st[sp - 1] != 0;
+            break;
+        default:
+            sp--;
+            if (binary(in->op, st[sp - 1], st[sp], &st[sp - 1]) == -1)
+            {
+                return error(text, len, in->op == A_POW ? "exponent less than 0" : "division by 0");
+            }
+            break;
+        }
+    }
+    *result = st[sp - 1];
+    return 0;
+}
+
+/*
+ * Function: arith_eval
+ * Evaluates an arithmetic expression. Its code comes from the cache, or
+ * is compiled and put there, replacing what held its slot.
+ *
+ * text : pointer to expression
+ * len : length of expression
+ * result : pointer to result
+ */
+int arith_eval(const char *text, size_t len, int64_t *result)
+{
+    uint32_t h = hash(text, len);
+    cached_t *e = &cache[h & (ARITH_CACHE - 1)];
+    compiler_t c;
+    arith_insn_t *code = NULL;
+    char *copy;
+
+    /* if the expression was compiled before */
+    if (e->code != NULL && e->hash == h && e->len == len && !memcmp(e->text, text, len))
+    {
+        return eval(e->code, e->n, result, text, len);
+    }
+    if (compile(&c, text, len) == -1)
+    {
+        return -1;
+    }
+    /*
+     * code the cache can not keep still runs once; so does that of a value
+     * being evaluated for another expression, whose code may sit in the
+     * slot it would take
+     */
+    if (nest || (code = malloc(c.n * sizeof(arith_insn_t))) == NULL || (copy = malloc(len + 1)) == NULL)
+    {
+        free(code);
+        return eval(c.code, c.n, result, text, len);
+    }
+    free(e->text);
+    free(e->code);
+    memcpy(code, c.code, c.n * sizeof(arith_insn_t));
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    e->text = copy;
+    e->len = len;
+    e->hash = h;
+    e->n = c.n;
+    e->code = code;
+    return eval(code, c.n, result, text, len);
+}
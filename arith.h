@@ -0,0 +1,21 @@
+#ifndef ARITH_H_
+#define ARITH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Arithmetic for $(( )), (( )) and array subscripts. An expression is
+ * compiled once into a short list of stack-machine instructions that refer
+ * to variables by their interned var_t, and the code is kept in a small
+ * cache keyed by the expression's text. Evaluating cached code runs on a
+ * fixed stack with 64-bit integers and allocates nothing.
+ */
+
+/*
+ * evaluates the first len bytes of text, returns 0 on success, -1 on failure
+ * errors are reported on stderr and fail with errno set to EINVAL
+ */
+int arith_eval(const char *text, size_t len, int64_t *result);
+
+#endif  // ARITH_H_
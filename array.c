@@ -0,0 +1,363 @@
+#include <stdlib.h>
+#include <string.h>
+#include "./array.h"
+
+/* Helper Functions */
+
+/*
+ * Function: in_arena
+ * Checks whether an element lives in the array's bulk-loaded buffer.
+ */
+static int in_arena(const array_t *a, const char *item)
+{
+    return a->arena != NULL && item >= a->arena && item < a->arena + a->arena_len;
+}
+
+/*
+ * Function: free_item
+ * Frees an element unless it lives in the arena.
+ */
+static void free_item(const array_t *a, char *item)
+{
+    if (!in_arena(a, item))
+    {
+        free(item);
+    }
+}
+
+/*
+ * Function: hash
+ * FNV-1a hash of a key.
+ */
+static uint32_t hash(const char *key)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *key; key++)
+    {
+        h ^= (unsigned char)*key;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Function: find
+ * Finds the index slot of key, or the empty slot ending its probe sequence.
+ * Removed entries are stepped over.
+ */
+static size_t find(const assoc_t *m, const char *key, uint32_t h)
+{
+    size_t i = h & (m->n_index - 1);
+
+    while (m->index[i])
+    {
+        if (m->index[i] != ASSOC_GONE)
+        {
+            const assoc_entry_t *e = &m->entries[m->index[i] - 1];
+
+            if (e->hash == h && !strcmp(e->key, key))
+            {
+                break;
+            }
+        }
+        i = (i + 1) & (m->n_index - 1);
+    }
+    return i;
+}
+
+/*
+ * Function: rebuild
+ * Drops removed entries and rebuilds the index with room for one more.
+ * Returns 0 on success, -1 on failure.
+ */
+static int rebuild(assoc_t *m)
+{
+    size_t n = 8;
+    size_t live = 0;
+    uint32_t *index;
+
+    while (n / 4 * 3 < m->count + 1)
+    {
+        n *= 2;
+    }
+    /* if calloc fails */
+    if ((index = calloc(n, sizeof(uint32_t))) == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < m->n_entries; i++)
+    {
+        if (m->entries[i].key != NULL)
+        {
+            size_t j = m->entries[i].hash & (n - 1);
+
+            m->entries[live] = m->entries[i];
+            while (index[j])
+            {
+                j = (j + 1) & (n - 1);
+            }
+            index[j] = (uint32_t)++live;
+        }
+    }
+    free(m->index);
+    m->index = index;
+    m->n_index = n;
+    m->n_entries = live;
+    return 0;
+}
+
+/*
+ * Function: array_set
+ * Sets an element, growing the vector if needed.
+ *
+ * a : pointer to array
+ * i : index of element
+ * value : pointer to value
+ * len : length of value
+ */
+int array_set(array_t *a, size_t i, const char *value, size_t len)
+{
+    char *item;
+
+    if (i >= a->cap)
+    {
+        size_t cap = a->cap ? a->cap : 8;
+        char **items;
+
+        while (cap <= i)
+        {
+            cap *= 2;
+        }
+        /* if realloc fails */
+        if ((items = realloc(a->items, cap * sizeof(char *))) == NULL)
+        {
+            return -1;
+        }
+        memset(items + a->cap, 0, (cap - a->cap) * sizeof(char *));
+        a->items = items;
+        a->cap = cap;
+    }
+    /* if malloc fails */
+    if ((item = malloc(len + 1)) == NULL)
+    {
+        return -1;
+    }
+    memcpy(item, value, len);
+    item[len] = '\0';
+
+    if (a->items[i] != NULL)
+    {
+        free_item(a, a->items[i]);
+    }
+    else
+    {
+        a->count++;
+    }
+    a->items[i] = item;
+    if (i >= a->n)
+    {
+        a->n = i + 1;
+    }
+    return 0;
+}
+
+/*
+ * Function: array_get
+ * Gets an element.
+ *
+ * a : pointer to array
+ * i : index of element
+ */
+const char *array_get(const array_t *a, size_t i)
+{
+    return i < a->n ? a->items[i] : NULL;
+}
+
+/*
+ * Function: array_unset
+ * Unsets an element.
+ *
+ * a : pointer to array
+ * i : index of element
+ */
+void array_unset(array_t *a, size_t i)
+{
+    if (i >= a->n || a->items[i] == NULL)
+    {
+        return;
+    }
+    free_item(a, a->items[i]);
+    a->items[i] = NULL;
+    a->count--;
+    /* drop unset elements from the end */
+    while (a->n && a->items[a->n - 1] == NULL)
+    {
+        a->n--;
+    }
+}
+
+/*
+ * Function: array_clear
+ * Unsets all elements and frees their storage.
+ *
+ * a : pointer to array
+ */
+void array_clear(array_t *a)
+{
+    for (size_t i = 0; i < a->n; i++)
+    {
+        if (a->items[i] != NULL)
+        {
+            free_item(a, a->items[i]);
+        }
+    }
+    free(a->items);
+    free(a->arena);
+    memset(a, 0, sizeof(array_t));
+}
+
+/*
+ * Function: array_adopt
+ * Replaces the elements with strings held in one buffer.
+ *
+ * a : pointer to array
+ * arena : pointer to buffer of the elements
+ * arena_len : size of buffer
+ * items : pointer to vector of the elements, of at least n pointers
+ * n : number of elements
+ */
+void array_adopt(array_t *a, char *arena, size_t arena_len, char **items, size_t n)
+{
+    array_clear(a);
+    a->items = items;
+    a->n = n;
+    a->cap = n;
+    a->count = n;
+    a->arena = arena;
+    a->arena_len = arena_len;
+}
+
+/*
+ * Function: assoc_set
+ * Sets the value of a key, adding the key at the end if it is new.
+ *
+ * m : pointer to associative array
+ * key : pointer to key
+ * value : pointer to value
+ * len : length of value
+ */
+int assoc_set(assoc_t *m, const char *key, const char *value, size_t len)
+{
+    uint32_t h = hash(key);
+    assoc_entry_t *e;
+    char *v;
+    size_t i;
+
+    /* if index is more than 3/4 full, counting removed entries, and can not be rebuilt */
+    if (m->n_entries + 1 > m->n_index / 4 * 3 && rebuild(m) == -1)
+    {
+        return -1;
+    }
+    /* if malloc fails */
+    if ((v = malloc(len + 1)) == NULL)
+    {
+        return -1;
+    }
+    memcpy(v, value, len);
+    v[len] = '\0';
+
+    if (m->index[i = find(m, key, h)])
+    {
+        e = &m->entries[m->index[i] - 1];
+        free(e->value);
+        e->value = v;
+        return 0;
+    }
+    if (m->n_entries == m->cap_entries)
+    {
+        size_t cap = m->cap_entries ? m->cap_entries * 2 : 8;
+
+        /* if realloc fails */
+        if ((e = realloc(m->entries, cap * sizeof(assoc_entry_t))) == NULL)
+        {
+            free(v);
+            return -1;
+        }
+        m->entries = e;
+        m->cap_entries = cap;
+    }
+    e = &m->entries[m->n_entries];
+    /* if strdup fails */
+    if ((e->key = strdup(key)) == NULL)
+    {
+        free(v);
+        return -1;
+    }
+    e->value = v;
+    e->hash = h;
+    m->index[i] = (uint32_t)++m->n_entries;
+    m->count++;
+    return 0;
+}
+
+/*
+ * Function: assoc_get
+ * Gets the value of a key.
+ *
+ * m : pointer to associative array
+ * key : pointer to key
+ */
+const char *assoc_get(const assoc_t *m, const char *key)
+{
+    size_t i;
+
+    if (!m->n_index || !m->index[i = find(m, key, hash(key))])
+    {
+        return NULL;
+    }
+    return m->entries[m->index[i] - 1].value;
+}
+
+/*
+ * Function: assoc_unset
+ * Removes a key. Its entry stays, emptied, until the index is rebuilt.
+ *
+ * m : pointer to associative array
+ * key : pointer to key
+ */
+void assoc_unset(assoc_t *m, const char *key)
+{
+    assoc_entry_t *e;
+    size_t i;
+
+    if (!m->n_index || !m->index[i = find(m, key, hash(key))])
+    {
+        return;
+    }
+    e = &m->entries[m->index[i] - 1];
+    free(e->key);
+    free(e->value);
+    e->key = NULL;
+    e->value = NULL;
+    m->index[i] = ASSOC_GONE;
+    m->count--;
+}
+
+/*
+ * Function: assoc_clear
+ * Removes all keys and frees their storage.
+ *
+ * m : pointer to associative array
+ */
+void assoc_clear(assoc_t *m)
+{
+    for (size_t i = 0; i < m->n_entries; i++)
+    {
+        free(m->entries[i].key);
+        free(m->entries[i].value);
+    }
+    free(m->entries);
+    free(m->index);
+    memset(m, 0, sizeof(assoc_t));
+}
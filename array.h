@@ -0,0 +1,71 @@
+#ifndef ARRAY_H_
+#define ARRAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Storage of array variables. An indexed array is a vector of element
+ * pointers, NULL where an element is unset; mapfile fills one from a single
+ * buffer, so its elements sit next to each other in memory. An associative
+ * array keeps its entries densely in insertion order, with an
+ * open-addressing table of entry numbers to find them by key.
+ */
+
+typedef struct array {
+    char **items;   /* element i, NULL if unset */
+    size_t n;       /* one past the highest element set */
+    size_t cap;
+    size_t count;   /* elements set */
+    char *arena;    /* buffer holding elements loaded in bulk, which are not freed one by one */
+    size_t arena_len;
+} array_t;
+
+#define ASSOC_GONE UINT32_MAX /* index slot of a removed entry */
+
+typedef struct assoc_entry {
+    char *key;      /* NULL once the entry is removed */
+    char *value;
+    uint32_t hash;
+} assoc_entry_t;
+
+typedef struct assoc {
+    assoc_entry_t *entries; /* in insertion order, removed ones included */
+    size_t n_entries;
+    size_t cap_entries;
+    uint32_t *index;        /* entry number + 1 by hash, 0 if empty, ASSOC_GONE if removed */
+    size_t n_index;         /* a power of two */
+    size_t count;           /* entries not removed */
+} assoc_t;
+
+/* sets element i to the first len bytes of value, returns 0 on success, -1 on failure */
+int array_set(array_t *a, size_t i, const char *value, size_t len);
+
+/* gets element i, NULL if it is unset */
+const char *array_get(const array_t *a, size_t i);
+
+/* unsets element i */
+void array_unset(array_t *a, size_t i);
+
+/* unsets all elements */
+void array_clear(array_t *a);
+
+/*
+ * replaces the elements with the n strings of arena, which the array takes
+ * over; items must hold them in order and be allocated to hold n pointers
+ */
+void array_adopt(array_t *a, char *arena, size_t arena_len, char **items, size_t n);
+
+/* sets the value of key, returns 0 on success, -1 on failure */
+int assoc_set(assoc_t *m, const char *key, const char *value, size_t len);
+
+/* gets the value of key, NULL if it is unset */
+const char *assoc_get(const assoc_t *m, const char *key);
+
+/* removes key */
+void assoc_unset(assoc_t *m, const char *key);
+
+/* removes all keys */
+void assoc_clear(assoc_t *m);
+
+#endif  // ARRAY_H_
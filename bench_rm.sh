@@ -0,0 +1,34 @@
+#!/bin/bash
+# Compares removing a tree with the rm -r builtin against /bin/rm -rf.
+# usage: ./bench_rm.sh [directories] [files per directory]
+set -e
+DIRS=${1:-2000}
+FILES=${2:-50}
+SH=$(pwd)/33noprompt
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# a tree two levels deep, so the builtin has directories to share out
+make_tree() {
+    local d
+    for ((d = 0; d < DIRS; d++)); do
+        mkdir -p "$DIR/tree/$((d % 40))/$d"
+        (cd "$DIR/tree/$((d % 40))/$d" && touch $(seq -f "f%g" "$FILES"))
+    done
+    sync
+}
+
+run() {
+    local start end
+    make_tree
+    start=$(date +%s%N)
+    "$@"
+    end=$(date +%s%N)
+    [ ! -e "$DIR/tree" ] || { echo "$LABEL left files behind"; exit 1; }
+    printf '%-16s %8.1f ms\n' "$LABEL" "$(((end - start) / 100000))e-1"
+}
+
+echo "$DIRS directories of $FILES files"
+echo "rm -r $DIR/tree" > "$DIR/script.sh"
+LABEL="/bin/rm -rf"; run /bin/rm -rf "$DIR/tree"
+LABEL="33sh rm -r"; run "$SH" "$DIR/script.sh"
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Compares startup of a bundled script (33sh --bundle) against running the
+# same script with 33sh, with and without the compiled-script cache.
+# usage: ./bench_startup.sh [runs] [script lines]
+set -e
+RUNS=${1:-500}
+LINES=${2:-200}
+SH=$(pwd)/33noprompt
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+export XDG_CACHE_HOME=$DIR/cache
+
+# a script of function definitions, so the time measured is the shell's own
+for ((i = 0; i < LINES; i++)); do
+    echo "f$i() { alias a$i=b$i && unalias a$i || return 1; } # line $i"
+done > "$DIR/script.sh"
+"$SH" --bundle "$DIR/script.sh" -o "$DIR/tool"
+
+run() {
+    local start end
+    start=$(date +%s%N)
+    for ((i = 0; i < RUNS; i++)); do
+        "$@" > /dev/null
+    done
+    end=$(date +%s%N)
+    printf '%-24s %8.1f us/run\n' "$LABEL" "$(((end - start) / RUNS / 100))e-1"
+}
+
+echo "$RUNS runs of a $LINES line script"
+LABEL="33sh script.sh (parse)"; run env XDG_CACHE_HOME=/dev/null "$SH" "$DIR/script.sh"
+LABEL="33sh script.sh (cache)"; run "$SH" "$DIR/script.sh"
+LABEL="bundled tool"; run "$DIR/tool"
@@ -0,0 +1,36 @@
+#ifndef BUILTINS_H_
+#define BUILTINS_H_
+
+#include <stdint.h>
+
+/*
+ * Builtin commands are listed in builtins.def. At build time mkbuiltins
+ * finds a seed for which builtin_hash puts every name in its own slot of a
+ * power-of-two table and writes that table to builtin_table.h, so a lookup
+ * costs one hash and one string compare.
+ */
+
+/* builtin flags; every builtin runs inside the shell process */
+#define BI_REDIRECT 0x1 /* takes redirections */
+#define BI_PIPESAFE 0x2 /* leaves shell state alone, so it may run in a child */
+
+typedef struct builtin {
+    const char *name;
+    int (*fn)(char *toks[]);
+    int flags;
+} builtin_t;
+
+/* hash of a builtin name, FNV-1a started from seed */
+static inline uint32_t builtin_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    for (; *name; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#endif  // BUILTINS_H_
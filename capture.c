@@ -0,0 +1,152 @@
+#define _GNU_SOURCE /* fopencookie, F_GETPIPE_SZ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "./capture.h"
+
+#define CAPTURE_MIN 256 /* first size of a capture buffer */
+#define PIPE_READ 65536 /* room kept for a read when the pipe size is unknown */
+
+capture_t *capture_current;
+
+/* Helper Functions */
+
+/*
+ * Function: reserve
+ * Makes room for n more bytes, doubling the buffer as needed.
+ * Returns 0 on success, -1 on failure.
+ */
+static int reserve(capture_t *c, size_t n)
+{
+    size_t cap = c->cap ? c->cap : CAPTURE_MIN;
+    char *p;
+
+    if (c->len + n <= c->cap)
+    {
+        return 0;
+    }
+    while (cap < c->len + n)
+    {
+        cap *= 2;
+    }
+    /* if realloc fails */
+    if ((p = realloc(c->buf, cap)) == NULL)
+    {
+        return -1;
+    }
+    c->buf = p;
+    c->cap = cap;
+    return 0;
+}
+
+/*
+ * Function: stream_write
+ * Write function of the capture stream: appends to the buffer.
+ */
+static ssize_t stream_write(void *cookie, const char *data, size_t n)
+{
+    capture_t *c = cookie;
+
+    /* if the buffer can not grow, the stream reports an error */
+    if (reserve(c, n) == -1)
+    {
+        return -1;
+    }
+    memcpy(c->buf + c->len, data, n);
+    c->len += n;
+    return (ssize_t)n;
+}
+
+/*
+ * Function: capture_start
+ * Starts capturing stdout. The stream is unbuffered, so what a builtin
+ * prints lands in the buffer at once, in order with what programs write.
+ *
+ * c : pointer to capture
+ */
+int capture_start(capture_t *c)
+{
+    cookie_io_functions_t io = {NULL, stream_write, NULL, NULL};
+
+    memset(c, 0, sizeof(capture_t));
+    /* if fopencookie fails */
+    if ((c->stream = fopencookie(c, "w", io)) == NULL)
+    {
+        return -1;
+    }
+    setvbuf(c->stream, NULL, _IONBF, 0);
+    fflush(stdout); /* output so far comes before the capture */
+    c->saved = stdout;
+    c->outer = capture_current;
+    stdout = c->stream;
+    capture_current = c;
+    return 0;
+}
+
+/*
+ * Function: capture_stop
+ * Stops capturing stdout and restores the stream it replaced.
+ *
+ * c : pointer to capture
+ */
+void capture_stop(capture_t *c)
+{
+    stdout = c->saved;
+    capture_current = c->outer;
+    fclose(c->stream);
+    c->stream = NULL;
+}
+
+/*
+ * Function: capture_read
+ * Reads fd until end of file, each read straight into the buffer with
+ * room for a full pipe's worth of data.
+ *
+ * c : pointer to capture
+ * fd : file descriptor to read, usually the read end of a pipe
+ */
+int capture_read(capture_t *c, int fd)
+{
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    size_t room = size > 0 ? (size_t)size : PIPE_READ;
+    ssize_t r;
+
+    for (;;)
+    {
+        /* if the buffer can not grow */
+        if (reserve(c, room) == -1)
+        {
+            return -1;
+        }
+        if ((r = read(fd, c->buf + c->len, c->cap - c->len)) > 0)
+        {
+            c->len += (size_t)r;
+        }
+        else if (!r)
+        {
+            return 0;
+        }
+        /* if read fails, other than by a signal */
+        else if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+/*
+ * Function: capture_free
+ * Frees the buffer of a capture.
+ *
+ * c : pointer to capture
+ */
+void capture_free(capture_t *c)
+{
+    free(c->buf);
+    c->buf = NULL;
+    c->len = 0;
+    c->cap = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Output of a command substitution. While a capture runs, stdout is a
+ * stream that appends straight to its buffer, so builtins and functions
+ * write into it without a pipe; a program gets a pipe instead, which is
+ * read into the same buffer. The buffer doubles as it fills.
+ */
+
+typedef struct capture {
+    char *buf;              /* output so far, not NUL terminated */
+    size_t len;
+    size_t cap;
+    FILE *stream;           /* stream writing to buf, stdout while capturing */
+    FILE *saved;            /* stdout before the capture started */
+    struct capture *outer;  /* capture this one runs in, NULL if none */
+} capture_t;
+
+/* innermost capture running, NULL if none */
+extern capture_t *capture_current;
+
+/* starts capturing stdout into c, returns 0 on success, -1 on failure */
+int capture_start(capture_t *c);
+
+/* stops capturing and restores stdout, keeping the buffer */
+void capture_stop(capture_t *c);
+
+/* reads fd up to end of file into c, returns 0 on success, -1 on failure */
+int capture_read(capture_t *c, int fd);
+
+/* frees the buffer of c */
+void capture_free(capture_t *c);
+
+#endif  // CAPTURE_H_
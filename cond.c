@@ -0,0 +1,655 @@
+#include <errno.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./arith.h"
+#include "./cond.h"
+#include "./expand.h"
+#include "./meta.h"
+#include "./vars.h"
+
+#define COND_REGEX 16 /* compiled regexes kept */
+#define MAX_GROUPS 32 /* groups of a match put in BASH_REMATCH */
+
+/* a compiled regex in the cache */
+typedef struct cached {
+    char *text;     /* regex as expanded, NULL if the slot is free */
+    regex_t re;
+} cached_t;
+
+/* an evaluation in progress */
+typedef struct cond {
+    const plan_t *plan;
+    uint32_t first;
+    uint32_t n;
+    uint32_t i;     /* next word */
+    int error;      /* set once an error has been reported */
+} cond_t;
+
+/* a test command in progress, over words already expanded */
+typedef struct test {
+    char **argv;
+    int argc;
+    int i;          /* next word */
+    int error;      /* set once an error has been reported */
+} test_t;
+
+static cached_t cache[COND_REGEX]; /* most recently used first */
+
+static int or_expr(cond_t *c, int skip);
+static int test_or(test_t *t);
+
+/* Helper Functions */
+
+/*
+ * Function: peek
+ * Gets the next word as written, NULL at the end.
+ */
+static const char *peek(const cond_t *c, uint32_t k)
+{
+    return c->i + k < c->n ? plan_word(c->plan, c->first + c->i + k) : NULL;
+}
+
+/*
+ * Function: is
+ * Checks whether the next word is w as written.
+ */
+static int is(const cond_t *c, const char *w)
+{
+    const char *s = peek(c, 0);
+
+    return s != NULL && !strcmp(s, w);
+}
+
+/*
+ * Function: bad
+ * Reports a malformed condition. Returns 0 so evaluators can return its result.
+ */
+static int bad(cond_t *c)
+{
+    if (!c->error)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Bad conditional expression.");
+    }
+    c->error = 1;
+    return 0;
+}
+
+/*
+ * Function: operand
+ * Expands the next word into one string held by ex: as it is (how 0), as a
+ * pattern (1) or as a regex (2). Returns the string, NULL on failure.
+ */
+static const char *operand(cond_t *c, expand_t *ex, int how)
+{
+    const char *w = peek(c, 0);
+    int r;
+
+    c->i++;
+    expand_init(ex);
+    r = how ? expand_pattern(ex, w, how == 2) : expand_string(ex, w);
+    /* if the word can not be expanded */
+    if (r == -1 || expand_finish(ex) == -1)
+    {
+        /* if it is not a bad substitution */
+        if (errno != EINVAL)
+        {
+            perror("expand");
+        }
+        expand_free(ex);
+        c->error = 1;
+        return NULL;
+    }
+    return ex->toks[0];
+}
+
+/*
+ * Function: compiled
+ * Gets the compiled form of an extended regex, from the cache or compiled
+ * into it, and moves it to the front. Returns it, NULL if it does not compile.
+ */
+static regex_t *compiled(const char *text)
+{
+    cached_t e;
+    int k = 0;
+    int r;
+
+    while (k < COND_REGEX && cache[k].text != NULL && strcmp(cache[k].text, text))
+    {
+        k++;
+    }
+    /* if the regex is not cached, compile it into the last slot */
+    if (k == COND_REGEX || cache[k].text == NULL)
+    {
+        k -= k == COND_REGEX;
+        if (cache[k].text != NULL)
+        {
+            regfree(&cache[k].re);
+            free(cache[k].text);
+            cache[k].text = NULL;
+        }
+        /* if regcomp fails */
+        if ((r = regcomp(&cache[k].re, text, REG_EXTENDED)) != 0)
+        {
+            char msg[128];
+
+            regerror(r, &cache[k].re, msg, sizeof(msg));
+            fprintf(stderr, "ERROR : %s: %s\n", text, msg);
+            return NULL;
+        }
+        /* if strdup fails */
+        if ((cache[k].text = strdup(text)) == NULL)
+        {
+            regfree(&cache[k].re);
+            return NULL;
+        }
+    }
+    e = cache[k];
+    memmove(cache + 1, cache, (size_t)k * sizeof(cached_t));
+    cache[0] = e;
+    return &cache[0].re;
+}
+
+/*
+ * Function: rematch
+ * Matches s against a regex, putting the match and its groups in the
+ * array BASH_REMATCH. Returns 1 if it matches, 0 if not, -1 on failure.
+ */
+static int rematch(const char *regex, const char *s)
+{
+    regmatch_t m[MAX_GROUPS];
+    regex_t *re;
+    var_t *var;
+    char sub[16];
+
+    if ((re = compiled(regex)) == NULL)
+    {
+        return -1;
+    }
+    if (regexec(re, s, MAX_GROUPS, m, 0))
+    {
+        return 0;
+    }
+    /* if BASH_REMATCH can not be set */
+    if ((var = var_intern("BASH_REMATCH", 12)) == NULL)
+    {
+        return -1;
+    }
+    var_unset(var);
+    for (size_t k = 0; k < MAX_GROUPS && k <= re->re_nsub; k++)
+    {
+        size_t len = m[k].rm_so == -1 ? 0 : (size_t)(m[k].rm_eo - m[k].rm_so);
+
+        snprintf(sub, sizeof(sub), "%zu", k);
+        if (var_set_element(var, sub, s + (m[k].rm_so == -1 ? 0 : m[k].rm_so), len) == -1)
+        {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function: file_test
+ * Applies a file test, -e -f -d -s -r -w -x or -L (also -h), to path.
+ */
+static int file_test(char op, const char *path)
+{
+    struct stat st;
+
+    if (op == 'r' || op == 'w' || op == 'x')
+    {
+        return !access(path, op == 'r' ? R_OK : op == 'w' ? W_OK : X_OK);
+    }
+    if (op == 'L' || op == 'h')
+    {
+        return !meta_stat(path, &st, 0) && S_ISLNK(st.st_mode);
+    }
+    if (meta_stat(path, &st, 1) == -1)
+    {
+        return 0;
+    }
+    return op == 'e' || (op == 'f' && S_ISREG(st.st_mode)) || (op == 'd' && S_ISDIR(st.st_mode)) ||
+           (op == 's' && st.st_size > 0);
+}
+
+/*
+ * Function: is_unary
+ * Checks whether w is a unary operator.
+ */
+static int is_unary(const char *w)
+{
+    return w != NULL && w[0] == '-' && w[1] && strchr("znvefdsrwxLh", w[1]) && !w[2];
+}
+
+/*
+ * Function: binary_op
+ * Gets the index of w among the binary operators, -1 if it is none.
+ */
+static int binary_op(const char *w)
+{
+    static const char *ops[] = {"==", "=", "!=", "=~", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+
+    for (int k = 0; w != NULL && k < (int)(sizeof(ops) / sizeof(ops[0])); k++)
+    {
+        if (!strcmp(w, ops[k]))
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Function: unary
+ * Evaluates a unary operator and its operand.
+ */
+static int unary(cond_t *c, int skip)
+{
+    char op = peek(c, 0)[1];
+    expand_t ex;
+    const char *s;
+    int r;
+
+    c->i++;
+    if (skip)
+    {
+        c->i++;
+        return 0;
+    }
+    if ((s = operand(c, &ex, 0)) == NULL)
+    {
+        return 0;
+    }
+    if (op == 'z' || op == 'n')
+    {
+        r = !*s == (op == 'z');
+    }
+    else if (op == 'v')
+    {
+        r = var_get(s) != NULL;
+    }
+    else
+    {
+        r = file_test(op, s);
+    }
+    expand_free(&ex);
+    return r;
+}
+
+/*
+ * Function: binary
+ * Evaluates a binary operator and its operands.
+ */
+static int binary(cond_t *c, int skip)
+{
+    int op = binary_op(peek(c, 1));
+    expand_t lx;
+    expand_t rx;
+    const char *l;
+    const char *r;
+    int64_t a;
+    int64_t b;
+    int v = 0;
+
+    if (skip)
+    {
+        c->i += 3;
+        return 0;
+    }
+    if ((l = operand(c, &lx, 0)) == NULL)
+    {
+        return 0;
+    }
+    c->i++;
+    if ((r = operand(c, &rx, op == 3 ? 2 : op < 3)) == NULL)
+    {
+        expand_free(&lx);
+        return 0;
+    }
+    switch (op)
+    {
+    case 0:
+    case 1:
+    case 2:
+        v = !fnmatch(r, l, 0) == (op != 2);
+        break;
+    case 3:
+        v = rematch(r, l);
+        c->error |= v == -1;
+        break;
+    case 4:
+        v = strcmp(l, r) < 0;
+        break;
+    case 5:
+        v = strcmp(l, r) > 0;
+        break;
+    default:
+        /* if either side is not a valid expression */
+        if (arith_eval(l, strlen(l), &a) == -1 || arith_eval(r, strlen(r), &b) == -1)
+        {
+            c->error = 1;
+            break;
+        }
+        v = op == 6 ? a == b : op == 7 ? a != b : op == 8 ? a < b : op == 9 ? a <= b : op == 10 ? a > b : a >= b;
+    }
+    expand_free(&lx);
+    expand_free(&rx);
+    return v > 0;
+}
+
+/*
+ * Function: primary
+ * Evaluates ( expression ), an operator and its operands, or a word,
+ * which is true if it is not empty.
+ */
+static int primary(cond_t *c, int skip)
+{
+    expand_t ex;
+    const char *s;
+    int v;
+
+    if (peek(c, 0) == NULL)
+    {
+        return bad(c);
+    }
+    if (is(c, "("))
+    {
+        c->i++;
+        v = or_expr(c, skip);
+        /* if the parenthesis is not closed */
+        if (!is(c, ")"))
+        {
+            return bad(c);
+        }
+        c->i++;
+        return v;
+    }
+    if (binary_op(peek(c, 1)) != -1)
+    {
+        /* if the right side is missing */
+        if (peek(c, 2) == NULL)
+        {
+            return bad(c);
+        }
+        return binary(c, skip);
+    }
+    if (is_unary(peek(c, 0)) && peek(c, 1) != NULL)
+    {
+        return unary(c, skip);
+    }
+    if (skip)
+    {
+        c->i++;
+        return 0;
+    }
+    if ((s = operand(c, &ex, 0)) == NULL)
+    {
+        return 0;
+    }
+    v = *s != '\0';
+    expand_free(&ex);
+    return v;
+}
+
+/*
+ * Function: not_expr
+ * Evaluates ! before an expression, which negates it.
+ */
+static int not_expr(cond_t *c, int skip)
+{
+    if (is(c, "!"))
+    {
+        c->i++;
+        return !not_expr(c, skip);
+    }
+    return primary(c, skip);
+}
+
+/*
+ * Function: and_expr
+ * Evaluates expressions joined by &&, skipping those after one is false.
+ */
+static int and_expr(cond_t *c, int skip)
+{
+    int v = not_expr(c, skip);
+
+    while (is(c, "&&") && !c->error)
+    {
+        c->i++;
+        v = not_expr(c, skip || !v) && v;
+    }
+    return v;
+}
+
+/*
+ * Function: or_expr
+ * Evaluates expressions joined by ||, skipping those after one is true.
+ */
+static int or_expr(cond_t *c, int skip)
+{
+    int v = and_expr(c, skip);
+
+    while (is(c, "||") && !c->error)
+    {
+        c->i++;
+        v = and_expr(c, skip || v) || v;
+    }
+    return v;
+}
+
+/*
+ * Function: test_peek
+ * Gets word k after the next one of a test command, NULL past the end.
+ */
+static const char *test_peek(const test_t *t, int k)
+{
+    return t->i + k < t->argc ? t->argv[t->i + k] : NULL;
+}
+
+/*
+ * Function: test_bad
+ * Reports a malformed test command. Returns 0 so evaluators can return its result.
+ */
+static int test_bad(test_t *t, const char *msg)
+{
+    if (!t->error)
+    {
+        fprintf(stderr, "ERROR : test: %s\n", msg);
+    }
+    t->error = 1;
+    return 0;
+}
+
+/*
+ * Function: integer
+ * Reads a decimal integer, blanks allowed around it.
+ * Returns 0 on success, -1 if s is not one.
+ */
+static int integer(const char *s, int64_t *v)
+{
+    char *end;
+
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    while (*end == ' ' || *end == '\t')
+    {
+        end++;
+    }
+    return end == s || *end || errno ? -1 : 0;
+}
+
+/*
+ * Function: test_binary
+ * Evaluates a binary operator of a test command. The operands are plain
+ * strings: = and != compare them whole, and -eq and the like want integers.
+ */
+static int test_binary(test_t *t)
+{
+    int op = binary_op(test_peek(t, 1));
+    const char *l = test_peek(t, 0);
+    const char *r = test_peek(t, 2);
+    int64_t a;
+    int64_t b;
+
+    t->i += 3;
+    switch (op)
+    {
+    case 0:
+    case 1:
+        return !strcmp(l, r);
+    case 2:
+        return strcmp(l, r) != 0;
+    case 4:
+        return strcmp(l, r) < 0;
+    case 5:
+        return strcmp(l, r) > 0;
+    }
+    /* if either side is not an integer */
+    if (integer(l, &a) == -1 || integer(r, &b) == -1)
+    {
+        return test_bad(t, "integer expression expected");
+    }
+    return op == 6 ? a == b : op == 7 ? a != b : op == 8 ? a < b : op == 9 ? a <= b : op == 10 ? a > b : a >= b;
+}
+
+/*
+ * Function: test_primary
+ * Evaluates ( expression ), an operator and its operands, or a word, which
+ * is true if it is not empty. As POSIX has it, a lone word is a string
+ * whatever it looks like, and a binary operator second of three words
+ * wins over ( and a unary operator.
+ */
+static int test_primary(test_t *t)
+{
+    const char *w = test_peek(t, 0);
+    int left = t->argc - t->i;
+    int op = binary_op(test_peek(t, 1));
+    int v;
+
+    if (w == NULL)
+    {
+        return test_bad(t, "argument expected");
+    }
+    if (left >= 3 && op != -1 && op != 3)
+    {
+        return test_binary(t);
+    }
+    if (left >= 2 && !strcmp(w, "("))
+    {
+        t->i++;
+        v = test_or(t);
+        /* if the parenthesis is not closed */
+        if (test_peek(t, 0) == NULL || strcmp(test_peek(t, 0), ")"))
+        {
+            return test_bad(t, "')' expected");
+        }
+        t->i++;
+        return v;
+    }
+    if (left >= 2 && is_unary(w))
+    {
+        t->i += 2;
+        if (w[1] == 'z' || w[1] == 'n')
+        {
+            return !*t->argv[t->i - 1] == (w[1] == 'z');
+        }
+        return w[1] == 'v' ? var_get(t->argv[t->i - 1]) != NULL : file_test(w[1], t->argv[t->i - 1]);
+    }
+    t->i++;
+    return *w != '\0';
+}
+
+/*
+ * Function: test_not
+ * Evaluates ! before an expression, which negates it, unless the ! is the
+ * left side of a binary operator.
+ */
+static int test_not(test_t *t)
+{
+    int op = binary_op(test_peek(t, 1));
+
+    if (t->argc - t->i >= 2 && !strcmp(test_peek(t, 0), "!") && (t->argc - t->i != 3 || op == -1 || op == 3))
+    {
+        t->i++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+/*
+ * Function: test_and
+ * Evaluates expressions joined by -a.
+ */
+static int test_and(test_t *t)
+{
+    int v = test_not(t);
+
+    while (test_peek(t, 0) != NULL && !strcmp(test_peek(t, 0), "-a") && !t->error)
+    {
+        t->i++;
+        v = test_not(t) && v;
+    }
+    return v;
+}
+
+/*
+ * Function: test_or
+ * Evaluates expressions joined by -o, which binds looser than -a.
+ */
+static int test_or(test_t *t)
+{
+    int v = test_and(t);
+
+    while (test_peek(t, 0) != NULL && !strcmp(test_peek(t, 0), "-o") && !t->error)
+    {
+        t->i++;
+        v = test_and(t) || v;
+    }
+    return v;
+}
+
+/*
+ * Function: cond_eval
+ * Evaluates the words of a [[ ]] command.
+ *
+ * plan : pointer to plan
+ * first : index of first word
+ * n : number of words
+ */
+int cond_eval(const plan_t *plan, uint32_t first, uint32_t n)
+{
+    cond_t c = {plan, first, n, 0, 0};
+    int v = or_expr(&c, 0);
+
+    /* if words are left over */
+    if (c.i < n)
+    {
+        bad(&c);
+    }
+    return c.error ? 2 : !v;
+}
+
+/*
+ * Function: cond_test
+ * Evaluates the arguments of a test or [ command.
+ *
+ * argv : pointer to arguments, without the command name or the closing ]
+ * argc : number of arguments
+ */
+int cond_test(char *argv[], int argc)
+{
+    test_t t = {argv, argc, 0, 0};
+    int v = argc && test_or(&t);
+
+    /* if words are left over */
+    if (t.i < argc)
+    {
+        test_bad(&t, "too many arguments");
+    }
+    return t.error ? 2 : !v;
+}
@@ -0,0 +1,28 @@
+#ifndef COND_H_
+#define COND_H_
+
+#include <stdint.h>
+#include "./plan.h"
+
+/*
+ * The conditional command [[ ... ]], run in the shell. Its words are kept
+ * as written and expanded only when they are reached, so && and || skip
+ * the expansions of a side they do not need. Operands are neither split
+ * nor matched as paths. The right side of == and != is a pattern, and the
+ * right side of =~ an extended regex. Compiled regexes are kept in a small
+ * cache, most recently used first.
+ */
+
+/*
+ * The test and [ builtins share the file and string operators, over words
+ * the command line already expanded; they join expressions with -a and -o,
+ * compare strings whole and integers without arithmetic.
+ */
+
+/* evaluates n words of plan from first, returns 0 if true, 1 if false, 2 on error */
+int cond_eval(const plan_t *plan, uint32_t first, uint32_t n);
+
+/* evaluates the argc arguments of test, returns 0 if true, 1 if false, 2 on error */
+int cond_test(char *argv[], int argc);
+
+#endif  // COND_H_
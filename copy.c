@@ -0,0 +1,482 @@
+#define _GNU_SOURCE /* copy_file_range */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./copy.h"
+#include "./meta.h"
+#include "./walk.h"
+
+#define COPY_CHUNK (1 << 30)  /* bytes asked for per copy_file_range or sendfile */
+#define COPY_BUF (1 << 20)    /* bytes of the buffer copied through as a last resort */
+#define COPY_SAME (-4096)     /* returned by copy_file when the destination is the source */
+
+/* a tree being copied */
+typedef struct tree {
+    const char *dest;   /* path of the copy of the root */
+    int preserve;       /* set to give copies the times of their sources */
+    mode_t mask;        /* the shell's umask */
+    dev_t dev;          /* device and inode of the copy of the root, so it is not copied into itself */
+    ino_t ino;
+} tree_t;
+
+/* Helper Functions */
+
+/*
+ * Function: copy_data
+ * Copies what is left of in to out, by the first means that works.
+ * Returns 0 on success, the errno value of a failed read, or the negated
+ * errno value of any other failure.
+ */
+static int copy_data(int in, int out, off_t size)
+{
+    ssize_t r;
+    ssize_t w;
+    off_t done = 0;
+    char *buf;
+
+    /* a reflink shares the source's blocks, on file systems that have them */
+    if (ioctl(out, FICLONE, in) == 0)
+    {
+        return 0;
+    }
+    while ((r = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0)) > 0)
+    {
+        done += r;
+    }
+    /* a file that says it is empty may still have data, as in /proc */
+    if (r == 0 && (done || size))
+    {
+        return 0;
+    }
+    if (r == -1 && errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)
+    {
+        return -errno;
+    }
+    while (r && (r = sendfile(out, in, NULL, COPY_CHUNK)) > 0)
+    {
+        done += r;
+    }
+    if (r == 0 && (done || size))
+    {
+        return 0;
+    }
+    if (r == -1 && errno != EINVAL && errno != ENOSYS)
+    {
+        return -errno;
+    }
+    /* if malloc fails */
+    if ((buf = malloc(COPY_BUF)) == NULL)
+    {
+        return -ENOMEM;
+    }
+    while ((r = read(in, buf, COPY_BUF)) != 0)
+    {
+        /* if read fails */
+        if (r == -1 && errno != EINTR)
+        {
+            r = errno;
+            free(buf);
+            return (int)r;
+        }
+        for (ssize_t at = 0; at < r; at += w)
+        {
+            /* if write fails */
+            if ((w = write(out, buf + at, (size_t)(r - at))) == -1)
+            {
+                if (errno == EINTR)
+                {
+                    w = 0;
+                    continue;
+                }
+                w = errno;
+                free(buf);
+                return (int)-w;
+            }
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/*
+ * Function: copy_file
+ * Copies a regular file, giving a new copy the mode of the source, and
+ * with preserve the mode and times of the source.
+ * Returns 0 on success, the errno value of a failure with the source,
+ * COPY_SAME if the destination is the source, or the negated errno value
+ * of another failure with the copy.
+ */
+static int copy_file(int sdir, const char *sname, int ddir, const char *dname, int follow, int preserve)
+{
+    struct stat st;
+    struct stat dst;
+    struct timespec times[2];
+    int in;
+    int out;
+    int err = 0;
+
+    /* if the source can not be opened */
+    if ((in = openat(sdir, sname, O_RDONLY | O_CLOEXEC | (follow ? 0 : O_NOFOLLOW))) == -1 || fstat(in, &st) == -1)
+    {
+        err = errno;
+        if (in != -1)
+        {
+            close(in);
+        }
+        return err;
+    }
+    /* truncated only once it is known not to be the source */
+    if ((out = openat(ddir, dname, O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 07777)) == -1)
+    {
+        err = -errno;
+        close(in);
+        return err;
+    }
+    if (fstat(out, &dst) == -1)
+    {
+        err = -errno;
+    }
+    else if (dst.st_dev == st.st_dev && dst.st_ino == st.st_ino)
+    {
+        err = COPY_SAME;
+    }
+    /* only a regular file has a length to cut; a device or pipe is written as is */
+    else if (S_ISREG(dst.st_mode) && ftruncate(out, 0) == -1)
+    {
+        err = -errno;
+    }
+    else
+    {
+        err = copy_data(in, out, st.st_size);
+    }
+    if (!err && preserve)
+    {
+        times[0] = st.st_atim;
+        times[1] = st.st_mtim;
+        if (fchmod(out, st.st_mode & 07777) == -1 || futimens(out, times) == -1)
+        {
+            err = -errno;
+        }
+    }
+    close(in);
+    if (close(out) == -1 && !err)
+    {
+        err = -errno;
+    }
+    return err;
+}
+
+/*
+ * Function: copy_special
+ * Copies what is not a regular file or directory: a symbolic link as a
+ * link to the same path, anything else as a new node of its kind.
+ * Returns 0 on success, the errno value of a failure with the source, or
+ * the negated errno value of a failure with the copy.
+ */
+static int copy_special(int sdir, const char *sname, int ddir, const char *dname, const struct stat *st,
+                        int preserve)
+{
+    char link[PATH_MAX];
+    struct timespec times[2];
+    ssize_t n;
+
+    if (S_ISLNK(st->st_mode))
+    {
+        /* if the link can not be read */
+        if ((n = readlinkat(sdir, sname, link, sizeof(link) - 1)) == -1)
+        {
+            return errno;
+        }
+        link[n] = '\0';
+        if (symlinkat(link, ddir, dname) == -1)
+        {
+            return -errno;
+        }
+    }
+    /* if the node can not be made */
+    else if (mknodat(ddir, dname, st->st_mode, st->st_rdev) == -1)
+    {
+        return -errno;
+    }
+    times[0] = st->st_atim;
+    times[1] = st->st_mtim;
+    if (preserve && utimensat(ddir, dname, times, AT_SYMLINK_NOFOLLOW) == -1)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/*
+ * Function: copy_enter
+ * Makes the copy of a directory before its entries are copied, writable
+ * by its owner until copy_leave gives it its mode.
+ */
+static int copy_enter(walk_t *w, walk_dir_t *d)
+{
+    tree_t *t = w->arg;
+    const char *name = d->parent != NULL ? d->name : t->dest;
+    struct stat st;
+    int dir;
+
+    /* if the directory can not be looked at */
+    if (fstat(d->fd, &st) == -1)
+    {
+        walk_fail(w, d, NULL, errno);
+        return -1;
+    }
+    /* if it is the copy, met again within the tree */
+    if (d->parent != NULL && st.st_dev == t->dev && st.st_ino == t->ino)
+    {
+        walk_fail(w, d, NULL, EINVAL);
+        return -1;
+    }
+    /* if the copy can not be made or opened */
+    if ((dir = d->parent != NULL ? walk_get(d->parent, 1) : AT_FDCWD) == -1 ||
+        (mkdirat(dir, name, (st.st_mode & 07777) | S_IRWXU) == -1 && errno != EEXIST) ||
+        (d->out = openat(dir, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 || fstat(d->out, &st) == -1)
+    {
+        walk_fail(w, d, NULL, errno);
+        walk_put(d->parent, 1, dir);
+        return -1;
+    }
+    walk_put(d->parent, 1, dir);
+    /* the root is entered before any thread starts */
+    if (d->parent == NULL)
+    {
+        t->dev = st.st_dev;
+        t->ino = st.st_ino;
+    }
+    return 0;
+}
+
+/*
+ * Function: copy_entry
+ * Copies an entry of a directory into its copy, unless it is a directory,
+ * which d_type may not tell but fstatat does. Returns 1 to walk into it.
+ */
+static int copy_entry(walk_t *w, walk_dir_t *d, const char *name, unsigned char type)
+{
+    tree_t *t = w->arg;
+    struct stat st;
+    int err;
+
+    if (type == DT_DIR)
+    {
+        return 1;
+    }
+    if (type == DT_REG)
+    {
+        err = copy_file(d->fd, name, d->out, name, 0, t->preserve);
+    }
+    else if (fstatat(d->fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+    {
+        err = errno;
+    }
+    else if (S_ISDIR(st.st_mode))
+    {
+        return 1;
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+        err = copy_file(d->fd, name, d->out, name, 0, t->preserve);
+    }
+    else
+    {
+        err = copy_special(d->fd, name, d->out, name, &st, t->preserve);
+    }
+    /* if the entry could not be copied; within a tree, a copy that is its source exists already */
+    if (err)
+    {
+        walk_fail(w, d, name, err == COPY_SAME ? EEXIST : err < 0 ? -err : err);
+    }
+    return 0;
+}
+
+/*
+ * Function: copy_leave
+ * Gives the copy of a directory its mode, and with preserve its times,
+ * once everything in it is copied.
+ */
+static void copy_leave(walk_t *w, walk_dir_t *d)
+{
+    tree_t *t = w->arg;
+    struct stat st;
+    struct timespec times[2];
+    int fd;
+    int out;
+
+    /* if the copy was never made, or the directory can not be looked at */
+    if ((out = walk_get(d, 1)) == -1 || (fd = walk_get(d, 0)) == -1 || fstat(fd, &st) == -1)
+    {
+        walk_put(d, 1, out);
+        if (out != -1)
+        {
+            walk_put(d, 0, fd);
+        }
+        return;
+    }
+    walk_put(d, 0, fd);
+    times[0] = st.st_atim;
+    times[1] = st.st_mtim;
+    /* if the mode or times can not be set */
+    if ((t->preserve && (fchmod(out, st.st_mode & 07777) == -1 || futimens(out, times) == -1)) ||
+        (!t->preserve && (st.st_mode & S_IRWXU) != S_IRWXU && fchmod(out, st.st_mode & 07777 & ~t->mask) == -1))
+    {
+        walk_fail(w, d, NULL, errno);
+    }
+    walk_put(d, 1, out);
+}
+
+/*
+ * Function: inside
+ * Checks whether the directory a copy would be made in is src or below
+ * it, so a tree is not copied into itself. Returns 1 if it is, 0 if not
+ * or if either path can not be resolved, which the copy then reports.
+ *
+ * src : directory copied
+ * target : path of the copy
+ */
+static int inside(const char *src, const char *target)
+{
+    char from[PATH_MAX];
+    char parent[PATH_MAX];
+    char in[PATH_MAX];
+    size_t len = strlen(target);
+    size_t n;
+
+    while (len > 1 && target[len - 1] == '/')
+    {
+        len--;
+    }
+    while (len && target[len - 1] != '/')
+    {
+        len--;
+    }
+    /* the directory of the copy is the target up to its last slash, / or . */
+    if (len >= sizeof(parent))
+    {
+        return 0;
+    }
+    memcpy(parent, len ? target : ".", len ? len : 1);
+    parent[len ? len : 1] = '\0';
+    if (realpath(src, from) == NULL || realpath(parent, in) == NULL)
+    {
+        return 0;
+    }
+    n = strlen(from);
+    return !strncmp(in, from, n) && (in[n] == '\0' || in[n] == '/' || n == 1);
+}
+
+/*
+ * Function: copy_paths
+ * Copies sources to dest, or into dest if it is a directory, which it
+ * must be for more than one source. Directories are copied only if
+ * recursive, and then symbolic links as links.
+ *
+ * srcs : sources
+ * n : number of sources
+ * dest : path of the copy, or directory to copy into
+ * recursive : set to copy directories
+ * preserve : set to give copies the mode and times of their sources
+ */
+int copy_paths(char *srcs[], size_t n, const char *dest, int recursive, int preserve)
+{
+    tree_t t;
+    walk_t w = {"cp", 0, &t, copy_enter, copy_entry, copy_leave, 0};
+    struct stat st;
+    int into = meta_stat(dest, &st, 1) == 0 && S_ISDIR(st.st_mode);
+    int status = 0;
+
+    /* if several sources are not copied into a directory */
+    if (n > 1 && !into)
+    {
+        fprintf(stderr, "cp: %s: %s\n", dest, strerror(ENOTDIR));
+        return 1;
+    }
+    t.preserve = preserve;
+    t.mask = umask(0);
+    umask(t.mask);
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *src = srcs[i];
+        char *path = NULL;
+        const char *target = dest;
+        int err;
+
+        /* a copy into dest takes the last component of its source */
+        if (into)
+        {
+            size_t len = strlen(src);
+            size_t start;
+
+            while (len > 1 && src[len - 1] == '/')
+            {
+                len--;
+            }
+            for (start = len; start && src[start - 1] != '/'; start--)
+            {
+            }
+            /* if malloc fails */
+            if ((path = malloc(strlen(dest) + len - start + 2)) == NULL)
+            {
+                perror("cp");
+                return 1;
+            }
+            sprintf(path, "%s/%.*s", dest, (int)(len - start), src + start);
+            target = path;
+        }
+        /* if the source is not there */
+        if ((recursive ? lstat(src, &st) : stat(src, &st)) == -1)
+        {
+            fprintf(stderr, "cp: %s: %s\n", src, strerror(errno));
+            status = 1;
+        }
+        else if (S_ISDIR(st.st_mode) && !recursive)
+        {
+            fprintf(stderr, "cp: %s: %s\n", src, strerror(EISDIR));
+            status = 1;
+        }
+        /* if the copy would be made within the tree it copies */
+        else if (S_ISDIR(st.st_mode) && inside(src, target))
+        {
+            fprintf(stderr, "cp: %s: %s\n", target, "Can not copy a directory into itself");
+            status = 1;
+        }
+        else if (S_ISDIR(st.st_mode))
+        {
+            t.dest = target;
+            status |= walk_tree(&w, src) == -1;
+            meta_bump(NULL); /* directories below it may be watched */
+        }
+        /* if the file could not be copied */
+        else if ((err = S_ISREG(st.st_mode) || !recursive ? copy_file(AT_FDCWD, src, AT_FDCWD, target, 1, preserve)
+                                                         : copy_special(AT_FDCWD, src, AT_FDCWD, target, &st, preserve)))
+        {
+            if (err == COPY_SAME)
+            {
+                fprintf(stderr, "cp: %s and %s are the same file\n", src, target);
+            }
+            else
+            {
+                fprintf(stderr, "cp: %s: %s\n", err < 0 ? target : src, strerror(err < 0 ? -err : err));
+            }
+            status = 1;
+        }
+        else
+        {
+            meta_bump(target);
+        }
+        free(path);
+    }
+    return status;
+}
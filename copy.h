@@ -0,0 +1,18 @@
+#ifndef COPY_H_
+#define COPY_H_
+
+#include <stddef.h>
+
+/*
+ * Copying of files and directory trees for the cp builtin. The data of a
+ * file is copied by the fastest means that works: a reflink sharing the
+ * source's blocks, then copy_file_range and sendfile, which copy in the
+ * kernel, then reads and writes of a large buffer. A tree is copied with
+ * the parallel walk of rm -r, each directory given its mode, and with
+ * preserve its times, once everything in it is copied.
+ */
+
+/* copies n sources to dest, into it if it is a directory, returns the exit status */
+int copy_paths(char *srcs[], size_t n, const char *dest, int recursive, int preserve);
+
+#endif  // COPY_H_
@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./defs.h"
+
+/* Global Variables */
+static def_t **table;  /* buckets, a power of two of them */
+static size_t n_buckets;
+static size_t n_defs;
+
+/* Helper Functions */
+
+/*
+ * Function: hash
+ * FNV-1a hash of a definition's kind and name.
+ */
+static size_t hash(int kind, const char *name)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    h ^= (unsigned int)kind;
+    for (; *name; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t)h;
+}
+
+/*
+ * Function: def_free
+ * Frees a definition and its plan.
+ */
+static void def_free(def_t *def)
+{
+    plan_free(def->plan);
+    free(def->name);
+    free(def->text);
+    free(def);
+}
+
+/*
+ * Function: rehash
+ * Doubles the number of buckets. Returns 0 on success, -1 on failure.
+ */
+static int rehash()
+{
+    size_t n = n_buckets ? n_buckets * 2 : 64;
+    def_t **t;
+
+    /* if calloc fails */
+    if ((t = calloc(n, sizeof(def_t *))) == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < n_buckets; i++)
+    {
+        def_t *def = table[i];
+
+        while (def != NULL)
+        {
+            def_t *next = def->next;
+            size_t b = hash(def->kind, def->name) & (n - 1);
+
+            def->next = t[b];
+            t[b] = def;
+            def = next;
+        }
+    }
+    free(table);
+    table = t;
+    n_buckets = n;
+    return 0;
+}
+
+/*
+ * Function: unlink_def
+ * Takes the definition of name out of the table. Returns it, NULL if none.
+ */
+static def_t *unlink_def(int kind, const char *name)
+{
+    def_t **p;
+
+    if (!n_buckets)
+    {
+        return NULL;
+    }
+    for (p = &table[hash(kind, name) & (n_buckets - 1)]; *p != NULL; p = &(*p)->next)
+    {
+        def_t *def = *p;
+
+        if (def->kind == kind && !strcmp(def->name, name))
+        {
+            *p = def->next;
+            n_defs--;
+            return def;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: retire
+ * Frees a definition taken out of the table, or leaves that to its last
+ * def_leave if it is in use.
+ */
+static void retire(def_t *def)
+{
+    if (def->running)
+    {
+        def->dead = 1;
+    }
+    else
+    {
+        def_free(def);
+    }
+}
+
+/*
+ * Function: by_name
+ * qsort comparator of definitions by name.
+ */
+static int by_name(const void *a, const void *b)
+{
+    return strcmp((*(def_t *const *)a)->name, (*(def_t *const *)b)->name);
+}
+
+/*
+ * Function: def_set
+ * Defines or redefines name.
+ *
+ * kind : DEF_FUNC or DEF_ALIAS
+ * name : pointer to name
+ * text : pointer to function body or alias value
+ */
+int def_set(int kind, const char *name, const char *text)
+{
+    def_t *def;
+    def_t *old;
+    size_t b;
+
+    /* if table is more than 3/4 full and can not grow */
+    if (n_defs + 1 > n_buckets / 4 * 3 && rehash() == -1)
+    {
+        return -1;
+    }
+    /* if allocating the definition fails */
+    if ((def = calloc(1, sizeof(def_t))) == NULL ||
+        (def->name = strdup(name)) == NULL || (def->text = strdup(text)) == NULL)
+    {
+        if (def != NULL)
+        {
+            free(def->name);
+            free(def);
+        }
+        return -1;
+    }
+    def->kind = kind;
+
+    if ((old = unlink_def(kind, name)) != NULL)
+    {
+        retire(old);
+    }
+    b = hash(kind, name) & (n_buckets - 1);
+    def->next = table[b];
+    table[b] = def;
+    n_defs++;
+    return 0;
+}
+
+/*
+ * Function: def_get
+ * Looks up the definition of name.
+ *
+ * kind : DEF_FUNC or DEF_ALIAS
+ * name : pointer to name
+ */
+def_t *def_get(int kind, const char *name)
+{
+    if (!n_buckets)
+    {
+        return NULL;
+    }
+    for (def_t *def = table[hash(kind, name) & (n_buckets - 1)]; def != NULL; def = def->next)
+    {
+        if (def->kind == kind && !strcmp(def->name, name))
+        {
+            return def;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: def_unset
+ * Removes the definition of name.
+ *
+ * kind : DEF_FUNC or DEF_ALIAS
+ * name : pointer to name
+ */
+int def_unset(int kind, const char *name)
+{
+    def_t *def;
+
+    /* if name is not defined */
+    if ((def = unlink_def(kind, name)) == NULL)
+    {
+        return -1;
+    }
+    retire(def);
+    return 0;
+}
+
+/*
+ * Function: def_plan
+ * Gets the parsed text of a definition, parsing it on first use.
+ *
+ * def : pointer to definition
+ */
+plan_t *def_plan(def_t *def)
+{
+    if (def->plan == NULL)
+    {
+        def->plan = plan_parse(def->text, strlen(def->text));
+    }
+    return def->plan;
+}
+
+/*
+ * Function: def_enter
+ * Marks a definition as in use.
+ *
+ * def : pointer to definition
+ */
+void def_enter(def_t *def)
+{
+    def->running++;
+}
+
+/*
+ * Function: def_leave
+ * Marks a use of a definition as done, freeing it if it was retired meanwhile.
+ *
+ * def : pointer to definition
+ */
+void def_leave(def_t *def)
+{
+    /* if this was the last use of a retired definition */
+    if (!--def->running && def->dead)
+    {
+        def_free(def);
+    }
+}
+
+/*
+ * Function: def_list
+ * Collects the definitions of a kind, sorted by name.
+ *
+ * kind : DEF_FUNC or DEF_ALIAS
+ */
+def_t **def_list(int kind)
+{
+    def_t **list;
+    size_t n = 0;
+
+    /* if malloc fails */
+    if ((list = malloc((n_defs + 1) * sizeof(def_t *))) == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < n_buckets; i++)
+    {
+        for (def_t *def = table[i]; def != NULL; def = def->next)
+        {
+            if (def->kind == kind)
+            {
+                list[n++] = def;
+            }
+        }
+    }
+    qsort(list, n, sizeof(def_t *), by_name);
+    list[n] = NULL;
+    return list;
+}
@@ -0,0 +1,52 @@
+#ifndef DEFS_H_
+#define DEFS_H_
+
+#include "./plan.h"
+
+/*
+ * Shell functions and aliases, kept in one hash table keyed by kind and name.
+ * A definition holds its text (function body or alias value) and parses it
+ * into a plan the first time it is used; later uses run that plan as-is.
+ */
+
+typedef enum { DEF_FUNC, DEF_ALIAS } def_kind_t;
+
+typedef struct def {
+    char *name;
+    char *text;       /* function body or alias value */
+    plan_t *plan;     /* parsed text, NULL until first use */
+    int kind;
+    int running;      /* uses in progress */
+    int dead;         /* replaced or removed while in use */
+    struct def *next; /* next definition in the same bucket */
+} def_t;
+
+/* defines or redefines name, returns 0 on success, -1 on failure */
+int def_set(int kind, const char *name, const char *text);
+
+/* gets the definition of name, NULL if there is none */
+def_t *def_get(int kind, const char *name);
+
+/* removes the definition of name, returns 0 on success, -1 if there is none */
+int def_unset(int kind, const char *name);
+
+/*
+ * gets the parsed plan of a definition, parsing its text on first use
+ * returns NULL on failure, with errno set as by plan_parse
+ */
+plan_t *def_plan(def_t *def);
+
+/*
+ * marks a definition as in use / no longer in use
+ * a definition replaced or removed while in use is freed by its last def_leave
+ */
+void def_enter(def_t *def);
+void def_leave(def_t *def);
+
+/*
+ * gets all definitions of a kind, sorted by name
+ * returns a NULL terminated array to free (but not its elements), NULL on failure
+ */
+def_t **def_list(int kind);
+
+#endif  // DEFS_H_
@@ -0,0 +1,2103 @@
+#include <errno.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "./arith.h"
+#include "./expand.h"
+#include "./glob.h"
+#include "./plan.h"
+#include "./vars.h"
+
+/* expansion flags */
+#define X_SPLIT 0x1   /* split unquoted values into fields */
+#define X_QUOTED 0x2  /* inside double quotes */
+#define X_PATTERN 0x4 /* escape quoted text, so a pattern matches it literally */
+#define X_GLOB 0x8    /* the same, for words that become paths if they match */
+#define X_HEREDOC 0x10 /* in a here-document, where quotes are plain text */
+#define X_REGEX 0x20  /* escape quoted text, so an extended regex matches it literally */
+
+#define HERE_DOC 1    /* the next word is the text of a here-document */
+#define HERE_STRING 2 /* the next word is a here-string */
+
+char op_in[] = "<";
+char op_out[] = ">";
+char op_append[] = ">>";
+char op_bg[] = "&";
+char op_here[] = "<<";
+
+/* a parameter named in ${...} */
+typedef struct ref {
+    const char *w;   /* word naming it */
+    size_t i;        /* offset of the name in w */
+    size_t n;        /* length of the name */
+    char list;       /* '@' or '*' if it stands for a list of values, else 0 */
+    int keys;        /* set for ${!name[@]}, the list of keys */
+    const char *key; /* expanded subscript, NULL if none */
+} ref_t;
+
+/* a list of values being expanded: positional parameters or array elements */
+typedef struct items {
+    char *const *argv;     /* values, NULL where unset, unless assoc is set */
+    size_t n;
+    const assoc_t *assoc;  /* entries of an associative array */
+    size_t count;          /* number of values */
+    int keys;              /* set to go through the keys instead */
+    size_t pos;
+    char tmp[24];          /* an index being given as a key */
+} items_t;
+
+/* a pattern operator applied to each value */
+typedef struct op {
+    char c;                /* '#', '%' or '/' */
+    int longest;           /* ## or %% */
+    int all;               /* // */
+    char anchor;           /* '#' or '%' for /# and /% */
+    const char *pattern;
+    const char *rep;
+} op_t;
+
+static int expand_text(expand_t *ex, const char *w, size_t i, size_t end, int flags);
+
+/* Helper Functions */
+
+/*
+ * Function: reserve
+ * Makes room for n more bytes of text. Returns 0 on success, -1 on failure.
+ */
+static int reserve(expand_t *ex, size_t n)
+{
+    size_t cap = ex->cap;
+    char *p;
+
+    if (ex->len + n <= cap)
+    {
+        return 0;
+    }
+    while (cap < ex->len + n)
+    {
+        cap *= 2;
+    }
+    /* if the text outgrows the inline buffer */
+    if (ex->buf == ex->sbuf)
+    {
+        if ((p = malloc(cap)) == NULL)
+        {
+            return -1;
+        }
+        memcpy(p, ex->buf, ex->len);
+    }
+    else if ((p = realloc(ex->buf, cap)) == NULL)
+    {
+        return -1;
+    }
+    ex->buf = p;
+    ex->cap = cap;
+    return 0;
+}
+
+/*
+ * Function: open_field
+ * Starts a word if none is being built, so it is kept even if it stays empty.
+ */
+static void open_field(expand_t *ex)
+{
+    if (!ex->open)
+    {
+        ex->open = 1;
+        ex->start = ex->len;
+    }
+}
+
+/*
+ * Function: add_field
+ * Adds a word to the list, lent if it is a value kept by a variable.
+ * Returns 0 on success, -1 on failure.
+ */
+static int add_field(expand_t *ex, char *ptr, size_t off, int lent)
+{
+    if (ex->n == ex->cap_fields)
+    {
+        int cap = ex->cap_fields * 2;
+        expand_field_t *p;
+
+        if (ex->fields == ex->sfields)
+        {
+            if ((p = malloc((size_t)cap * sizeof(expand_field_t))) == NULL)
+            {
+                return -1;
+            }
+            memcpy(p, ex->fields, (size_t)ex->n * sizeof(expand_field_t));
+        }
+        else if ((p = realloc(ex->fields, (size_t)cap * sizeof(expand_field_t))) == NULL)
+        {
+            return -1;
+        }
+        ex->fields = p;
+        ex->cap_fields = cap;
+    }
+    ex->fields[ex->n].ptr = ptr;
+    ex->fields[ex->n].off = off;
+    ex->fields[ex->n].lent = lent;
+    ex->lent += lent;
+    ex->n++;
+    return 0;
+}
+
+/*
+ * Function: unescape
+ * Removes the backslashes escaping pattern characters of the word being
+ * built, once it is known not to be a pattern.
+ */
+static void unescape(expand_t *ex)
+{
+    size_t j = ex->start;
+
+    for (size_t i = ex->start; i < ex->len; i++)
+    {
+        i += ex->buf[i] == '\\' && i + 1 < ex->len;
+        ex->buf[j++] = ex->buf[i];
+    }
+    ex->len = j;
+    ex->escaped = 0;
+}
+
+static int end_field(expand_t *ex);
+static int put(expand_t *ex, const char *s, size_t n);
+
+/*
+ * Function: end_glob
+ * Ends a word holding an unquoted * ? or [, replacing it by the paths it
+ * matches. A word that matches nothing is kept, its escapes removed.
+ * Returns 0 on success, -1 on failure.
+ */
+static int end_glob(expand_t *ex)
+{
+    glob_list_t g;
+    int n;
+
+    ex->glob = 0;
+    if (reserve(ex, 1) == -1)
+    {
+        return -1;
+    }
+    ex->buf[ex->len] = '\0';
+    if ((n = glob_expand(ex->buf + ex->start, &g)) <= 0)
+    {
+        if (ex->escaped)
+        {
+            unescape(ex);
+        }
+        return n == -1 ? -1 : end_field(ex);
+    }
+    ex->len = ex->start;
+    ex->open = 0;
+    ex->escaped = 0;
+    for (size_t i = 0; i < g.n; i++)
+    {
+        if (put(ex, g.paths[i], strlen(g.paths[i])) == -1 || end_field(ex) == -1)
+        {
+            glob_list_free(&g);
+            return -1;
+        }
+    }
+    glob_list_free(&g);
+    return 0;
+}
+
+/*
+ * Function: end_field
+ * Ends the word being built, if any. Returns 0 on success, -1 on failure.
+ */
+static int end_field(expand_t *ex)
+{
+    if (!ex->open)
+    {
+        return 0;
+    }
+    if (ex->glob)
+    {
+        return end_glob(ex);
+    }
+    if (ex->escaped)
+    {
+        unescape(ex);
+    }
+    if (reserve(ex, 1) == -1)
+    {
+        return -1;
+    }
+    ex->buf[ex->len++] = '\0';
+    ex->open = 0;
+    return add_field(ex, NULL, ex->start, 0);
+}
+
+/*
+ * Function: put
+ * Adds n bytes of s to the word being built. Returns 0 on success, -1 on failure.
+ */
+static int put(expand_t *ex, const char *s, size_t n)
+{
+    if (reserve(ex, n) == -1)
+    {
+        return -1;
+    }
+    open_field(ex);
+    memcpy(ex->buf + ex->len, s, n);
+    ex->len += n;
+    return 0;
+}
+
+/*
+ * Function: is_special
+ * Checks whether any of n bytes is one a pattern, or a regex, treats specially.
+ */
+static int is_special(const char *s, size_t n, int flags)
+{
+    const char *special = flags & X_REGEX ? "\\.[]()*+?{}|^$" : "*?[]\\";
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (s[i] && strchr(special, s[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: put_lit
+ * Adds a character written in the word. When building a pattern, quoted
+ * characters that a pattern would treat specially are escaped, and a
+ * word that may become paths notes the unquoted ones.
+ */
+static int put_lit(expand_t *ex, char c, int flags, int quoted)
+{
+    if (!(flags & (X_PATTERN | X_GLOB | X_REGEX)) || !is_special(&c, 1, flags))
+    {
+        return put(ex, &c, 1);
+    }
+    /* if character must match itself */
+    if (quoted || c == '\\')
+    {
+        ex->escaped |= flags & X_GLOB;
+        if (put(ex, "\\", 1) == -1)
+        {
+            return -1;
+        }
+    }
+    else if (c != ']')
+    {
+        ex->glob |= flags & X_GLOB;
+    }
+    return put(ex, &c, 1);
+}
+
+/*
+ * Function: put_value
+ * Adds n bytes of a parameter's value. Unquoted values of command words are
+ * split into fields on the characters of $IFS (blank, tab and line break by
+ * default); an unquoted empty value adds nothing.
+ */
+static int put_value(expand_t *ex, const char *v, size_t n, int flags)
+{
+    const char *ifs;
+    size_t i = 0;
+
+    if ((flags & X_QUOTED) || !(flags & X_SPLIT))
+    {
+        if (!(flags & (X_PATTERN | X_GLOB | X_REGEX)) || !(flags & X_QUOTED) || !is_special(v, n, flags))
+        {
+            return put(ex, v, n);
+        }
+        for (; i < n; i++)
+        {
+            if (put_lit(ex, v[i], flags, 1) == -1)
+            {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if ((ifs = var_get("IFS")) == NULL)
+    {
+        ifs = " \t\n";
+    }
+    while (i < n)
+    {
+        size_t run = i;
+
+        /* take the longest run of characters that are not separators */
+        while (run < n && !(v[run] && strchr(ifs, v[run])))
+        {
+            run++;
+        }
+        if (!(flags & X_GLOB) || !is_special(v + i, run - i, flags))
+        {
+            if (run > i && put(ex, v + i, run - i) == -1)
+            {
+                return -1;
+            }
+        }
+        /* the unquoted value holds a pattern */
+        else
+        {
+            for (size_t k = i; k < run; k++)
+            {
+                if (put_lit(ex, v[k], flags, 0) == -1)
+                {
+                    return -1;
+                }
+            }
+        }
+        /* if a separator ends the run, it ends the word */
+        if (run < n && end_field(ex) == -1)
+        {
+            return -1;
+        }
+        i = run + 1;
+    }
+    return 0;
+}
+
+/*
+ * Function: bad_subst
+ * Reports a malformed ${...}. Returns -1.
+ */
+static int bad_subst()
+{
+    fprintf(stderr, "%s\n", "SYNTAX ERROR : Bad substitution.");
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * Function: name_len
+ * Length of the parameter name at w[i]: a variable name, a number, or one
+ * of the special parameters ? $ # @ *. Only one digit is taken unless
+ * braced. Returns 0 if there is no name.
+ */
+static size_t name_len(const char *w, size_t i, size_t end, int braced)
+{
+    size_t n = 0;
+
+    if (i >= end)
+    {
+        return 0;
+    }
+    if (w[i] >= '0' && w[i] <= '9')
+    {
+        while (i + n < end && w[i + n] >= '0' && w[i + n] <= '9' && (braced || !n))
+        {
+            n++;
+        }
+        return n;
+    }
+    if (strchr("?$#@*", w[i]) && w[i])
+    {
+        return 1;
+    }
+    if (!var_name_ok(w + i, 1))
+    {
+        return 0;
+    }
+    /* the rest of a name may hold digits too */
+    while (i + n < end && (var_name_ok(w + i + n, 1) || (w[i + n] >= '0' && w[i + n] <= '9')))
+    {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Function: set_element
+ * Sets an element with var_set_element, reporting a bad subscript.
+ */
+static int set_element(var_t *var, const char *sub, const char *value, size_t len)
+{
+    int r = var_set_element(var, sub, value, len);
+
+    /* if the subscript is before the first element */
+    if (r == -1 && errno == EDOM)
+    {
+        fprintf(stderr, "ERROR : %s[%s]: bad array subscript.\n", var->name, sub);
+        errno = EINVAL;
+    }
+    return r;
+}
+
+/*
+ * Function: subscript
+ * Evaluates the expanded subscript sub of var as arithmetic, unless var is
+ * an associative array, writing the index to tmp. Returns the subscript to
+ * use, NULL on failure.
+ */
+static const char *subscript(const var_t *var, const char *sub, char *tmp, size_t size)
+{
+    int64_t k;
+
+    if (var != NULL && (var->flags & VAR_ASSOC))
+    {
+        return sub;
+    }
+    if (arith_eval(sub, strlen(sub), &k) == -1)
+    {
+        return NULL;
+    }
+    snprintf(tmp, size, "%lld", (long long)k);
+    return tmp;
+}
+
+/*
+ * Function: param
+ * Gets the value of the parameter named w[i..i+n), or of its element named
+ * by key if key is not NULL. Numbers that have to be formatted are written
+ * to tmp. Returns NULL if the parameter is unset.
+ */
+static const char *param(const char *w, size_t i, size_t n, const char *key, char *tmp, size_t size)
+{
+    params_t p = var_get_params();
+    var_t *var;
+
+    if (key != NULL)
+    {
+        return var_element(var_find(w + i, n), key);
+    }
+    switch (w[i])
+    {
+    case '?':
+        snprintf(tmp, size, "%d", last_status);
+        return tmp;
+    case '$':
+        snprintf(tmp, size, "%d", (int)getpid());
+        return tmp;
+    case '#':
+        snprintf(tmp, size, "%d", p.argc);
+        return tmp;
+    case '@':
+    case '*':
+        return p.argc ? "" : NULL;
+    }
+    if (w[i] >= '0' && w[i] <= '9')
+    {
+        long k = strtol(w + i, NULL, 10);
+
+        if (!k)
+        {
+            return var_get_arg0();
+        }
+        return k <= p.argc ? p.argv[k - 1] : NULL;
+    }
+    var = var_find(w + i, n);
+    return var != NULL ? var_value(var) : NULL;
+}
+
+/*
+ * Function: items_of
+ * Sets up it to go through the values of $@ or $*, when w[i] is @ or *, or
+ * through those of the variable named w[i..i+n) as name[@], or through its
+ * keys. Returns the number of values.
+ */
+static size_t items_of(items_t *it, const char *w, size_t i, size_t n, int keys)
+{
+    const var_t *var;
+
+    memset(it, 0, sizeof(items_t));
+    it->keys = keys;
+    if (w[i] == '@' || w[i] == '*')
+    {
+        params_t p = var_get_params();
+
+        it->argv = p.argv;
+        it->n = (size_t)p.argc;
+        return it->count = it->n;
+    }
+    if ((var = var_find(w + i, n)) == NULL)
+    {
+        return 0;
+    }
+    if (var->flags & VAR_ARRAY)
+    {
+        it->argv = var->array->items;
+        it->n = var->array->n;
+        return it->count = var->array->count;
+    }
+    if (var->flags & VAR_ASSOC)
+    {
+        it->assoc = var->assoc;
+        return it->count = var->assoc->count;
+    }
+    /* a variable that is not an array is a list of its value */
+    it->argv = &var->value;
+    it->n = 1;
+    return it->count = var->value != NULL;
+}
+
+/*
+ * Function: next_item
+ * Gets the next value, or key, of a list. Returns NULL at its end.
+ */
+static char *next_item(items_t *it)
+{
+    if (it->assoc != NULL)
+    {
+        const assoc_entry_t *e;
+
+        while (it->pos < it->assoc->n_entries && it->assoc->entries[it->pos].key == NULL)
+        {
+            it->pos++;
+        }
+        if (it->pos == it->assoc->n_entries)
+        {
+            return NULL;
+        }
+        e = &it->assoc->entries[it->pos++];
+        return it->keys ? e->key : e->value;
+    }
+    /* unset elements are skipped */
+    while (it->pos < it->n && it->argv[it->pos] == NULL)
+    {
+        it->pos++;
+    }
+    if (it->pos == it->n)
+    {
+        return NULL;
+    }
+    if (it->keys)
+    {
+        snprintf(it->tmp, sizeof(it->tmp), "%zu", it->pos++);
+        return it->tmp;
+    }
+    return it->argv[it->pos++];
+}
+
+/*
+ * Function: expand_sub
+ * Expands w[a..b) into a string of its own, held by sub.
+ * Returns the string, NULL on failure.
+ */
+static char *expand_sub(expand_t *sub, const char *w, size_t a, size_t b, int flags)
+{
+    expand_init(sub);
+    if (expand_text(sub, w, a, b, flags) == -1 || reserve(sub, 1) == -1)
+    {
+        return NULL;
+    }
+    sub->buf[sub->len] = '\0';
+    return sub->buf;
+}
+
+/*
+ * Function: match
+ * Checks whether pattern matches the first n bytes of s, which it
+ * terminates for the call.
+ */
+static int match(const char *pattern, char *s, size_t n)
+{
+    char c = s[n];
+    int r;
+
+    s[n] = '\0';
+    r = fnmatch(pattern, s, 0) == 0;
+    s[n] = c;
+    return r;
+}
+
+/*
+ * Function: trim
+ * Applies ${v#pat}, ${v##pat}, ${v%pat} or ${v%%pat} to v and adds the result.
+ */
+static int trim(expand_t *ex, char *v, const char *pattern, char op, int longest, int flags)
+{
+    size_t n = strlen(v);
+    size_t from = 0;
+    size_t to = n;
+
+    if (op == '#')
+    {
+        /* shortest prefix first, or longest */
+        for (size_t k = 0; k <= n; k++)
+        {
+            size_t len = longest ? n - k : k;
+
+            if (match(pattern, v, len))
+            {
+                from = len;
+                break;
+            }
+        }
+    }
+    else
+    {
+        /* shortest suffix first, or longest */
+        for (size_t k = 0; k <= n; k++)
+        {
+            size_t start = longest ? k : n - k;
+
+            if (fnmatch(pattern, v + start, 0) == 0)
+            {
+                to = start;
+                break;
+            }
+        }
+    }
+    return put_value(ex, v + from, to - from, flags);
+}
+
+/*
+ * Function: replace
+ * Applies ${v/pat/rep} to v and adds the result. The longest match at the
+ * first position that matches is replaced; every match with all set, only
+ * one at the start or end with anchor '#' or '%'.
+ */
+static int replace(expand_t *ex, char *v, const char *pattern, const char *rep, int all, char anchor, int flags)
+{
+    size_t n = strlen(v);
+    size_t done = 0; /* bytes of v added so far */
+    size_t rep_len = strlen(rep);
+
+    for (size_t s = 0; s <= n && (!s || anchor != '#'); s++)
+    {
+        size_t e = n;
+        int found = 0;
+
+        /* find the longest match at s; only anchored patterns may match nothing */
+        while (1)
+        {
+            if ((e > s || anchor) && match(pattern, v + s, e - s))
+            {
+                found = 1;
+                break;
+            }
+            if (e == s || anchor == '%')
+            {
+                break;
+            }
+            e--;
+        }
+        if (!found)
+        {
+            continue;
+        }
+        if (put_value(ex, v + done, s - done, flags) == -1 || put_value(ex, rep, rep_len, flags) == -1)
+        {
+            return -1;
+        }
+        done = e;
+        if (!all)
+        {
+            break;
+        }
+        s = e - 1;
+    }
+    return put_value(ex, v + done, n - done, flags);
+}
+
+/*
+ * Function: put_op
+ * Adds a value, after applying a pattern operator to it if op is not NULL.
+ */
+static int put_op(expand_t *ex, const char *v, const op_t *op, int flags)
+{
+    char *copy;
+    int r;
+
+    if (op == NULL)
+    {
+        return put_value(ex, v, strlen(v), flags);
+    }
+    /* if strdup fails */
+    if ((copy = strdup(v)) == NULL)
+    {
+        return -1;
+    }
+    if (op->c == '/')
+    {
+        r = replace(ex, copy, op->pattern, op->rep, op->all, op->anchor, flags);
+    }
+    else
+    {
+        r = trim(ex, copy, op->pattern, op->c, op->longest, flags);
+    }
+    free(copy);
+    return r;
+}
+
+/*
+ * Function: put_list
+ * Adds the values of a list: $@, $*, name[@], name[*] or the keys of
+ * ${!name[@]}, each through op if it is not NULL. Unquoted, or as "$@",
+ * each value becomes a word of its own; "$*", or either one where words are
+ * not split, joins them with the first character of $IFS. A quoted "$@" or
+ * "${name[@]}" word that is all of one value takes it from where it is kept
+ * rather than copying it, except for the last, which later text may join.
+ */
+static int put_list(expand_t *ex, items_t *it, char c, const op_t *op, int flags)
+{
+    const char *ifs = var_get("IFS");
+    int join = !(flags & X_SPLIT) || (c == '*' && (flags & X_QUOTED));
+    int lend = c == '@' && (flags & X_QUOTED) && (flags & X_SPLIT) && !(flags & X_PATTERN) && op == NULL &&
+               !(it->keys && it->assoc == NULL);
+    int lent = 0;
+    char *v;
+
+    if (ifs == NULL)
+    {
+        ifs = " ";
+    }
+    /* if "$@" has nothing to expand, it makes no word at all */
+    if (!it->count && c == '@' && (flags & X_QUOTED))
+    {
+        ex->at_empty = 1;
+    }
+    for (size_t k = 0; (v = next_item(it)) != NULL; k++)
+    {
+        if (k)
+        {
+            if (join && *ifs && put(ex, ifs, 1) == -1)
+            {
+                return -1;
+            }
+            /* if each value is a word, the next one starts a new one */
+            if (!join && !lent && (flags & X_QUOTED))
+            {
+                open_field(ex);
+            }
+            if (!join && !lent && end_field(ex) == -1)
+            {
+                return -1;
+            }
+        }
+        lent = lend && !ex->open && k + 1 < it->count;
+        if (lent && add_field(ex, v, 0, 1) == -1)
+        {
+            return -1;
+        }
+        if (!lent && put_op(ex, v, op, flags) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: brace_op
+ * Applies the operator of ${...} at w[op..close) to the parameter named in
+ * it, adding the result.
+ */
+static int brace_op(expand_t *ex, const ref_t *ref, size_t op, size_t close, int flags)
+{
+    const char *w = ref->w;
+    char tmp[32];
+    const char *value = NULL;
+    int colon = 0;
+    items_t it;
+    expand_t sub;
+    expand_t sub2;
+    op_t o;
+    char *v;
+    int r;
+
+    if (ref->list)
+    {
+        items_of(&it, w, ref->i, ref->n, ref->keys);
+    }
+    else
+    {
+        value = param(w, ref->i, ref->n, ref->key, tmp, sizeof(tmp));
+    }
+    if (op == close)
+    {
+        if (ref->list)
+        {
+            return put_list(ex, &it, ref->list, NULL, flags);
+        }
+        return value != NULL ? put_value(ex, value, strlen(value), flags) : 0;
+    }
+
+    if (w[op] == ':' && op + 1 < close && strchr("-=+", w[op + 1]))
+    {
+        colon = 1;
+        op++;
+    }
+    switch (w[op])
+    {
+    case '-':
+    case '=':
+    case '+':
+        /* if the parameter counts as set */
+        if (ref->list ? it.count > 0 : value != NULL && (!colon || *value))
+        {
+            if (w[op] == '+')
+            {
+                return expand_text(ex, w, op + 1, close, flags);
+            }
+            if (ref->list)
+            {
+                return put_list(ex, &it, ref->list, NULL, flags);
+            }
+            return put_value(ex, value, strlen(value), flags);
+        }
+        if (w[op] == '-')
+        {
+            return expand_text(ex, w, op + 1, close, flags);
+        }
+        if (w[op] == '+')
+        {
+            return 0;
+        }
+        /* if only variables and their elements can be assigned to */
+        if (ref->list || !var_name_ok(w + ref->i, ref->n))
+        {
+            fprintf(stderr, "ERROR : $%.*s: cannot assign in this way.\n", (int)ref->n, w + ref->i);
+            errno = EINVAL;
+            return -1;
+        }
+        {
+            var_t *var;
+
+            if ((v = expand_sub(&sub, w, op + 1, close, 0)) == NULL)
+            {
+                expand_free(&sub);
+                return -1;
+            }
+            /* an element being replaced may be a word lent out already */
+            r = expand_own(ex) == -1 || (var = var_intern(w + ref->i, ref->n)) == NULL ? -1 :
+                ref->key != NULL ? set_element(var, ref->key, v, sub.len) : var_set(var, v, sub.len);
+            expand_free(&sub);
+            if (r == -1)
+            {
+                return -1;
+            }
+            value = param(w, ref->i, ref->n, ref->key, tmp, sizeof(tmp));
+            return value != NULL ? put_value(ex, value, strlen(value), flags) : 0;
+        }
+    case '#':
+    case '%':
+    case '/':
+        break;
+    default:
+        return bad_subst();
+    }
+
+    /* pattern operators take no colon */
+    if (colon)
+    {
+        return bad_subst();
+    }
+    memset(&o, 0, sizeof(op_t));
+    o.c = w[op];
+    if (o.c == '/')
+    {
+        int open = 0;
+        size_t pat;
+        size_t slash;
+
+        if (op + 1 < close && w[op + 1] == '/')
+        {
+            o.all = 1;
+            op++;
+        }
+        else if (op + 1 < close && (w[op + 1] == '#' || w[op + 1] == '%'))
+        {
+            o.anchor = w[++op];
+        }
+        pat = op + 1;
+        slash = plan_skip(w, close, pat, '/', &open);
+        o.pattern = expand_sub(&sub, w, pat, slash, X_PATTERN);
+        o.rep = o.pattern == NULL ? NULL : expand_sub(&sub2, w, slash < close ? slash + 1 : close, close, 0);
+        r = o.rep == NULL ? -1 : 0;
+    }
+    else
+    {
+        o.longest = op + 1 < close && w[op + 1] == o.c;
+        o.pattern = expand_sub(&sub, w, op + 1 + (size_t)o.longest, close, X_PATTERN);
+        r = o.pattern == NULL ? -1 : 0;
+    }
+    /* the value is fetched again, as expanding the pattern may have changed it */
+    if (r == -1)
+    {
+        r = -1;
+    }
+    else if (ref->list)
+    {
+        items_of(&it, w, ref->i, ref->n, ref->keys);
+        r = put_list(ex, &it, ref->list, &o, flags);
+    }
+    else
+    {
+        value = param(w, ref->i, ref->n, ref->key, tmp, sizeof(tmp));
+        r = value != NULL ? put_op(ex, value, &o, flags) : 0;
+    }
+    if (o.c == '/' && o.pattern != NULL)
+    {
+        expand_free(&sub2);
+    }
+    expand_free(&sub);
+    return r;
+}
+
+/*
+ * Function: expand_brace
+ * Expands ${...} starting at w[*ip], moving *ip past it.
+ */
+static int expand_brace(expand_t *ex, const char *w, size_t *ip, size_t end, int flags)
+{
+    char tmp[32];
+    size_t i = *ip + 2;
+    size_t close;
+    size_t op;
+    int open = 0;
+    int length = 0;
+    ref_t ref;
+    expand_t sub;
+    char key[24];
+    size_t sub_a = 0;   /* subscript at w[sub_a..sub_b), if sub_b is not 0 */
+    size_t sub_b = 0;
+    int r;
+
+    close = plan_skip(w, end, i, '}', &open);
+    /* if ${ is not closed */
+    if (open)
+    {
+        return bad_subst();
+    }
+    *ip = close + 1;
+    memset(&ref, 0, sizeof(ref_t));
+    ref.w = w;
+    /* if it is ${#name}, the length of a value, rather than ${#} */
+    if (w[i] == '#' && i + 1 < close)
+    {
+        length = 1;
+        i++;
+    }
+    /* if it is ${!name[@]}, the keys of an array */
+    else if (w[i] == '!' && i + 1 < close)
+    {
+        ref.keys = 1;
+        i++;
+    }
+    /* if there is no name */
+    if ((ref.n = name_len(w, i, close, 1)) == 0)
+    {
+        return bad_subst();
+    }
+    ref.i = i;
+    op = i + ref.n;
+    if (w[i] == '@' || w[i] == '*')
+    {
+        ref.list = w[i];
+    }
+    /* a subscript may follow the name of a variable */
+    if (op < close && w[op] == '[' && var_name_ok(w + i, ref.n))
+    {
+        size_t rb = plan_skip(w, close, op + 1, ']', &open);
+
+        /* if [ is not closed, or closed at once */
+        if (open || rb >= close || rb == op + 1)
+        {
+            return bad_subst();
+        }
+        if (rb == op + 2 && (w[op + 1] == '@' || w[op + 1] == '*'))
+        {
+            ref.list = w[op + 1];
+        }
+        else
+        {
+            sub_a = op + 1;
+            sub_b = rb;
+        }
+        op = rb + 1;
+    }
+    /* if ! is not followed by name[@] or name[*], or # by a name alone */
+    if ((ref.keys && (!ref.list || !var_name_ok(w + i, ref.n))) || (length && op != close))
+    {
+        return bad_subst();
+    }
+    if (length && ref.list)
+    {
+        items_t it;
+
+        snprintf(tmp, sizeof(tmp), "%zu", items_of(&it, w, i, ref.n, 0));
+        return put_value(ex, tmp, strlen(tmp), flags);
+    }
+    if (sub_b && ((ref.key = expand_sub(&sub, w, sub_a, sub_b, 0)) == NULL ||
+                  (ref.key = subscript(var_find(w + i, ref.n), ref.key, key, sizeof(key))) == NULL))
+    {
+        expand_free(&sub);
+        return -1;
+    }
+    if (length)
+    {
+        const char *value = param(w, i, ref.n, ref.key, tmp, sizeof(tmp));
+
+        snprintf(tmp, sizeof(tmp), "%zu", value != NULL ? strlen(value) : 0);
+        r = put_value(ex, tmp, strlen(tmp), flags);
+    }
+    else
+    {
+        r = brace_op(ex, &ref, op, close, flags);
+    }
+    if (sub_b)
+    {
+        expand_free(&sub);
+    }
+    return r;
+}
+
+/*
+ * Function: arith_text
+ * Evaluates the expression w[a..end). An expression written without $ or
+ * quotes is evaluated from its text in the word, so its compiled code is
+ * found in the cache each time the word runs; others are expanded first.
+ */
+static int arith_text(const char *w, size_t a, size_t end, int64_t *k)
+{
+    const char *special = strpbrk(w + a, "$`'\\\"");
+    expand_t sub;
+    char *text;
+    int r;
+
+    /* if the expression holds nothing to expand */
+    if (special == NULL || (size_t)(special - w) >= end)
+    {
+        return arith_eval(w + a, end - a, k);
+    }
+    text = expand_sub(&sub, w, a, end, 0);
+    r = text == NULL ? -1 : arith_eval(text, sub.len, k);
+    expand_free(&sub);
+    return r;
+}
+
+/*
+ * Function: expand_arith
+ * Expands $((...)) starting at w[*ip], moving *ip past it.
+ */
+static int expand_arith(expand_t *ex, const char *w, size_t *ip, size_t end, int flags)
+{
+    char tmp[24];
+    size_t a = *ip + 3;
+    size_t close;
+    int open = 0;
+    int64_t k;
+
+    close = plan_skip(w, end, *ip + 2, ')', &open);
+    /* if (( is not closed by )) */
+    if (open || close >= end || w[close - 1] != ')' || close - 1 < a)
+    {
+        return bad_subst();
+    }
+    *ip = close + 1;
+    if (arith_text(w, a, close - 1, &k) == -1)
+    {
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%lld", (long long)k);
+    return put_value(ex, tmp, strlen(tmp), flags);
+}
+
+/*
+ * Function: expand_command
+ * Expands $(...) or `...` starting at w[*ip], moving *ip past it, to the
+ * output of its commands. Trailing line breaks are dropped by ending the
+ * value before them. Words lent so far are copied first, as the commands
+ * may change the arrays they point into.
+ */
+static int expand_command(expand_t *ex, const char *w, size_t *ip, size_t end, int flags)
+{
+    int quote = w[*ip] == '`';
+    size_t a = *ip + (quote ? 1 : 2);
+    size_t close;
+    size_t n = 0;
+    char *text;
+    capture_t c;
+    int open = 0;
+    int r;
+
+    close = plan_skip(w, end, a, quote ? '`' : ')', &open);
+    /* if the substitution is not closed */
+    if (open || close >= end)
+    {
+        return bad_subst();
+    }
+    *ip = close + 1;
+    if (ex->lent && expand_own(ex) == -1)
+    {
+        return -1;
+    }
+    /* if malloc fails */
+    if ((text = malloc(close - a + 1)) == NULL)
+    {
+        return -1;
+    }
+    /* inside backquotes, a backslash escapes only $ ` and itself */
+    for (size_t i = a; i < close; i++)
+    {
+        if (quote && w[i] == '\\' && i + 1 < close && strchr("$`\\", w[i + 1]))
+        {
+            i++;
+        }
+        text[n++] = w[i];
+    }
+    r = command_subst(text, n, &c);
+    free(text);
+    if (r == -1)
+    {
+        return -1;
+    }
+    while (c.len && c.buf[c.len - 1] == '\n')
+    {
+        c.len--;
+    }
+    r = c.len ? put_value(ex, c.buf, c.len, flags) : 0;
+    capture_free(&c);
+    return r;
+}
+
+/*
+ * Function: expand_dollar
+ * Expands the $ expression starting at w[*ip], moving *ip past it. A $ that
+ * starts no expression stays as it is.
+ */
+static int expand_dollar(expand_t *ex, const char *w, size_t *ip, size_t end, int flags)
+{
+    char tmp[32];
+    size_t i = *ip + 1;
+    size_t n;
+    const char *value;
+
+    if (i < end && w[i] == '{')
+    {
+        return expand_brace(ex, w, ip, end, flags);
+    }
+    if (i + 1 < end && w[i] == '(' && w[i + 1] == '(')
+    {
+        return expand_arith(ex, w, ip, end, flags);
+    }
+    if (i < end && w[i] == '(')
+    {
+        return expand_command(ex, w, ip, end, flags);
+    }
+    /* if $ is not followed by a name */
+    if ((n = name_len(w, i, end, 0)) == 0)
+    {
+        *ip = i;
+        return put_lit(ex, '$', flags, flags & X_QUOTED);
+    }
+    *ip = i + n;
+    if (w[i] == '@' || w[i] == '*')
+    {
+        items_t it;
+
+        items_of(&it, w, i, n, 0);
+        return put_list(ex, &it, w[i], NULL, flags);
+    }
+    value = param(w, i, n, NULL, tmp, sizeof(tmp));
+    return value != NULL ? put_value(ex, value, strlen(value), flags) : 0;
+}
+
+/*
+ * Function: expand_text
+ * Expands w[i..end): removes quotes and backslashes and replaces $
+ * expressions, adding the result to ex.
+ */
+static int expand_text(expand_t *ex, const char *w, size_t i, size_t end, int flags)
+{
+    int open = 0;
+    size_t j;
+
+    while (i < end)
+    {
+        char c = w[i];
+
+        /* single quotes hold text as it is */
+        if (c == '\'' && !(flags & X_QUOTED))
+        {
+            int lit;
+
+            j = plan_skip(w, end, i + 1, '\'', &open);
+            lit = (flags & (X_PATTERN | X_GLOB | X_REGEX)) && is_special(w + i + 1, j - i - 1, flags);
+            if (!lit && put(ex, w + i + 1, j - i - 1) == -1)
+            {
+                return -1;
+            }
+            for (size_t k = i + 1; lit && k < j; k++)
+            {
+                if (put_lit(ex, w[k], flags, 1) == -1)
+                {
+                    return -1;
+                }
+            }
+            open_field(ex);
+            i = j + 1;
+        }
+        /* double quotes hold text but expand $ */
+        else if (c == '"' && !(flags & X_HEREDOC))
+        {
+            int at = ex->at_empty;
+
+            j = plan_skip(w, end, i + 1, '"', &open);
+            ex->at_empty = 0;
+            if (expand_text(ex, w, i + 1, j, flags | X_QUOTED) == -1)
+            {
+                return -1;
+            }
+            /* the quotes make a word even if empty, unless all they held was "$@" */
+            if (!ex->at_empty)
+            {
+                open_field(ex);
+            }
+            ex->at_empty = at;
+            i = j + 1;
+        }
+        else if (c == '\\' && i + 1 < end)
+        {
+            char next = w[i + 1];
+
+            /* a backslash before a line break joins the lines */
+            if (next == '\n')
+            {
+                i += 2;
+            }
+            /* inside double quotes, a backslash only escapes $ " ` and itself, in a here-document not " */
+            else if ((flags & X_QUOTED) && !strchr(flags & X_HEREDOC ? "$`\\" : "$\"`\\", next))
+            {
+                if (put_lit(ex, '\\', flags, 1) == -1)
+                {
+                    return -1;
+                }
+                i++;
+            }
+            else
+            {
+                if (put_lit(ex, next, flags, 1) == -1)
+                {
+                    return -1;
+                }
+                i += 2;
+            }
+        }
+        else if (c == '$')
+        {
+            if (expand_dollar(ex, w, &i, end, flags) == -1)
+            {
+                return -1;
+            }
+        }
+        else if (c == '`')
+        {
+            if (expand_command(ex, w, &i, end, flags) == -1)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            if (put_lit(ex, c, flags, flags & X_QUOTED) == -1)
+            {
+                return -1;
+            }
+            i++;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: keyed_element
+ * Sets the element of a [key]=value word of an array assignment, held at
+ * w[a - 1..end) with its ] at w[b]. Later elements follow an indexed one.
+ */
+static int keyed_element(var_t *to, const char *w, size_t a, size_t b, size_t end, long *next)
+{
+    expand_t kx;
+    expand_t vx;
+    char tmp[24];
+    const char *key = expand_sub(&kx, w, a, b, 0);
+    char *value = NULL;
+    int r = -1;
+
+    if (key != NULL && (key = subscript(to, key, tmp, sizeof(tmp))) != NULL &&
+        (value = expand_sub(&vx, w, b + 2, end, 0)) != NULL)
+    {
+        r = set_element(to, key, value, vx.len);
+    }
+    if (!r && (to->flags & VAR_ARRAY))
+    {
+        *next = var_index(to, key) + 1;
+    }
+    if (key != NULL)
+    {
+        expand_free(&vx);
+    }
+    expand_free(&kx);
+    return r;
+}
+
+/*
+ * Function: listed_elements
+ * Expands a plain word of an indexed array assignment, held at w[i..end),
+ * and sets an element for each field it makes.
+ */
+static int listed_elements(var_t *to, const char *w, size_t i, size_t end, long *next)
+{
+    expand_t ex;
+    int r;
+
+    expand_init(&ex);
+    r = expand_text(&ex, w, i, end, X_SPLIT | X_GLOB) == -1 || end_field(&ex) == -1 || expand_finish(&ex) == -1 ? -1 : 0;
+    for (int k = 0; !r && k < ex.n; k++)
+    {
+        r = array_set(to->array, (size_t)(*next)++, ex.toks[k], strlen(ex.toks[k]));
+    }
+    expand_free(&ex);
+    return r;
+}
+
+/*
+ * Function: compound
+ * Assigns the list of elements at w[i..end), the inside of name=(...), to
+ * var, or adds it to var's elements for name+=(...).
+ */
+static int compound(var_t *var, const char *w, size_t i, size_t end, int append)
+{
+    size_t len = strlen(var->name);
+    var_t *to = var; /* variable the elements go to */
+    long next = 0;   /* index of the next element of an indexed array */
+    int open = 0;
+    int r;
+
+    /* new elements are built aside, so they may use the values they replace */
+    if (!append)
+    {
+        /* if calloc fails */
+        if ((to = calloc(1, sizeof(var_t) + len + 1)) == NULL)
+        {
+            return -1;
+        }
+        memcpy(to->name, var->name, len + 1);
+    }
+    r = var_make_array(to, (var->flags & VAR_ASSOC) != 0);
+    if (!r && (to->flags & VAR_ARRAY))
+    {
+        next = (long)to->array->n;
+    }
+    while (!r && i < end)
+    {
+        size_t j;
+        size_t rb;
+
+        if (strchr(" \t\n", w[i]))
+        {
+            i++;
+            continue;
+        }
+        /* a comment runs to the end of the line */
+        if (w[i] == '#')
+        {
+            while (i < end && w[i] != '\n')
+            {
+                i++;
+            }
+            continue;
+        }
+        j = plan_skip(w, end, i, 0, &open);
+        rb = w[i] == '[' ? plan_skip(w, j, i + 1, ']', &open) : j;
+        /* if an operator is in the list */
+        if (j == i)
+        {
+            fprintf(stderr, "SYNTAX ERROR : Unexpected %c in array assignment.\n", w[i]);
+            errno = EINVAL;
+            r = -1;
+        }
+        else if (!open && rb + 1 < j && w[rb + 1] == '=')
+        {
+            r = keyed_element(to, w, i + 1, rb, j, &next);
+        }
+        /* if an associative array is given a value without a key */
+        else if (to->flags & VAR_ASSOC)
+        {
+            fprintf(stderr, "ERROR : %s: %.*s: must be [key]=value.\n", var->name, (int)(j - i), w + i);
+            errno = EINVAL;
+            r = -1;
+        }
+        else
+        {
+            r = listed_elements(to, w, i, j, &next);
+        }
+        open = 0;
+        i = j;
+    }
+    if (to == var)
+    {
+        return r;
+    }
+    if (!r)
+    {
+        var_unset(var);
+        var->array = to->array;
+        var->assoc = to->assoc;
+        var->flags = to->flags;
+    }
+    else
+    {
+        var_unset(to);
+    }
+    free(to);
+    return r;
+}
+
+/*
+ * Function: brace_skip
+ * Skips a backslash escape, quotes or a $ expression starting at w[i],
+ * whose braces do not expand. Returns the offset after it, i if none
+ * starts there.
+ */
+static size_t brace_skip(const char *w, size_t len, size_t i)
+{
+    char c = w[i];
+    int open = 0;
+
+    if (c == '\\')
+    {
+        i += 2;
+    }
+    else if (c == '\'' || c == '"' || c == '`')
+    {
+        i = plan_skip(w, len, i + 1, c, &open) + 1;
+    }
+    else if (c == '$' && i + 1 < len && (w[i + 1] == '{' || w[i + 1] == '('))
+    {
+        i = plan_skip(w, len, i + 2, w[i + 1] == '{' ? '}' : ')', &open) + 1;
+    }
+    return i < len ? i : len;
+}
+
+/*
+ * Function: brace_end
+ * Finds the } closing the brace whose { is at w[o], and sets *list if a
+ * comma at its level makes it a list. Returns the offset of the }, 0 if
+ * it is not closed.
+ */
+static size_t brace_end(const char *w, size_t len, size_t o, int *list)
+{
+    int depth = 0;
+    size_t i = o + 1;
+
+    *list = 0;
+    while (i < len)
+    {
+        size_t j = brace_skip(w, len, i);
+
+        if (j != i)
+        {
+            i = j;
+            continue;
+        }
+        if (w[i] == '}' && !depth)
+        {
+            return i;
+        }
+        depth += (w[i] == '{') - (w[i] == '}');
+        *list |= w[i] == ',' && !depth;
+        i++;
+    }
+    return 0;
+}
+
+/*
+ * Function: range_end
+ * Reads an integer, or a letter if alpha is set, from s[i..n).
+ * Returns the offset after it, i if there is none.
+ */
+static size_t range_end(const char *s, size_t i, size_t n, int alpha)
+{
+    size_t j = i + (i < n && s[i] == '-');
+
+    if (alpha)
+    {
+        return i < n && ((s[i] >= 'a' && s[i] <= 'z') || (s[i] >= 'A' && s[i] <= 'Z')) ? i + 1 : i;
+    }
+    while (j < n && s[j] >= '0' && s[j] <= '9')
+    {
+        j++;
+    }
+    return j > i + (s[i] == '-') ? j : i;
+}
+
+/*
+ * Function: padded
+ * Checks whether the integer s[0..n) is written with a leading zero.
+ */
+static int padded(const char *s, size_t n)
+{
+    size_t k = s[0] == '-';
+
+    return s[k] == '0' && n > k + 1;
+}
+
+/*
+ * Function: parse_range
+ * Reads the inside of a sequence brace, x..y or x..y..step, where x and y
+ * are both integers or both letters. Integers written with a leading zero
+ * are padded to the width of the wider end. Returns 1 if s is one, else 0.
+ */
+static int parse_range(const char *s, size_t n, range_t *r)
+{
+    int alpha = n > 0 && !(s[0] == '-' || (s[0] >= '0' && s[0] <= '9'));
+    size_t x = range_end(s, 0, n, alpha);
+    size_t y;
+    size_t z = 0;
+    int64_t step = 1;
+
+    if (!x || x + 2 > n || s[x] != '.' || s[x + 1] != '.' || (y = range_end(s, x + 2, n, alpha)) == x + 2)
+    {
+        return 0;
+    }
+    if (y < n)
+    {
+        /* if what follows is not ..step */
+        if (y + 2 > n || s[y] != '.' || s[y + 1] != '.' || (z = range_end(s, y + 2, n, 0)) != n || z == y + 2)
+        {
+            return 0;
+        }
+        errno = 0;
+        step = strtoll(s + y + 2, NULL, 10);
+        if (errno == ERANGE || step == INT64_MIN)
+        {
+            return 0;
+        }
+        step = step < 0 ? -step : step ? step : 1;
+    }
+    memset(r, 0, sizeof(range_t));
+    r->alpha = alpha;
+    if (alpha)
+    {
+        r->at = s[0];
+        r->end = s[x + 2];
+    }
+    else
+    {
+        errno = 0;
+        r->at = strtoll(s, NULL, 10);
+        r->end = strtoll(s + x + 2, NULL, 10);
+        if (errno == ERANGE)
+        {
+            return 0;
+        }
+        if (padded(s, x) || padded(s + x + 2, y - x - 2))
+        {
+            r->width = (int)(x > y - x - 2 ? x : y - x - 2);
+        }
+    }
+    r->step = r->at <= r->end ? step : -step;
+    return 1;
+}
+
+static int end_field(expand_t *ex);
+
+/*
+ * Function: expand_braces
+ * Expands the first brace in w[0..len), a list {a,b} or a sequence
+ * {x..y[..step]}, into one word per item, each expanded in turn; a word
+ * without one is expanded as a command word.
+ * Returns 0 on success, -1 on failure.
+ */
+static int expand_braces(expand_t *ex, const char *w, size_t len)
+{
+    size_t o = 0;
+    size_t c = 0;
+    int list = 0;
+    range_t r;
+    char num[32];
+    char *s;
+    int failed = 0;
+
+    while (o < len)
+    {
+        size_t j = brace_skip(w, len, o);
+
+        if (j != o)
+        {
+            o = j;
+            continue;
+        }
+        if (w[o] == '{' && (c = brace_end(w, len, o, &list)) != 0 && (list || parse_range(w + o + 1, c - o - 1, &r)))
+        {
+            break;
+        }
+        o++;
+    }
+    /* if the word holds no brace */
+    if (o >= len)
+    {
+        if (expand_text(ex, w, 0, len, X_SPLIT | X_GLOB) == -1)
+        {
+            return -1;
+        }
+        return end_field(ex);
+    }
+    /* if malloc fails */
+    if ((s = malloc(len + sizeof(num))) == NULL)
+    {
+        return -1;
+    }
+    memcpy(s, w, o);
+    if (list)
+    {
+        size_t a = o + 1;
+
+        while (a <= c && !failed)
+        {
+            size_t b = a;
+            int depth = 0;
+
+            /* an item ends at a comma of the list's own level */
+            while (b < c && (depth || w[b] != ','))
+            {
+                size_t j = brace_skip(w, len, b);
+
+                if (j != b)
+                {
+                    b = j;
+                    continue;
+                }
+                depth += (w[b] == '{') - (w[b] == '}');
+                b++;
+            }
+            memcpy(s + o, w + a, b - a);
+            memcpy(s + o + b - a, w + c + 1, len - c - 1);
+            failed = expand_braces(ex, s, o + b - a + len - c - 1) == -1;
+            a = b + 1;
+        }
+    }
+    else
+    {
+        while (!failed && range_next(&r, num, sizeof(num)))
+        {
+            size_t n = strlen(num);
+
+            memcpy(s + o, num, n);
+            memcpy(s + o + n, w + c + 1, len - c - 1);
+            failed = expand_braces(ex, s, o + n + len - c - 1) == -1;
+        }
+    }
+    free(s);
+    return failed ? -1 : 0;
+}
+
+/*
+ * Function: expand_init
+ * Starts an expansion with no words, held in the inline buffers.
+ *
+ * ex : pointer to expansion
+ */
+void expand_init(expand_t *ex)
+{
+    ex->toks = NULL;
+    ex->n = 0;
+    ex->buf = ex->sbuf;
+    ex->len = 0;
+    ex->cap = EXPAND_BUF;
+    ex->fields = ex->sfields;
+    ex->cap_fields = EXPAND_WORDS;
+    ex->open = 0;
+    ex->start = 0;
+    ex->at_empty = 0;
+    ex->lent = 0;
+    ex->glob = 0;
+    ex->escaped = 0;
+    ex->here = 0;
+}
+
+/*
+ * Function: expand_word
+ * Expands a word of a command, adding the fields it makes.
+ *
+ * ex : pointer to expansion
+ * word : pointer to word as written
+ */
+int expand_word(expand_t *ex, const char *word)
+{
+    int here = ex->here;
+
+    ex->here = 0;
+    /* operators the parser left as words are only ever written bare */
+    if (!strcmp(word, "<"))
+    {
+        return add_field(ex, op_in, 0, 0);
+    }
+    if (!strcmp(word, ">"))
+    {
+        return add_field(ex, op_out, 0, 0);
+    }
+    if (!strcmp(word, ">>"))
+    {
+        return add_field(ex, op_append, 0, 0);
+    }
+    if (!strcmp(word, "&"))
+    {
+        return add_field(ex, op_bg, 0, 0);
+    }
+    /* << is followed by the text of its here-document, <<< by a word */
+    if (!strcmp(word, "<<") || !strcmp(word, "<<<"))
+    {
+        ex->here = word[2] ? HERE_STRING : HERE_DOC;
+        return add_field(ex, op_here, 0, 0);
+    }
+    /* the text a command reads is one field, not split or matched as paths */
+    if (here)
+    {
+        if (expand_text(ex, word, 0, strlen(word), here == HERE_DOC ? X_QUOTED | X_HEREDOC : 0) == -1)
+        {
+            return -1;
+        }
+        open_field(ex);
+        /* a here-string ends with a line break */
+        if (here == HERE_STRING && put(ex, "\n", 1) == -1)
+        {
+            return -1;
+        }
+        return end_field(ex);
+    }
+    return expand_braces(ex, word, strlen(word));
+}
+
+/*
+ * Function: expand_range
+ * Checks whether a word, as written, is a sequence brace alone, so it can
+ * be stepped through without making its words.
+ *
+ * word : pointer to word
+ * r : pointer to range set from it
+ */
+int expand_range(const char *word, range_t *r)
+{
+    size_t len = strlen(word);
+
+    return len > 2 && word[0] == '{' && word[len - 1] == '}' && parse_range(word + 1, len - 2, r);
+}
+
+/*
+ * Function: range_next
+ * Writes the next value of a range to buf.
+ *
+ * r : pointer to range
+ * buf : pointer to buffer
+ * size : size of buffer
+ */
+int range_next(range_t *r, char *buf, size_t size)
+{
+    uint64_t left;
+
+    if (r->done)
+    {
+        return 0;
+    }
+    if (r->alpha)
+    {
+        snprintf(buf, size, "%c", (char)r->at);
+    }
+    else
+    {
+        snprintf(buf, size, "%0*" PRId64, r->width, r->at);
+    }
+    /* the range ends once the step would pass its end */
+    left = r->step > 0 ? (uint64_t)r->end - (uint64_t)r->at : (uint64_t)r->at - (uint64_t)r->end;
+    if (left < (r->step > 0 ? (uint64_t)r->step : 0 - (uint64_t)r->step))
+    {
+        r->done = 1;
+    }
+    else
+    {
+        r->at += r->step;
+    }
+    return 1;
+}
+
+/*
+ * Function: expand_string
+ * Expands a word into exactly one field, without splitting it.
+ *
+ * ex : pointer to expansion
+ * word : pointer to word as written
+ */
+int expand_string(expand_t *ex, const char *word)
+{
+    if (expand_text(ex, word, 0, strlen(word), 0) == -1)
+    {
+        return -1;
+    }
+    open_field(ex);
+    return end_field(ex);
+}
+
+/*
+ * Function: expand_pattern
+ * Expands a word into one field to match against, without splitting it.
+ * Quoted characters are escaped, so they match themselves.
+ *
+ * ex : pointer to expansion
+ * word : pointer to word as written
+ * regex : set for an extended regex, 0 for a pattern
+ */
+int expand_pattern(expand_t *ex, const char *word, int regex)
+{
+    if (expand_text(ex, word, 0, strlen(word), regex ? X_REGEX : X_PATTERN) == -1)
+    {
+        return -1;
+    }
+    open_field(ex);
+    return end_field(ex);
+}
+
+/*
+ * Function: expand_arith_word
+ * Evaluates the expression of an arithmetic command, (( word )).
+ *
+ * word : pointer to expression as written
+ * result : pointer to value
+ */
+int expand_arith_word(const char *word, int64_t *result)
+{
+    return arith_text(word, 0, strlen(word), result);
+}
+
+/*
+ * Function: expand_assign_name
+ * Checks whether a word, as written, is an assignment: NAME=value,
+ * NAME+=value, NAME[sub]=value or NAME[sub]+=value, where value may be an
+ * array (...). Returns the length of NAME, 0 if it is not an assignment.
+ *
+ * word : pointer to word
+ */
+size_t expand_assign_name(const char *word)
+{
+    size_t len = strlen(word);
+    size_t n = name_len(word, 0, len, 1);
+    size_t i = n;
+    int open = 0;
+
+    if (!var_name_ok(word, n))
+    {
+        return 0;
+    }
+    if (word[i] == '[')
+    {
+        i = plan_skip(word, len, i + 1, ']', &open);
+        /* if [ is not closed, or closed at once */
+        if (open || i >= len || i == n + 1)
+        {
+            return 0;
+        }
+        i++;
+    }
+    if (word[i] == '+')
+    {
+        i++;
+    }
+    return word[i] == '=' ? n : 0;
+}
+
+/*
+ * Function: expand_assign
+ * Carries out an assignment word. With scalar set, as for the assignments
+ * that prefix a command, only NAME=value and NAME+=value are allowed.
+ *
+ * word : pointer to word as written, known to be an assignment
+ * scalar : nonzero to refuse arrays and elements
+ */
+int expand_assign(const char *word, int scalar)
+{
+    size_t len = strlen(word);
+    size_t n = expand_assign_name(word);
+    size_t i = n;
+    size_t sub = 0;  /* ] ending the subscript, 0 if none */
+    int append = 0;
+    int open = 0;
+    const char *old;
+    expand_t kx;
+    expand_t ex;
+    char tmp[24];
+    const char *key = NULL;
+    var_t *var;
+    int r;
+
+    /* if variable can not be interned */
+    if ((var = var_intern(word, n)) == NULL)
+    {
+        return -1;
+    }
+    if (word[i] == '[')
+    {
+        i = sub = plan_skip(word, len, i + 1, ']', &open);
+        i++;
+    }
+    if (word[i] == '+')
+    {
+        append = 1;
+        i++;
+    }
+    i++;
+    /* if it needs an array, or an element, that can not be put back */
+    if (scalar && (sub || (word[i] == '(' && word[len - 1] == ')')))
+    {
+        fprintf(stderr, "ERROR : %.*s: cannot assign an array for a command.\n", (int)n, word);
+        errno = EINVAL;
+        return -1;
+    }
+    if (!sub && word[i] == '(' && word[len - 1] == ')')
+    {
+        return compound(var, word, i + 1, len - 1, append);
+    }
+    if (sub && ((key = expand_sub(&kx, word, n + 1, sub, 0)) == NULL ||
+                (key = subscript(var, key, tmp, sizeof(tmp))) == NULL))
+    {
+        expand_free(&kx);
+        return -1;
+    }
+    expand_init(&ex);
+    old = key != NULL ? var_element(var, key) : var_value(var);
+    /* the value is the old one followed by the new one for += */
+    if ((append && old != NULL && put(&ex, old, strlen(old)) == -1) || expand_text(&ex, word, i, len, 0) == -1 ||
+        reserve(&ex, 1) == -1)
+    {
+        r = -1;
+    }
+    else
+    {
+        ex.buf[ex.len] = '\0';
+        r = key != NULL ? set_element(var, key, ex.buf, ex.len) : var_set(var, ex.buf, ex.len);
+    }
+    expand_free(&ex);
+    if (sub)
+    {
+        expand_free(&kx);
+    }
+    return r;
+}
+
+/*
+ * Function: expand_own
+ * Copies the words lent by variables into the expansion's own text, so
+ * they outlive changes to the variables. A word being built stays last.
+ *
+ * ex : pointer to expansion
+ */
+int expand_own(expand_t *ex)
+{
+    char *tail = NULL;
+    size_t tail_len = 0;
+    int r = 0;
+
+    if (!ex->lent)
+    {
+        return 0;
+    }
+    if (ex->open && (tail_len = ex->len - ex->start) > 0)
+    {
+        /* if malloc fails */
+        if ((tail = malloc(tail_len)) == NULL)
+        {
+            return -1;
+        }
+        memcpy(tail, ex->buf + ex->start, tail_len);
+    }
+    if (ex->open)
+    {
+        ex->len = ex->start;
+    }
+    for (int k = 0; !r && k < ex->n; k++)
+    {
+        expand_field_t *f = &ex->fields[k];
+        size_t n;
+
+        if (!f->lent)
+        {
+            continue;
+        }
+        n = strlen(f->ptr) + 1;
+        if ((r = reserve(ex, n)) == 0)
+        {
+            memcpy(ex->buf + ex->len, f->ptr, n);
+            f->ptr = NULL;
+            f->off = ex->len;
+            f->lent = 0;
+            ex->len += n;
+            ex->lent--;
+        }
+    }
+    if (ex->open)
+    {
+        ex->start = ex->len;
+        /* if the word being built can not be put back */
+        if (reserve(ex, tail_len) == -1)
+        {
+            r = -1;
+        }
+        else if (tail_len)
+        {
+            memcpy(ex->buf + ex->len, tail, tail_len);
+            ex->len += tail_len;
+        }
+    }
+    free(tail);
+    return r;
+}
+
+/*
+ * Function: expand_finish
+ * Builds the NULL terminated toks array of the words expanded so far.
+ *
+ * ex : pointer to expansion
+ */
+int expand_finish(expand_t *ex)
+{
+    char **toks = ex->stoks;
+
+    if (ex->toks != NULL && ex->toks != ex->stoks)
+    {
+        free(ex->toks);
+    }
+    ex->toks = NULL;
+    /* if the words do not fit in the inline array */
+    if (ex->n > EXPAND_WORDS && (toks = malloc(((size_t)ex->n + 1) * sizeof(char *))) == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < ex->n; i++)
+    {
+        toks[i] = ex->fields[i].ptr != NULL ? ex->fields[i].ptr : ex->buf + ex->fields[i].off;
+    }
+    toks[ex->n] = NULL;
+    ex->toks = toks;
+    return 0;
+}
+
+/*
+ * Function: expand_free
+ * Frees what an expansion allocated. The inline buffers need nothing.
+ *
+ * ex : pointer to expansion
+ */
+void expand_free(expand_t *ex)
+{
+    if (ex->buf != ex->sbuf)
+    {
+        free(ex->buf);
+    }
+    if (ex->fields != ex->sfields)
+    {
+        free(ex->fields);
+    }
+    if (ex->toks != NULL && ex->toks != ex->stoks)
+    {
+        free(ex->toks);
+    }
+    expand_init(ex);
+}
@@ -0,0 +1,126 @@
+#ifndef EXPAND_H_
+#define EXPAND_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./capture.h"
+
+/*
+ * Expansion turns the words of a plan, as written, into the arguments of a
+ * command: quotes are removed and $var, ${var...}, the special parameters,
+ * $((...)) and the output of $(...) and `...` replace what names them.
+ * Words with an unquoted * ? or [ are then replaced by the paths they
+ * match, if any. Unquoted values are
+ * split into fields on $IFS. The operators < > >> and & come out as the
+ * op_* strings below, so they can be told apart from quoted look-alikes by
+ * address. Here-documents and here-strings come out as op_here and the text
+ * to read, expanded as one field. Brace lists {a,b} and sequences
+ * {x..y..step} in command words come first, making a word of each item.
+ *
+ * The words of "$@" and "${name[@]}" are lent: they point at the values
+ * where they are kept, so a large array reaches the argv of a program
+ * without being copied. expand_own copies them when they might change
+ * before their last use.
+ */
+
+extern char op_in[];     /* "<" */
+extern char op_out[];    /* ">" */
+extern char op_append[]; /* ">>" */
+extern char op_bg[];     /* "&" */
+extern char op_here[];   /* "<<", before the text stdin reads for << and <<< */
+
+/* exit status of the last command, for $? (kept by sh.c) */
+extern int last_status;
+
+/*
+ * runs len bytes of text as commands with their output captured into c, for
+ * $(...) and `...`, returns 0 on success, -1 on failure (kept by sh.c)
+ */
+int command_subst(const char *text, size_t len, capture_t *c);
+
+#define EXPAND_WORDS 32  /* words held without allocating */
+#define EXPAND_BUF 256   /* bytes of words held without allocating */
+
+typedef struct expand_field {
+    char *ptr;           /* the word if it is an operator or lent, NULL if it is in buf */
+    size_t off;          /* offset of the word in buf */
+    int lent;            /* set if ptr is a value kept by a variable */
+} expand_field_t;
+
+typedef struct expand {
+    char **toks;         /* NULL terminated words, set by expand_finish */
+    int n;               /* number of words */
+    char *buf;           /* text of the words */
+    size_t len;
+    size_t cap;
+    expand_field_t *fields;
+    int cap_fields;
+    int open;            /* set while a word is being built */
+    size_t start;        /* offset of the word being built */
+    int at_empty;        /* set when "$@" had no parameters */
+    int lent;            /* number of lent words */
+    int glob;            /* set if the word being built has an unquoted * ? or [ */
+    int escaped;         /* set if it has quoted ones, escaped by a backslash */
+    int here;            /* set if the next word is the text of a << or <<< */
+    char sbuf[EXPAND_BUF];
+    expand_field_t sfields[EXPAND_WORDS];
+    char *stoks[EXPAND_WORDS + 1];
+} expand_t;
+
+/* a sequence brace {x..y..step}, stepped through one value at a time */
+typedef struct range {
+    int64_t at;          /* next value */
+    int64_t end;         /* last value, if a step lands on it */
+    int64_t step;        /* negative if the range counts down */
+    int width;           /* digits integers are zero padded to, 0 for none */
+    int alpha;           /* set if the values are letters */
+    int done;
+} range_t;
+
+/* starts an empty expansion */
+void expand_init(expand_t *ex);
+
+/*
+ * expands a word and adds its fields, returns 0 on success, -1 on failure
+ * bad substitutions are reported on stderr and fail with errno set to EINVAL
+ */
+int expand_word(expand_t *ex, const char *word);
+
+/* checks whether a word as written is a sequence brace alone, setting r from it */
+int expand_range(const char *word, range_t *r);
+
+/* writes the next value of r to buf, returns 0 once there are none left */
+int range_next(range_t *r, char *buf, size_t size);
+
+/* expands a word into one string, without field splitting, as for an assignment */
+int expand_string(expand_t *ex, const char *word);
+
+/*
+ * expands a word into one pattern (regex 0) or extended regex (regex 1) in
+ * which quoted characters match themselves, as for [[ == ]] and [[ =~ ]]
+ */
+int expand_pattern(expand_t *ex, const char *word, int regex);
+
+/* expands and evaluates the expression of (( word )), returns 0 on success, -1 on failure */
+int expand_arith_word(const char *word, int64_t *result);
+
+/* length of the name assigned by a word as written, 0 if it is not an assignment */
+size_t expand_assign_name(const char *word);
+
+/*
+ * carries out an assignment word: NAME=value, NAME+=value, NAME[sub]=value
+ * or NAME=(...); with scalar set only the first two, returns 0 on success,
+ * -1 on failure, with errno set to EINVAL if it was reported on stderr
+ */
+int expand_assign(const char *word, int scalar);
+
+/* copies lent words, so they no longer depend on variables, returns 0 on success, -1 on failure */
+int expand_own(expand_t *ex);
+
+/* sets toks to the words expanded so far, returns 0 on success, -1 on failure */
+int expand_finish(expand_t *ex);
+
+/* frees the memory of an expansion */
+void expand_free(expand_t *ex);
+
+#endif  // EXPAND_H_
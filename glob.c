@@ -0,0 +1,811 @@
+#define _GNU_SOURCE /* SYS_getdents64 */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "./glob.h"
+#include "./meta.h"
+
+#define DENTS_BUF 65536  /* bytes of entries asked for per getdents64 */
+#define MAX_PARTS 256    /* components of a pattern */
+#define WALK_SERIAL 64   /* directories a ** walk reads alone before it starts threads */
+#define WALK_THREADS 4   /* most threads reading directories for one walk */
+#define SORT_SMALL 12    /* runs this short are insertion sorted */
+#define GLOB_KEPT 1024   /* most listings kept from one command line to the next */
+
+/* an entry as getdents64 returns it */
+typedef struct dirent64_raw {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} dirent64_raw_t;
+
+/* the entries of a directory, each a d_type byte then the NUL terminated name */
+typedef struct listing {
+    struct listing *next;  /* in its hash chain */
+    uint32_t hash;
+    uint64_t gen;          /* generation of the directory when read, 0 if not watched */
+    char *data;
+    size_t len;
+    char path[];
+} listing_t;
+
+/* a match in progress */
+typedef struct match {
+    glob_list_t *g;
+    char *parts[MAX_PARTS];  /* components of the pattern */
+    size_t n_parts;
+    int dir_only;            /* set if the pattern ends with '/' */
+    int failed;
+} match_t;
+
+/*
+ * a ** walk. Every directory found is queued; the queue is never emptied,
+ * so once the walk ends it holds the whole tree.
+ */
+typedef struct walk {
+    char **queue;
+    size_t head;             /* next directory to read */
+    size_t tail;
+    size_t cap;
+    int busy;                /* threads reading a directory */
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} walk_t;
+
+/* listings read, by path, the newest of a path first in its chain */
+static listing_t **slots;
+static size_t n_slots;
+static size_t n_listings;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Helper Functions */
+
+/*
+ * Function: hash
+ * FNV-1a hash of a path.
+ */
+static uint32_t hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *s; s++)
+    {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Function: read_listing
+ * Reads the entries of a directory, "" being the current one, in batches
+ * of DENTS_BUF bytes. . and .. are left out.
+ * Returns a new listing, NULL if the directory can not be read.
+ */
+static listing_t *read_listing(const char *path, uint32_t h, uint64_t gen)
+{
+    uint64_t buf[DENTS_BUF / sizeof(uint64_t)];
+    size_t plen = strlen(path);
+    size_t cap = 1024;
+    listing_t *l;
+    long r;
+    int fd;
+
+    /* if path is not a directory that can be opened */
+    if ((fd = open(plen ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        return NULL;
+    }
+    /* if malloc fails */
+    if ((l = malloc(sizeof(listing_t) + plen + 1)) == NULL || (l->data = malloc(cap)) == NULL)
+    {
+        free(l);
+        close(fd);
+        return NULL;
+    }
+    memcpy(l->path, path, plen + 1);
+    l->next = NULL;
+    l->hash = h;
+    l->gen = gen;
+    l->len = 0;
+
+    while ((r = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)
+    {
+        for (long off = 0; off < r;)
+        {
+            const dirent64_raw_t *d = (const void *)((const char *)buf + off);
+            size_t n = strlen(d->d_name);
+
+            off += d->d_reclen;
+            if (d->d_name[0] == '.' && (n == 1 || (n == 2 && d->d_name[1] == '.')))
+            {
+                continue;
+            }
+            if (l->len + n + 2 > cap)
+            {
+                char *p;
+
+                while (cap < l->len + n + 2)
+                {
+                    cap *= 2;
+                }
+                /* if realloc fails */
+                if ((p = realloc(l->data, cap)) == NULL)
+                {
+                    r = -1;
+                    break;
+                }
+                l->data = p;
+            }
+            l->data[l->len++] = (char)d->d_type;
+            memcpy(l->data + l->len, d->d_name, n + 1);
+            l->len += n + 1;
+        }
+        if (r == -1)
+        {
+            break;
+        }
+    }
+    close(fd);
+    /* if the directory could not be read whole */
+    if (r == -1)
+    {
+        free(l->data);
+        free(l);
+        return NULL;
+    }
+    return l;
+}
+
+/*
+ * Function: cache_add
+ * Adds a listing to the cache, growing the table as needed.
+ * Returns 0 on success, -1 on failure. Called with cache_lock held.
+ */
+static int cache_add(listing_t *l)
+{
+    if (n_listings >= n_slots)
+    {
+        size_t n = n_slots ? n_slots * 2 : 64;
+        listing_t **p;
+
+        /* if calloc fails */
+        if ((p = calloc(n, sizeof(listing_t *))) == NULL)
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < n_slots; i++)
+        {
+            while (slots[i] != NULL)
+            {
+                listing_t *next = slots[i]->next;
+
+                slots[i]->next = p[slots[i]->hash & (n - 1)];
+                p[slots[i]->hash & (n - 1)] = slots[i];
+                slots[i] = next;
+            }
+        }
+        free(slots);
+        slots = p;
+        n_slots = n;
+    }
+    l->next = slots[l->hash & (n_slots - 1)];
+    slots[l->hash & (n_slots - 1)] = l;
+    n_listings++;
+    return 0;
+}
+
+/*
+ * Function: get_listing
+ * Gets the entries of a directory, from the cache if the directory is
+ * unchanged since they were read. A stale listing stays in its chain behind
+ * the new one, as a pattern of this command line may still be using it.
+ * Returns NULL if it can not be read.
+ */
+static const listing_t *get_listing(const char *path)
+{
+    uint32_t h = hash(path);
+    uint64_t gen = meta_dir_gen(path);
+    listing_t *l = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    if (n_slots)
+    {
+        for (l = slots[h & (n_slots - 1)]; l != NULL && (l->hash != h || strcmp(l->path, path)); l = l->next)
+        {
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    if (l != NULL && (!gen || l->gen != gen))
+    {
+        l = NULL;
+    }
+    if (l != NULL || (l = read_listing(path, h, gen)) == NULL)
+    {
+        return l;
+    }
+    pthread_mutex_lock(&cache_lock);
+    /* if the cache can not hold it */
+    if (cache_add(l) == -1)
+    {
+        free(l->data);
+        free(l);
+        l = NULL;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return l;
+}
+
+/*
+ * Function: next_entry
+ * Steps to the entry after e in a listing.
+ */
+static const char *next_entry(const char *e)
+{
+    return e + strlen(e + 1) + 2;
+}
+
+/*
+ * Function: join
+ * Appends '/' and name to the path held in path[0..plen), "" being the
+ * current directory. Returns the new length, 0 if it would not fit.
+ */
+static size_t join(char *path, size_t plen, const char *name)
+{
+    size_t n = strlen(name);
+    size_t sep = plen && path[plen - 1] != '/';
+
+    if (plen + sep + n >= PATH_MAX)
+    {
+        return 0;
+    }
+    if (sep)
+    {
+        path[plen++] = '/';
+    }
+    memcpy(path + plen, name, n + 1);
+    return plen + n;
+}
+
+/*
+ * Function: is_dir
+ * Checks whether an entry of directory dir is a directory. d_type answers
+ * without a stat unless the file system left it unknown, or the entry is a
+ * symbolic link to be followed.
+ */
+static int is_dir(const char *dir, const char *name, unsigned char type, int follow)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    size_t plen = strlen(dir);
+
+    if (type == DT_DIR)
+    {
+        return 1;
+    }
+    if ((type != DT_UNKNOWN && (type != DT_LNK || !follow)) || plen >= PATH_MAX)
+    {
+        return 0;
+    }
+    memcpy(path, dir, plen + 1);
+    return join(path, plen, name) && meta_stat(path, &st, follow) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Function: has_magic
+ * Checks whether a pattern component holds an unescaped * ? or [.
+ */
+static int has_magic(const char *s)
+{
+    for (; *s; s++)
+    {
+        if (*s == '\\' && s[1])
+        {
+            s++;
+        }
+        else if (*s == '*' || *s == '?' || *s == '[')
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: add
+ * Adds a matched path to the list, with a '/' if the pattern ended with one.
+ */
+static void add(match_t *m, const char *path, size_t len)
+{
+    glob_list_t *g = m->g;
+    int slash = m->dir_only && len && path[len - 1] != '/';
+
+    if (g->len + len + 2 > g->cap)
+    {
+        size_t cap = g->cap ? g->cap : 1024;
+        char *p;
+
+        while (cap < g->len + len + 2)
+        {
+            cap *= 2;
+        }
+        /* if realloc fails */
+        if ((p = realloc(g->buf, cap)) == NULL)
+        {
+            m->failed = 1;
+            return;
+        }
+        g->buf = p;
+        g->cap = cap;
+    }
+    memcpy(g->buf + g->len, path, len);
+    g->len += len;
+    if (slash)
+    {
+        g->buf[g->len++] = '/';
+    }
+    g->buf[g->len++] = '\0';
+    g->n++;
+}
+
+/*
+ * Function: walk_dir
+ * Reads a directory of a ** walk and queues its subdirectories. Hidden
+ * ones are skipped and symbolic links are not followed, so the walk ends.
+ */
+static void walk_dir(walk_t *w, const char *dir)
+{
+    char path[PATH_MAX];
+    size_t plen = strlen(dir);
+    const listing_t *l;
+
+    if ((l = get_listing(dir)) == NULL)
+    {
+        return;
+    }
+    memcpy(path, dir, plen + 1);
+    for (const char *e = l->data; e < l->data + l->len; e = next_entry(e))
+    {
+        char *sub;
+
+        if (e[1] == '.' || !is_dir(dir, e + 1, (unsigned char)e[0], 0) || !join(path, plen, e + 1))
+        {
+            continue;
+        }
+        sub = strdup(path);
+        path[plen] = '\0';
+        pthread_mutex_lock(&w->lock);
+        if (sub != NULL && w->tail == w->cap)
+        {
+            size_t cap = w->cap * 2;
+            char **p;
+
+            /* if realloc fails */
+            if ((p = realloc(w->queue, cap * sizeof(char *))) == NULL)
+            {
+                free(sub);
+                sub = NULL;
+            }
+            else
+            {
+                w->queue = p;
+                w->cap = cap;
+            }
+        }
+        /* if the directory could not be queued */
+        if (sub == NULL)
+        {
+            w->failed = 1;
+        }
+        else
+        {
+            w->queue[w->tail++] = sub;
+            pthread_cond_signal(&w->cond);
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+/*
+ * Function: walk_thread
+ * Reads queued directories until the queue is empty and no thread is
+ * reading one that might queue more.
+ */
+static void *walk_thread(void *arg)
+{
+    walk_t *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;)
+    {
+        char *dir;
+
+        while (w->head == w->tail && w->busy && !w->failed)
+        {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->head == w->tail || w->failed)
+        {
+            break;
+        }
+        dir = w->queue[w->head++];
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+        walk_dir(w, dir);
+        pthread_mutex_lock(&w->lock);
+        w->busy--;
+    }
+    /* wake the others, which can only be waiting for the end now */
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/*
+ * Function: walk
+ * Finds root and every directory under it. Small trees are read by this
+ * thread alone; once WALK_SERIAL directories are read and more are queued,
+ * up to WALK_THREADS threads share the rest.
+ * Returns 0 on success, -1 on failure.
+ */
+static int walk(walk_t *w, const char *root)
+{
+    pthread_t threads[WALK_THREADS - 1];
+    long cpus;
+    int n = 0;
+
+    memset(w, 0, sizeof(walk_t));
+    /* if the queue can not be started */
+    if ((w->queue = malloc(64 * sizeof(char *))) == NULL || (w->queue[0] = strdup(root)) == NULL)
+    {
+        free(w->queue);
+        w->queue = NULL;
+        return -1;
+    }
+    w->cap = 64;
+    w->tail = 1;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    while (w->head < w->tail && w->head < WALK_SERIAL && !w->failed)
+    {
+        walk_dir(w, w->queue[w->head++]);
+    }
+    /* if the tree is large, read the rest in parallel */
+    if (w->head < w->tail && !w->failed)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        while (n < WALK_THREADS - 1 && n + 1 < cpus && !pthread_create(&threads[n], NULL, walk_thread, w))
+        {
+            n++;
+        }
+        walk_thread(w);
+        while (n)
+        {
+            pthread_join(threads[--n], NULL);
+        }
+    }
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    return w->failed ? -1 : 0;
+}
+
+static void match(match_t *m, char *path, size_t plen, size_t i);
+
+/*
+ * Function: globstar
+ * Matches the pattern components from i on in path and every directory
+ * under it. A ** that ends the pattern matches every file under path.
+ */
+static void globstar(match_t *m, char *path, size_t plen, size_t i)
+{
+    char dir[PATH_MAX];
+    walk_t w;
+
+    if (walk(&w, path) == -1)
+    {
+        m->failed = 1;
+    }
+    for (size_t k = 0; k < w.tail; k++)
+    {
+        size_t dlen = strlen(w.queue[k]);
+        const listing_t *l;
+
+        memcpy(dir, w.queue[k], dlen + 1);
+        free(w.queue[k]);
+        if (m->failed)
+        {
+            continue;
+        }
+        if (i < m->n_parts)
+        {
+            match(m, dir, dlen, i);
+            continue;
+        }
+        if ((l = get_listing(dir)) == NULL)
+        {
+            continue;
+        }
+        for (const char *e = l->data; e < l->data + l->len; e = next_entry(e))
+        {
+            size_t n;
+
+            if (e[1] == '.' || (m->dir_only && !is_dir(dir, e + 1, (unsigned char)e[0], 1)) ||
+                (n = join(dir, dlen, e + 1)) == 0)
+            {
+                continue;
+            }
+            add(m, dir, n);
+            dir[dlen] = '\0';
+        }
+    }
+    free(w.queue);
+    path[plen] = '\0';
+}
+
+/*
+ * Function: match
+ * Matches pattern components from i on, below the path held in
+ * path[0..plen). Literal components are appended without reading the
+ * directory; only the path they end in is checked to exist.
+ */
+static void match(match_t *m, char *path, size_t plen, size_t i)
+{
+    const char *part;
+    const listing_t *l;
+    struct stat st;
+
+    if (m->failed)
+    {
+        return;
+    }
+    if (i == m->n_parts)
+    {
+        add(m, path, plen);
+        return;
+    }
+    part = m->parts[i];
+    if (!strcmp(part, "**"))
+    {
+        globstar(m, path, plen, i + 1);
+        return;
+    }
+    if (!has_magic(part))
+    {
+        char name[NAME_MAX + 1];
+        size_t n = 0;
+
+        for (; *part && n < NAME_MAX; part++)
+        {
+            part += *part == '\\' && part[1];
+            name[n++] = *part;
+        }
+        name[n] = '\0';
+        /* if the name is too long to exist */
+        if (*part || (n = join(path, plen, name)) == 0)
+        {
+            return;
+        }
+        if (i + 1 < m->n_parts ||
+            (meta_stat(path, &st, m->dir_only) == 0 &&
+             (!m->dir_only || S_ISDIR(st.st_mode))))
+        {
+            match(m, path, n, i + 1);
+        }
+        path[plen] = '\0';
+        return;
+    }
+    if ((l = get_listing(path)) == NULL)
+    {
+        return;
+    }
+    for (const char *e = l->data; e < l->data + l->len; e = next_entry(e))
+    {
+        const char *name = e + 1;
+        size_t n;
+
+        /* a leading dot must be matched by one */
+        if ((name[0] == '.' && part[0] != '.') || fnmatch(part, name, 0) ||
+            ((i + 1 < m->n_parts || m->dir_only) && !is_dir(path, name, (unsigned char)e[0], 1)) ||
+            (n = join(path, plen, name)) == 0)
+        {
+            continue;
+        }
+        match(m, path, n, i + 1);
+        path[plen] = '\0';
+    }
+}
+
+/*
+ * Function: sort_strings
+ * Sorts n strings that agree on their first d bytes, by multikey
+ * quicksort: each pass splits on one byte, so no byte is compared twice
+ * for long shared prefixes such as the directories of a ** walk.
+ */
+static void sort_strings(char **a, size_t n, size_t d)
+{
+    while (n > SORT_SMALL)
+    {
+        unsigned char x = (unsigned char)a[0][d];
+        unsigned char y = (unsigned char)a[n / 2][d];
+        unsigned char z = (unsigned char)a[n - 1][d];
+        unsigned char v = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+        size_t lt = 0;
+        size_t gt = n;
+        size_t i = 0;
+        char *t;
+
+        /* split into bytes below, equal to and above v */
+        while (i < gt)
+        {
+            unsigned char c = (unsigned char)a[i][d];
+
+            if (c < v)
+            {
+                t = a[lt];
+                a[lt++] = a[i];
+                a[i++] = t;
+            }
+            else if (c > v)
+            {
+                t = a[--gt];
+                a[gt] = a[i];
+                a[i] = t;
+            }
+            else
+            {
+                i++;
+            }
+        }
+        sort_strings(a, lt, d);
+        sort_strings(a + gt, n - gt, d);
+        /* if the equal strings all end here, they are sorted */
+        if (!v)
+        {
+            return;
+        }
+        a += lt;
+        n = gt - lt;
+        d++;
+    }
+    for (size_t i = 1; i < n; i++)
+    {
+        for (size_t j = i; j && strcmp(a[j] + d, a[j - 1] + d) < 0; j--)
+        {
+            char *t = a[j];
+
+            a[j] = a[j - 1];
+            a[j - 1] = t;
+        }
+    }
+}
+
+/*
+ * Function: glob_expand
+ * Expands a pattern into the paths it matches, sorted. Components are
+ * split on '/'; "**" stands for any number of directories. Hidden files
+ * only match components starting with a dot.
+ *
+ * pattern : pointer to pattern
+ * g : pointer to list to fill, to be freed with glob_list_free
+ */
+int glob_expand(const char *pattern, glob_list_t *g)
+{
+    char copy[PATH_MAX];
+    char path[PATH_MAX];
+    size_t len = strlen(pattern);
+    size_t plen = 0;
+    match_t m;
+    char *s;
+
+    memset(g, 0, sizeof(glob_list_t));
+    memset(&m, 0, sizeof(m));
+    m.g = g;
+    /* if the pattern is too long to match a path */
+    if (len >= PATH_MAX)
+    {
+        return 0;
+    }
+    memcpy(copy, pattern, len + 1);
+    m.dir_only = len && pattern[len - 1] == '/';
+    if (copy[0] == '/')
+    {
+        path[plen++] = '/';
+    }
+    path[plen] = '\0';
+    for (s = copy; *s && m.n_parts < MAX_PARTS;)
+    {
+        char *end = strchr(s, '/');
+
+        if (end != NULL)
+        {
+            *end = '\0';
+        }
+        if (*s)
+        {
+            m.parts[m.n_parts++] = s;
+        }
+        s = end != NULL ? end + 1 : s + strlen(s);
+    }
+    if (*s || !m.n_parts)
+    {
+        return 0;
+    }
+    match(&m, path, plen, 0);
+    /* if paths array can not be made */
+    if (m.failed || (g->n && (g->paths = malloc(g->n * sizeof(char *))) == NULL))
+    {
+        glob_list_free(g);
+        errno = ENOMEM;
+        return -1;
+    }
+    s = g->buf;
+    for (size_t i = 0; i < g->n; i++)
+    {
+        g->paths[i] = s;
+        s += strlen(s) + 1;
+    }
+    sort_strings(g->paths, g->n, 0);
+    return (int)g->n;
+}
+
+/*
+ * Function: glob_list_free
+ * Frees the paths of a list.
+ *
+ * g : pointer to list
+ */
+void glob_list_free(glob_list_t *g)
+{
+    free(g->buf);
+    free(g->paths);
+    memset(g, 0, sizeof(glob_list_t));
+}
+
+/*
+ * Function: glob_forget
+ * Frees the listings a newer one of the same directory replaced, once no
+ * pattern uses them, and every listing when more than GLOB_KEPT are held.
+ */
+void glob_forget()
+{
+    int all = n_listings > GLOB_KEPT;
+
+    for (size_t i = 0; i < n_slots && n_listings; i++)
+    {
+        listing_t **at = &slots[i];
+
+        while (*at != NULL)
+        {
+            listing_t *l = *at;
+            const listing_t *newer = slots[i];
+
+            while (!all && newer != l && (newer->hash != l->hash || strcmp(newer->path, l->path)))
+            {
+                newer = newer->next;
+            }
+            /* if the listing is kept */
+            if (!all && newer == l && l->gen)
+            {
+                at = &l->next;
+                continue;
+            }
+            *at = l->next;
+            free(l->data);
+            free(l);
+            n_listings--;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef GLOB_H_
+#define GLOB_H_
+
+#include <stddef.h>
+
+/*
+ * Pathname expansion of * ? [...] and **. Directories are read whole with
+ * large getdents64 batches, and d_type tells directories apart without a
+ * stat. What was read is cached for as long as the directory's generation
+ * in the metadata cache is unchanged, so patterns share their listings
+ * across command lines. A ** walk over a large tree is spread over a few
+ * threads.
+ */
+
+typedef struct glob_list {
+    char *buf;      /* matched paths, NUL terminated one after the other */
+    size_t len;
+    size_t cap;
+    char **paths;   /* matched paths in byte order, set by glob_expand */
+    size_t n;
+} glob_list_t;
+
+/*
+ * expands pattern, where a backslash makes the next character literal,
+ * into the paths it matches, returns their number, -1 on failure
+ */
+int glob_expand(const char *pattern, glob_list_t *g);
+
+/* frees the paths of g */
+void glob_list_free(glob_list_t *g);
+
+/* frees the listings replaced by newer ones, to be called between command lines */
+void glob_forget();
+
+#endif  // GLOB_H_
@@ -0,0 +1,17 @@
+#ifndef HERE_H_
+#define HERE_H_
+
+#include <stddef.h>
+
+/*
+ * Standard input of a here-document or here-string, staged in memory. A
+ * short text goes through a pipe, filled before the command starts. A long
+ * one is written once to a sealed memfd that is kept, so a loop feeding
+ * the same text to a command on every pass shares one copy; each command
+ * gets a descriptor of its own, reading from the start.
+ */
+
+/* gets a descriptor to read text from, to be closed by the caller, -1 on failure */
+int here_open(const char *text, size_t len);
+
+#endif  // HERE_H_
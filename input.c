@@ -0,0 +1,534 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./input.h"
+#include "./timer.h"
+#include "./vars.h"
+
+#define INPUT_FDS 64       /* descriptors that can have read-ahead */
+#define INPUT_BLOCK 65536  /* bytes read ahead at a time */
+#define SEP_BLANK 1        /* an IFS character that is also a blank */
+#define SEP_OTHER 2        /* any other IFS character */
+
+/* the read-ahead of a descriptor */
+typedef struct ahead {
+    char *buf;
+    size_t at;      /* first byte not yet used */
+    size_t len;     /* bytes in buf */
+    size_t cap;
+    int seekable;
+    int given;      /* set once input_sync gave the unused bytes back */
+    off_t pos;      /* offset they were given back at, if seekable */
+    dev_t dev;      /* file the descriptor was open on then */
+    ino_t ino;
+} ahead_t;
+
+/* a growable string */
+typedef struct text {
+    char *s;
+    size_t len;
+    size_t cap;
+} text_t;
+
+static ahead_t *aheads[INPUT_FDS];
+static text_t joined;  /* a line continued with backslash newline */
+static text_t field;   /* a field as assigned */
+
+/* Helper Functions */
+
+/*
+ * Function: reserve
+ * Makes room for n more bytes in t, doubling it as needed.
+ * Returns 0 on success, -1 on failure.
+ */
+static int reserve(text_t *t, size_t n)
+{
+    size_t cap = t->cap ? t->cap : 256;
+    char *p;
+
+    if (t->len + n <= t->cap)
+    {
+        return 0;
+    }
+    while (cap < t->len + n)
+    {
+        cap *= 2;
+    }
+    /* if realloc fails */
+    if ((p = realloc(t->s, cap)) == NULL)
+    {
+        return -1;
+    }
+    t->s = p;
+    t->cap = cap;
+    return 0;
+}
+
+/*
+ * Function: get_ahead
+ * Gets the read-ahead of fd. Bytes given back by input_sync are used again
+ * only if fd is still open on the same file and, if seekable, still at the
+ * offset they were given back at. Returns NULL on failure.
+ */
+static ahead_t *get_ahead(int fd)
+{
+    ahead_t *a;
+    struct stat st;
+
+    /* if fd can not have read-ahead */
+    if (fd < 0 || fd >= INPUT_FDS)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+    /* if calloc fails */
+    if ((a = aheads[fd]) == NULL && (a = aheads[fd] = calloc(1, sizeof(ahead_t))) == NULL)
+    {
+        return NULL;
+    }
+    if (a->given)
+    {
+        a->given = 0;
+        if (a->at < a->len &&
+            (fstat(fd, &st) == -1 || st.st_dev != a->dev || st.st_ino != a->ino ||
+             (a->seekable && (lseek(fd, 0, SEEK_CUR) != a->pos || lseek(fd, (off_t)(a->len - a->at), SEEK_CUR) == -1))))
+        {
+            a->at = a->len = 0;
+        }
+    }
+    return a;
+}
+
+/*
+ * Function: refill
+ * Reads another block after the unused bytes of a read-ahead, moving them
+ * to the front first. A descriptor that can not be moved back, such as a
+ * pipe other processes may read after the shell, is read no further than
+ * need bytes, or a byte at a time if need is 0; as it may block, it is
+ * waited on along with the limit of timeout. Returns the number of bytes
+ * read, 0 at end of file, -1 on failure.
+ */
+static ssize_t refill(ahead_t *a, int fd, size_t need)
+{
+    size_t n;
+    ssize_t r;
+    char *p;
+
+    if (a->at == a->len)
+    {
+        a->at = a->len = 0;
+        a->seekable = lseek(fd, 0, SEEK_CUR) != -1;
+    }
+    else if (a->at)
+    {
+        memmove(a->buf, a->buf + a->at, a->len - a->at);
+        a->len -= a->at;
+        a->at = 0;
+    }
+    if (a->cap - a->len < INPUT_BLOCK / 2)
+    {
+        size_t cap = a->cap ? a->cap * 2 : INPUT_BLOCK;
+
+        /* if realloc fails */
+        if ((p = realloc(a->buf, cap)) == NULL)
+        {
+            return -1;
+        }
+        a->buf = p;
+        a->cap = cap;
+    }
+    n = a->cap - a->len;
+    if (!a->seekable)
+    {
+        n = need && need < n ? need : 1;
+        /* if the limit of timeout passes before there is input */
+        if (!timer_ready(fd))
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+    while ((r = read(fd, a->buf + a->len, n)) == -1 && errno == EINTR)
+    {
+    }
+    a->len += r > 0 ? (size_t)r : 0;
+    return r;
+}
+
+/*
+ * Function: record
+ * Gets the next record of fd, up to a delim byte, which is used but left
+ * out, or of max bytes if max is not 0. The record stays in the read-ahead
+ * until the next call. Returns 1 if delim ended it, 2 if max did, 0 if
+ * end of file did (it may be empty), -1 on failure.
+ */
+static int record(int fd, char delim, size_t max, const char **rec, size_t *n)
+{
+    ahead_t *a;
+    size_t scanned = 0;
+    ssize_t r;
+
+    if ((a = get_ahead(fd)) == NULL)
+    {
+        return -1;
+    }
+    for (;;)
+    {
+        size_t avail = a->len - a->at;
+        size_t limit = max && max < avail ? max : avail;
+        const char *p = limit > scanned ? memchr(a->buf + a->at + scanned, delim, limit - scanned) : NULL;
+
+        *rec = a->buf + a->at;
+        if (p != NULL || (max && avail >= max))
+        {
+            *n = p != NULL ? (size_t)(p - *rec) : max;
+            a->at += *n + (p != NULL);
+            return p != NULL ? 1 : 2;
+        }
+        scanned = limit;
+        if ((r = refill(a, fd, max ? max - avail : 0)) <= 0)
+        {
+            *rec = a->buf + a->at;
+            *n = a->len - a->at;
+            a->at = a->len;
+            return (int)r;
+        }
+    }
+}
+
+/*
+ * Function: continued
+ * Checks whether a line ends with a backslash that is not itself escaped.
+ */
+static int continued(const char *s, size_t n)
+{
+    size_t k = 0;
+
+    while (k < n && s[n - 1 - k] == '\\')
+    {
+        k++;
+    }
+    return k % 2;
+}
+
+/*
+ * Function: set_var
+ * Sets a variable named by the read builtin.
+ * Returns 0 on success, -1 after reporting a failure.
+ */
+static int set_var(const char *name, const char *value, size_t len)
+{
+    var_t *var;
+
+    /* if the variable can not be set */
+    if ((var = var_intern(name, strlen(name))) == NULL || var_set(var, value, len) == -1)
+    {
+        perror("read");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function: split
+ * Splits a line into fields at IFS characters and assigns them to names in
+ * turn, the last name taking the rest of the line. Unless raw, a backslash
+ * makes the next character literal. Blanks of IFS around a field are left
+ * out. Returns 0 on success, -1 after reporting a failure.
+ */
+static int split(char *names[], const char *s, size_t n, int raw)
+{
+    const char *ifs = var_get("IFS");
+    unsigned char sep[256] = {0};
+    size_t i = 0;
+
+    for (ifs = ifs == NULL ? " \t\n" : ifs; *ifs; ifs++)
+    {
+        sep[(unsigned char)*ifs] = strchr(" \t\n", *ifs) ? SEP_BLANK : SEP_OTHER;
+    }
+    for (int k = 0; names[k] != NULL; k++)
+    {
+        int last = names[k + 1] == NULL;
+        size_t keep = 0; /* length of the field without trailing blanks */
+
+        field.len = 0;
+        while (i < n && sep[(unsigned char)s[i]] == SEP_BLANK)
+        {
+            i++;
+        }
+        while (i < n && (last || !sep[(unsigned char)s[i]]))
+        {
+            char c = s[i++];
+
+            if (!raw && c == '\\')
+            {
+                if (i == n)
+                {
+                    break;
+                }
+                c = s[i++];
+                keep = field.len + 1;
+            }
+            else if (sep[(unsigned char)c] != SEP_BLANK)
+            {
+                keep = field.len + 1;
+            }
+            /* if the field can not grow */
+            if (reserve(&field, 1) == -1)
+            {
+                perror("read");
+                return -1;
+            }
+            field.s[field.len++] = c;
+        }
+        /* a separator is blanks, one other IFS character, or both */
+        while (i < n && sep[(unsigned char)s[i]] == SEP_BLANK)
+        {
+            i++;
+        }
+        i += i < n && sep[(unsigned char)s[i]] == SEP_OTHER;
+        if (set_var(names[k], field.s != NULL ? field.s : "", last ? keep : field.len) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: unescape
+ * Assigns a line to REPLY whole, only backslashes taken out unless raw.
+ * Returns 0 on success, -1 after reporting a failure.
+ */
+static int unescape(const char *s, size_t n, int raw)
+{
+    field.len = 0;
+    /* if the line can not be copied */
+    if (reserve(&field, n + 1) == -1)
+    {
+        perror("read");
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (raw || s[i] != '\\')
+        {
+            field.s[field.len++] = s[i];
+        }
+        else if (i + 1 < n)
+        {
+            field.s[field.len++] = s[++i];
+        }
+    }
+    return set_var("REPLY", field.s, field.len);
+}
+
+/*
+ * Function: input_read
+ * Reads from fd, taking bytes read ahead of it first.
+ *
+ * fd : file descriptor
+ * buf : pointer to buffer
+ * n : size of buffer
+ */
+ssize_t input_read(int fd, void *buf, size_t n)
+{
+    ahead_t *a = fd >= 0 && fd < INPUT_FDS && aheads[fd] != NULL ? get_ahead(fd) : NULL;
+
+    if (a != NULL && a->at < a->len)
+    {
+        n = n < a->len - a->at ? n : a->len - a->at;
+        memcpy(buf, a->buf + a->at, n);
+        a->at += n;
+        return (ssize_t)n;
+    }
+    return read(fd, buf, n);
+}
+
+/*
+ * Function: input_sync
+ * Gives back the bytes read ahead of every descriptor: a seekable one is
+ * moved back to the first unused byte, and the file it is open on noted so
+ * the bytes can be used again if it is unchanged.
+ */
+void input_sync()
+{
+    struct stat st;
+
+    for (int fd = 0; fd < INPUT_FDS; fd++)
+    {
+        ahead_t *a = aheads[fd];
+
+        if (a == NULL || a->given || a->at == a->len)
+        {
+            continue;
+        }
+        /* if the descriptor can not be checked later, or moved back now */
+        if (fstat(fd, &st) == -1 ||
+            (a->seekable && (a->pos = lseek(fd, -(off_t)(a->len - a->at), SEEK_CUR)) == -1))
+        {
+            a->at = a->len = 0;
+            continue;
+        }
+        a->dev = st.st_dev;
+        a->ino = st.st_ino;
+        a->given = 1;
+    }
+}
+
+/*
+ * Function: input_push
+ * Takes the read-ahead of fd aside while a builtin runs with fd redirected.
+ *
+ * fd : file descriptor about to be redirected
+ */
+void *input_push(int fd)
+{
+    ahead_t *a = NULL;
+
+    if (fd >= 0 && fd < INPUT_FDS)
+    {
+        a = aheads[fd];
+        aheads[fd] = NULL;
+    }
+    return a;
+}
+
+/*
+ * Function: input_pop
+ * Ends a redirection of fd: what was read ahead of the file it was
+ * redirected to is given back if it can be, and the read-ahead taken aside
+ * by input_push is put back.
+ *
+ * fd : file descriptor about to be restored
+ * saved : read-ahead returned by input_push
+ */
+void input_pop(int fd, void *saved)
+{
+    ahead_t *a;
+
+    if (fd < 0 || fd >= INPUT_FDS)
+    {
+        return;
+    }
+    if ((a = aheads[fd]) != NULL)
+    {
+        if (a->seekable && !a->given && a->at < a->len)
+        {
+            lseek(fd, -(off_t)(a->len - a->at), SEEK_CUR);
+        }
+        free(a->buf);
+        free(a);
+    }
+    aheads[fd] = saved;
+}
+
+/*
+ * Function: input_vars
+ * Reads a line into variables: read [-r] [-d delim] [-n count] [-u fd]
+ * [name ...]. The line is split at IFS characters, the last name taking
+ * what is left; with no name it goes whole to REPLY. Unless -r is given, a
+ * backslash makes the next character literal and backslash newline
+ * continues the line. The status is 1 if end of file came first, the
+ * variables set to what was read.
+ *
+ * argv : pointer to arguments, after the command name
+ */
+int input_vars(char *argv[])
+{
+    char delim = '\n';
+    int raw = 0;
+    long count = 0; /* bytes to read at most, 0 for a whole line */
+    int fd = STDIN_FILENO;
+    const char *rec;
+    size_t n;
+    int r;
+    int i = 0;
+
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        char opt = argv[i][1];
+        char *arg = argv[i][2] ? argv[i] + 2 : argv[i + 1];
+
+        if (opt == 'r' && !argv[i][2])
+        {
+            raw = 1;
+            continue;
+        }
+        /* if option is not known, or lacks its argument */
+        if (!strchr("dnu", opt) || arg == NULL)
+        {
+            fprintf(stderr, "%s\n", "usage: read [-r] [-d delim] [-n count] [-u fd] [name ...]");
+            return 2;
+        }
+        if (!argv[i][2])
+        {
+            i++;
+        }
+        if (opt == 'd')
+        {
+            delim = arg[0];
+        }
+        else if (opt == 'n')
+        {
+            count = atol(arg);
+        }
+        else
+        {
+            fd = atoi(arg);
+        }
+    }
+    for (int k = i; argv[k] != NULL; k++)
+    {
+        /* if name is not valid */
+        if (!var_name_ok(argv[k], strlen(argv[k])))
+        {
+            fprintf(stderr, "ERROR : read: %s: not a valid name.\n", argv[k]);
+            return 1;
+        }
+    }
+
+    joined.len = 0;
+    while ((r = record(fd, delim, count > 0 ? (size_t)count - joined.len : 0, &rec, &n)) == 1 && !raw &&
+           delim == '\n' && continued(rec, n))
+    {
+        /* if the line can not grow */
+        if (reserve(&joined, n) == -1)
+        {
+            perror("read");
+            return 1;
+        }
+        memcpy(joined.s + joined.len, rec, n - 1);
+        joined.len += n - 1;
+    }
+    /* if read fails; the limit of timeout passing is timeout's to report */
+    if (r == -1)
+    {
+        if (errno != ETIMEDOUT)
+        {
+            perror("read");
+        }
+        return 1;
+    }
+    if (joined.len)
+    {
+        /* if the line can not grow */
+        if (reserve(&joined, n) == -1)
+        {
+            perror("read");
+            return 1;
+        }
+        memcpy(joined.s + joined.len, rec, n);
+        joined.len += n;
+        rec = joined.s;
+        n = joined.len;
+    }
+    if ((argv[i] != NULL ? split(argv + i, rec, n, raw) : unescape(rec, n, raw)) == -1)
+    {
+        return 1;
+    }
+    return !r;
+}
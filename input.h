@@ -0,0 +1,31 @@
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <sys/types.h>
+
+/*
+ * Input of the read builtin. Each seekable descriptor gets a read-ahead
+ * buffer filled a block at a time, so a while read loop costs no system
+ * call for most lines. Before the shell starts a program the bytes read
+ * ahead are given back: the descriptor is moved back with lseek, and if
+ * nothing moved it since, the buffer is used again. A pipe or terminal can
+ * not take bytes back, and other processes may read it after the shell,
+ * so it is read no further than the record: a byte at a time for a line.
+ */
+
+/* reads up to n bytes from fd, taking bytes read ahead first; returns the number read, -1 on failure */
+ssize_t input_read(int fd, void *buf, size_t n);
+
+/* gives back the bytes read ahead, to be called before another process may read the descriptors */
+void input_sync();
+
+/* takes the read-ahead of fd aside before fd is redirected, returns it for input_pop */
+void *input_push(int fd);
+
+/* gives back what was read ahead of the redirected fd, then puts back the read-ahead taken aside */
+void input_pop(int fd, void *saved);
+
+/* read [-r] [-d delim] [-n count] [-u fd] [name ...], returns the exit status */
+int input_vars(char *argv[]);
+
+#endif  // INPUT_H_
@@ -0,0 +1,506 @@
+#define _GNU_SOURCE /* pipe2 */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./memo.h"
+#include "./plan.h"
+#include "./vars.h"
+
+#define MEMO_MAGIC 0x326f6d656d3333ULL  /* "33memo2" */
+#define MEMO_BUF 65536                    /* bytes read at a time when hashing, passing or replaying */
+#define MEMO_SIZE (64ULL << 20)           /* bytes the cache may grow to without $MEMO_MAX */
+
+__extension__ typedef unsigned __int128 hash_t;
+
+/* what an entry starts with; its parts follow */
+typedef struct memo_hdr {
+    uint64_t magic;
+    int64_t status;
+    uint64_t size;      /* bytes of parts */
+} memo_hdr_t;
+
+/* what each part of the output starts with; its bytes follow */
+typedef struct memo_part {
+    uint32_t to;        /* STDOUT_FILENO or STDERR_FILENO */
+    uint32_t len;       /* at most MEMO_BUF */
+} memo_part_t;
+
+/* an entry of the cache, as eviction sees it */
+typedef struct entry {
+    struct timespec used;   /* last hit or store */
+    uint64_t size;
+    char name[40];
+} entry_t;
+
+/* Helper Functions */
+
+/*
+ * Function: mix
+ * FNV-1a hash of n bytes, prefixed by n so fields can not run together,
+ * continuing from h.
+ */
+static hash_t mix(hash_t h, const void *p, size_t n)
+{
+    const hash_t prime = ((hash_t)1 << 88) | 0x13b;
+    const unsigned char *s = p;
+    uint64_t len = n;
+
+    for (size_t i = 0; i < sizeof(len); i++)
+    {
+        h = (h ^ ((const unsigned char *)&len)[i]) * prime;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        h = (h ^ s[i]) * prime;
+    }
+    return h;
+}
+
+/*
+ * Function: mix_file
+ * Hashes a declared input, by its bytes if content is set, by its size,
+ * modification time and inode otherwise.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+static int mix_file(hash_t *h, const char *path, int content)
+{
+    struct stat st;
+    int64_t fields[5];
+    char *buf;
+    ssize_t r = 0;
+    int fd;
+
+    *h = mix(*h, path, strlen(path));
+    if (!content)
+    {
+        /* if the input can not be looked at */
+        if (stat(path, &st) == -1)
+        {
+            return -1;
+        }
+        fields[0] = (int64_t)st.st_size;
+        fields[1] = (int64_t)st.st_mtim.tv_sec;
+        fields[2] = (int64_t)st.st_mtim.tv_nsec;
+        fields[3] = (int64_t)st.st_ino;
+        fields[4] = (int64_t)st.st_dev;
+        *h = mix(*h, fields, sizeof(fields));
+        return 0;
+    }
+    /* if the input can not be read */
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return -1;
+    }
+    if ((buf = malloc(MEMO_BUF)) == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+    while ((r = read(fd, buf, MEMO_BUF)) > 0 || (r == -1 && errno == EINTR))
+    {
+        if (r > 0)
+        {
+            *h = mix(*h, buf, (size_t)r);
+        }
+    }
+    free(buf);
+    close(fd);
+    return r == -1 ? -1 : 0;
+}
+
+/*
+ * Function: write_all
+ * Writes n bytes to fd, however many writes it takes.
+ * Returns 0 on success, -1 on failure.
+ */
+static int write_all(int fd, const char *p, size_t n)
+{
+    ssize_t r;
+
+    while (n)
+    {
+        /* if the write fails */
+        if ((r = write(fd, p, n)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+/*
+ * Function: replay
+ * Writes the parts of an entry in order, those of stdout to stdout, which
+ * may be a capture, and those of stderr to stderr. Returns its status, -1
+ * if it is not an entry.
+ */
+static int replay(int fd)
+{
+    memo_hdr_t hdr;
+    memo_part_t part;
+    char *buf;
+    FILE *to = NULL;
+    uint64_t left;
+
+    /* if the entry is damaged or of another version */
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) || hdr.magic != MEMO_MAGIC ||
+        (buf = malloc(MEMO_BUF)) == NULL)
+    {
+        return -1;
+    }
+    lseek(fd, (off_t)sizeof(hdr), SEEK_SET);
+    for (left = hdr.size; left; left -= sizeof(part) + part.len)
+    {
+        /* if the entry was cut short */
+        if (left < sizeof(part) || read(fd, &part, sizeof(part)) != (ssize_t)sizeof(part) || part.len > MEMO_BUF ||
+            left - sizeof(part) < part.len || read(fd, buf, part.len) != (ssize_t)part.len)
+        {
+            free(buf);
+            return -1;
+        }
+        /* what went to the other stream so far comes first */
+        if (to != (part.to == STDERR_FILENO ? stderr : stdout) && to != NULL)
+        {
+            fflush(to);
+        }
+        to = part.to == STDERR_FILENO ? stderr : stdout;
+        fwrite(buf, 1, part.len, to);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    free(buf);
+    return (int)hdr.status;
+}
+
+/*
+ * Function: pass_on
+ * Thread of a recorded run: reads the pipes of its stdout and stderr as
+ * output comes, passes each read on and appends it to the entry as a
+ * part, until both pipes are closed.
+ */
+static void *pass_on(void *arg)
+{
+    memo_t *m = arg;
+    struct pollfd fds[2] = {{m->pipes[0], POLLIN, 0}, {m->pipes[1], POLLIN, 0}};
+    struct {
+        memo_part_t part;
+        char data[MEMO_BUF];
+    } buf;
+    ssize_t r;
+    int open = 2;
+
+    while (open && (poll(fds, 2, -1) != -1 || errno == EINTR))
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            if (fds[k].fd == -1 || !fds[k].revents)
+            {
+                continue;
+            }
+            if ((r = read(fds[k].fd, buf.data, MEMO_BUF)) > 0)
+            {
+                /* output goes on even when it can not be recorded */
+                if (k == 0 && m->stream != NULL)
+                {
+                    fwrite(buf.data, 1, (size_t)r, m->stream);
+                    fflush(m->stream);
+                }
+                else if (m->to[k] != -1)
+                {
+                    write_all(m->to[k], buf.data, (size_t)r);
+                }
+                buf.part.to = k ? STDERR_FILENO : STDOUT_FILENO;
+                buf.part.len = (uint32_t)r;
+                if (m->ok && write_all(m->fd, (const char *)&buf, sizeof(memo_part_t) + (size_t)r) == -1)
+                {
+                    m->ok = 0;
+                }
+                m->size += sizeof(memo_part_t) + (size_t)r;
+            }
+            /* a pipe ends once every writer has closed it */
+            else if (r == 0 || errno != EINTR)
+            {
+                fds[k].fd = -1;
+                open--;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: by_use
+ * Orders entries from the least recently used.
+ */
+static int by_use(const void *a, const void *b)
+{
+    const struct timespec *x = &((const entry_t *)a)->used;
+    const struct timespec *y = &((const entry_t *)b)->used;
+
+    if (x->tv_sec != y->tv_sec)
+    {
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    }
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+/*
+ * Function: evict
+ * Removes the entries of the cache directory used least recently while it
+ * is larger than its limit, down to three quarters of it, so a full cache
+ * is not trimmed on every store.
+ */
+static void evict(const char *dir)
+{
+    const char *max = var_get("MEMO_MAX");
+    uint64_t limit = max != NULL && *max ? strtoull(max, NULL, 10) : MEMO_SIZE;
+    uint64_t total = 0;
+    entry_t *entries = NULL;
+    entry_t *p;
+    size_t n = 0;
+    size_t cap = 0;
+    struct dirent *e;
+    struct stat st;
+    DIR *d;
+
+    /* if the directory can not be read */
+    if ((d = opendir(dir)) == NULL)
+    {
+        return;
+    }
+    while ((e = readdir(d)) != NULL)
+    {
+        /* only entries have names of 32 digits; those being recorded have a suffix */
+        if (strlen(e->d_name) != 32 || fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        {
+            continue;
+        }
+        if (n == cap)
+        {
+            /* if realloc fails, the cache stays as it is */
+            if ((p = realloc(entries, (cap ? cap * 2 : 64) * sizeof(entry_t))) == NULL)
+            {
+                break;
+            }
+            entries = p;
+            cap = cap ? cap * 2 : 64;
+        }
+        entries[n].used = st.st_mtim;
+        entries[n].size = (uint64_t)st.st_size;
+        strcpy(entries[n].name, e->d_name);
+        total += entries[n++].size;
+    }
+    if (total > limit)
+    {
+        qsort(entries, n, sizeof(entry_t), by_use);
+        for (size_t i = 0; i < n && total > limit / 4 * 3; i++)
+        {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0)
+            {
+                total -= entries[i].size;
+            }
+        }
+    }
+    free(entries);
+    closedir(d);
+}
+
+/*
+ * Function: memo_lookup
+ * Makes the key of a command and looks it up. On a hit the entry is
+ * replayed and marked as used. On a miss, the entry is opened to record
+ * the run, after room for the header. If the cache can not be written,
+ * m->fd is -1 and the command runs unrecorded.
+ *
+ * m : result looked up
+ * argv : command line
+ * inputs : files the command reads
+ * n_inputs : number of inputs
+ * names : variables the command depends on
+ * n_names : number of names
+ * content : set to hash inputs by their bytes
+ */
+int memo_lookup(memo_t *m, char *argv[], char *inputs[], size_t n_inputs, char *names[], size_t n_names,
+                int content)
+{
+    hash_t h = ((hash_t)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+    char dir[PATH_MAX];
+    char cwd[PATH_MAX];
+    const char *value;
+    int fd;
+    int status;
+
+    m->fd = m->out = m->err = -1;
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        cwd[0] = '\0';
+    }
+    h = mix(h, cwd, strlen(cwd));
+    for (size_t i = 0; argv[i] != NULL; i++)
+    {
+        h = mix(h, argv[i], strlen(argv[i]) + 1);
+    }
+    h = mix(h, "", 0); /* the command line ends */
+    for (size_t i = 0; i < n_names; i++)
+    {
+        value = var_get(names[i]);
+        h = mix(h, names[i], strlen(names[i]));
+        /* an unset variable differs from an empty one */
+        h = value != NULL ? mix(h, value, strlen(value) + 1) : mix(h, "", 0);
+    }
+    for (size_t i = 0; i < n_inputs; i++)
+    {
+        /* if an input can not be read */
+        if (mix_file(&h, inputs[i], content) == -1)
+        {
+            fprintf(stderr, "memo: %s: %s\n", inputs[i], strerror(errno));
+            return -1;
+        }
+    }
+    /* if there is no cache to use */
+    if (plan_cache_dir("memo", dir, sizeof(dir)) == -1 ||
+        snprintf(m->path, sizeof(m->path), "%s/%016llx%016llx", dir, (unsigned long long)(h >> 64),
+                 (unsigned long long)h) >= (int)sizeof(m->path) ||
+        snprintf(m->tmp, sizeof(m->tmp), "%s.%ld", m->path, (long)getpid()) >= (int)sizeof(m->tmp))
+    {
+        return MEMO_MISS;
+    }
+    if ((fd = open(m->path, O_RDONLY | O_CLOEXEC)) != -1)
+    {
+        fflush(stdout); /* output so far comes before the replay */
+        status = replay(fd);
+        /* a hit counts as a use for eviction */
+        if (status != -1)
+        {
+            futimens(fd, NULL);
+            close(fd);
+            return status;
+        }
+        close(fd);
+    }
+    /* if the entry can not be recorded, the command runs unrecorded */
+    if ((m->fd = open(m->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) != -1 &&
+        lseek(m->fd, (off_t)sizeof(memo_hdr_t), SEEK_SET) == -1)
+    {
+        close(m->fd);
+        unlink(m->tmp);
+        m->fd = -1;
+    }
+    return MEMO_MISS;
+}
+
+/*
+ * Function: memo_record
+ * Starts recording a run: opens a pipe for its stdout and one for its
+ * stderr, and a thread that passes what comes through them on to where
+ * stdout, or stream, and stderr are now while appending it to the entry.
+ * If it fails, the entry is dropped and the command runs unrecorded.
+ *
+ * m : result looked up, with its entry open
+ * stream : stream stdout goes to instead of its descriptor, NULL if none
+ */
+int memo_record(memo_t *m, FILE *stream)
+{
+    int out[2] = {-1, -1};
+    int err[2] = {-1, -1};
+
+    fflush(stdout); /* output so far goes where stdout was */
+    m->stream = stream;
+    m->size = 0;
+    m->ok = 1;
+    /* a descriptor that is closed takes no output */
+    m->to[0] = stream == NULL ? fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10) : -1;
+    m->to[1] = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+    m->pipes[0] = m->pipes[1] = -1;
+    if (pipe2(out, O_CLOEXEC) == 0 && pipe2(err, O_CLOEXEC) == 0)
+    {
+        m->pipes[0] = out[0];
+        m->pipes[1] = err[0];
+    }
+    /* if the pipes or the thread can not be made */
+    if (m->pipes[1] == -1 || pthread_create(&m->thread, NULL, pass_on, m) != 0)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            if (out[k] != -1)
+            {
+                close(out[k]);
+            }
+            if (err[k] != -1)
+            {
+                close(err[k]);
+            }
+            if (m->to[k] != -1)
+            {
+                close(m->to[k]);
+            }
+        }
+        close(m->fd);
+        unlink(m->tmp);
+        m->fd = -1;
+        return -1;
+    }
+    m->out = out[1];
+    m->err = err[1];
+    return 0;
+}
+
+/*
+ * Function: memo_store
+ * Finishes the entry of a recorded run: closes the write ends of its
+ * pipes, waits for the thread to pass on the last of its output, which
+ * lasts until anything the run left behind closes them too, writes its
+ * header and files it under its key. A run ended by a signal is not
+ * filed.
+ *
+ * m : result recorded
+ * status : exit status of the run
+ */
+int memo_store(memo_t *m, int status)
+{
+    memo_hdr_t hdr = {MEMO_MAGIC, status, 0};
+    char *slash;
+    int ok;
+
+    if (m->fd == -1)
+    {
+        return status;
+    }
+    close(m->out);
+    close(m->err);
+    pthread_join(m->thread, NULL);
+    for (int k = 0; k < 2; k++)
+    {
+        close(m->pipes[k]);
+        if (m->to[k] != -1)
+        {
+            close(m->to[k]);
+        }
+    }
+    hdr.size = m->size;
+    ok = m->ok && status < 128 && pwrite(m->fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr);
+    /* if the run is not worth filing or the entry can not be filed */
+    if (close(m->fd) == -1 || !ok || rename(m->tmp, m->path) == -1)
+    {
+        unlink(m->tmp);
+        return status;
+    }
+    slash = strrchr(m->path, '/');
+    *slash = '\0';
+    evict(m->path);
+    *slash = '/';
+    return status;
+}
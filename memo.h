@@ -0,0 +1,62 @@
+#ifndef MEMO_H_
+#define MEMO_H_
+
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Cache of the results of deterministic commands, for the memo builtin.
+ * A result is filed under a 128-bit FNV-1a hash of the working directory,
+ * the command line, the variables named and the input files declared,
+ * each file by its size, modification time and inode, or by its bytes.
+ * An entry holds the exit status of one run and its stdout and stderr as
+ * one sequence of parts, in the order the shell read them, in the memo
+ * directory of the shell's cache. While a run is recorded its output is
+ * passed through as it comes, by a thread reading it from two pipes; what
+ * the command writes to stdout and stderr in quick succession may be read
+ * in the other order. Once the directory grows past $MEMO_MAX bytes (64
+ * MiB by default) the entries used least recently are removed.
+ */
+
+#define MEMO_MISS -2  /* returned by memo_lookup when the command has to run */
+
+/* a result being looked up or recorded */
+typedef struct memo {
+    char path[PATH_MAX];  /* entry of the key */
+    char tmp[PATH_MAX];   /* entry while it is recorded */
+    int fd;               /* entry while it is recorded, -1 if the run is not recorded */
+    int out;              /* write end of the pipe for the command's stdout, -1 once given away */
+    int err;              /* write end of the pipe for its stderr */
+    int pipes[2];         /* read ends of the pipes, for the thread */
+    int to[2];            /* where the thread passes stdout and stderr on */
+    FILE *stream;         /* stream stdout is passed to instead, NULL if none */
+    uint64_t size;        /* bytes of parts recorded */
+    int ok;               /* cleared if the entry could not be written */
+    pthread_t thread;
+} memo_t;
+
+/*
+ * looks up a command; on a hit replays its output and returns its status,
+ * otherwise returns MEMO_MISS with m->fd open to record the run if the
+ * cache can be written, -1 if an input can not be read
+ */
+int memo_lookup(memo_t *m, char *argv[], char *inputs[], size_t n_inputs, char *names[], size_t n_names,
+                int content);
+
+/*
+ * starts passing output written to m->out and m->err on to stdout, or
+ * stream if not NULL, and stderr while recording it; returns 0 on success,
+ * -1 on failure
+ */
+int memo_record(memo_t *m, FILE *stream);
+
+/*
+ * waits for the output of a recorded run to end, once its write ends are
+ * closed, and files its result under its key; returns status
+ */
+int memo_store(memo_t *m, int status);
+
+#endif  // MEMO_H_
@@ -0,0 +1,484 @@
+#define _GNU_SOURCE /* CLOCK_MONOTONIC_COARSE */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+#include "./meta.h"
+
+#define META_SLOTS 1024    /* paths cached, a power of two */
+#define META_DIRS 256      /* directories watched, a power of two */
+#define META_TICK 20000000 /* nanoseconds changes may go unread while no program starts */
+#define EVENT_BUF 4096     /* bytes of inotify events read at once */
+#define WATCH_MASK (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+/* a watched directory */
+typedef struct dir {
+    char *path;     /* absolute path, NULL if the slot is free */
+    int wd;         /* inotify watch, -1 if there is none */
+    uint64_t gen;   /* generation, changed whenever the directory is */
+} dir_t;
+
+/* what lstat said about a path */
+typedef struct entry {
+    char *path;     /* absolute path, NULL if the slot is free */
+    uint32_t hash;
+    uint32_t dir;   /* slot of the directory holding it */
+    uint64_t gen;   /* generation of that directory when it was read */
+    int err;        /* errno of lstat, 0 if it succeeded */
+    struct stat st;
+} entry_t;
+
+static dir_t dirs[META_DIRS];
+static entry_t entries[META_SLOTS];
+static int ifd = -1;          /* inotify descriptor, -2 if there can be none */
+static uint64_t next_gen = 1; /* generations are never reused */
+static int ran;               /* set if a program started since changes were read */
+static struct timespec last;  /* when changes were last read */
+static char cwd[PATH_MAX];
+static int cwd_known;         /* 1 if cwd is known, -1 if it can not be, 0 if not read yet */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Helper Functions */
+
+/*
+ * Function: hash
+ * FNV-1a hash of n bytes of a path.
+ */
+static uint32_t hash(const char *s, size_t n)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Function: absolute
+ * Writes the absolute form of path to key, without trailing slashes.
+ * Returns its length, 0 if it is not known or too long.
+ */
+static size_t absolute(const char *path, char *key, size_t size)
+{
+    size_t n = strlen(path);
+    size_t len = 0;
+
+    if (path[0] != '/')
+    {
+        if (!cwd_known)
+        {
+            cwd_known = getcwd(cwd, sizeof(cwd)) != NULL ? 1 : -1;
+        }
+        /* if the working directory is not known */
+        if (cwd_known != 1 || (len = strlen(cwd)) + n + 2 > size)
+        {
+            return 0;
+        }
+        memcpy(key, cwd, len);
+        if (n && !(n == 1 && path[0] == '.'))
+        {
+            key[len++] = '/';
+        }
+        else
+        {
+            n = 0;
+        }
+    }
+    else if (n + 1 > size)
+    {
+        return 0;
+    }
+    memcpy(key + len, path, n);
+    len += n;
+    while (len > 1 && key[len - 1] == '/')
+    {
+        len--;
+    }
+    key[len] = '\0';
+    return len;
+}
+
+/*
+ * Function: bump_all
+ * Gives every directory a new generation.
+ */
+static void bump_all()
+{
+    for (int i = 0; i < META_DIRS; i++)
+    {
+        dirs[i].gen = next_gen++;
+    }
+}
+
+/*
+ * Function: unwatch
+ * Stops watching a directory whose path may name another one now. Its
+ * entries are dropped, and it is watched again at the next lookup.
+ */
+static void unwatch(dir_t *d)
+{
+    int shared = 0;
+
+    /* the watch goes, unless another path names the same directory */
+    for (int i = 0; d->wd != -1 && i < META_DIRS; i++)
+    {
+        shared |= &dirs[i] != d && dirs[i].wd == d->wd;
+    }
+    if (d->wd != -1 && !shared)
+    {
+        inotify_rm_watch(ifd, d->wd);
+    }
+    d->wd = -1;
+    d->gen = next_gen++;
+}
+
+/*
+ * Function: drop_below
+ * Unwatches the directories at or below the first len bytes of key. When
+ * a name is removed, moved or made, a directory path through it, which
+ * may go by a symbolic link, names another directory or none.
+ */
+static void drop_below(const char *key, size_t len)
+{
+    for (int i = 0; i < META_DIRS; i++)
+    {
+        if (dirs[i].path != NULL && dirs[i].wd != -1 && !strncmp(dirs[i].path, key, len) &&
+            (dirs[i].path[len] == '\0' || dirs[i].path[len] == '/'))
+        {
+            unwatch(&dirs[i]);
+        }
+    }
+}
+
+/*
+ * Function: read_changes
+ * Reads the pending inotify events, if a program started since they were
+ * last read or META_TICK has passed, and bumps the directories they name.
+ * A directory moved or removed changes the paths below it, which may be
+ * in other directories, so it bumps them all. Any name removed, moved or
+ * made also unwatches the directories whose paths go through it, as a
+ * symbolic link replaced sends nothing to the directory it named.
+ */
+static void read_changes()
+{
+    char buf[EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char key[PATH_MAX * 2];
+    struct timespec now;
+    ssize_t r;
+
+    if (ifd < 0)
+    {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    if (!ran && (now.tv_sec - last.tv_sec) * 1000000000L + (now.tv_nsec - last.tv_nsec) < META_TICK)
+    {
+        return;
+    }
+    ran = 0;
+    last = now;
+    while ((r = read(ifd, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t off = 0; off < r;)
+        {
+            const struct inotify_event *ev = (const void *)(buf + off);
+
+            off += (ssize_t)(sizeof(struct inotify_event) + ev->len);
+            /* if events were lost, or a directory moved or went away */
+            if ((ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) ||
+                ((ev->mask & IN_ISDIR) && (ev->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))))
+            {
+                bump_all();
+            }
+            for (int i = 0; i < META_DIRS; i++)
+            {
+                if (dirs[i].path == NULL || dirs[i].wd != ev->wd)
+                {
+                    continue;
+                }
+                dirs[i].gen = next_gen++;
+                dirs[i].wd = ev->mask & IN_IGNORED ? -1 : dirs[i].wd;
+                /* if it moved, its path and those below it name other directories or none */
+                if (ev->mask & IN_MOVE_SELF)
+                {
+                    drop_below(dirs[i].path, strlen(dirs[i].path));
+                }
+                /* if a name in it went, moved or came */
+                else if (ev->len && (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) &&
+                         snprintf(key, sizeof(key), "%s/%s", strcmp(dirs[i].path, "/") ? dirs[i].path : "",
+                                  ev->name) < (int)sizeof(key))
+                {
+                    drop_below(key, strlen(key));
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Function: find_dir
+ * Gets the slot of the first len bytes of key as a directory, NULL if it
+ * is not in the table.
+ */
+static dir_t *find_dir(const char *key, size_t len)
+{
+    dir_t *d = &dirs[hash(key, len) & (META_DIRS - 1)];
+
+    return d->path != NULL && !strncmp(d->path, key, len) && d->path[len] == '\0' ? d : NULL;
+}
+
+static dir_t *watch_dir(const char *key, size_t len);
+
+/*
+ * Function: watch_links
+ * Watches the directories holding the symbolic links on the path made of
+ * the first len bytes of key, so that replacing a link is seen.
+ */
+static void watch_links(const char *key, size_t len)
+{
+    char prefix[PATH_MAX * 2];
+    struct stat st;
+    size_t parent = 1; /* length of the directory holding the component */
+
+    for (size_t i = 1; i <= len; i++)
+    {
+        if (i < len && key[i] != '/')
+        {
+            continue;
+        }
+        memcpy(prefix, key, i);
+        prefix[i] = '\0';
+        if (lstat(prefix, &st) == 0 && S_ISLNK(st.st_mode))
+        {
+            watch_dir(prefix, parent);
+        }
+        parent = i;
+    }
+}
+
+/*
+ * Function: watch_dir
+ * Gets the slot of the first len bytes of key as a watched directory,
+ * watching it in place of what the slot held if needed.
+ * Returns it, NULL if it can not be watched.
+ */
+static dir_t *watch_dir(const char *key, size_t len)
+{
+    dir_t *d = &dirs[hash(key, len) & (META_DIRS - 1)];
+    int shared = 0;
+
+    if (find_dir(key, len) == d && d->wd != -1)
+    {
+        return d;
+    }
+    watch_links(key, len);
+    if (ifd == -1)
+    {
+        ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        ifd = ifd == -1 ? -2 : ifd;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &last);
+    }
+    if (ifd == -2)
+    {
+        return NULL;
+    }
+    if (find_dir(key, len) != d)
+    {
+        /* the watch goes with the slot, unless another path names the same directory */
+        for (int i = 0; d->wd != -1 && i < META_DIRS; i++)
+        {
+            shared |= &dirs[i] != d && dirs[i].wd == d->wd;
+        }
+        if (d->path != NULL && d->wd != -1 && !shared)
+        {
+            inotify_rm_watch(ifd, d->wd);
+        }
+        free(d->path);
+        /* if malloc fails */
+        if ((d->path = malloc(len + 1)) == NULL)
+        {
+            return NULL;
+        }
+        memcpy(d->path, key, len);
+        d->path[len] = '\0';
+    }
+    d->gen = next_gen++;
+    d->wd = inotify_add_watch(ifd, d->path, WATCH_MASK);
+    return d->wd == -1 ? NULL : d;
+}
+
+/*
+ * Function: cached_lstat
+ * lstat through the cache. Called with lock held.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+static int cached_lstat(const char *path, struct stat *st)
+{
+    char key[PATH_MAX * 2];
+    size_t len = absolute(path, key, sizeof(key));
+    const char *base = strrchr(key, '/');
+    uint32_t h;
+    entry_t *e;
+    dir_t *d;
+    uint64_t gen;
+    int r;
+    int err;
+
+    /* if the path is relative to an unknown directory, or ends in . or .. or a slash */
+    if (!len || base == NULL || !strcmp(base, "/.") || !strcmp(base, "/..") || path[strlen(path) - 1] == '/')
+    {
+        return lstat(path, st);
+    }
+    h = hash(key, len);
+    e = &entries[h & (META_SLOTS - 1)];
+    if (e->path != NULL && e->hash == h && !strcmp(e->path, key) && dirs[e->dir].gen == e->gen &&
+        dirs[e->dir].wd != -1)
+    {
+        if (e->err)
+        {
+            errno = e->err;
+            return -1;
+        }
+        *st = e->st;
+        return 0;
+    }
+    /* if the directory holding it can not be watched */
+    if ((d = watch_dir(key, base == key ? 1 : (size_t)(base - key))) == NULL)
+    {
+        return lstat(path, st);
+    }
+    gen = d->gen;
+    r = lstat(path, st);
+    err = r == -1 ? errno : 0;
+    /* if it failed for another reason than not being there, it is not kept */
+    if (err && err != ENOENT)
+    {
+        return -1;
+    }
+    free(e->path);
+    if ((e->path = strdup(key)) != NULL)
+    {
+        e->hash = h;
+        e->dir = (uint32_t)(d - dirs);
+        e->gen = gen;
+        e->err = err;
+        e->st = *st;
+    }
+    errno = err;
+    return r;
+}
+
+/*
+ * Function: meta_stat
+ * Stats a path, through the cache. A symbolic link that is followed is
+ * stat'ed afresh, as its target may be anywhere.
+ *
+ * path : pointer to path
+ * st : pointer to stat buffer
+ * follow : set to follow a final symbolic link
+ */
+int meta_stat(const char *path, struct stat *st, int follow)
+{
+    int r;
+
+    /* a missing path, as from a line of only redirections, fails as stat would */
+    if (path == NULL || !*path)
+    {
+        errno = path == NULL ? EFAULT : ENOENT;
+        return -1;
+    }
+    pthread_mutex_lock(&lock);
+    read_changes();
+    r = cached_lstat(path, st);
+    pthread_mutex_unlock(&lock);
+    if (r == 0 && follow && S_ISLNK(st->st_mode))
+    {
+        return stat(path, st);
+    }
+    return r;
+}
+
+/*
+ * Function: meta_dir_gen
+ * Gets the generation of a directory, watching it if needed.
+ *
+ * path : pointer to path, "" for the working directory
+ */
+uint64_t meta_dir_gen(const char *path)
+{
+    char key[PATH_MAX * 2];
+    size_t len;
+    dir_t *d;
+    uint64_t gen = 0;
+
+    pthread_mutex_lock(&lock);
+    read_changes();
+    if ((len = absolute(path, key, sizeof(key))) != 0 && (d = watch_dir(key, len)) != NULL)
+    {
+        gen = d->gen;
+    }
+    pthread_mutex_unlock(&lock);
+    return gen;
+}
+
+/*
+ * Function: meta_bump
+ * Drops what is cached about the directory holding path, and about the
+ * directories through path, after the shell changed it.
+ *
+ * path : pointer to path, NULL for every directory
+ */
+void meta_bump(const char *path)
+{
+    char key[PATH_MAX * 2];
+    size_t len;
+    const char *base;
+    dir_t *d;
+
+    pthread_mutex_lock(&lock);
+    if (path == NULL)
+    {
+        bump_all();
+    }
+    else if ((len = absolute(path, key, sizeof(key))) != 0 && (base = strrchr(key, '/')) != NULL)
+    {
+        /* path may have been a directory, or a link to one, on other watched paths */
+        drop_below(key, len);
+        if ((d = find_dir(key, base == key ? 1 : (size_t)(base - key))) != NULL)
+        {
+            d->gen = next_gen++;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Function: meta_cwd
+ * Rereads the working directory, which relative paths are cached under.
+ */
+void meta_cwd()
+{
+    pthread_mutex_lock(&lock);
+    cwd_known = getcwd(cwd, sizeof(cwd)) != NULL ? 1 : -1;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Function: meta_ran
+ * Notes that a program started, so changes are read at the next lookup.
+ */
+void meta_ran()
+{
+    pthread_mutex_lock(&lock);
+    ran = 1;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,41 @@
+#ifndef META_H_
+#define META_H_
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+/*
+ * File metadata kept between lookups, shared by file tests, globbing, cd
+ * and the command probe. An entry holds what lstat said about a path,
+ * including that it does not exist, and is good for as long as the
+ * directory holding it is unchanged. Directories are watched with inotify,
+ * along with those holding symbolic links on their paths, and a name that
+ * goes, moves or comes unwatches the directories whose paths run through
+ * it. Changes are read when a command has run since the last lookup, and at
+ * most every few milliseconds otherwise. The shell's own rm and ln bump a
+ * directory's generation at once. The tables are of fixed size, an entry
+ * replacing the one in its slot.
+ */
+
+/*
+ * stats path, following a final symbolic link if follow is set, from the
+ * cache when it can; returns 0 on success, -1 with errno set on failure
+ */
+int meta_stat(const char *path, struct stat *st, int follow);
+
+/*
+ * gets the generation of the directory at path, which changes whenever its
+ * entries do, 0 if it can not be watched
+ */
+uint64_t meta_dir_gen(const char *path);
+
+/* drops what is cached about the directory holding path, or about everything if path is NULL */
+void meta_bump(const char *path);
+
+/* notes that the working directory changed */
+void meta_cwd();
+
+/* notes that a program was started, which may change files */
+void meta_ran();
+
+#endif  // META_H_
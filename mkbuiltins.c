@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./builtins.h"
+
+/*
+ * mkbuiltins: reads builtins.def on stdin and writes builtin_table.h on
+ * stdout, a table of the builtins laid out by a perfect hash.
+ */
+
+#define MAX_BUILTINS 256 /* maximum number of builtins */
+#define MAX_LINE 256     /* maximum length of a line of builtins.def */
+#define MAX_TRIES 1000000 /* seeds tried per table size */
+
+typedef struct entry {
+    char name[64];
+    char fn[64];
+    char flags[128];
+} entry_t;
+
+entry_t entries[MAX_BUILTINS];
+int n_entries;
+
+/* Function Prototypes */
+void read_def();
+void add_flag(entry_t *e, char *flag, int line);
+int try_seed(uint32_t seed, uint32_t size, int *slots);
+
+int main()
+{
+    int slots[MAX_BUILTINS * 4]; /* entry in each table slot, -1 if none */
+    uint32_t size = 1;
+    uint32_t seed = 0;
+    int found = 0;
+
+    read_def();
+    while (size < 2 * (uint32_t)n_entries)
+    {
+        size *= 2;
+    }
+    /* try seeds until every name hashes to its own slot, widening the table if needed */
+    while (!found)
+    {
+        for (seed = 0; seed < MAX_TRIES; seed++)
+        {
+            if (try_seed(seed, size, slots))
+            {
+                found = 1;
+                break;
+            }
+        }
+        if (!found)
+        {
+            /* if table can not grow any more */
+            if (size * 2 > sizeof(slots) / sizeof(slots[0]))
+            {
+                fprintf(stderr, "%s\n", "mkbuiltins: no perfect hash found.");
+                exit(EXIT_FAILURE); /* exit(1) */
+            }
+            size *= 2;
+        }
+    }
+
+    printf("/* generated by mkbuiltins from builtins.def, do not edit */\n");
+    printf("#define BUILTIN_SEED %uu\n", seed);
+    printf("#define BUILTIN_SIZE %u\n\n", size);
+    printf("static const builtin_t builtin_table[BUILTIN_SIZE] = {\n");
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (slots[i] != -1)
+        {
+            entry_t *e = &entries[slots[i]];
+
+            printf("    [%u] = {\"%s\", %s, %s},\n", i, e->name, e->fn, e->flags);
+        }
+    }
+    printf("};\n");
+    return 0;
+}
+
+/*
+ * Function: read_def
+ * Reads "name handler flags..." lines from stdin into entries. Blank lines
+ * and lines starting with '#' are skipped.
+ */
+void read_def()
+{
+    char line[MAX_LINE];
+    char *tok;
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        entry_t *e = &entries[n_entries];
+
+        lineno++;
+        /* if line is blank or a comment */
+        if ((tok = strtok(line, " \t\n")) == NULL || *tok == '#')
+        {
+            continue;
+        }
+        /* if there are too many builtins, or a name is too long */
+        if (n_entries == MAX_BUILTINS || strlen(tok) >= sizeof(e->name))
+        {
+            fprintf(stderr, "mkbuiltins: line %d: too many builtins or name too long.\n", lineno);
+            exit(EXIT_FAILURE); /* exit(1) */
+        }
+        strcpy(e->name, tok);
+        /* if handler is missing or too long */
+        if ((tok = strtok(NULL, " \t\n")) == NULL || strlen(tok) >= sizeof(e->fn))
+        {
+            fprintf(stderr, "mkbuiltins: line %d: bad handler.\n", lineno);
+            exit(EXIT_FAILURE); /* exit(1) */
+        }
+        strcpy(e->fn, tok);
+        strcpy(e->flags, "0");
+        while ((tok = strtok(NULL, " \t\n")) != NULL)
+        {
+            add_flag(e, tok, lineno);
+        }
+        /* if name is listed twice */
+        for (int i = 0; i < n_entries; i++)
+        {
+            if (!strcmp(entries[i].name, e->name))
+            {
+                fprintf(stderr, "mkbuiltins: line %d: %s listed twice.\n", lineno, e->name);
+                exit(EXIT_FAILURE); /* exit(1) */
+            }
+        }
+        n_entries++;
+    }
+}
+
+/*
+ * Function: add_flag
+ * Adds the BI_ constant for a flag named in builtins.def to an entry.
+ *
+ * e : pointer to entry
+ * flag : pointer to flag name
+ * line : line number, for errors
+ */
+void add_flag(entry_t *e, char *flag, int line)
+{
+    const char *names[] = {"redirect", "pipesafe"};
+    const char *consts[] = {"BI_REDIRECT", "BI_PIPESAFE"};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!strcmp(flag, names[i]))
+        {
+            if (!strcmp(e->flags, "0"))
+            {
+                strcpy(e->flags, consts[i]);
+            }
+            else
+            {
+                strcat(strcat(e->flags, " | "), consts[i]);
+            }
+            return;
+        }
+    }
+    fprintf(stderr, "mkbuiltins: line %d: unknown flag %s.\n", line, flag);
+    exit(EXIT_FAILURE); /* exit(1) */
+}
+
+/*
+ * Function: try_seed
+ * Places every entry in the slot its hash picks. Returns 1 if no two entries
+ * collide, 0 otherwise.
+ *
+ * seed : hash seed
+ * size : table size, a power of two
+ * slots : pointer to table of entry indices to fill
+ */
+int try_seed(uint32_t seed, uint32_t size, int *slots)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        slots[i] = -1;
+    }
+    for (int i = 0; i < n_entries; i++)
+    {
+        uint32_t slot = builtin_hash(entries[i].name, seed) & (size - 1);
+
+        if (slots[slot] != -1)
+        {
+            return 0;
+        }
+        slots[slot] = i;
+    }
+    return 1;
+}
@@ -0,0 +1,1748 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./plan.h"
+
+/* hash of the shell sources, set by the Makefile so caches die with the build */
+#ifndef BUILD_HASH
+#define BUILD_HASH 0
+#endif
+
+#define CACHE_MAGIC "33SHPLN"  /* compiled-script cache file magic */
+#define BUNDLE_MAGIC "33SHBDL" /* magic of a plan bundled into an executable */
+#define BUNDLE_END "33SHEND"   /* magic of the trailer ending a bundled executable */
+#define BUNDLE_ALIGN 65536     /* bundled plans start on this boundary, so they can be mapped */
+#define MAX_NEST 64            /* maximum nesting of quotes and ${...} in a word */
+
+/* header of a compiled-script cache file, followed by nodes, words and strs */
+typedef struct cache_hdr {
+    char magic[8];
+    uint64_t build;      /* build hash of the shell that wrote the file */
+    uint64_t dev;        /* script's device, inode, size and mtime */
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t sum;        /* FNV-1a of everything after the header */
+    uint32_t n_nodes;
+    uint32_t n_words;
+    uint32_t n_strs;
+    uint32_t root;
+} cache_hdr_t;
+
+/*
+ * trailer of a bundled executable: the shell binary, padding, a cache_hdr_t
+ * with magic BUNDLE_MAGIC and no script stat, the plan, then this
+ */
+typedef struct bundle_end {
+    uint64_t offset;     /* file offset of the bundled plan's header */
+    char magic[8];
+} bundle_end_t;
+
+/* tokens of shell input */
+typedef enum {
+    T_END, T_WORD, T_NEWLINE, T_SEMI, T_AMP, T_AND, T_OR, T_PIPE, T_LPAREN, T_RPAREN
+} tok_type_t;
+
+/* state of the tokenizer: the input and the token last read from it */
+typedef struct lexer {
+    const char *text;
+    size_t len;
+    size_t i;     /* offset of the next unread byte */
+    int type;     /* type of the current token */
+    size_t start; /* offset of the current token */
+    int error;    /* set once a syntax error has been reported */
+    int more;     /* set if the input ended inside a construct */
+    size_t here;  /* offset of the line after the last here-document read, 0 if none */
+} lexer_t;
+
+/* Helper Functions */
+
+/*
+ * Function: fnv
+ * FNV-1a hash of n bytes, continuing from h.
+ */
+static uint64_t fnv(const void *p, size_t n, uint64_t h)
+{
+    const unsigned char *c = p;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= c[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * Function: build_hash
+ * Identifies this build of the shell. Falls back to the compile time when the
+ * Makefile did not provide a hash of the sources.
+ */
+static uint64_t build_hash()
+{
+    static const char stamp[] = __DATE__ " " __TIME__;
+
+    if (BUILD_HASH)
+    {
+        return BUILD_HASH;
+    }
+    return fnv(stamp, sizeof(stamp), 0xcbf29ce484222325ULL);
+}
+
+/*
+ * Function: grow
+ * Makes room for need elements of size bytes in *arr, doubling its capacity.
+ * Returns 0 on success, -1 on failure.
+ */
+static int grow(void **arr, uint32_t *cap, uint32_t need, size_t size)
+{
+    uint32_t n = *cap ? *cap : 16;
+    void *p;
+
+    if (need <= *cap)
+    {
+        return 0;
+    }
+    while (n < need)
+    {
+        /* if capacity would overflow */
+        if (n > UINT32_MAX / 2)
+        {
+            return -1;
+        }
+        n *= 2;
+    }
+    /* if realloc fails */
+    if ((p = realloc(*arr, (size_t)n * size)) == NULL)
+    {
+        return -1;
+    }
+    *arr = p;
+    *cap = n;
+    return 0;
+}
+
+/*
+ * Function: add_node
+ * Appends a node to the plan. Returns its index, 0 on failure.
+ */
+static uint32_t add_node(plan_t *plan, uint32_t type, uint32_t a, uint32_t b)
+{
+    if (grow((void **)&plan->nodes, &plan->cap_nodes, plan->n_nodes + 1, sizeof(plan_node_t)) == -1)
+    {
+        return 0;
+    }
+    plan->nodes[plan->n_nodes].type = type;
+    plan->nodes[plan->n_nodes].a = a;
+    plan->nodes[plan->n_nodes].b = b;
+    return plan->n_nodes++;
+}
+
+/*
+ * Function: add_word
+ * Copies len bytes of text into the string pool as a new word.
+ * Returns 0 on success, -1 on failure.
+ */
+static int add_word(plan_t *plan, const char *text, size_t len)
+{
+    /* if the word does not fit in the pool */
+    if (len >= UINT32_MAX - plan->n_strs)
+    {
+        return -1;
+    }
+    if (grow((void **)&plan->words, &plan->cap_words, plan->n_words + 1, sizeof(uint32_t)) == -1 ||
+        grow((void **)&plan->strs, &plan->cap_strs, plan->n_strs + (uint32_t)len + 1, 1) == -1)
+    {
+        return -1;
+    }
+    memcpy(plan->strs + plan->n_strs, text, len);
+    plan->strs[plan->n_strs + len] = '\0';
+    plan->words[plan->n_words++] = plan->n_strs;
+    plan->n_strs += (uint32_t)len + 1;
+    return 0;
+}
+
+/*
+ * Function: is_list
+ * Checks that node n is an and-or list that comes before node i.
+ */
+static int is_list(const plan_t *plan, uint32_t n, uint32_t i)
+{
+    return n && n < i && (plan->nodes[n].type == N_CMD || plan->nodes[n].type == N_AND ||
+                          plan->nodes[n].type == N_OR || plan->nodes[n].type == N_FUNC ||
+                          plan->nodes[n].type == N_WHILE || plan->nodes[n].type == N_UNTIL ||
+                          plan->nodes[n].type == N_IF || plan->nodes[n].type == N_ARITH ||
+                          plan->nodes[n].type == N_COND || plan->nodes[n].type == N_FOR ||
+                          plan->nodes[n].type == N_REDIR);
+}
+
+/*
+ * Function: is_node
+ * Checks that node n is of the given type and comes before node i.
+ */
+static int is_node(const plan_t *plan, uint32_t n, uint32_t i, uint32_t type)
+{
+    return n && n < i && plan->nodes[n].type == type;
+}
+
+/*
+ * Function: plan_check
+ * Makes sure every index and offset in a mapped plan is in range, so a
+ * damaged cache file can not send the shell outside of the mapping.
+ * Returns 0 if the plan is sound, -1 otherwise.
+ */
+static int plan_check(const plan_t *plan)
+{
+    if (!plan->n_nodes || (plan->n_strs && plan->strs[plan->n_strs - 1] != '\0'))
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < plan->n_words; i++)
+    {
+        if (plan->words[i] >= plan->n_strs)
+        {
+            return -1;
+        }
+    }
+    for (uint32_t i = 1; i < plan->n_nodes; i++)
+    {
+        const plan_node_t *n = &plan->nodes[i];
+
+        switch (n->type)
+        {
+        case N_CMD:
+        case N_COND:
+            if (n->a > plan->n_words || n->b > plan->n_words - n->a)
+            {
+                return -1;
+            }
+            break;
+        /* children come before their node, the next sequence node after it */
+        case N_SEQ:
+            if (!is_list(plan, n->a, i) ||
+                (n->b && (n->b <= i || n->b >= plan->n_nodes || plan->nodes[n->b].type != N_SEQ)))
+            {
+                return -1;
+            }
+            break;
+        case N_AND:
+        case N_OR:
+            if (!is_list(plan, n->a, i) || !is_list(plan, n->b, i))
+            {
+                return -1;
+            }
+            break;
+        case N_FUNC:
+            if (n->a >= plan->n_words || n->b >= plan->n_words)
+            {
+                return -1;
+            }
+            break;
+        case N_WHILE:
+        case N_UNTIL:
+            if (!is_node(plan, n->a, i, N_SEQ) || !is_node(plan, n->b, i, N_SEQ))
+            {
+                return -1;
+            }
+            break;
+        case N_FOR:
+            if (!is_node(plan, n->a, i, N_CMD) || !plan->nodes[n->a].b || !is_node(plan, n->b, i, N_SEQ))
+            {
+                return -1;
+            }
+            break;
+        case N_IF:
+            if (!is_node(plan, n->a, i, N_SEQ) || !is_node(plan, n->b, i, N_THEN))
+            {
+                return -1;
+            }
+            break;
+        case N_THEN:
+            if (!is_node(plan, n->a, i, N_SEQ) ||
+                (n->b && !is_node(plan, n->b, i, N_SEQ) && !is_node(plan, n->b, i, N_IF)))
+            {
+                return -1;
+            }
+            break;
+        case N_REDIR:
+            if (!is_list(plan, n->a, i) || !is_node(plan, n->b, i, N_CMD))
+            {
+                return -1;
+            }
+            break;
+        case N_ARITH:
+            if (n->a >= plan->n_words)
+            {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (plan->root && (plan->root >= plan->n_nodes || plan->nodes[plan->root].type != N_SEQ))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function: hdr_len
+ * Size of the header and plan sections described by hdr.
+ */
+static uint64_t hdr_len(const cache_hdr_t *hdr)
+{
+    return sizeof(cache_hdr_t) + (uint64_t)hdr->n_nodes * sizeof(plan_node_t) +
+           (uint64_t)hdr->n_words * sizeof(uint32_t) + hdr->n_strs;
+}
+
+/*
+ * Function: hdr_ok
+ * Checks that a mapped header was written by this build and that the plan
+ * after it fills exactly len bytes and matches its checksum.
+ */
+static int hdr_ok(const cache_hdr_t *hdr, uint64_t len)
+{
+    return hdr->build == build_hash() && hdr_len(hdr) == len &&
+           hdr->sum == fnv(hdr + 1, (size_t)(len - sizeof(cache_hdr_t)), 0xcbf29ce484222325ULL);
+}
+
+/*
+ * Function: map_plan
+ * Points plan at the sections following the header at the start of map and
+ * checks them. Takes ownership of map. Returns plan, NULL if it is corrupt.
+ */
+static plan_t *map_plan(plan_t *plan, void *map, size_t map_len)
+{
+    cache_hdr_t *hdr = map;
+
+    plan->nodes = (plan_node_t *)(hdr + 1);
+    plan->words = (uint32_t *)(plan->nodes + hdr->n_nodes);
+    plan->strs = (char *)(plan->words + hdr->n_words);
+    plan->n_nodes = hdr->n_nodes;
+    plan->n_words = hdr->n_words;
+    plan->n_strs = hdr->n_strs;
+    plan->root = hdr->root;
+    plan->map = map;
+    plan->map_len = map_len;
+    /* if the plan is corrupt */
+    if (plan_check(plan) == -1)
+    {
+        plan_free(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+/*
+ * Function: write_plan
+ * Writes a header of the given magic, with the script stat st if not NULL,
+ * followed by the plan sections to fd. Returns 0 on success, -1 on failure.
+ */
+static int write_plan(int fd, const char *magic, const plan_t *plan, const struct stat *st)
+{
+    cache_hdr_t hdr;
+    uint64_t sum = 0xcbf29ce484222325ULL;
+    size_t nodes_len = plan->n_nodes * sizeof(plan_node_t);
+    size_t words_len = plan->n_words * sizeof(uint32_t);
+
+    sum = fnv(plan->nodes, nodes_len, sum);
+    sum = fnv(plan->words, words_len, sum);
+    sum = fnv(plan->strs, plan->n_strs, sum);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, magic, sizeof(hdr.magic));
+    hdr.build = build_hash();
+    if (st != NULL)
+    {
+        hdr.dev = (uint64_t)st->st_dev;
+        hdr.ino = (uint64_t)st->st_ino;
+        hdr.size = (uint64_t)st->st_size;
+        hdr.mtime_sec = (int64_t)st->st_mtim.tv_sec;
+        hdr.mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    }
+    hdr.sum = sum;
+    hdr.n_nodes = plan->n_nodes;
+    hdr.n_words = plan->n_words;
+    hdr.n_strs = plan->n_strs;
+    hdr.root = plan->root;
+
+    if (write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+        write(fd, plan->nodes, nodes_len) != (ssize_t)nodes_len ||
+        write(fd, plan->words, words_len) != (ssize_t)words_len ||
+        write(fd, plan->strs, plan->n_strs) != (ssize_t)plan->n_strs)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function: cache_file
+ * Builds the cache file name of a script, creating the cache directory
+ * if needed. Returns 0 on success, -1 on failure.
+ */
+static int cache_file(const char *path, char *out, size_t n)
+{
+    char real[PATH_MAX];
+    char dir[PATH_MAX];
+    int len;
+
+    /* if script path can not be resolved or there is no cache directory */
+    if (realpath(path, real) == NULL || plan_cache_dir(NULL, dir, sizeof(dir)) == -1)
+    {
+        return -1;
+    }
+    len = snprintf(out, n, "%s/%016llx.33c", dir,
+                   (unsigned long long)fnv(real, strlen(real), 0xcbf29ce484222325ULL));
+    return (len < 0 || (size_t)len >= n) ? -1 : 0;
+}
+
+/*
+ * Function: cache_read
+ * Maps the cache file at cpath. Returns the plan it holds if it was written by
+ * this build for the script described by st and is intact, NULL otherwise.
+ */
+static plan_t *cache_read(const char *cpath, const struct stat *st)
+{
+    int fd;
+    struct stat cst;
+    void *map;
+    cache_hdr_t *hdr;
+    plan_t *plan;
+
+    /* if there is no cache file */
+    if ((fd = open(cpath, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &cst) == -1 || (uint64_t)cst.st_size < sizeof(cache_hdr_t) ||
+        (map = mmap(NULL, (size_t)cst.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    hdr = map;
+    /* if the entry is stale, from another build, truncated or damaged */
+    if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->dev != (uint64_t)st->st_dev || hdr->ino != (uint64_t)st->st_ino ||
+        hdr->size != (uint64_t)st->st_size || hdr->mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+        hdr->mtime_nsec != (int64_t)st->st_mtim.tv_nsec ||
+        !hdr_ok(hdr, (uint64_t)cst.st_size) || (plan = calloc(1, sizeof(plan_t))) == NULL)
+    {
+        munmap(map, (size_t)cst.st_size);
+        return NULL;
+    }
+
+    return map_plan(plan, map, (size_t)cst.st_size);
+}
+
+/*
+ * Function: cache_write
+ * Writes plan to the cache file at cpath, keyed by the script's stat st.
+ * The file is written under a temporary name and renamed into place, so
+ * readers never see a partial entry. Failures leave the cache untouched.
+ */
+static void cache_write(const char *cpath, const plan_t *plan, const struct stat *st)
+{
+    char tmp[PATH_MAX];
+    int fd;
+    int ok;
+
+    /* if temporary name does not fit */
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", cpath) >= (int)sizeof(tmp))
+    {
+        return;
+    }
+    /* if mkstemp fails */
+    if ((fd = mkstemp(tmp)) == -1)
+    {
+        return;
+    }
+    ok = write_plan(fd, CACHE_MAGIC, plan, st) == 0;
+    if (close(fd) == -1 || !ok || rename(tmp, cpath) == -1)
+    {
+        unlink(tmp);
+    }
+}
+
+/*
+ * Function: bundle_offset
+ * Finds the plan bundled into the executable open at fd, of size bytes.
+ * Returns the offset of its header, or size if there is none.
+ */
+static uint64_t bundle_offset(int fd, uint64_t size)
+{
+    bundle_end_t end;
+
+    if (size < sizeof(end) + sizeof(cache_hdr_t) ||
+        pread(fd, &end, sizeof(end), (off_t)(size - sizeof(end))) != (ssize_t)sizeof(end) ||
+        memcmp(end.magic, BUNDLE_END, sizeof(end.magic)) || end.offset % BUNDLE_ALIGN ||
+        end.offset > size - sizeof(end) - sizeof(cache_hdr_t))
+    {
+        return size;
+    }
+    return end.offset;
+}
+
+/*
+ * Function: skip_part
+ * Skips text from offset i up to the character close, or for a whole word
+ * (close 0) up to a blank or operator. Quotes, backslashes and ${...} nested
+ * on the way are skipped as units, so what they hold does not end the word.
+ * Returns the offset reached; sets *open if the input ends inside a quote
+ * or ${...}.
+ */
+static size_t skip_part(const char *t, size_t len, size_t i, char close, int depth, int *open)
+{
+    while (i < len)
+    {
+        char c = t[i];
+        char sub;
+
+        /* single quotes hold everything up to the next one */
+        if (close == '\'')
+        {
+            if (c == '\'')
+            {
+                return i;
+            }
+            i++;
+            continue;
+        }
+        if (c == close || (!close && strchr(" \t\n;&|()", c)))
+        {
+            return i;
+        }
+        if (c == '\\')
+        {
+            /* if the backslash ends the input, the line goes on */
+            if (i + 1 >= len)
+            {
+                *open = 1;
+                return len;
+            }
+            i += 2;
+            continue;
+        }
+        if (c == '\'' && close != '"')
+        {
+            sub = '\'';
+        }
+        else if (c == '"')
+        {
+            sub = '"';
+        }
+        else if (c == '$' && i + 1 < len && t[i + 1] == '{')
+        {
+            sub = '}';
+            i++;
+        }
+        else if (c == '`')
+        {
+            sub = '`';
+        }
+        /* $(...) and $((...)) hold parentheses that nest */
+        else if ((c == '$' && i + 1 < len && t[i + 1] == '(') || (c == '(' && close == ')'))
+        {
+            sub = ')';
+            i += c == '$';
+        }
+        else
+        {
+            i++;
+            continue;
+        }
+        /* if the nested part is unterminated, or nested too deeply */
+        if (depth >= MAX_NEST || (i = skip_part(t, len, i + 1, sub, depth + 1, open)) >= len)
+        {
+            *open = 1;
+            return len;
+        }
+        i++;
+    }
+    /* if input ends inside a quote or ${...} */
+    if (close)
+    {
+        *open = 1;
+    }
+    return i < len ? i : len;
+}
+
+/*
+ * Function: plan_skip
+ * Skips a word, or part of one, as the tokenizer does.
+ *
+ * text : pointer to text
+ * len : length of text
+ * i : offset to start from
+ * close : character ending the part, 0 for a whole word
+ * open : pointer to flag set if text ends inside a quote or ${...}
+ */
+size_t plan_skip(const char *text, size_t len, size_t i, char close, int *open)
+{
+    return skip_part(text, len, i, close, 0, open);
+}
+
+/*
+ * Function: compound_start
+ * Checks whether t[start..end) is "name=" or "name+=", which a ( after it
+ * turns into an array assignment.
+ */
+static int compound_start(const char *t, size_t start, size_t end)
+{
+    size_t i = start;
+
+    if (end - start < 2 || t[end - 1] != '=' || (t[i] >= '0' && t[i] <= '9'))
+    {
+        return 0;
+    }
+    while (i < end && (t[i] == '_' || (t[i] >= 'a' && t[i] <= 'z') || (t[i] >= 'A' && t[i] <= 'Z') ||
+                       (t[i] >= '0' && t[i] <= '9')))
+    {
+        i++;
+    }
+    if (i > start && i + 1 < end && t[i] == '+')
+    {
+        i++;
+    }
+    return i > start && i + 1 == end;
+}
+
+/*
+ * Function: lex
+ * Reads the next token of the input into lx. Blanks separate words, the
+ * operators ; & && || and line breaks end them, and a word starting with
+ * '#' comments out the rest of its line. A word that ends inside a quote
+ * reads as the end of input, with lx->more set.
+ * Returns the token type.
+ */
+static int lex(lexer_t *lx)
+{
+    const char *t = lx->text;
+
+    while (lx->i < lx->len && (t[lx->i] == ' ' || t[lx->i] == '\t'))
+    {
+        lx->i++;
+    }
+    /* if word starts a comment */
+    if (lx->i < lx->len && t[lx->i] == '#')
+    {
+        while (lx->i < lx->len && t[lx->i] != '\n')
+        {
+            lx->i++;
+        }
+    }
+    lx->start = lx->i;
+    if (lx->i >= lx->len)
+    {
+        return lx->type = T_END;
+    }
+
+    switch (t[lx->i])
+    {
+    case '\n':
+        lx->i++;
+        /* the text of here-documents on the line is skipped */
+        if (lx->here)
+        {
+            lx->i = lx->here;
+            lx->here = 0;
+        }
+        return lx->type = T_NEWLINE;
+    case ';':
+        lx->i++;
+        return lx->type = T_SEMI;
+    case '&':
+        lx->i++;
+        if (lx->i < lx->len && t[lx->i] == '&')
+        {
+            lx->i++;
+            return lx->type = T_AND;
+        }
+        return lx->type = T_AMP;
+    case '|':
+        lx->i++;
+        if (lx->i < lx->len && t[lx->i] == '|')
+        {
+            lx->i++;
+            return lx->type = T_OR;
+        }
+        return lx->type = T_PIPE;
+    case '(':
+        lx->i++;
+        return lx->type = T_LPAREN;
+    case ')':
+        lx->i++;
+        return lx->type = T_RPAREN;
+    }
+    lx->i = skip_part(t, lx->len, lx->i, 0, 0, &lx->more);
+    /* an array assignment, name=(...) or name+=(...), is one word */
+    if (!lx->more && lx->i < lx->len && t[lx->i] == '(' && compound_start(t, lx->start, lx->i))
+    {
+        lx->i = skip_part(t, lx->len, lx->i + 1, ')', 0, &lx->more);
+        if (!lx->more)
+        {
+            lx->i = skip_part(t, lx->len, lx->i + 1, 0, 0, &lx->more);
+        }
+    }
+    /* if the word is unterminated */
+    if (lx->more)
+    {
+        return lx->type = T_END;
+    }
+    return lx->type = T_WORD;
+}
+
+/*
+ * Function: syntax_error
+ * Reports an unexpected token. Returns 0 so parsers can return its result.
+ */
+static uint32_t syntax_error(lexer_t *lx)
+{
+    static const char *names[] = {"end of input", "word", "line break", ";", "&", "&&", "||", "|", "(", ")"};
+
+    /* if input ended early, the caller may supply more of it */
+    if (lx->type == T_END)
+    {
+        lx->more = 1;
+        return 0;
+    }
+    if (lx->type == T_PIPE)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Pipes are not supported.");
+    }
+    else
+    {
+        fprintf(stderr, "SYNTAX ERROR : Unexpected %s.\n", names[lx->type]);
+    }
+    lx->error = 1;
+    return 0;
+}
+
+/*
+ * Function: is_word
+ * Checks if the current token is the word w.
+ */
+static int is_word(const lexer_t *lx, const char *w)
+{
+    size_t n = strlen(w);
+
+    return lx->type == T_WORD && lx->i - lx->start == n && !strncmp(lx->text + lx->start, w, n);
+}
+
+/*
+ * Function: is_reserved
+ * Checks if the current token is a reserved word that ends the list before
+ * it, inside a loop or an if.
+ */
+static int is_reserved(const lexer_t *lx)
+{
+    return is_word(lx, "do") || is_word(lx, "done") || is_word(lx, "then") || is_word(lx, "elif") ||
+           is_word(lx, "else") || is_word(lx, "fi");
+}
+
+/*
+ * Function: parse_func
+ * Parses the rest of a function definition, "() { body }", after its name.
+ * The body is only skimmed for its closing brace and kept as text; it is
+ * parsed the first time the function is called.
+ * Returns the N_FUNC node, 0 on failure.
+ */
+static uint32_t parse_func(plan_t *plan, lexer_t *lx, uint32_t name)
+{
+    size_t start;
+    int depth = 1;    /* braces open */
+    int cmd_pos = 1;  /* set if the next word starts a command */
+
+    /* if name is not followed by "() {" */
+    if (lex(lx) != T_RPAREN)
+    {
+        return syntax_error(lx);
+    }
+    while (lex(lx) == T_NEWLINE)
+    {
+    }
+    if (!is_word(lx, "{"))
+    {
+        return syntax_error(lx);
+    }
+    start = lx->i;
+
+    /* find the brace closing the body; braces only count as commands */
+    while (depth)
+    {
+        switch (lex(lx))
+        {
+        case T_END:
+            return syntax_error(lx);
+        case T_WORD:
+            if (cmd_pos && is_word(lx, "{"))
+            {
+                depth++;
+            }
+            else if (cmd_pos && is_word(lx, "}"))
+            {
+                depth--;
+            }
+            else if (!cmd_pos || !is_reserved(lx))
+            {
+                cmd_pos = 0;
+            }
+            break;
+        default:
+            cmd_pos = 1;
+            break;
+        }
+    }
+    if (add_word(plan, lx->text + start, lx->start - start) == -1)
+    {
+        return 0;
+    }
+    lex(lx);
+    return add_node(plan, N_FUNC, name, plan->n_words - 1);
+}
+
+static int parse_seq(plan_t *plan, lexer_t *lx, uint32_t *first);
+
+/*
+ * Function: parse_body
+ * Parses a non-empty list ended by the reserved word end, and moves past it.
+ * Returns 0 on success, -1 on failure.
+ */
+static int parse_body(plan_t *plan, lexer_t *lx, const char *end, uint32_t *first)
+{
+    if (parse_seq(plan, lx, first) == -1)
+    {
+        return -1;
+    }
+    /* if the list is empty or ended by anything else */
+    if (!*first || !is_word(lx, end))
+    {
+        syntax_error(lx);
+        return -1;
+    }
+    lex(lx);
+    return 0;
+}
+
+/*
+ * Function: parse_loop
+ * Parses "while list; do list; done", or the same with until.
+ * Returns the N_WHILE or N_UNTIL node, 0 on failure.
+ */
+static uint32_t parse_loop(plan_t *plan, lexer_t *lx)
+{
+    uint32_t type = is_word(lx, "while") ? N_WHILE : N_UNTIL;
+    uint32_t cond;
+    uint32_t body;
+
+    lex(lx);
+    if (parse_body(plan, lx, "do", &cond) == -1 || parse_body(plan, lx, "done", &body) == -1)
+    {
+        return 0;
+    }
+    return add_node(plan, type, cond, body);
+}
+
+/*
+ * Function: parse_for
+ * Parses "for name [in words]; do list; done". Without in, the words are
+ * "$@". The name and the words make an N_CMD node that is never run.
+ * Returns the N_FOR node, 0 on failure.
+ */
+static uint32_t parse_for(plan_t *plan, lexer_t *lx)
+{
+    uint32_t first = plan->n_words;
+    uint32_t list;
+    uint32_t body;
+
+    /* if the name is missing */
+    if (lex(lx) != T_WORD || is_reserved(lx))
+    {
+        return syntax_error(lx);
+    }
+    if (add_word(plan, lx->text + lx->start, lx->i - lx->start) == -1)
+    {
+        return 0;
+    }
+    while (lex(lx) == T_NEWLINE)
+    {
+    }
+    if (is_word(lx, "in"))
+    {
+        /* the list ends at ; or a line break, so do in it is a word */
+        while (lex(lx) == T_WORD)
+        {
+            if (add_word(plan, lx->text + lx->start, lx->i - lx->start) == -1)
+            {
+                return 0;
+            }
+        }
+    }
+    else if (add_word(plan, "\"$@\"", 4) == -1)
+    {
+        return 0;
+    }
+    if (lx->type == T_SEMI)
+    {
+        lex(lx);
+    }
+    while (lx->type == T_NEWLINE)
+    {
+        lex(lx);
+    }
+    /* if do is missing */
+    if (!is_word(lx, "do"))
+    {
+        return syntax_error(lx);
+    }
+    lex(lx);
+    if ((list = add_node(plan, N_CMD, first, plan->n_words - first)) == 0 ||
+        parse_body(plan, lx, "done", &body) == -1)
+    {
+        return 0;
+    }
+    return add_node(plan, N_FOR, list, body);
+}
+
+/*
+ * Function: parse_if
+ * Parses "if list; then list; [elif list; then list;]... [else list;] fi",
+ * from the if or elif. An elif becomes an N_IF in the else branch.
+ * Returns the N_IF node, 0 on failure.
+ */
+static uint32_t parse_if(plan_t *plan, lexer_t *lx)
+{
+    uint32_t cond;
+    uint32_t then;
+    uint32_t rest = 0;
+
+    lex(lx);
+    if (parse_body(plan, lx, "then", &cond) == -1 || parse_seq(plan, lx, &then) == -1)
+    {
+        return 0;
+    }
+    /* if the then branch is empty */
+    if (!then)
+    {
+        return syntax_error(lx);
+    }
+    if (is_word(lx, "elif"))
+    {
+        if ((rest = parse_if(plan, lx)) == 0)
+        {
+            return 0;
+        }
+    }
+    else if (is_word(lx, "else"))
+    {
+        lex(lx);
+        if (parse_body(plan, lx, "fi", &rest) == -1)
+        {
+            return 0;
+        }
+    }
+    /* if the if is not closed */
+    else if (!is_word(lx, "fi"))
+    {
+        return syntax_error(lx);
+    }
+    else
+    {
+        lex(lx);
+    }
+    if ((then = add_node(plan, N_THEN, then, rest)) == 0)
+    {
+        return 0;
+    }
+    return add_node(plan, N_IF, cond, then);
+}
+
+/*
+ * Function: parse_arith
+ * Parses an arithmetic command, "(( expression ))", from its first '('.
+ * The expression is kept as one word, up to the )) matching the ((.
+ * Returns the N_ARITH node, 0 on failure.
+ */
+static uint32_t parse_arith(plan_t *plan, lexer_t *lx)
+{
+    const char *t = lx->text;
+    size_t start = lx->i + 1;
+    size_t i = start;
+    int depth = 0; /* parentheses open inside the expression */
+
+    for (; i < lx->len && (t[i] != ')' || depth); i++)
+    {
+        depth += t[i] == '(';
+        depth -= t[i] == ')';
+    }
+    /* if input ends before the closing )) */
+    if (i + 1 >= lx->len)
+    {
+        lx->i = lx->len;
+        lx->type = T_END;
+        return syntax_error(lx);
+    }
+    /* if the expression closes with a single ) */
+    if (t[i + 1] != ')')
+    {
+        lx->i = i + 1;
+        lx->type = T_RPAREN;
+        return syntax_error(lx);
+    }
+    if (add_word(plan, t + start, i - start) == -1)
+    {
+        return 0;
+    }
+    lx->i = i + 2;
+    lex(lx);
+    return add_node(plan, N_ARITH, plan->n_words - 1, 0);
+}
+
+/*
+ * Function: parse_cond
+ * Parses a conditional command, "[[ words ]]". Its operators && || ( and )
+ * are kept as words, and the regex after =~ is read as one word up to a
+ * blank outside parentheses, so ( ) and | in it need no quoting.
+ * Returns the N_COND node, 0 on failure.
+ */
+static uint32_t parse_cond(plan_t *plan, lexer_t *lx)
+{
+    static const char *ops[] = {NULL, NULL, NULL, NULL, NULL, "&&", "||", NULL, "(", ")"};
+    uint32_t first = plan->n_words;
+    const char *t = lx->text;
+
+    for (lex(lx); !is_word(lx, "]]"); lex(lx))
+    {
+        /* a line may break inside the condition */
+        if (lx->type == T_NEWLINE)
+        {
+            continue;
+        }
+        /* if the condition is not closed, or holds ; & or | */
+        if (lx->type != T_WORD && ops[lx->type] == NULL)
+        {
+            return syntax_error(lx);
+        }
+        if (lx->type != T_WORD)
+        {
+            if (add_word(plan, ops[lx->type], strlen(ops[lx->type])) == -1)
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (add_word(plan, t + lx->start, lx->i - lx->start) == -1)
+        {
+            return 0;
+        }
+        if (is_word(lx, "=~"))
+        {
+            size_t i = lx->i;
+            int depth = 0;
+
+            while (i < lx->len && (t[i] == ' ' || t[i] == '\t'))
+            {
+                i++;
+            }
+            lx->start = i;
+            while (i < lx->len && t[i] != '\n' && (depth || !strchr(" \t;&", t[i])))
+            {
+                if (t[i] == '\'' || t[i] == '"' || t[i] == '\\')
+                {
+                    i = t[i] == '\\' ? i + 2 : plan_skip(t, lx->len, i + 1, t[i], &lx->more) + 1;
+                    continue;
+                }
+                depth += (t[i] == '(') - (t[i] == ')');
+                i++;
+            }
+            /* if the regex is missing or unterminated */
+            if (i == lx->start || i > lx->len || lx->more)
+            {
+                lx->i = lx->len;
+                lx->type = T_END;
+                return syntax_error(lx);
+            }
+            if (add_word(plan, t + lx->start, i - lx->start) == -1)
+            {
+                return 0;
+            }
+            lx->i = i;
+        }
+    }
+    /* if the condition is empty */
+    if (plan->n_words == first)
+    {
+        return syntax_error(lx);
+    }
+    lex(lx);
+    return add_node(plan, N_COND, first, plan->n_words - first);
+}
+
+/*
+ * Function: parse_here
+ * Parses a here-document, "<< word" or "<<- word", whose text is the lines
+ * after the current one up to a line holding only the word; <<- strips the
+ * tabs that start each line. Adds the words "<<" and the text. If the word
+ * has quotes, the text is escaped, so expansion leaves it as it is. A
+ * here-string, "<<< word", is added as "<<<" and the word. The word may
+ * be written right after the operator.
+ * Returns 0 on success, -1 on failure.
+ */
+static int parse_here(plan_t *plan, lexer_t *lx)
+{
+    const char *t = lx->text;
+    int third = lx->i - lx->start > 2 ? t[lx->start + 2] : 0;
+    size_t op = third == '<' || third == '-' ? 3 : 2;
+    int strip = third == '-';
+    int quoted;
+    size_t start;   /* offset of the text */
+    size_t end;     /* offset of the line ending it */
+    size_t next;    /* offset after that line */
+    size_t n = 0;
+    char *delim;
+    char *body;
+    int r;
+
+    /* if the word is not written right after the operator, and is missing */
+    if (lx->i - lx->start > op)
+    {
+        lx->start += op;
+    }
+    else if (lex(lx) != T_WORD)
+    {
+        syntax_error(lx);
+        return -1;
+    }
+    /* a here-string is only split off its operator */
+    if (op == 3 && !strip)
+    {
+        if (add_word(plan, "<<<", 3) == -1 || add_word(plan, t + lx->start, lx->i - lx->start) == -1)
+        {
+            return -1;
+        }
+        lex(lx);
+        return 0;
+    }
+    quoted = memchr(t + lx->start, '\'', lx->i - lx->start) || memchr(t + lx->start, '"', lx->i - lx->start) ||
+             memchr(t + lx->start, '\\', lx->i - lx->start);
+    /* if malloc fails */
+    if ((delim = malloc(lx->i - lx->start + 1)) == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = lx->start; i < lx->i; i++)
+    {
+        if (t[i] == '\\' && i + 1 < lx->i)
+        {
+            delim[n++] = t[++i];
+        }
+        else if (t[i] != '\'' && t[i] != '"')
+        {
+            delim[n++] = t[i];
+        }
+    }
+
+    /* the text starts after the current line, or after the here-documents before it */
+    start = lx->here;
+    if (!start)
+    {
+        const char *nl = memchr(t + lx->i, '\n', lx->len - lx->i);
+
+        start = nl != NULL ? (size_t)(nl - t) + 1 : lx->len;
+    }
+    for (end = start; ; end = next)
+    {
+        const char *nl;
+        size_t k = end;
+
+        /* if input ends before the word does, the caller may supply more */
+        if (end >= lx->len)
+        {
+            free(delim);
+            lx->more = 1;
+            return -1;
+        }
+        nl = memchr(t + end, '\n', lx->len - end);
+        next = nl != NULL ? (size_t)(nl - t) + 1 : lx->len;
+        while (strip && k < next && t[k] == '\t')
+        {
+            k++;
+        }
+        if (next - (nl != NULL) - k == n && !memcmp(t + k, delim, n))
+        {
+            break;
+        }
+    }
+    free(delim);
+
+    /* if malloc fails */
+    if ((body = malloc(2 * (end - start) + 1)) == NULL)
+    {
+        return -1;
+    }
+    n = 0;
+    for (size_t i = start; i < end; i++)
+    {
+        /* if the line starts with tabs to strip */
+        if (strip && (i == start || t[i - 1] == '\n'))
+        {
+            while (i < end && t[i] == '\t')
+            {
+                i++;
+            }
+            if (i == end)
+            {
+                break;
+            }
+        }
+        if (quoted && strchr("\\$`", t[i]))
+        {
+            body[n++] = '\\';
+        }
+        body[n++] = t[i];
+    }
+    r = add_word(plan, "<<", 2) == -1 || add_word(plan, body, n) == -1 ? -1 : 0;
+    free(body);
+    lx->here = next;
+    lex(lx);
+    return r;
+}
+
+/*
+ * Function: parse_redirs
+ * Parses the redirections written after a compound command, as in
+ * "done < file". Their words make an N_CMD node that is never run, kept
+ * with the command in an N_REDIR node.
+ * Returns the N_REDIR node, node itself if no redirection follows, 0 on
+ * failure or if node is 0.
+ */
+static uint32_t parse_redirs(plan_t *plan, lexer_t *lx, uint32_t node)
+{
+    uint32_t first = plan->n_words;
+    uint32_t cmd;
+
+    while (node && (is_word(lx, "<") || is_word(lx, ">") || is_word(lx, ">>") ||
+                    (lx->type == T_WORD && lx->i - lx->start >= 2 && !strncmp(lx->text + lx->start, "<<", 2))))
+    {
+        /* if the word starts a here-document or here-string, which parse_here reads past */
+        if (lx->i - lx->start >= 2 && !strncmp(lx->text + lx->start, "<<", 2))
+        {
+            if (parse_here(plan, lx) == -1)
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (add_word(plan, lx->text + lx->start, lx->i - lx->start) == -1)
+        {
+            return 0;
+        }
+        /* if the file is missing */
+        if (lex(lx) != T_WORD)
+        {
+            return syntax_error(lx);
+        }
+        if (add_word(plan, lx->text + lx->start, lx->i - lx->start) == -1)
+        {
+            return 0;
+        }
+        lex(lx);
+    }
+    if (!node || plan->n_words == first)
+    {
+        return node;
+    }
+    if ((cmd = add_node(plan, N_CMD, first, plan->n_words - first)) == 0)
+    {
+        return 0;
+    }
+    return add_node(plan, N_REDIR, node, cmd);
+}
+
+/*
+ * Function: parse_cmd
+ * Parses a loop, a for, an if, a conditional, an arithmetic command, the words of a simple
+ * command, or a function definition. The compound commands may be followed by
+ * redirections.
+ * Returns its node, 0 on failure.
+ */
+static uint32_t parse_cmd(plan_t *plan, lexer_t *lx)
+{
+    uint32_t first = plan->n_words;
+
+    if (is_word(lx, "while") || is_word(lx, "until"))
+    {
+        return parse_redirs(plan, lx, parse_loop(plan, lx));
+    }
+    if (is_word(lx, "if"))
+    {
+        return parse_redirs(plan, lx, parse_if(plan, lx));
+    }
+    if (is_word(lx, "for"))
+    {
+        return parse_redirs(plan, lx, parse_for(plan, lx));
+    }
+    if (is_word(lx, "[["))
+    {
+        return parse_redirs(plan, lx, parse_cond(plan, lx));
+    }
+    if (lx->type == T_LPAREN && lx->i < lx->len && lx->text[lx->i] == '(')
+    {
+        return parse_redirs(plan, lx, parse_arith(plan, lx));
+    }
+    /* if command does not start with a word, or with a reserved word out of place */
+    if (lx->type != T_WORD || is_reserved(lx))
+    {
+        return syntax_error(lx);
+    }
+    while (lx->type == T_WORD)
+    {
+        /* if the word starts a here-document or here-string, which parse_here reads past */
+        if (lx->i - lx->start >= 2 && !strncmp(lx->text + lx->start, "<<", 2))
+        {
+            if (parse_here(plan, lx) == -1)
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (add_word(plan, lx->text + lx->start, lx->i - lx->start) == -1)
+        {
+            return 0;
+        }
+        lex(lx);
+    }
+    /* if first word names a function being defined */
+    if (lx->type == T_LPAREN && plan->n_words == first + 1)
+    {
+        return parse_func(plan, lx, first);
+    }
+    return add_node(plan, N_CMD, first, plan->n_words - first);
+}
+
+/*
+ * Function: parse_and_or
+ * Parses commands joined by && and ||, which group to the left.
+ * Returns the list's node, 0 on failure.
+ */
+static uint32_t parse_and_or(plan_t *plan, lexer_t *lx)
+{
+    uint32_t left;
+    uint32_t right;
+    uint32_t type;
+
+    if ((left = parse_cmd(plan, lx)) == 0)
+    {
+        return 0;
+    }
+    while (lx->type == T_AND || lx->type == T_OR)
+    {
+        type = lx->type == T_AND ? N_AND : N_OR;
+        /* a line may break after an operator */
+        while (lex(lx) == T_NEWLINE)
+        {
+        }
+        if ((right = parse_cmd(plan, lx)) == 0 || (left = add_node(plan, type, left, right)) == 0)
+        {
+            return 0;
+        }
+    }
+    return left;
+}
+
+/*
+ * Function: parse_seq
+ * Parses a sequence of and-or lists, ended by ; & or a line break, up to the
+ * end of input or a reserved word that closes a compound command. A list
+ * ended by & must be a single command, which gets a trailing "&" word so
+ * fork_and_exec runs it in the background.
+ * Sets *first to the first N_SEQ node, 0 if the sequence is empty.
+ * Returns 0 on success, -1 on failure.
+ */
+static int parse_seq(plan_t *plan, lexer_t *lx, uint32_t *first)
+{
+    uint32_t last = 0; /* last N_SEQ node */
+    uint32_t list;
+    uint32_t seq;
+
+    *first = 0;
+    while (lx->type != T_END && !is_reserved(lx))
+    {
+        /* if line is blank */
+        if (lx->type == T_NEWLINE)
+        {
+            lex(lx);
+            continue;
+        }
+        if ((list = parse_and_or(plan, lx)) == 0)
+        {
+            return -1;
+        }
+        if (lx->type == T_AMP)
+        {
+            /* if a whole and-or list is put in the background */
+            if (plan->nodes[list].type != N_CMD)
+            {
+                fprintf(stderr, "%s\n", "SYNTAX ERROR : Only single commands can run in the background.");
+                lx->error = 1;
+                return -1;
+            }
+            /* the command's words are the last ones in the plan */
+            if (add_word(plan, "&", 1) == -1)
+            {
+                return -1;
+            }
+            plan->nodes[list].b++;
+        }
+        else if (lx->type != T_SEMI && lx->type != T_NEWLINE && lx->type != T_END)
+        {
+            syntax_error(lx);
+            return -1;
+        }
+        if ((seq = add_node(plan, N_SEQ, list, 0)) == 0)
+        {
+            return -1;
+        }
+        if (last)
+        {
+            plan->nodes[last].b = seq;
+        }
+        else
+        {
+            *first = seq;
+        }
+        last = seq;
+        if (lx->type != T_END)
+        {
+            lex(lx);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: plan_parse
+ * Parses shell input into a sequence of and-or lists.
+ *
+ * text : pointer to input
+ * len : length of input
+ */
+plan_t *plan_parse(const char *text, size_t len)
+{
+    plan_t *plan;
+    lexer_t lx;
+
+    /* if calloc fails */
+    if ((plan = calloc(1, sizeof(plan_t))) == NULL)
+    {
+        return NULL;
+    }
+    /* if reserving nodes[0] fails */
+    add_node(plan, N_NONE, 0, 0);
+    if (plan->n_nodes != 1)
+    {
+        plan_free(plan);
+        return NULL;
+    }
+
+    memset(&lx, 0, sizeof(lx));
+    lx.text = text;
+    lx.len = len;
+    lex(&lx);
+    /* if a reserved word closes nothing */
+    if (parse_seq(plan, &lx, &plan->root) == 0 && lx.type != T_END)
+    {
+        syntax_error(&lx);
+    }
+
+    /* if parsing stopped early */
+    if (lx.type != T_END || lx.error || lx.more)
+    {
+        plan_free(plan);
+        errno = lx.error ? EINVAL : lx.more ? EAGAIN : ENOMEM;
+        return NULL;
+    }
+    return plan;
+}
+
+/*
+ * Function: plan_cache_dir
+ * Builds the path of the shell's cache directory ($XDG_CACHE_HOME/33sh or
+ * ~/.cache/33sh), or of sub within it, creating them if needed.
+ * Returns 0 on success, -1 on failure.
+ *
+ * sub : subdirectory, NULL for the cache directory itself
+ * dir : buffer for the path
+ * n : size of dir
+ */
+int plan_cache_dir(const char *sub, char *dir, size_t n)
+{
+    char *base = getenv("XDG_CACHE_HOME");
+    size_t used;
+    int len;
+
+    if (base != NULL && *base)
+    {
+        len = snprintf(dir, n, "%s", base);
+    }
+    else if ((base = getenv("HOME")) != NULL && *base)
+    {
+        len = snprintf(dir, n, "%s/.cache", base);
+    }
+    else
+    {
+        return -1;
+    }
+    /* if cache directory can not be created */
+    if (len < 0 || (size_t)len >= n - sizeof("/33sh") ||
+        (mkdir(dir, 0700) == -1 && errno != EEXIST) ||
+        (strcat(dir, "/33sh"), mkdir(dir, 0700) == -1 && errno != EEXIST))
+    {
+        return -1;
+    }
+    used = strlen(dir);
+    /* if the subdirectory can not be created */
+    if (sub != NULL && ((len = snprintf(dir + used, n - used, "/%s", sub)) < 0 || (size_t)len >= n - used ||
+                        (mkdir(dir, 0700) == -1 && errno != EEXIST)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function: plan_load_script
+ * Loads the plan of a script, going through the compiled-script cache.
+ *
+ * path : pointer to script path
+ */
+plan_t *plan_load_script(const char *path)
+{
+    char cpath[PATH_MAX];
+    struct stat st;
+    plan_t *plan = NULL;
+    char *text;
+    size_t len = 0;
+    ssize_t r;
+    int fd;
+    int cached;
+
+    /* if script can not be opened */
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+    cached = S_ISREG(st.st_mode) && cache_file(path, cpath, sizeof(cpath)) == 0;
+    /* if the cache has a valid entry, skip parsing */
+    if (cached && (plan = cache_read(cpath, &st)) != NULL)
+    {
+        close(fd);
+        return plan;
+    }
+
+    /* read whole script */
+    if ((text = malloc((size_t)st.st_size + 1)) == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    while ((r = read(fd, text + len, (size_t)st.st_size - len)) > 0)
+    {
+        len += (size_t)r;
+        if (len == (size_t)st.st_size)
+        {
+            break;
+        }
+    }
+    close(fd);
+    if (r == -1)
+    {
+        free(text);
+        return NULL;
+    }
+
+    plan = plan_parse(text, len);
+    free(text);
+    /* if the whole script was read, cache its plan */
+    if (plan != NULL && cached && len == (size_t)st.st_size)
+    {
+        cache_write(cpath, plan, &st);
+    }
+    return plan;
+}
+
+/*
+ * Function: plan_bundle
+ * Writes an executable made of the shell binary at self followed by plan.
+ * The file is written under a temporary name and renamed into place.
+ *
+ * plan : pointer to plan
+ * self : pointer to path of the running shell binary
+ * out : pointer to path of the executable to write
+ */
+int plan_bundle(const plan_t *plan, const char *self, const char *out)
+{
+    char tmp[PATH_MAX];
+    char buf[65536];
+    struct stat st;
+    bundle_end_t end;
+    uint64_t len;
+    uint64_t done = 0;
+    mode_t mask;
+    ssize_t r = 0;
+    int in;
+    int fd;
+    int saved;
+    int ok;
+
+    /* if temporary name does not fit */
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", out) >= (int)sizeof(tmp))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    /* if shell binary can not be opened */
+    if ((in = open(self, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return -1;
+    }
+    if (fstat(in, &st) == -1 || (fd = mkstemp(tmp)) == -1)
+    {
+        saved = errno;
+        close(in);
+        errno = saved;
+        return -1;
+    }
+    /* copy the shell, leaving out a plan bundled into it before */
+    len = bundle_offset(in, (uint64_t)st.st_size);
+    while (done < len && (r = read(in, buf, len - done < sizeof(buf) ? (size_t)(len - done) : sizeof(buf))) > 0)
+    {
+        if (write(fd, buf, (size_t)r) != r)
+        {
+            r = -1;
+            break;
+        }
+        done += (uint64_t)r;
+    }
+    close(in);
+
+    mask = umask(0);
+    umask(mask);
+    memset(&end, 0, sizeof(end));
+    end.offset = (len + BUNDLE_ALIGN - 1) / BUNDLE_ALIGN * BUNDLE_ALIGN;
+    memcpy(end.magic, BUNDLE_END, sizeof(end.magic));
+    /* if the shell binary was cut short */
+    if (r != -1 && done != len)
+    {
+        errno = EIO;
+    }
+    /* pad to the plan's offset, then write plan and trailer */
+    ok = done == len && ftruncate(fd, (off_t)end.offset) == 0 &&
+         lseek(fd, (off_t)end.offset, SEEK_SET) != -1 &&
+         write_plan(fd, BUNDLE_MAGIC, plan, NULL) == 0 &&
+         write(fd, &end, sizeof(end)) == (ssize_t)sizeof(end) && fchmod(fd, 0777 & ~mask) == 0;
+    /* if any step failed */
+    if (!ok || close(fd) == -1 || rename(tmp, out) == -1)
+    {
+        saved = errno;
+        if (!ok)
+        {
+            close(fd);
+        }
+        unlink(tmp);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function: plan_load_bundle
+ * Maps the plan bundled into the executable at path.
+ *
+ * path : pointer to executable path
+ */
+plan_t *plan_load_bundle(const char *path)
+{
+    struct stat st;
+    uint64_t off;
+    size_t len;
+    void *map;
+    plan_t *plan;
+    int fd;
+
+    /* if executable can not be read, or has no plan in it */
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1 ||
+        (off = bundle_offset(fd, (uint64_t)st.st_size)) == (uint64_t)st.st_size)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        errno = ENOENT;
+        return NULL;
+    }
+    len = (size_t)((uint64_t)st.st_size - sizeof(bundle_end_t) - off);
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)off);
+    close(fd);
+    /* if the plan can not be mapped */
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    /* if the plan is from another build or damaged */
+    if (memcmp(((cache_hdr_t *)map)->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) ||
+        !hdr_ok(map, len) || (plan = calloc(1, sizeof(plan_t))) == NULL)
+    {
+        munmap(map, len);
+        errno = ENOEXEC;
+        return NULL;
+    }
+    if ((plan = map_plan(plan, map, len)) == NULL)
+    {
+        errno = ENOEXEC;
+    }
+    return plan;
+}
+
+/*
+ * Function: plan_free
+ * Frees a plan, unmapping it if it came from the cache.
+ *
+ * plan : pointer to plan
+ */
+void plan_free(plan_t *plan)
+{
+    if (plan == NULL)
+    {
+        return;
+    }
+    if (plan->map != NULL)
+    {
+        munmap(plan->map, plan->map_len);
+    }
+    else
+    {
+        free(plan->nodes);
+        free(plan->words);
+        free(plan->strs);
+    }
+    free(plan);
+}
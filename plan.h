@@ -0,0 +1,99 @@
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A plan is the parsed form of shell input. Nodes and words refer to each
+ * other by index and to their text by offset into one string pool, so a plan
+ * holds no pointers and can be written to disk and mapped back in as-is.
+ */
+
+/* node types */
+typedef enum { N_NONE, N_CMD, N_SEQ, N_AND, N_OR, N_FUNC, N_WHILE, N_UNTIL, N_IF, N_THEN, N_ARITH, N_COND, N_FOR,
+               N_REDIR } node_type_t;
+
+/*
+ * N_CMD: a = index of first word,  b = number of words
+ * N_SEQ: a = and-or list,          b = next N_SEQ node (0 ends the sequence)
+ * N_AND, N_OR: a = left side,      b = right side
+ * N_FUNC: a = word holding name,   b = word holding the unparsed body text
+ * N_WHILE, N_UNTIL: a = condition, b = body, both N_SEQ
+ * N_IF: a = condition N_SEQ,       b = N_THEN node
+ * N_THEN: a = N_SEQ run if the condition holds,
+ *         b = N_SEQ run otherwise, an N_IF for elif, or 0
+ * N_ARITH: a = word holding the expression of (( ))
+ * N_COND: a = index of first word of [[ ]], b = number of words
+ * N_FOR: a = N_CMD node of the name and the words of the list, b = body N_SEQ
+ * N_REDIR: a = compound command,  b = N_CMD node of the redirections around it
+ */
+typedef struct plan_node {
+    uint32_t type;
+    uint32_t a;
+    uint32_t b;
+} plan_node_t;
+
+typedef struct plan {
+    plan_node_t *nodes; /* nodes[0] is unused so that 0 can mean "none" */
+    uint32_t *words;    /* string pool offset of each word */
+    char *strs;         /* string pool of NUL terminated words */
+    uint32_t n_nodes;
+    uint32_t n_words;
+    uint32_t n_strs;
+    uint32_t root;      /* first N_SEQ node, 0 if the plan is empty */
+    uint32_t cap_nodes;
+    uint32_t cap_words;
+    uint32_t cap_strs;
+    void *map;          /* mapping the plan lives in, NULL if heap allocated */
+    size_t map_len;
+} plan_t;
+
+/*
+ * parses len bytes of shell input, returns new plan or NULL on failure
+ * syntax errors are reported on stderr and fail with errno set to EINVAL,
+ * input that ends inside a construct fails silently with errno set to EAGAIN
+ */
+plan_t *plan_parse(const char *text, size_t len);
+
+/*
+ * loads the plan of the script at path
+ * uses the compiled-script cache when it holds an entry matching the script's
+ * inode, mtime, size and the shell build, otherwise parses the script and
+ * refreshes the cache. returns NULL (with errno set) if the script can't be read
+ */
+plan_t *plan_load_script(const char *path);
+
+/*
+ * writes to out an executable made of the shell binary at self with plan
+ * bundled into it, returns 0 on success, -1 (with errno set) on failure
+ */
+int plan_bundle(const plan_t *plan, const char *self, const char *out);
+
+/*
+ * maps the plan bundled into the executable at path
+ * returns NULL with errno set to ENOENT if there is none, ENOEXEC if it is
+ * damaged or from another build
+ */
+plan_t *plan_load_bundle(const char *path);
+
+/*
+ * skips text from offset i to the character close, or for close 0 to the end
+ * of the word, stepping over quotes, backslashes and ${...} as the tokenizer
+ * does; returns the offset reached and sets *open if text ends inside one
+ */
+size_t plan_skip(const char *text, size_t len, size_t i, char close, int *open);
+
+/* builds the path of the shell's cache directory, or of sub within it, creating them; returns 0 on success, -1 on failure */
+int plan_cache_dir(const char *sub, char *dir, size_t n);
+
+/* frees a plan returned by plan_parse, plan_load_script or plan_load_bundle */
+void plan_free(plan_t *plan);
+
+/* gets the text of word i of a plan */
+static inline char *plan_word(const plan_t *plan, uint32_t i)
+{
+    return plan->strs + plan->words[i];
+}
+
+#endif  // PLAN_H_
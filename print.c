@@ -0,0 +1,554 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "./capture.h"
+#include "./print.h"
+
+#define PRINT_MIN 256     /* first size of the output buffer */
+#define PRINT_KEEP 65536  /* largest buffer kept between calls */
+
+/* a conversion of a printf format */
+typedef struct spec {
+    int left;   /* - flag */
+    int zero;   /* 0 flag */
+    int plus;   /* + flag */
+    int space;  /* ' ' flag */
+    int alt;    /* # flag */
+    long width;
+    long prec;  /* -1 if not given */
+} spec_t;
+
+static char *buf;   /* output of the running command */
+static size_t len;
+static size_t cap;
+static int failed;  /* set if the buffer could not grow */
+
+/* Helper Functions */
+
+/*
+ * Function: reserve
+ * Makes room for n more bytes, doubling the buffer as needed.
+ * Returns 0 on success, -1 on failure.
+ */
+static int reserve(size_t n)
+{
+    size_t size = cap ? cap : PRINT_MIN;
+    char *p;
+
+    if (len + n <= cap)
+    {
+        return 0;
+    }
+    while (size < len + n)
+    {
+        size *= 2;
+    }
+    /* if realloc fails */
+    if (failed || (p = realloc(buf, size)) == NULL)
+    {
+        failed = 1;
+        return -1;
+    }
+    buf = p;
+    cap = size;
+    return 0;
+}
+
+/*
+ * Function: put
+ * Appends n bytes to the output.
+ */
+static void put(const char *s, size_t n)
+{
+    if (n && reserve(n) == 0)
+    {
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+}
+
+/*
+ * Function: fill
+ * Appends n copies of c to the output.
+ */
+static void fill(char c, long n)
+{
+    if (n > 0 && reserve((size_t)n) == 0)
+    {
+        memset(buf + len, c, (size_t)n);
+        len += (size_t)n;
+    }
+}
+
+/*
+ * Function: flush
+ * Writes the output and empties the buffer, freeing it if it grew large.
+ * Returns 0 on success, 1 after reporting a failure.
+ */
+static int flush(const char *who)
+{
+    size_t off = 0;
+    ssize_t w;
+    int r = 0;
+
+    if (failed)
+    {
+        errno = ENOMEM;
+        r = -1;
+    }
+    /* if a substitution captures stdout, its stream takes the output */
+    else if (capture_current != NULL)
+    {
+        r = len && fwrite(buf, 1, len, stdout) != len ? -1 : 0;
+    }
+    else
+    {
+        fflush(stdout); /* job notices printed so far come first */
+        while (off < len)
+        {
+            if ((w = write(STDOUT_FILENO, buf + off, len - off)) > 0)
+            {
+                off += (size_t)w;
+            }
+            /* if write fails, other than by a signal */
+            else if (errno != EINTR)
+            {
+                r = -1;
+                break;
+            }
+        }
+    }
+    if (r == -1)
+    {
+        perror(who);
+    }
+    len = 0;
+    failed = 0;
+    if (cap > PRINT_KEEP)
+    {
+        free(buf);
+        buf = NULL;
+        cap = 0;
+    }
+    return r == -1;
+}
+
+/*
+ * Function: hex
+ * Gets the value of a hexadecimal digit, -1 if c is none.
+ */
+static int hex(char c)
+{
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+/*
+ * Function: escape
+ * Appends the character of the backslash escape at s, s[0] being the
+ * character after the backslash. In echo -e and %b an octal escape is
+ * written \0NNN and \c ends the output; in a format it is \NNN. An unknown
+ * escape is kept as it is. Returns the number of characters used after
+ * the backslash, -1 for \c.
+ */
+static int escape(const char *s, int b)
+{
+    static const char from[] = "abefnrtv\\\"'";
+    static const char to[] = "\a\b\033\f\n\r\t\v\\\"'";
+    const char *p = *s ? strchr(from, *s) : NULL;
+    int used = 0;
+    int v = 0;
+    char c;
+
+    if (p != NULL && (!b || p - from < 9))
+    {
+        put(to + (p - from), 1);
+        return 1;
+    }
+    if (b && *s == 'c')
+    {
+        return -1;
+    }
+    if (*s >= '0' && *s <= '7')
+    {
+        used = b && *s == '0';
+        for (; used < (b ? 4 : 3) && s[used] >= '0' && s[used] <= '7'; used++)
+        {
+            v = v * 8 + s[used] - '0';
+        }
+        c = (char)v;
+        put(&c, 1);
+        return used;
+    }
+    if (*s == 'x' && hex(s[1]) != -1)
+    {
+        for (used = 1; used < 3 && hex(s[used]) != -1; used++)
+        {
+            v = v * 16 + hex(s[used]);
+        }
+        c = (char)v;
+        put(&c, 1);
+        return used;
+    }
+    put("\\", 1);
+    return 0;
+}
+
+/*
+ * Function: put_escaped
+ * Appends s with its backslash escapes, as echo -e and %b read them.
+ * Returns 1 if \c ended it, 0 otherwise.
+ */
+static int put_escaped(const char *s)
+{
+    int used;
+
+    while (*s)
+    {
+        size_t n = strcspn(s, "\\");
+
+        put(s, n);
+        if (!s[n])
+        {
+            break;
+        }
+        if ((used = escape(s + n + 1, 1)) == -1)
+        {
+            return 1;
+        }
+        s += n + 1 + (size_t)used;
+    }
+    return 0;
+}
+
+/*
+ * Function: put_field
+ * Pads the output from start, a conversion already in the buffer, to the
+ * width it asks for.
+ */
+static void put_field(const spec_t *sp, size_t start)
+{
+    long pad = sp->width - (long)(len - start);
+
+    if (pad <= 0)
+    {
+        return;
+    }
+    if (sp->left)
+    {
+        fill(' ', pad);
+    }
+    else if (reserve((size_t)pad) == 0)
+    {
+        memmove(buf + start + pad, buf + start, len - start);
+        memset(buf + start, ' ', (size_t)pad);
+        len += (size_t)pad;
+    }
+}
+
+/*
+ * Function: number
+ * Reads the argument of a numeric conversion: an integer in C syntax, or
+ * the code of the character after a leading quote. A missing argument is
+ * 0. Sets *bad after reporting an invalid one.
+ */
+static int64_t number(const char *arg, int *bad)
+{
+    char *end;
+    int64_t v;
+
+    if (arg == NULL || !*arg)
+    {
+        return 0;
+    }
+    if (*arg == '\'' || *arg == '"')
+    {
+        return (unsigned char)arg[1];
+    }
+    errno = 0;
+    v = strtoll(arg, &end, 0);
+    /* if the argument is not all a number */
+    if (end == arg || *end || errno)
+    {
+        fprintf(stderr, "ERROR : printf: %s: invalid number\n", arg);
+        *bad = 1;
+    }
+    return v;
+}
+
+/*
+ * Function: put_number
+ * Appends an integer conversion, d i u o x or X, of value v.
+ */
+static void put_number(const spec_t *sp, char conv, int64_t v)
+{
+    char digits[32];
+    char *d = digits + sizeof(digits);
+    const char *sign = "";
+    const char *prefix = "";
+    int base = conv == 'o' ? 8 : conv == 'x' || conv == 'X' ? 16 : 10;
+    uint64_t u = (uint64_t)v;
+    long n;
+    long zeros;
+    long body;
+
+    if (conv == 'd' || conv == 'i')
+    {
+        u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+        sign = v < 0 ? "-" : sp->plus ? "+" : sp->space ? " " : "";
+    }
+    for (uint64_t k = u; k || (d == digits + sizeof(digits) && sp->prec); k /= (uint64_t)base)
+    {
+        *--d = (conv == 'X' ? "0123456789ABCDEF" : "0123456789abcdef")[k % (uint64_t)base];
+    }
+    n = (long)(digits + sizeof(digits) - d);
+    zeros = sp->prec > n ? sp->prec - n : 0;
+    if (sp->alt && base == 16 && u)
+    {
+        prefix = conv == 'X' ? "0X" : "0x";
+    }
+    else if (sp->alt && base == 8 && !zeros && (!n || *d != '0'))
+    {
+        zeros = 1;
+    }
+    body = (long)(strlen(sign) + strlen(prefix)) + zeros + n;
+    if (!sp->left && !(sp->zero && sp->prec < 0))
+    {
+        fill(' ', sp->width - body);
+    }
+    put(sign, strlen(sign));
+    put(prefix, strlen(prefix));
+    if (!sp->left && sp->zero && sp->prec < 0)
+    {
+        fill('0', sp->width - body);
+    }
+    fill('0', zeros);
+    put(d, (size_t)n);
+    if (sp->left)
+    {
+        fill(' ', sp->width - body);
+    }
+}
+
+/*
+ * Function: read_spec
+ * Reads the flags, width and precision of a conversion, taking * from the
+ * arguments. Returns the character after them.
+ */
+static const char *read_spec(const char *f, spec_t *sp, char ***args, int *bad)
+{
+    memset(sp, 0, sizeof(spec_t));
+    sp->prec = -1;
+    for (;; f++)
+    {
+        if (*f == '-')
+        {
+            sp->left = 1;
+        }
+        else if (*f == '0')
+        {
+            sp->zero = 1;
+        }
+        else if (*f == '+')
+        {
+            sp->plus = 1;
+        }
+        else if (*f == ' ')
+        {
+            sp->space = 1;
+        }
+        else if (*f == '#')
+        {
+            sp->alt = 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (*f == '*')
+    {
+        sp->width = (long)number(**args, bad);
+        *args += **args != NULL;
+        f++;
+        /* a negative width from an argument left justifies */
+        if (sp->width < 0)
+        {
+            sp->left = 1;
+            sp->width = -sp->width;
+        }
+    }
+    for (; *f >= '0' && *f <= '9'; f++)
+    {
+        sp->width = sp->width * 10 + *f - '0';
+    }
+    if (*f == '.')
+    {
+        sp->prec = 0;
+        if (*++f == '*')
+        {
+            sp->prec = (long)number(**args, bad);
+            *args += **args != NULL;
+            sp->prec = sp->prec < 0 ? -1 : sp->prec;
+            f++;
+        }
+        for (; *f >= '0' && *f <= '9'; f++)
+        {
+            sp->prec = sp->prec * 10 + *f - '0';
+        }
+    }
+    return f;
+}
+
+/*
+ * Function: format_once
+ * Appends fmt once, taking arguments from *args as conversions use them;
+ * missing ones are empty. Returns 1 if %b met \c, -1 on an invalid
+ * conversion, 0 otherwise.
+ */
+static int format_once(const char *f, char ***args, int *bad)
+{
+    spec_t sp;
+    const char *arg;
+    size_t start;
+    size_t n;
+    int used;
+
+    while (*f)
+    {
+        n = strcspn(f, "\\%");
+        put(f, n);
+        f += n;
+        if (*f == '\\')
+        {
+            used = escape(f + 1, 0);
+            f += 1 + used;
+            continue;
+        }
+        if (!*f)
+        {
+            break;
+        }
+        if (f[1] == '%')
+        {
+            put("%", 1);
+            f += 2;
+            continue;
+        }
+        f = read_spec(f + 1, &sp, args, bad);
+        /* if the conversion is not one printf knows */
+        if (!*f || !strchr("sbcdiuoxX", *f))
+        {
+            fprintf(stderr, "ERROR : printf: %c: invalid format character\n", *f ? *f : '%');
+            return -1;
+        }
+        arg = **args;
+        *args += arg != NULL;
+        start = len;
+        switch (*f)
+        {
+        case 's':
+            n = arg == NULL ? 0 : strlen(arg);
+            put(arg, sp.prec >= 0 && (size_t)sp.prec < n ? (size_t)sp.prec : n);
+            put_field(&sp, start);
+            break;
+        case 'b':
+            used = arg != NULL && put_escaped(arg);
+            if (sp.prec >= 0 && len - start > (size_t)sp.prec)
+            {
+                len = start + (size_t)sp.prec;
+            }
+            put_field(&sp, start);
+            if (used)
+            {
+                return 1;
+            }
+            break;
+        case 'c':
+            put(arg, arg != NULL && *arg);
+            put_field(&sp, start);
+            break;
+        default:
+            put_number(&sp, *f, number(arg, bad));
+        }
+        f++;
+    }
+    return 0;
+}
+
+/*
+ * Function: print_echo
+ * Prints its arguments separated by blanks and ended by a newline. -n
+ * leaves out the newline, -e reads backslash escapes and -E does not.
+ *
+ * argv : pointer to arguments, after the command name
+ */
+int print_echo(char *argv[])
+{
+    int newline = 1;
+    int esc = 0;
+    int k = 0;
+
+    for (; argv[k] != NULL && argv[k][0] == '-' && argv[k][1] && strspn(argv[k] + 1, "neE") == strlen(argv[k] + 1);
+         k++)
+    {
+        for (const char *o = argv[k] + 1; *o; o++)
+        {
+            newline &= *o != 'n';
+            esc = *o == 'e' ? 1 : *o == 'E' ? 0 : esc;
+        }
+    }
+    for (int first = k; argv[k] != NULL; k++)
+    {
+        if (k > first)
+        {
+            put(" ", 1);
+        }
+        if (!esc)
+        {
+            put(argv[k], strlen(argv[k]));
+        }
+        /* if \c ends the output */
+        else if (put_escaped(argv[k]))
+        {
+            newline = 0;
+            break;
+        }
+    }
+    if (newline)
+    {
+        put("\n", 1);
+    }
+    return flush("echo");
+}
+
+/*
+ * Function: print_format
+ * Prints its arguments as a format says, reusing the format for as long
+ * as arguments remain and it takes some.
+ *
+ * argv : pointer to arguments, after the command name
+ */
+int print_format(char *argv[])
+{
+    char **args;
+    char **before;
+    int bad = 0;
+    int r;
+
+    /* if the format is missing */
+    if (argv[0] == NULL)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : printf needs a format.");
+        return 2;
+    }
+    args = argv + 1;
+    do
+    {
+        before = args;
+        r = format_once(argv[0], &args, &bad);
+    } while (!r && *args != NULL && args != before);
+    return flush("printf") || r == -1 || bad;
+}
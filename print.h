@@ -0,0 +1,18 @@
+#ifndef PRINT_H_
+#define PRINT_H_
+
+/*
+ * The echo and printf builtins. Their output is formatted into one buffer
+ * the shell keeps between calls, without stdio, and written out with a
+ * single write once the whole command is formatted. stdout is flushed
+ * first, so job notices printed with printf come out in order; while a
+ * substitution captures stdout the buffer goes to its stream instead.
+ */
+
+/* echo [-neE] args, returns the exit status */
+int print_echo(char *argv[]);
+
+/* printf format args, the format reused while arguments remain, returns the exit status */
+int print_format(char *argv[]);
+
+#endif  // PRINT_H_
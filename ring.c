@@ -0,0 +1,270 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "./ring.h"
+
+#define RING_ENTRIES 256  /* operations submitted per system call */
+#define RING_MIN 4        /* fewest operations worth submitting through the ring */
+
+/* the shell's io_uring, mapped once */
+static struct {
+    int state;                  /* 0 until set up, 1 when usable, -1 if not available */
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned entries;
+    int known[3];               /* set for each RING_ operation the kernel supports */
+} ring;
+
+/* opcode of each RING_ operation */
+static const unsigned char opcodes[3] = {IORING_OP_UNLINKAT, IORING_OP_LINKAT, IORING_OP_MKDIRAT};
+
+/* Helper Functions */
+
+/*
+ * Function: probe
+ * Asks the kernel which of the operations the ring supports. Returns the
+ * number it does, 0 if it can not tell.
+ */
+static int probe()
+{
+    struct io_uring_probe *pr;
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    int n = 0;
+
+    /* if there is no room for the answer */
+    if ((pr = calloc(1, size)) == NULL)
+    {
+        return 0;
+    }
+    /* if the kernel predates probing, it predates these operations too */
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, pr, 256) == 0)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            ring.known[k] = opcodes[k] <= pr->last_op && opcodes[k] < pr->ops_len &&
+                            (pr->ops[opcodes[k]].flags & IO_URING_OP_SUPPORTED);
+            n += ring.known[k];
+        }
+    }
+    free(pr);
+    return n;
+}
+
+/*
+ * Function: setup
+ * Sets up and maps the io_uring, and probes which operations it supports.
+ * Returns 0 on success, -1 if it is not available or supports none of
+ * them, after which it is not tried again.
+ */
+static int setup()
+{
+    struct io_uring_params p;
+    size_t sq_size;
+    size_t cq_size;
+    char *sq;
+    char *cq;
+    void *sqes;
+
+    if (ring.state)
+    {
+        return ring.state == 1 ? 0 : -1;
+    }
+    ring.state = -1;
+    memset(&p, 0, sizeof(p));
+    /* if the kernel or its seccomp policy refuses io_uring; its descriptor is close-on-exec */
+    if ((ring.fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &p)) == -1)
+    {
+        return -1;
+    }
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+    }
+    sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    }
+    sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring.fd, IORING_OFF_SQES);
+    /* if a ring can not be mapped, or runs none of the operations; what was mapped goes with the process */
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED || !probe())
+    {
+        close(ring.fd);
+        return -1;
+    }
+    ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring.sqes = sqes;
+    ring.entries = p.sq_entries;
+    ring.state = 1;
+    return 0;
+}
+
+/*
+ * Function: run_one
+ * Runs an operation with its own system call.
+ */
+static void run_one(ring_op_t *o)
+{
+    int r;
+
+    switch (o->op)
+    {
+    case RING_UNLINK:
+        r = unlinkat(AT_FDCWD, o->path, o->flags);
+        break;
+    case RING_LINK:
+        r = linkat(AT_FDCWD, o->target, AT_FDCWD, o->path, o->flags);
+        break;
+    default:
+        r = mkdirat(AT_FDCWD, o->path, o->mode);
+        break;
+    }
+    o->err = r == -1 ? errno : 0;
+}
+
+/*
+ * Function: fill
+ * Fills the submission entry of an operation.
+ */
+static void fill(struct io_uring_sqe *sqe, const ring_op_t *o, size_t index)
+{
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)o->path;
+    sqe->user_data = index;
+    sqe->opcode = opcodes[o->op];
+    switch (o->op)
+    {
+    case RING_UNLINK:
+        sqe->unlink_flags = (unsigned)o->flags;
+        break;
+    case RING_LINK:
+        sqe->addr = (uintptr_t)o->target;
+        sqe->len = (unsigned)AT_FDCWD;
+        sqe->addr2 = (uintptr_t)o->path;
+        sqe->hardlink_flags = (unsigned)o->flags;
+        break;
+    default:
+        sqe->len = o->mode;
+        break;
+    }
+}
+
+/*
+ * Function: submit
+ * Submits n operations, no more than the ring holds, and waits for them
+ * all. Returns 0 on success, -1 if they could not be submitted.
+ */
+static int submit(ring_op_t ops[], size_t first, unsigned n)
+{
+    unsigned tail = *ring.sq_tail;
+    unsigned head;
+    long r;
+
+    for (unsigned k = 0; k < n; k++)
+    {
+        unsigned slot = (tail + k) & *ring.sq_mask;
+
+        fill(&ring.sqes[slot], &ops[first + k], first + k);
+        ring.sq_array[slot] = slot;
+    }
+    __atomic_store_n(ring.sq_tail, tail + n, __ATOMIC_RELEASE);
+    /* if interrupted before anything was taken, submit again */
+    while ((r = syscall(__NR_io_uring_enter, ring.fd, n, n, IORING_ENTER_GETEVENTS, NULL, 0)) == -1 &&
+           errno == EINTR && __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) == tail)
+    {
+    }
+    /* if nothing was taken, the entries are withdrawn */
+    if (r == -1 && __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) == tail)
+    {
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        return -1;
+    }
+    /* reap the completions, submitting what was left and waiting for what still runs */
+    for (unsigned done = 0; done < n;)
+    {
+        head = *ring.cq_head;
+        while (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+        {
+            syscall(__NR_io_uring_enter, ring.fd, tail + n - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE), 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+        }
+        do
+        {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            ring_op_t *o = &ops[cqe->user_data];
+
+            o->err = cqe->res < 0 ? -cqe->res : 0;
+            head++;
+            done++;
+        } while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE));
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/*
+ * Function: ring_run
+ * Runs n operations, through the io_uring when there are enough of them
+ * and it is available, one by one otherwise. An operation the kernel's
+ * io_uring does not support is always run on its own.
+ *
+ * ops : operations, each given its err
+ * n : number of operations
+ */
+void ring_run(ring_op_t ops[], size_t n)
+{
+    size_t i = 0;
+    unsigned k;
+
+    if (n >= RING_MIN && setup() == 0)
+    {
+        for (; i < n; i += k)
+        {
+            /* a run of supported operations goes through the ring, as many as it holds */
+            for (k = 0; i + k < n && k < ring.entries && ring.known[ops[i + k].op]; k++)
+            {
+            }
+            if (!k)
+            {
+                run_one(&ops[i]);
+                k = 1;
+            }
+            /* if the ring fails, the rest are run one by one */
+            else if (submit(ops, i, k) == -1)
+            {
+                break;
+            }
+        }
+    }
+    for (; i < n; i++)
+    {
+        run_one(&ops[i]);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * File system operations run in batches for the rm, ln and mkdir builtins.
+ * A batch of a few operations or more is submitted through an io_uring
+ * set up the first time it is needed, so a long argument list costs a
+ * system call per few hundred operations rather than one per path. The
+ * operations the kernel supports are probed when the ring is set up; where
+ * io_uring, or one of its operations, is not available the operations are
+ * run one by one instead. Operations of a batch may run in any order,
+ * so a batch should not name a path twice.
+ */
+
+#define RING_UNLINK 0  /* unlinkat(AT_FDCWD, path, flags) */
+#define RING_LINK 1    /* linkat(AT_FDCWD, target, AT_FDCWD, path, flags) */
+#define RING_MKDIR 2   /* mkdirat(AT_FDCWD, path, mode) */
+
+/* an operation of a batch */
+typedef struct ring_op {
+    int op;             /* RING_UNLINK, RING_LINK or RING_MKDIR */
+    char *path;         /* path removed, linked or made */
+    char *target;       /* existing file to link, for RING_LINK */
+    int flags;          /* flags of unlinkat or linkat */
+    mode_t mode;        /* mode of a new directory */
+    int err;            /* set to 0 on success, to the errno value on failure */
+} ring_op_t;
+
+/* runs n operations, setting the err of each */
+void ring_run(ring_op_t ops[], size_t n);
+
+#endif  // RING_H_
@@ -0,0 +1,151 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "./meta.h"
+#include "./ring.h"
+#include "./rmtree.h"
+#include "./walk.h"
+
+/* Helper Functions */
+
+/*
+ * Function: remove_entry
+ * Removes an entry of a directory at once unless it is a directory, which
+ * d_type may not tell but unlinkat does. Returns 1 to walk into it.
+ */
+static int remove_entry(walk_t *w, walk_dir_t *d, const char *name, unsigned char type)
+{
+    if (type != DT_DIR && unlinkat(d->fd, name, 0) == 0)
+    {
+        return 0;
+    }
+    /* if the file can not be removed */
+    if (type != DT_DIR && errno != EISDIR)
+    {
+        walk_fail(w, d, name, errno);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Function: remove_dir
+ * Removes a directory once it is empty, unless something below it was kept.
+ */
+static void remove_dir(walk_t *w, walk_dir_t *d)
+{
+    int at;
+
+    if (__atomic_load_n(&d->kept, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    /* if the emptied directory can not be removed */
+    if ((at = d->parent != NULL ? walk_get(d->parent, 0) : AT_FDCWD) == -1 ||
+        unlinkat(at, d->name, AT_REMOVEDIR) == -1)
+    {
+        walk_fail(w, d->parent, d->name, errno);
+    }
+    walk_put(d->parent, 0, at);
+}
+
+/*
+ * Function: remove_tree
+ * Removes a directory and everything below it.
+ * Returns 0 on success, -1 if anything could not be removed.
+ */
+static int remove_tree(const char *path, int force)
+{
+    walk_t w = {"rm", force, NULL, NULL, remove_entry, remove_dir, 0};
+
+    return walk_tree(&w, path);
+}
+
+/*
+ * Function: dot
+ * Checks whether the last component of a path is . or .., or the path is
+ * the root, which rm -r refuses.
+ */
+static int dot(const char *path)
+{
+    size_t n = strlen(path);
+    size_t start;
+
+    while (n > 1 && path[n - 1] == '/')
+    {
+        n--;
+    }
+    for (start = n; start && path[start - 1] != '/'; start--)
+    {
+    }
+    return (n == 1 && path[0] == '/') || (n - start == 1 && path[start] == '.') ||
+           (n - start == 2 && path[start] == '.' && path[start + 1] == '.');
+}
+
+/*
+ * Function: rmtree_paths
+ * Removes files, and with recursive directories and what they hold. The
+ * paths are first unlinked in one batch; directories among them are then
+ * removed in turn, and errors reported in the order of the paths. With
+ * force a path that does not exist is not an error.
+ *
+ * paths : pointer to NULL terminated paths
+ * recursive : set to remove directories
+ * force : set to pass over paths that do not exist
+ */
+int rmtree_paths(char *paths[], int recursive, int force)
+{
+    ring_op_t *ops;
+    size_t n = 0;
+    int status = 0;
+
+    while (paths[n] != NULL)
+    {
+        n++;
+    }
+    /* if calloc fails */
+    if ((ops = calloc(n, sizeof(ring_op_t))) == NULL)
+    {
+        perror("rm");
+        return 1;
+    }
+    /* unlinking without AT_REMOVEDIR leaves ., .. and / alone, so they can go too */
+    for (size_t i = 0; i < n; i++)
+    {
+        ops[i].op = RING_UNLINK;
+        ops[i].path = paths[i];
+    }
+    ring_run(ops, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *path = paths[i];
+        int err = ops[i].err;
+
+        if (err == 0)
+        {
+            meta_bump(path);
+        }
+        else if (recursive && dot(path))
+        {
+            fprintf(stderr, "rm: %s: refusing to remove . .. or /\n", path);
+            status = 1;
+        }
+        /* if it is a directory to remove with what it holds */
+        else if (err == EISDIR && recursive)
+        {
+            status |= remove_tree(path, force) == -1;
+            meta_bump(NULL); /* directories below it may be watched */
+        }
+        else if (err != ENOENT || !force)
+        {
+            fprintf(stderr, "rm: %s: %s\n", path, strerror(err));
+            status = 1;
+        }
+    }
+    free(ops);
+    return status;
+}
@@ -0,0 +1,14 @@
+#ifndef RMTREE_H_
+#define RMTREE_H_
+
+/*
+ * Removal of files and directory trees for the rm builtin. The paths are
+ * unlinked in one batch; a directory among them is then removed with a
+ * parallel walk, each file unlinked relative to its directory's
+ * descriptor and each directory removed by the thread that empties it.
+ */
+
+/* removes each path, directories with their contents if recursive, returns the exit status */
+int rmtree_paths(char *paths[], int recursive, int force);
+
+#endif  // RMTREE_H_
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Runs the behavioural tests of the shell's own builtins and syntax. Each
+# test NAME.sh in shell_2_tests/builtin_tests is run by the shell as a script,
+# in a directory of its own, and its stdout compared with NAME.out. NAME.in,
+# if there is one, is piped to the shell's stdin.
+# usage: ./run_builtin_tests.sh [-v] [names...]
+SUITE=$(pwd)/shell_2_tests/builtin_tests
+export SH=${SH:-$(pwd)/33noprompt}
+VERBOSE=0
+if [ "$1" = "-v" ]; then
+    VERBOSE=1
+    shift
+fi
+if [ $# -eq 0 ]; then
+    set -- $(cd "$SUITE" && ls *.sh | sed 's/\.sh$//')
+fi
+
+# a low descriptor limit, so a builtin holding too many open shows
+ulimit -n 256
+failed=0
+for name in "$@"; do
+    dir=$(mktemp -d)
+    # the shell's caches live in the test's directory, so every run starts cold
+    if [ -e "$SUITE/$name.in" ]; then
+        (cd "$dir" && cat "$SUITE/$name.in" | XDG_CACHE_HOME="$dir/.cache" timeout 60 "$SH" "$SUITE/$name.sh") \
+            > "$dir/.stdout" 2> "$dir/.stderr"
+    else
+        (cd "$dir" && XDG_CACHE_HOME="$dir/.cache" timeout 60 "$SH" "$SUITE/$name.sh" < /dev/null) \
+            > "$dir/.stdout" 2> "$dir/.stderr"
+    fi
+    if cmp -s "$dir/.stdout" "$SUITE/$name.out"; then
+        echo "$name: PASS"
+    else
+        echo "$name: FAIL"
+        failed=$((failed + 1))
+        if [ $VERBOSE -eq 1 ]; then
+            diff "$SUITE/$name.out" "$dir/.stdout"
+            sed 's/^/stderr: /' "$dir/.stderr"
+        fi
+    fi
+    rm -rf "$dir"
+done
+echo "$(($# - failed)) of $# tests passed"
+[ $failed -eq 0 ]
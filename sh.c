@@ -1,50 +1,210 @@
+#define _GNU_SOURCE /* pipe2 */
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include "./arith.h"
+#include "./builtins.h"
+#include "./capture.h"
+#include "./cond.h"
+#include "./copy.h"
+#include "./defs.h"
+#include "./expand.h"
+#include "./glob.h"
+#include "./here.h"
+#include "./input.h"
 #include "./jobs.h"
+#include "./memo.h"
+#include "./meta.h"
+#include "./plan.h"
+#include "./print.h"
+#include "./ring.h"
+#include "./rmtree.h"
+#include "./timer.h"
+#include "./vars.h"
+#include "./watch.h"
 
 /* Global Variables */
 #define MAX_SIZE 1024 /* maximum size of buffer */
+#define MAX_DEPTH 1000 /* maximum depth of nested function calls */
+#define MAX_JOBS 64    /* most batches of a command run at once */
+#define ARG_SLACK 2048 /* bytes of the argument limit left unused, as xargs does */
 job_list_t *j_list; /* shell job list */
 int j_cnt = 1;
+int job_control;    /* set when stdin is a terminal */
+int last_status;    /* exit status of the last command */
+char *pending;      /* lines of an unfinished construct, NULL if none */
+int func_depth;     /* number of function calls in progress */
+int func_return;    /* set by return until its function call ends */
+int loop_depth;     /* number of loops running in the current function call */
+int loop_jump;      /* number of loops break or continue still has to leave */
+int loop_next;      /* set if the jump is a continue, which resumes the last loop left */
+int subst_depth;    /* number of command substitutions running */
+int subst_exit;     /* set by exit until its command substitution ends */
+int subst_count;    /* number of command substitutions run so far */
+int subst_cwd = -1; /* directory to return to after the running substitution, -1 if unchanged */
+int alias_depth;    /* set while running an expanded alias */
+extern char **environ;
+
+/* fields of a command that ...+ runs in batches, each with the other fields */
+typedef struct batch {
+    int from;       /* first field of the batched word */
+    int to;         /* one past its last field */
+    int jobs;       /* batches run at once */
+} batch_t;
+
+/* a sequence brace in the list of a for loop, stepped through in place */
+typedef struct for_range {
+    range_t r;
+    int at;         /* word of the expanded list it comes before */
+} for_range_t;
 
 /* Function Prototypes */
 void ignore_signals();
 void reap();
 void parse(char *buff);
-void commands(char *toks[]);
-void cd(char *toks[]);
-void ln(char *toks[]);
-void rm(char *toks[]);
-void bg(char *argv[]);
-void fg(char *argv[]);
-void redirection(char *toks[]);
-void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol, char *in_path, char *out_path);
+void parse_error(char *what);
+int run_plan(plan_t *plan);
+int run_node(plan_t *plan, uint32_t n);
+int run_loop(plan_t *plan, plan_node_t *node);
+int run_for(plan_t *plan, plan_node_t *node);
+int for_pass(plan_t *plan, uint32_t body, var_t *var, const char *value, int *status);
+int run_redirect(plan_t *plan, plan_node_t *node);
+int stopped();
+int run_cmd(plan_t *plan, plan_node_t *node);
+int assign(plan_t *plan, uint32_t first, uint32_t n, char *toks[], const batch_t *batch);
+size_t array_word(const char *word);
+int batch_jobs(const char *word);
+size_t arg_limit();
+int run_batches(char *toks[], const batch_t *batch);
+int expand_error(expand_t *ex);
+void run_script(char *path);
+void bundle(int argc, char *argv[]);
+int commands(char *toks[]);
+int function(def_t *def, char *toks[]);
+int expand_alias(def_t *def, char *toks[]);
+int alias(char *toks[]);
+int unalias(char *toks[]);
+int return_cmd(char *toks[]);
+int break_cmd(char *toks[]);
+int source(char *toks[]);
+int exit_cmd(char *toks[]);
+int jobs_cmd(char *toks[]);
+int export(char *toks[]);
+int unset(char *toks[]);
+int declare(char *toks[]);
+int mapfile(char *toks[]);
+int test_cmd(char *toks[]);
+int echo_cmd(char *toks[]);
+int printf_cmd(char *toks[]);
+int read_cmd(char *toks[]);
+char *read_all(int fd, size_t *len);
+void print_quoted(const char *s);
+const builtin_t *builtin_get(const char *name);
+int builtin_redirect(const builtin_t *b, def_t *def, plan_t *plan, uint32_t node, char *toks[]);
+int redirect_fd(int fd, int target, int *saved);
+int cd(char *toks[]);
+int ln(char *toks[]);
+int rm(char *toks[]);
+int cp(char *toks[]);
+int memo(char *toks[]);
+int watch(char *toks[]);
+int sleep_cmd(char *toks[]);
+int timeout_cmd(char *toks[]);
+void make_dirs(char *paths[], size_t n, int parents, int errs[]);
+int mkdir_cmd(char *toks[]);
+int bg(char *argv[]);
+int fg(char *argv[]);
+int redirection(char *toks[]);
+int parse_redirects(char *toks[], int n, char *argv[], char **in_symbol, char **in_path, char **out_symbol,
+                    char **out_path);
+int fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol, char *in_path, char *out_path);
+int track_job(pid_t f, int is_bg, char *path);
+int wait_status(int status);
 void restore_signals();
 
-int main()
+#include "./builtin_table.h"
+
+int main(int argc, char *argv[])
 {
     char buff[MAX_SIZE]; /* buffer of size 1024 */
     ssize_t r;           /* read return value */
+    size_t len = 0;      /* length of an unfinished line held in buffer */
+    char *end;           /* pointer to last line break in buffer */
+    plan_t *plan;        /* pointer to plan bundled into this executable */
 
     j_list = init_job_list();
+    job_control = isatty(STDIN_FILENO);
+    /* if environment can not be imported */
+    if (var_import(environ) == -1)
+    {
+        perror("environ");
+        exit(EXIT_FAILURE); /* exit(1) */
+    }
 
     ignore_signals(); /* ignore signals in parent */
 
+    /* if a script is bundled into this executable, run it and nothing else */
+    if ((plan = plan_load_bundle("/proc/self/exe")) != NULL || errno != ENOENT)
+    {
+        /* if the bundled script is damaged */
+        if (plan == NULL)
+        {
+            perror("bundle");
+            cleanup_job_list(j_list);
+            exit(EXIT_FAILURE); /* exit(1) */
+        }
+        var_set_arg0(argv[0]);
+        var_params(argv + 1, argc - 1);
+        run_plan(plan);
+        plan_free(plan);
+        reap();
+        cleanup_job_list(j_list);
+        exit(last_status);
+    }
+    /* if asked to bundle a script into an executable */
+    if (argc > 1 && !strcmp(argv[1], "--bundle"))
+    {
+        bundle(argc, argv);
+    }
+    /* if a script is given, run it instead of reading commands */
+    if (argc > 1)
+    {
+        var_set_arg0(argv[1]);
+        var_params(argv + 2, argc - 2);
+        run_script(argv[1]);
+        cleanup_job_list(j_list);
+        exit(last_status);
+    }
+    /* if interactive, run ~/.33shrc if there is one */
+    if (job_control && getenv("HOME") != NULL)
+    {
+        char rc[MAX_SIZE];
+
+        snprintf(rc, sizeof(rc), "%s/.33shrc", getenv("HOME"));
+        if (access(rc, R_OK) == 0)
+        {
+            char *rc_toks[] = {"source", rc, NULL};
+
+            source(rc_toks);
+        }
+    }
+
     while (1)
     {
         reap(); 
-        memset(buff, '\0', MAX_SIZE); /* instantiate buffer */
 #ifdef PROMPT
-        const void *prompt;  /* pointer to the shell prompt "33sh> " */
-        prompt = "33sh> ";
+        const char *prompt;  /* pointer to the shell prompt "33sh> " */
+        prompt = pending == NULL ? "33sh> " : "> ";
 
-        if (write(STDOUT_FILENO, prompt, sizeof(prompt)-1) == -1)
+        /* if no line is unfinished and write fails */
+        if (!len && write(STDOUT_FILENO, prompt, strlen(prompt)) == -1)
         {
             perror("write");
             exit(EXIT_FAILURE); /* exit(1) */
@@ -52,7 +212,7 @@ int main()
 #endif
         
         /* if copying commandline to buffer fails */
-        if ((r = read(STDIN_FILENO, buff, MAX_SIZE)) == -1)
+        if ((r = input_read(STDIN_FILENO, buff + len, MAX_SIZE - 1 - len)) == -1)
         {
             perror("read");
             cleanup_job_list(j_list);
@@ -61,11 +221,44 @@ int main()
         /* if it reaches EOF */
         else if (!r)
         {
+            /* if last line has no line break, run it anyway */
+            if (len)
+            {
+                buff[len] = '\0';
+                parse(buff);
+            }
+            /* if input ended inside a construct */
+            if (pending != NULL)
+            {
+                errno = EAGAIN;
+                parse_error("parse");
+                last_status = 2;
+            }
             cleanup_job_list(j_list);
-            exit(EXIT_SUCCESS); /* exit(0) */
+            exit(last_status);
+        }
+        len += (size_t)r;
+        buff[len] = '\0'; /* set last element in buffer to null */
+
+        /* 
+         * one read may hold several lines, or end in the middle of one.
+         * run every complete line and keep the rest for the next read,
+         * unless it already fills the buffer.
+         */
+        if ((end = strrchr(buff, '\n')) == NULL)
+        {
+            /* if buffer is full, run the line as it is */
+            if (len == MAX_SIZE - 1)
+            {
+                parse(buff);
+                len = 0;
+            }
+            continue;
         }
-        buff[r] = '\0'; /* set last element in buffer to null */
+        *end = '\0';
         parse(buff);
+        len -= (size_t)(end + 1 - buff);
+        memmove(buff, end + 1, len);
     }
     cleanup_job_list(j_list);
     return 1;
@@ -109,6 +302,7 @@ void reap()
     int status;
     int child_jid; /* child process job ID */
 
+    timer_check(); /* time limits of background jobs fire here */
     /* while the end of job list is NOT reached */
     while ((w = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
     {
@@ -123,6 +317,11 @@ void reap()
             }
         }
 
+        /* if process ended, its time limit has nothing left to stop */
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            timer_forget(w);
+        }
         /* if process terminates normally with exit */
         if (WIFEXITED(status))
         {
@@ -188,191 +387,2807 @@ void reap()
             }
         }
     }
-    /* if waitpid fails to return process ID of the terminated child */
-    // if (w == -1)
-    // {
-    //     perror("waitpid");
-    //     return;
-    // }
-    return;
+    /* if waitpid fails to return process ID of the terminated child */
+    // if (w == -1)
+    // {
+    //     perror("waitpid");
+    //     return;
+    // }
+    return;
+}
+
+/*
+ * Function: parse
+ * Parses input given by user and runs it. Input that ends inside a
+ * construct (such as a function body) is held back until the rest arrives.
+ * 
+ * buff : pointer to buffer
+ */
+void parse(char *buff)
+{
+    plan_t *plan;
+    char *text = buff;
+
+    /* if earlier lines are waiting for this one */
+    if (pending != NULL)
+    {
+        size_t len = strlen(pending);
+        char *p;
+
+        /* if realloc fails */
+        if ((p = realloc(pending, len + strlen(buff) + 2)) == NULL)
+        {
+            perror("realloc");
+            free(pending);
+            pending = NULL;
+            return;
+        }
+        p[len] = '\n';
+        strcpy(p + len + 1, buff);
+        text = pending = p;
+    }
+
+    /* if plan_parse fails */
+    if ((plan = plan_parse(text, strlen(text))) == NULL)
+    {
+        /* if construct is unfinished, wait for more lines */
+        if (errno == EAGAIN && (pending != NULL || (pending = strdup(buff)) != NULL))
+        {
+            return;
+        }
+        parse_error("parse");
+        free(pending);
+        pending = NULL;
+        last_status = 2;
+        return;
+    }
+    free(pending);
+    pending = NULL;
+    run_plan(plan);
+    plan_free(plan);
+    return;
+}
+
+/*
+ * Function: parse_error
+ * Reports why a plan could not be made, unless plan_parse already did.
+ *
+ * what : pointer to what was being parsed
+ */
+void parse_error(char *what)
+{
+    /* if input ended inside a construct */
+    if (errno == EAGAIN)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Unexpected end of input.");
+    }
+    /* if it is not a syntax error */
+    else if (errno != EINVAL)
+    {
+        perror(what);
+    }
+}
+
+/*
+ * Function: run_plan
+ * Runs a parsed plan. Returns the exit status of its last command.
+ *
+ * plan : pointer to plan
+ */
+int run_plan(plan_t *plan)
+{
+    /* if plan is empty */
+    if (!plan->root)
+    {
+        return last_status;
+    }
+    return run_node(plan, plan->root);
+}
+
+/*
+ * Function: run_node
+ * Runs node n of a plan. Commands of a sequence run in order and && / ||
+ * short-circuit on the exit status of their left side. Jobs that finished
+ * meanwhile are reaped in one batch between elements. return, break and
+ * continue stop sequences and lists until they reach what they end.
+ * Returns the exit status of the last command run.
+ *
+ * plan : pointer to plan
+ * n : index of node
+ */
+int run_node(plan_t *plan, uint32_t n)
+{
+    plan_node_t *node = &plan->nodes[n];
+
+    switch (node->type)
+    {
+    case N_CMD:
+        return last_status = run_cmd(plan, node);
+    case N_AND:
+        /* if left side fails, skip right side */
+        if (run_node(plan, node->a) || stopped())
+        {
+            return last_status;
+        }
+        reap();
+        return run_node(plan, node->b);
+    case N_OR:
+        /* if left side succeeds, skip right side */
+        if (!run_node(plan, node->a) || stopped())
+        {
+            return last_status;
+        }
+        reap();
+        return run_node(plan, node->b);
+    case N_FUNC:
+        /* if def_set fails */
+        if (def_set(DEF_FUNC, plan_word(plan, node->a), plan_word(plan, node->b)) == -1)
+        {
+            perror("function");
+            return last_status = 1;
+        }
+        return last_status = 0;
+    case N_SEQ:
+        for (uint32_t seq = n; seq && !stopped(); seq = plan->nodes[seq].b)
+        {
+            /* if this is not the first element, reap jobs that finished meanwhile */
+            if (seq != n)
+            {
+                reap();
+            }
+            run_node(plan, plan->nodes[seq].a);
+        }
+        return last_status;
+    case N_WHILE:
+    case N_UNTIL:
+        return run_loop(plan, node);
+    case N_FOR:
+        return run_for(plan, node);
+    case N_IF:
+        run_node(plan, node->a);
+        /* if the condition was cut short by return, break, continue or exit */
+        if (stopped())
+        {
+            return last_status;
+        }
+        node = &plan->nodes[node->b];
+        if (!last_status)
+        {
+            return run_node(plan, node->a);
+        }
+        /* if there is no branch for a false condition */
+        if (!node->b)
+        {
+            return last_status = 0;
+        }
+        return run_node(plan, node->b);
+    case N_ARITH:
+    {
+        int64_t k;
+
+        /* the status is 0 if the expression is not 0 */
+        return last_status = expand_arith_word(plan_word(plan, node->a), &k) == -1 ? 1 : !k;
+    }
+    case N_COND:
+        return last_status = cond_eval(plan, node->a, node->b);
+    case N_REDIR:
+        return run_redirect(plan, node);
+    }
+    return last_status;
+}
+
+/*
+ * Function: run_loop
+ * Runs a while or until loop. The body runs as long as the condition
+ * succeeds (while) or fails (until); break and continue end the loop or
+ * the current pass through it.
+ * Returns the exit status of the last body command run, 0 if none ran.
+ *
+ * plan : pointer to plan
+ * node : pointer to N_WHILE or N_UNTIL node
+ */
+int run_loop(plan_t *plan, plan_node_t *node)
+{
+    uint32_t cond = node->a;
+    uint32_t body = node->b;
+    int until = node->type == N_UNTIL;
+    int status = 0;
+
+    loop_depth++;
+    for (;;)
+    {
+        /* if the condition ends the loop */
+        if ((run_node(plan, cond) == 0) == until && !stopped())
+        {
+            break;
+        }
+        if (!stopped())
+        {
+            status = run_node(plan, body);
+        }
+        if (func_return || subst_exit)
+        {
+            break;
+        }
+        /* if break or continue ends this loop, or one around it */
+        if (loop_jump && (--loop_jump || !loop_next))
+        {
+            break;
+        }
+        reap();
+    }
+    loop_depth--;
+    return last_status = status;
+}
+
+/*
+ * Function: run_for
+ * Runs a for loop: the body runs once per word of the list, with the
+ * name set to it. The list is expanded before the first pass, except
+ * that a word that is a sequence brace alone, {1..1000000}, is stepped
+ * through as the loop goes, without making its words.
+ * Returns the exit status of the last body command run, 0 if none ran.
+ *
+ * plan : pointer to plan
+ * node : pointer to N_FOR node
+ */
+int run_for(plan_t *plan, plan_node_t *node)
+{
+    plan_node_t *list = &plan->nodes[node->a];
+    const char *name = plan_word(plan, list->a);
+    for_range_t *ranges = NULL; /* sequence braces of the list */
+    for_range_t *p;
+    int n_ranges = 0;
+    int status = 0;
+    int stop = 0;
+    char num[32];
+    expand_t ex;
+    var_t *var;
+
+    /* if the name can not be a variable */
+    if (!var_name_ok(name, strlen(name)))
+    {
+        fprintf(stderr, "SYNTAX ERROR : %s: Not a valid loop variable.\n", name);
+        return last_status = 2;
+    }
+    /* if the variable can not be made */
+    if ((var = var_intern(name, strlen(name))) == NULL)
+    {
+        perror("for");
+        return last_status = 1;
+    }
+    expand_init(&ex);
+    for (uint32_t i = 1; i < list->b; i++)
+    {
+        const char *word = plan_word(plan, list->a + i);
+        range_t r;
+
+        if (expand_range(word, &r))
+        {
+            /* if realloc fails */
+            if ((p = realloc(ranges, (size_t)(n_ranges + 1) * sizeof(for_range_t))) == NULL)
+            {
+                perror("realloc");
+                free(ranges);
+                expand_free(&ex);
+                return last_status = 1;
+            }
+            ranges = p;
+            ranges[n_ranges].r = r;
+            ranges[n_ranges++].at = ex.n;
+        }
+        /* if expand_word fails */
+        else if (expand_word(&ex, word) == -1)
+        {
+            free(ranges);
+            return last_status = expand_error(&ex);
+        }
+    }
+    /* if the words can not be kept apart from the variables the body may change */
+    if (expand_finish(&ex) == -1 || expand_own(&ex) == -1)
+    {
+        free(ranges);
+        return last_status = expand_error(&ex);
+    }
+
+    loop_depth++;
+    for (int i = 0, k = 0; i <= ex.n && !stop; i++)
+    {
+        for (; k < n_ranges && ranges[k].at == i && !stop; k++)
+        {
+            while (!stop && range_next(&ranges[k].r, num, sizeof(num)))
+            {
+                stop = for_pass(plan, node->b, var, num, &status);
+            }
+        }
+        if (i < ex.n && !stop)
+        {
+            stop = for_pass(plan, node->b, var, ex.toks[i], &status);
+        }
+    }
+    loop_depth--;
+    free(ranges);
+    expand_free(&ex);
+    return last_status = status;
+}
+
+/*
+ * Function: for_pass
+ * Runs one pass of a for loop with the variable set to value.
+ * Returns 1 if the loop ends, by break or otherwise, 0 if it goes on.
+ *
+ * plan : pointer to plan
+ * body : index of body N_SEQ
+ * var : pointer to loop variable
+ * value : pointer to value
+ * status : pointer to exit status of the last body command
+ */
+int for_pass(plan_t *plan, uint32_t body, var_t *var, const char *value, int *status)
+{
+    /* if the variable can not be set */
+    if (var_set(var, value, strlen(value)) == -1)
+    {
+        fprintf(stderr, "ERROR : %s: Can not set loop variable.\n", value);
+        *status = 1;
+        return 1;
+    }
+    *status = run_node(plan, body);
+    if (func_return || subst_exit)
+    {
+        return 1;
+    }
+    /* if break or continue ends this loop, or one around it */
+    if (loop_jump && (--loop_jump || !loop_next))
+    {
+        return 1;
+    }
+    reap();
+    return 0;
+}
+
+/*
+ * Function: run_redirect
+ * Runs a compound command with the redirections written after it, which
+ * hold for the whole command: a loop ending in "done < file" reads the
+ * file through one read-ahead, pass after pass.
+ * Returns the exit status of the command.
+ *
+ * plan : pointer to plan
+ * node : pointer to N_REDIR node
+ */
+int run_redirect(plan_t *plan, plan_node_t *node)
+{
+    plan_node_t *redirs = &plan->nodes[node->b];
+    uint32_t cmd = node->a;
+    expand_t ex;
+    int status;
+
+    expand_init(&ex);
+    for (uint32_t i = 0; i < redirs->b; i++)
+    {
+        /* if expand_word fails */
+        if (expand_word(&ex, plan_word(plan, redirs->a + i)) == -1)
+        {
+            return last_status = expand_error(&ex);
+        }
+    }
+    /* if the words can not be kept apart from the variables the command may change */
+    if (expand_finish(&ex) == -1 || expand_own(&ex) == -1)
+    {
+        return last_status = expand_error(&ex);
+    }
+    status = builtin_redirect(NULL, NULL, plan, cmd, ex.toks);
+    expand_free(&ex);
+    return last_status = status;
+}
+
+/*
+ * Function: stopped
+ * Checks whether return, break, continue or exit in a command substitution
+ * is cutting short the commands being run.
+ */
+int stopped()
+{
+    return func_return || loop_jump || subst_exit;
+}
+
+/*
+ * Function: command_subst
+ * Runs the commands of $(...) or `...` inside the shell, with stdout
+ * captured: builtins and functions print straight into the buffer, and
+ * programs get a pipe that fork_and_exec drains into it. exit ends the
+ * substitution rather than the shell, break, continue and return do not
+ * reach past it, and a cd is undone when it ends.
+ *
+ * text : pointer to commands
+ * len : length of commands
+ * c : pointer to capture, which holds the output on success
+ */
+int command_subst(const char *text, size_t len, capture_t *c)
+{
+    plan_t *plan;
+    int loops = loop_depth;
+    int cwd = subst_cwd;
+
+    /* if commands do not parse */
+    if ((plan = plan_parse(text, len)) == NULL)
+    {
+        parse_error("substitution");
+        errno = EINVAL;
+        return -1;
+    }
+    /* if capture can not start */
+    if (capture_start(c) == -1)
+    {
+        perror("substitution");
+        plan_free(plan);
+        errno = EINVAL;
+        return -1;
+    }
+    subst_depth++;
+    subst_count++;
+    loop_depth = 0;
+    subst_cwd = -1;
+    run_plan(plan);
+    /* if a cd ran, go back */
+    if (subst_cwd != -1)
+    {
+        if (fchdir(subst_cwd) == -1)
+        {
+            perror("cd");
+        }
+        close(subst_cwd);
+        meta_cwd();
+    }
+    subst_cwd = cwd;
+    loop_depth = loops;
+    func_return = 0;
+    subst_exit = 0;
+    subst_depth--;
+    capture_stop(c);
+    plan_free(plan);
+    return 0;
+}
+
+/*
+ * Function: run_cmd
+ * Runs a simple command of a plan. Its words are expanded first; leading
+ * NAME=value words are assignments, which last only for the command if
+ * there is one. Words lent by arrays are copied unless they go straight to
+ * a program, as anything run in the shell may change the arrays. Kept apart
+ * from run_node so only commands, not every level of nesting, hold an
+ * expansion on the stack.
+ *
+ * plan : pointer to plan
+ * node : pointer to N_CMD node
+ */
+int run_cmd(plan_t *plan, plan_node_t *node)
+{
+    expand_t ex;
+    batch_t batch = {0, 0, 0};
+    uint32_t n_assign = 0;
+    uint32_t arrays[node->b]; /* words of name=(...) given to declare */
+    uint32_t n_arrays = 0;
+    int declaring;
+    int prev = 0; /* first field of the last word expanded */
+    int status;
+
+    while (n_assign < node->b && expand_assign_name(plan_word(plan, node->a + n_assign)))
+    {
+        n_assign++;
+    }
+    declaring = n_assign < node->b && !strcmp(plan_word(plan, node->a + n_assign), "declare");
+    expand_init(&ex);
+    for (uint32_t i = n_assign; i < node->b; i++)
+    {
+        size_t len;
+
+        /* declare gets only the name of an array assignment, which is carried out after it as written */
+        if (declaring && i > n_assign && (len = array_word(plan_word(plan, node->a + i))) != 0)
+        {
+            char name[len + 1];
+
+            memcpy(name, plan_word(plan, node->a + i), len);
+            name[len] = '\0';
+            arrays[n_arrays++] = node->a + i;
+            prev = ex.n;
+            /* if expand_word fails */
+            if (expand_word(&ex, name) == -1)
+            {
+                return expand_error(&ex);
+            }
+            continue;
+        }
+        /* if the word is the first ...+ and follows an argument, it batches that argument's fields */
+        if (!batch.jobs && i > n_assign + 1 && (batch.jobs = batch_jobs(plan_word(plan, node->a + i))) != 0)
+        {
+            batch.from = prev;
+            batch.to = ex.n;
+            continue;
+        }
+        prev = ex.n;
+        /* if expand_word fails */
+        if (expand_word(&ex, plan_word(plan, node->a + i)) == -1)
+        {
+            return expand_error(&ex);
+        }
+    }
+    /* if expand_finish fails */
+    if (expand_finish(&ex) == -1)
+    {
+        return expand_error(&ex);
+    }
+    /* if lent words can not be copied where the shell itself runs the command */
+    if (ex.lent && (n_assign || def_get(DEF_ALIAS, ex.toks[0]) != NULL || def_get(DEF_FUNC, ex.toks[0]) != NULL ||
+                    builtin_get(ex.toks[0]) != NULL) &&
+        (expand_own(&ex) == -1 || expand_finish(&ex) == -1))
+    {
+        return expand_error(&ex);
+    }
+    if (n_assign)
+    {
+        int substs = subst_count;
+
+        status = assign(plan, node->a, n_assign, ex.n ? ex.toks : NULL, &batch);
+        /* assignments alone take the status of the last substitution they ran */
+        if (!status && !ex.n && substs != subst_count)
+        {
+            status = last_status;
+        }
+    }
+    else
+    {
+        /* check for commands */
+        status = !ex.n ? 0 : batch.jobs ? run_batches(ex.toks, &batch) : commands(ex.toks);
+    }
+    for (uint32_t k = 0; k < n_arrays && !status; k++)
+    {
+        /* if the array assignment fails */
+        if (expand_assign(plan_word(plan, arrays[k]), 0) == -1)
+        {
+            /* if it was not reported already */
+            if (errno != EINVAL)
+            {
+                perror("declare");
+            }
+            status = 1;
+        }
+    }
+    expand_free(&ex);
+    glob_forget(); /* listings replaced during the command line are no longer used */
+    return status;
+}
+
+/*
+ * Function: array_word
+ * Checks for an array assignment, name=(...) or name+=(...).
+ * Returns the length of name, 0 if word is not one.
+ *
+ * word : pointer to word as written
+ */
+size_t array_word(const char *word)
+{
+    size_t n = expand_assign_name(word);
+    size_t len = strlen(word);
+    size_t i = n + (word[n] == '+');
+
+    return n && word[i] == '=' && word[i + 1] == '(' && word[len - 1] == ')' ? n : 0;
+}
+
+/*
+ * Function: assign
+ * Runs the assignments of a command. Without a command they set shell
+ * variables and arrays; with one they are exported for it alone and undone
+ * after, so they may not involve arrays.
+ *
+ * plan : pointer to plan
+ * first : index of first assignment word
+ * n : number of assignment words
+ * toks : pointer to tokens array of the command, NULL if none
+ * batch : pointer to the fields the command runs in batches, jobs 0 if none
+ */
+int assign(plan_t *plan, uint32_t first, uint32_t n, char *toks[], const batch_t *batch)
+{
+    struct {
+        var_t *var;
+        char *value; /* value before the command, NULL if unset */
+        int flags;
+    } saved[n];
+    uint32_t done;
+    int status = 0;
+
+    for (done = 0; done < n; done++)
+    {
+        char *word = plan_word(plan, first + done);
+        var_t *var;
+
+        /* if variable can not be interned */
+        if ((var = var_intern(word, expand_assign_name(word))) == NULL)
+        {
+            perror("assign");
+            status = 1;
+            break;
+        }
+        saved[done].var = var;
+        saved[done].flags = var->flags;
+        saved[done].value = NULL;
+        /* if an array would have to be put back */
+        if (toks != NULL && (var->flags & (VAR_ARRAY | VAR_ASSOC)))
+        {
+            fprintf(stderr, "ERROR : %s: cannot assign an array for a command.\n", var->name);
+            status = 1;
+            break;
+        }
+        /* if old value can not be kept */
+        if (toks != NULL && var->value != NULL && (saved[done].value = strdup(var->value)) == NULL)
+        {
+            perror("assign");
+            status = 1;
+            break;
+        }
+        /* if the assignment fails */
+        if (expand_assign(word, toks != NULL) == -1)
+        {
+            /* if it was not reported already */
+            if (errno != EINVAL)
+            {
+                perror("assign");
+            }
+            status = 1;
+            done++;
+            break;
+        }
+        if (toks != NULL)
+        {
+            var_export(var, 1);
+        }
+    }
+    if (toks == NULL)
+    {
+        return status;
+    }
+    if (!status)
+    {
+        status = batch->jobs ? run_batches(toks, batch) : commands(toks);
+    }
+    /* undo the assignments, last first */
+    while (done--)
+    {
+        var_t *var = saved[done].var;
+
+        if (saved[done].value != NULL)
+        {
+            var_set(var, saved[done].value, strlen(saved[done].value));
+            free(saved[done].value);
+        }
+        else
+        {
+            var_unset(var);
+        }
+        var_export(var, saved[done].flags & VAR_EXPORT);
+    }
+    return status;
+}
+
+/*
+ * Function: expand_error
+ * Reports why words could not be expanded, unless that was done already,
+ * and frees the expansion. Returns the exit status of the command.
+ *
+ * ex : pointer to expansion
+ */
+int expand_error(expand_t *ex)
+{
+    /* if it is not a bad substitution */
+    if (errno != EINVAL)
+    {
+        perror("expand");
+    }
+    expand_free(ex);
+    return 1;
+}
+
+/*
+ * Function: run_script
+ * Runs the script at path, using its compiled plan from the cache if possible.
+ *
+ * path : pointer to script path
+ */
+void run_script(char *path)
+{
+    plan_t *plan;
+
+    /* if script can not be loaded */
+    if ((plan = plan_load_script(path)) == NULL)
+    {
+        int syntax = errno == EINVAL || errno == EAGAIN;
+
+        parse_error(path);
+        cleanup_job_list(j_list);
+        exit(syntax ? 2 : EXIT_FAILURE);
+    }
+    run_plan(plan);
+    plan_free(plan);
+    reap();
+    return;
+}
+
+/*
+ * Function: bundle
+ * Handles "--bundle script -o output": writes output, a copy of this shell
+ * with the plan of script built into it, then exits. Running output runs
+ * the plan without reading or parsing the script.
+ *
+ * argc : number of arguments
+ * argv : pointer to arguments array
+ */
+void bundle(int argc, char *argv[])
+{
+    plan_t *plan;
+    int status = 0;
+
+    /* if usage is wrong */
+    if (argc != 5 || strcmp(argv[3], "-o"))
+    {
+        fprintf(stderr, "%s\n", "usage: 33sh --bundle script -o output");
+        exit(2);
+    }
+    /* if script can not be loaded */
+    if ((plan = plan_load_script(argv[2])) == NULL)
+    {
+        status = errno == EINVAL || errno == EAGAIN ? 2 : EXIT_FAILURE;
+        parse_error(argv[2]);
+    }
+    /* if output can not be written */
+    else if (plan_bundle(plan, "/proc/self/exe", argv[4]) == -1)
+    {
+        perror(argv[4]);
+        status = EXIT_FAILURE;
+    }
+    plan_free(plan);
+    cleanup_job_list(j_list);
+    exit(status);
+}
+
+/*
+ * Function: batch_jobs
+ * Checks for the batch word ...+, or ...+N to run N batches at once.
+ * Returns the number of batches run at once, 0 if word is not a batch word.
+ *
+ * word : pointer to word as written
+ */
+int batch_jobs(const char *word)
+{
+    long jobs = 1;
+    char *end;
+
+    if (strncmp(word, "...+", 4))
+    {
+        return 0;
+    }
+    if (word[4] != '\0')
+    {
+        /* if the count is not a number */
+        if (word[4] < '0' || word[4] > '9' || (jobs = strtol(word + 4, &end, 10)) < 1 || *end != '\0')
+        {
+            return 0;
+        }
+    }
+    return jobs > MAX_JOBS ? MAX_JOBS : (int)jobs;
+}
+
+/*
+ * Function: arg_limit
+ * Gets the bytes of arguments a program can be given: ARG_MAX less the
+ * environment it gets and some slack.
+ */
+size_t arg_limit()
+{
+    long max = sysconf(_SC_ARG_MAX);
+    size_t limit = max > 0 ? (size_t)max : 131072;
+    size_t env = 0;
+    char **envp = var_environ();
+
+    for (int i = 0; envp != NULL && envp[i] != NULL; i++)
+    {
+        env += strlen(envp[i]) + 1 + sizeof(char *);
+    }
+    return limit > env + 2 * ARG_SLACK ? limit - env - ARG_SLACK : ARG_SLACK;
+}
+
+/*
+ * Function: run_batches
+ * Runs a command once per batch of the fields that ...+ followed, each
+ * batch as many as fit in the argument limit, with the fields before and
+ * after them repeated in every run. A program, or a builtin that leaves
+ * the shell's state alone, can run batch->jobs batches at once, each in a
+ * child; other builtins, functions and commands in a substitution run one
+ * batch after another. The batches are not a job of their own, so they
+ * can not run in the background. Returns the status of the first batch
+ * that failed, 0 if none did.
+ *
+ * toks : pointer to tokens array
+ * batch : pointer to the batched fields
+ */
+int run_batches(char *toks[], const batch_t *batch)
+{
+    size_t limit = arg_limit();
+    size_t fixed = sizeof(char *); /* the NULL ending argv */
+    int n = 0;
+    int jobs = batch->jobs;
+    int first = 0; /* status of first batch that failed */
+    int status;
+    int w;          /* wait status */
+    int running = 0;
+    int out = -1;   /* index of an output redirection, which truncates once */
+    pid_t pids[MAX_JOBS];
+    char **argv;
+    const builtin_t *b = builtin_get(toks[0]);
+
+    while (toks[n] != NULL)
+    {
+        n++;
+    }
+    /* if the batches are asked to run in the background */
+    if (toks[n - 1] == op_bg)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Batches (...+) can not run in the background.");
+        return 2;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (i < batch->from || i >= batch->to)
+        {
+            fixed += strlen(toks[i]) + 1 + sizeof(char *);
+            out = toks[i] == op_out && toks[i + 1] != NULL ? i : out;
+        }
+    }
+    /* if the batches have to run in the shell, one after another */
+    if (capture_current != NULL || def_get(DEF_ALIAS, toks[0]) != NULL
+        || def_get(DEF_FUNC, toks[0]) != NULL || (b != NULL && !(b->flags & BI_PIPESAFE)))
+    {
+        jobs = 1;
+    }
+    /* if malloc fails */
+    if ((argv = malloc(((size_t)n + 1) * sizeof(char *))) == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+    memcpy(argv, toks, (size_t)batch->from * sizeof(char *));
+    /* if output is redirected, the file is emptied once and every batch appends to it */
+    if (out != -1)
+    {
+        int fd;
+
+        /* if open fails */
+        if ((fd = open(toks[out + 1], O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1)
+        {
+            perror("open");
+            free(argv);
+            return 1;
+        }
+        close(fd);
+    }
+
+    for (int i = batch->from; i < batch->to && !stopped();)
+    {
+        size_t size = fixed;
+        int k = batch->from;
+
+        /* a batch takes at least one field, as many as fit after that */
+        do
+        {
+            size += strlen(toks[i]) + 1 + sizeof(char *);
+            argv[k++] = toks[i++];
+        } while (i < batch->to && size + strlen(toks[i]) + 1 + sizeof(char *) <= limit);
+        memcpy(argv + k, toks + batch->to, ((size_t)(n - batch->to) + 1) * sizeof(char *));
+        if (out != -1)
+        {
+            argv[out < batch->from ? out : k + out - batch->to] = op_append;
+        }
+
+        if (jobs == 1)
+        {
+            status = commands(argv);
+            first = first ? first : status;
+            continue;
+        }
+        /* if all jobs run, wait for the oldest */
+        if (running == jobs)
+        {
+            status = waitpid(pids[0], &w, 0) == -1 ? 1 : wait_status(w);
+            first = first ? first : status;
+            memmove(pids, pids + 1, (size_t)--running * sizeof(pid_t));
+        }
+        fflush(stdout);
+        meta_ran();
+        input_sync();
+        /* if fork fails */
+        if ((pids[running] = fork()) == -1)
+        {
+            perror("fork");
+            first = first ? first : 1;
+            break;
+        }
+        /* if child process runs the batch, as a command of its own */
+        if (!pids[running])
+        {
+            job_control = 0;
+            status = b != NULL ? commands(argv) : redirection(argv);
+            fflush(stdout);
+            _exit(status);
+        }
+        running++;
+    }
+    for (int r = 0; r < running; r++)
+    {
+        status = waitpid(pids[r], &w, 0) == -1 ? 1 : wait_status(w);
+        first = first ? first : status;
+    }
+    free(argv);
+    return first;
+}
+
+/* 
+ * Function: commands
+ * Checks if first token is a command. If it is not, calls fork_and_exec.
+ * 
+ * toks : pointer to tokens array
+ */
+int commands(char *toks[])
+{
+    def_t *def;
+    const builtin_t *b;
+
+    /* if command is an alias, expand it (once) */
+    if (!alias_depth && (def = def_get(DEF_ALIAS, toks[0])) != NULL)
+    {
+        return expand_alias(def, toks);
+    }
+    /* if command is a function, it takes redirections as a builtin does */
+    if ((def = def_get(DEF_FUNC, toks[0])) != NULL)
+    {
+        return builtin_redirect(NULL, def, NULL, 0, toks);
+    }
+
+    /* if command is a builtin */
+    if ((b = builtin_get(toks[0])) != NULL)
+    {
+        return b->flags & BI_REDIRECT ? builtin_redirect(b, NULL, NULL, 0, toks) : b->fn(toks);
+    }
+    return redirection(toks);
+}
+
+/*
+ * Function: builtin_get
+ * Looks up a builtin in the perfect-hash table generated from builtins.def.
+ * Returns its entry, NULL if name is not a builtin.
+ *
+ * name : pointer to command name
+ */
+const builtin_t *builtin_get(const char *name)
+{
+    const builtin_t *b = &builtin_table[builtin_hash(name, BUILTIN_SEED) & (BUILTIN_SIZE - 1)];
+
+    return b->name != NULL && !strcmp(b->name, name) ? b : NULL;
+}
+
+/*
+ * Function: exit_cmd
+ * Exits the shell with the given status or that of the last command.
+ *
+ * toks : pointer to tokens array
+ */
+int exit_cmd(char *toks[])
+{
+    /* if run in a command substitution, only end that */
+    if (subst_depth)
+    {
+        subst_exit = 1;
+        return toks[1] != NULL ? atoi(toks[1]) : last_status;
+    }
+    cleanup_job_list(j_list);
+    exit(toks[1] != NULL ? atoi(toks[1]) : last_status);
+}
+
+/*
+ * Function: jobs_cmd
+ * Prints the job list.
+ *
+ * toks : pointer to tokens array
+ */
+int jobs_cmd(char *toks[])
+{
+    (void)toks;
+    jobs(j_list);
+    return 0;
+}
+
+/*
+ * Function: function
+ * Calls a shell function. Its body is parsed on the first call only.
+ *
+ * def : pointer to function definition
+ * toks : pointer to tokens array
+ */
+int function(def_t *def, char *toks[])
+{
+    plan_t *plan;
+    params_t saved;
+    int status;
+    int loops;
+    int argc = 0;
+
+    /* if calls are nested too deeply */
+    if (func_depth >= MAX_DEPTH)
+    {
+        fprintf(stderr, "ERROR : %s: Maximum function nesting exceeded.\n", toks[0]);
+        return 1;
+    }
+    /* if body does not parse */
+    if ((plan = def_plan(def)) == NULL)
+    {
+        parse_error(toks[0]);
+        return 2;
+    }
+    while (toks[argc + 1] != NULL)
+    {
+        argc++;
+    }
+    def_enter(def);
+    func_depth++;
+    loops = loop_depth; /* break and continue do not reach loops around the call */
+    loop_depth = 0;
+    saved = var_params(toks + 1, argc); /* arguments are $1, $2, ... for the call */
+    status = run_plan(plan);
+    var_params(saved.argv, saved.argc);
+    func_depth--;
+    func_return = 0;
+    loop_depth = loops;
+    def_leave(def);
+    return status;
+}
+
+/*
+ * Function: expand_alias
+ * Runs an alias. A single-command alias has its words put in front of the
+ * arguments; an alias holding a list runs as is.
+ *
+ * def : pointer to alias definition
+ * toks : pointer to tokens array
+ */
+int expand_alias(def_t *def, char *toks[])
+{
+    char **atoks;
+    expand_t ex;
+    plan_t *plan;
+    plan_node_t *cmd;
+    int status;
+    int n = 0;
+    int failed = 0;
+
+    /* if value does not parse */
+    if ((plan = def_plan(def)) == NULL)
+    {
+        parse_error(toks[0]);
+        return 2;
+    }
+    /* if alias is empty */
+    if (!plan->root)
+    {
+        return toks[1] != NULL ? commands(toks + 1) : 0;
+    }
+    cmd = &plan->nodes[plan->nodes[plan->root].a];
+
+    def_enter(def);
+    alias_depth++;
+    /* if alias is a single command */
+    if (!plan->nodes[plan->root].b && cmd->type == N_CMD)
+    {
+        expand_init(&ex);
+        for (uint32_t i = 0; i < cmd->b && !failed; i++)
+        {
+            failed = expand_word(&ex, plan_word(plan, cmd->a + i)) == -1;
+        }
+        /* if alias words can not be expanded */
+        if (failed || expand_finish(&ex) == -1)
+        {
+            status = expand_error(&ex);
+        }
+        else
+        {
+            while (toks[n + 1] != NULL)
+            {
+                n++;
+            }
+            /* if malloc fails */
+            if ((atoks = malloc(((size_t)ex.n + (size_t)n + 1) * sizeof(char *))) == NULL)
+            {
+                perror("malloc");
+                status = 1;
+            }
+            else
+            {
+                memcpy(atoks, ex.toks, (size_t)ex.n * sizeof(char *));
+                memcpy(atoks + ex.n, toks + 1, ((size_t)n + 1) * sizeof(char *));
+                n += ex.n;
+                status = n ? commands(atoks) : 0;
+                free(atoks);
+            }
+            expand_free(&ex);
+        }
+    }
+    /* if alias is a list, which can not take arguments */
+    else if (toks[1] != NULL)
+    {
+        fprintf(stderr, "ERROR : %s: Alias of a command list takes no arguments.\n", toks[0]);
+        status = 2;
+    }
+    else
+    {
+        status = run_plan(plan);
+    }
+    alias_depth--;
+    def_leave(def);
+    return status;
+}
+
+/*
+ * Function: alias
+ * Defines aliases given as name=value, or prints the ones named (or all).
+ *
+ * toks : pointer to tokens array
+ */
+int alias(char *toks[])
+{
+    def_t *def;
+    char *eq;
+    int status = 0;
+
+    /* if no arguments are given, print all aliases */
+    if (toks[1] == NULL)
+    {
+        def_t **list = def_list(DEF_ALIAS);
+
+        /* if def_list fails */
+        if (list == NULL)
+        {
+            perror("alias");
+            return 1;
+        }
+        for (int i = 0; list[i] != NULL; i++)
+        {
+            printf("alias %s='%s'\n", list[i]->name, list[i]->text);
+        }
+        free(list);
+        return 0;
+    }
+    for (int i = 1; toks[i] != NULL; i++)
+    {
+        /* if argument only names an alias */
+        if ((eq = strchr(toks[i], '=')) == NULL)
+        {
+            if ((def = def_get(DEF_ALIAS, toks[i])) == NULL)
+            {
+                fprintf(stderr, "ERROR : alias %s not found.\n", toks[i]);
+                status = 1;
+                continue;
+            }
+            printf("alias %s='%s'\n", def->name, def->text);
+            continue;
+        }
+        *eq = '\0';
+        /* if alias name is empty or def_set fails */
+        if (eq == toks[i] || def_set(DEF_ALIAS, toks[i], eq + 1) == -1)
+        {
+            fprintf(stderr, "ERROR : alias %s could not be defined.\n", toks[i]);
+            status = 1;
+        }
+        *eq = '=';
+    }
+    return status;
+}
+
+/*
+ * Function: unalias
+ * Removes the aliases named.
+ *
+ * toks : pointer to tokens array
+ */
+int unalias(char *toks[])
+{
+    int status = 0;
+
+    /* if no alias is named */
+    if (toks[1] == NULL)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : unalias failed.");
+        return 2;
+    }
+    for (int i = 1; toks[i] != NULL; i++)
+    {
+        /* if alias does not exist */
+        if (def_unset(DEF_ALIAS, toks[i]) == -1)
+        {
+            fprintf(stderr, "ERROR : alias %s not found.\n", toks[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/*
+ * Function: return_cmd
+ * Returns from the function being run, with the given status or that of
+ * the last command.
+ *
+ * toks : pointer to tokens array
+ */
+int return_cmd(char *toks[])
+{
+    /* if no function is running */
+    if (!func_depth)
+    {
+        fprintf(stderr, "%s\n", "ERROR : return used outside of a function.");
+        return 1;
+    }
+    func_return = 1;
+    return toks[1] != NULL ? atoi(toks[1]) : last_status;
+}
+
+/*
+ * Function: break_cmd
+ * Leaves the n innermost loops (break [n]), or resumes the nth innermost
+ * at its condition (continue [n]); n is 1 if not given.
+ *
+ * toks : pointer to tokens array
+ */
+int break_cmd(char *toks[])
+{
+    long n = 1;
+    char *end;
+
+    /* if no loop is running */
+    if (!loop_depth)
+    {
+        fprintf(stderr, "ERROR : %s used outside of a loop.\n", toks[0]);
+        return 1;
+    }
+    /* if the count is not a positive number */
+    if (toks[1] != NULL && ((n = strtol(toks[1], &end, 10)) < 1 || *end || end == toks[1]))
+    {
+        fprintf(stderr, "ERROR : %s: %s: loop count out of range.\n", toks[0], toks[1]);
+        return 1;
+    }
+    loop_jump = n < loop_depth ? (int)n : loop_depth;
+    loop_next = toks[0][0] == 'c';
+    return 0;
+}
+
+/*
+ * Function: source
+ * Runs a script in the current shell, so its functions and aliases stay
+ * defined. Goes through the compiled-script cache like run_script.
+ *
+ * toks : pointer to tokens array
+ */
+int source(char *toks[])
+{
+    plan_t *plan;
+    int status;
+
+    /* if no file is given */
+    if (toks[1] == NULL)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : source failed.");
+        return 2;
+    }
+    /* if script can not be loaded */
+    if ((plan = plan_load_script(toks[1])) == NULL)
+    {
+        int syntax = errno == EINVAL || errno == EAGAIN;
+
+        parse_error(toks[1]);
+        return syntax ? 2 : 1;
+    }
+    status = run_plan(plan);
+    plan_free(plan);
+    return status;
+}
+
+/*
+ * Function: export
+ * Exports the variables named, setting those given as name=value, or
+ * prints the exported variables if none are named.
+ *
+ * toks : pointer to tokens array
+ */
+int export(char *toks[])
+{
+    int status = 0;
+
+    /* if no variables are named, print the exported ones */
+    if (toks[1] == NULL)
+    {
+        var_t **list = var_list(VAR_EXPORT);
+
+        /* if var_list fails */
+        if (list == NULL)
+        {
+            perror("export");
+            return 1;
+        }
+        for (int i = 0; list[i] != NULL; i++)
+        {
+            printf("export %s=", list[i]->name);
+            print_quoted(list[i]->value);
+            putchar('\n');
+        }
+        free(list);
+        return 0;
+    }
+    for (int i = 1; toks[i] != NULL; i++)
+    {
+        char *eq = strchr(toks[i], '=');
+        size_t len = eq != NULL ? (size_t)(eq - toks[i]) : strlen(toks[i]);
+        var_t *var;
+
+        /* if name is not valid */
+        if (!var_name_ok(toks[i], len))
+        {
+            fprintf(stderr, "ERROR : export: %s: not a valid name.\n", toks[i]);
+            status = 1;
+            continue;
+        }
+        /* if variable can not be interned or set */
+        if ((var = var_intern(toks[i], len)) == NULL ||
+            (eq != NULL && var_set(var, eq + 1, strlen(eq + 1)) == -1))
+        {
+            perror("export");
+            status = 1;
+            continue;
+        }
+        var_export(var, 1);
+    }
+    return status;
+}
+
+/*
+ * Function: print_quoted
+ * Prints a string in single quotes, as the shell would read it back.
+ *
+ * s : pointer to string
+ */
+void print_quoted(const char *s)
+{
+    putchar('\'');
+    for (; *s; s++)
+    {
+        /* a quote closes the quotes, is escaped, and reopens them */
+        if (*s == '\'')
+        {
+            fputs("'\\''", stdout);
+        }
+        else
+        {
+            putchar(*s);
+        }
+    }
+    putchar('\'');
+}
+
+/*
+ * Function: unset
+ * Unsets the variables, or array elements name[sub], named, or with -f the
+ * functions named.
+ *
+ * toks : pointer to tokens array
+ */
+int unset(char *toks[])
+{
+    int funcs = 0;
+    int status = 0;
+    int i = 1;
+
+    if (toks[1] != NULL && (!strcmp(toks[1], "-f") || !strcmp(toks[1], "-v")))
+    {
+        funcs = toks[1][1] == 'f';
+        i++;
+    }
+    for (; toks[i] != NULL; i++)
+    {
+        char *sub = strchr(toks[i], '[');
+        size_t len = strlen(toks[i]);
+        size_t n = sub != NULL ? (size_t)(sub - toks[i]) : len;
+        char index[24];
+        int64_t k;
+        var_t *var;
+
+        if (funcs)
+        {
+            def_unset(DEF_FUNC, toks[i]);
+            continue;
+        }
+        /* if name is not valid, or a subscript is not closed at the end */
+        if (!var_name_ok(toks[i], n) || (sub != NULL && (toks[i][len - 1] != ']' || len - n < 3)))
+        {
+            fprintf(stderr, "ERROR : unset: %s: not a valid name.\n", toks[i]);
+            status = 1;
+            continue;
+        }
+        if ((var = var_find(toks[i], n)) == NULL)
+        {
+            continue;
+        }
+        if (sub == NULL)
+        {
+            var_unset(var);
+            continue;
+        }
+        toks[i][len - 1] = '\0';
+        /* a subscript of an indexed array is an arithmetic expression */
+        if (!(var->flags & VAR_ASSOC) && arith_eval(sub + 1, len - n - 2, &k) == 0)
+        {
+            snprintf(index, sizeof(index), "%lld", (long long)k);
+            var_unset_element(var, index);
+        }
+        else if (var->flags & VAR_ASSOC)
+        {
+            var_unset_element(var, sub + 1);
+        }
+        else
+        {
+            status = 1;
+        }
+        toks[i][len - 1] = ']';
+    }
+    return status;
+}
+
+/*
+ * Function: declare
+ * Declares variables: -a makes indexed arrays, -A associative arrays and
+ * -x exports; name=value also sets a value, element 0 of an array. An
+ * array assignment, name=(...), reaches declare as name alone and is
+ * carried out by run_cmd once declare has made the array. With no names,
+ * prints the variables that have the flags given.
+ *
+ * toks : pointer to tokens array
+ */
+int declare(char *toks[])
+{
+    int flags = 0;
+    int status = 0;
+    int i = 1;
+
+    for (; toks[i] != NULL && toks[i][0] == '-' && toks[i][1]; i++)
+    {
+        for (char *c = toks[i] + 1; *c; c++)
+        {
+            /* if option is not known */
+            if (!strchr("aAx", *c))
+            {
+                fprintf(stderr, "ERROR : declare: -%c: invalid option.\n", *c);
+                return 2;
+            }
+            flags |= *c == 'a' ? VAR_ARRAY : *c == 'A' ? VAR_ASSOC : VAR_EXPORT;
+        }
+    }
+    /* if an array is to be both kinds */
+    if ((flags & VAR_ARRAY) && (flags & VAR_ASSOC))
+    {
+        fprintf(stderr, "%s\n", "ERROR : declare: -a and -A can not be combined.");
+        return 2;
+    }
+    if (toks[i] == NULL)
+    {
+        var_t **list = var_list(flags);
+
+        /* if var_list fails */
+        if (list == NULL)
+        {
+            perror("declare");
+            return 1;
+        }
+        for (int k = 0; list[k] != NULL; k++)
+        {
+            var_t *var = list[k];
+            const char *sep = "";
+            size_t j = 0;
+
+            printf("declare -%s %s", var->flags & VAR_ARRAY ? "a" : var->flags & VAR_ASSOC ? "A" :
+                                     var->flags & VAR_EXPORT ? "x" : "-", var->name);
+            if (var->value != NULL)
+            {
+                putchar('=');
+                print_quoted(var->value);
+            }
+            if (var->flags & VAR_ARRAY)
+            {
+                fputs("=(", stdout);
+                for (; j < var->array->n; j++)
+                {
+                    if (var->array->items[j] != NULL)
+                    {
+                        printf("%s[%zu]=", sep, j);
+                        print_quoted(var->array->items[j]);
+                        sep = " ";
+                    }
+                }
+                putchar(')');
+            }
+            if (var->flags & VAR_ASSOC)
+            {
+                fputs("=(", stdout);
+                for (; j < var->assoc->n_entries; j++)
+                {
+                    if (var->assoc->entries[j].key != NULL)
+                    {
+                        printf("%s[", sep);
+                        print_quoted(var->assoc->entries[j].key);
+                        fputs("]=", stdout);
+                        print_quoted(var->assoc->entries[j].value);
+                        sep = " ";
+                    }
+                }
+                putchar(')');
+            }
+            putchar('\n');
+        }
+        free(list);
+        return 0;
+    }
+    for (; toks[i] != NULL; i++)
+    {
+        char *eq = strchr(toks[i], '=');
+        size_t len = eq != NULL ? (size_t)(eq - toks[i]) : strlen(toks[i]);
+        var_t *var;
+
+        /* if name is not valid */
+        if (!var_name_ok(toks[i], len))
+        {
+            fprintf(stderr, "ERROR : declare: %s: not a valid name.\n", toks[i]);
+            status = 1;
+            continue;
+        }
+        /* if variable can not be interned */
+        if ((var = var_intern(toks[i], len)) == NULL)
+        {
+            perror("declare");
+            status = 1;
+            continue;
+        }
+        /* if variable is an array of the other kind */
+        if ((flags & (VAR_ARRAY | VAR_ASSOC)) && var_make_array(var, flags & VAR_ASSOC) == -1)
+        {
+            if (var->flags & (VAR_ARRAY | VAR_ASSOC))
+            {
+                fprintf(stderr, "ERROR : declare: %s: cannot convert array.\n", toks[i]);
+            }
+            else
+            {
+                perror("declare");
+            }
+            status = 1;
+            continue;
+        }
+        /* if value can not be set */
+        if (eq != NULL && var_set(var, eq + 1, strlen(eq + 1)) == -1)
+        {
+            perror("declare");
+            status = 1;
+            continue;
+        }
+        /* arrays are never exported */
+        if ((flags & VAR_EXPORT) && !(var->flags & (VAR_ARRAY | VAR_ASSOC)))
+        {
+            var_export(var, 1);
+        }
+    }
+    return status;
+}
+
+/*
+ * Function: test_cmd
+ * Evaluates a condition in the shell: test expr, or [ expr ] whose last
+ * argument must be ].
+ *
+ * toks : pointer to tokens array
+ */
+int test_cmd(char *toks[])
+{
+    int n = 0;
+
+    while (toks[n + 1] != NULL)
+    {
+        n++;
+    }
+    if (!strcmp(toks[0], "["))
+    {
+        /* if the closing bracket is missing */
+        if (!n || strcmp(toks[n], "]"))
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : Missing ].");
+            return 2;
+        }
+        n--;
+    }
+    return cond_test(toks + 1, n);
+}
+
+/*
+ * Function: echo_cmd
+ * Prints its arguments in the shell, without running /bin/echo.
+ *
+ * toks : pointer to tokens array
+ */
+int echo_cmd(char *toks[])
+{
+    return print_echo(toks + 1);
+}
+
+/*
+ * Function: printf_cmd
+ * Prints formatted arguments in the shell.
+ *
+ * toks : pointer to tokens array
+ */
+int printf_cmd(char *toks[])
+{
+    return print_format(toks + 1);
+}
+
+/*
+ * Function: read_cmd
+ * Reads a line into variables, a block of input at a time.
+ *
+ * toks : pointer to tokens array
+ */
+int read_cmd(char *toks[])
+{
+    return input_vars(toks + 1);
+}
+
+/*
+ * Function: read_all
+ * Reads everything left on fd into one buffer, with a byte to spare after
+ * it. Regular files are read into a buffer of their size at once.
+ * Returns the buffer, NULL on failure.
+ *
+ * fd : file descriptor
+ * len : pointer to length read
+ */
+char *read_all(int fd, size_t *len)
+{
+    struct stat st;
+    size_t cap = 65536;
+    char *buf;
+    char *p;
+    ssize_t r;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        cap = (size_t)st.st_size + 2;
+    }
+    /* if malloc fails */
+    if ((buf = malloc(cap)) == NULL)
+    {
+        return NULL;
+    }
+    *len = 0;
+    while (1)
+    {
+        if (*len + 1 == cap)
+        {
+            /* if realloc fails */
+            if ((p = realloc(buf, cap * 2)) == NULL)
+            {
+                free(buf);
+                return NULL;
+            }
+            buf = p;
+            cap *= 2;
+        }
+        /* if read fails */
+        if ((r = read(fd, buf + *len, cap - *len - 1)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            free(buf);
+            return NULL;
+        }
+        if (r == 0)
+        {
+            return buf;
+        }
+        *len += (size_t)r;
+    }
+}
+
+/*
+ * Function: builtin_redirect
+ * Runs a builtin, a function or a compound command with its redirections
+ * applied in the shell. Each descriptor redirected is saved with F_DUPFD_CLOEXEC,
+ * replaced for the command and restored after it, so no child process is
+ * needed; programs a function runs inherit the redirection. While a
+ * substitution captures stdout, output redirected to a file bypasses the
+ * capture stream.
+ *
+ * b : pointer to builtin, NULL for a function or a compound command
+ * def : pointer to function definition, NULL for a builtin or a compound command
+ * plan : pointer to plan of a compound command, NULL for a builtin or a function
+ * node : index of the compound command's node
+ * toks : pointer to tokens array, only the redirections for a compound command
+ */
+int builtin_redirect(const builtin_t *b, def_t *def, plan_t *plan, uint32_t node, char *toks[])
+{
+    char *in_symbol = "\0";   /* input symbol */
+    char *out_symbol = "\0";  /* output symbol */
+    char *in_path = "\0";     /* input path */
+    char *out_path = "\0";    /* output path */
+    int in = -1;              /* file stdin is redirected to */
+    int out = -1;             /* file stdout is redirected to */
+    int saved_in = -1;        /* stdin of the shell while redirected */
+    int saved_out = -1;
+    void *ahead = NULL;       /* read-ahead of the shell's stdin */
+    FILE *stream = stdout;
+    capture_t *capture = capture_current;
+    char **argv;
+    int n = 0;
+    int argc = 0;
+    int slots;
+    int status = 1;
+
+    while (toks[n] != NULL && toks[n] != op_in && toks[n] != op_out && toks[n] != op_append && toks[n] != op_here)
+    {
+        n++;
+    }
+    /* if there is no redirection */
+    if (toks[n] == NULL)
+    {
+        return def != NULL ? function(def, toks) : b != NULL ? b->fn(toks) : run_node(plan, node);
+    }
+    while (toks[n] != NULL)
+    {
+        n++;
+    }
+    /* if calloc fails */
+    if ((argv = calloc((size_t)n + 1, sizeof(char *))) == NULL)
+    {
+        perror("calloc");
+        return 1;
+    }
+    /* if the redirections are malformed */
+    if ((slots = parse_redirects(toks, n, argv, &in_symbol, &in_path, &out_symbol, &out_path)) == -1)
+    {
+        free(argv);
+        return 2;
+    }
+    /* the builtin gets its arguments without the slots of redirections */
+    for (int i = 0; i < slots; i++)
+    {
+        if (argv[i] != NULL)
+        {
+            argv[argc++] = argv[i];
+        }
+    }
+    argv[argc] = NULL;
+    /* if a compound command is left with words other than redirections */
+    if (b == NULL && def == NULL && argc)
+    {
+        fprintf(stderr, "SYNTAX ERROR : %s: Ambiguous redirection.\n", argv[0]);
+        free(argv);
+        return 1;
+    }
+
+    /* if stdin is a here-document or here-string and its text can not be staged */
+    if (in_symbol == op_here && (in = here_open(in_path, strlen(in_path))) == -1)
+    {
+        perror("here-document");
+        free(argv);
+        return 1;
+    }
+    /* if the input file can not be opened */
+    if (in_symbol == op_in && (in = open(in_path, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        perror("open");
+        free(argv);
+        return 1;
+    }
+    if (out_symbol == op_out || out_symbol == op_append)
+    {
+        out = open(out_path, O_WRONLY | O_CREAT | O_CLOEXEC | (out_symbol == op_out ? O_TRUNC : O_APPEND), 0600);
+        meta_bump(out_path); /* the file may be new */
+    }
+    /* if the output file can not be opened */
+    if (out_path[0] && out == -1)
+    {
+        perror("open");
+        if (in != -1)
+        {
+            close(in);
+        }
+        free(argv);
+        return 1;
+    }
+
+    fflush(stdout); /* output so far goes where stdout was */
+    if (in != -1)
+    {
+        ahead = input_push(STDIN_FILENO);
+    }
+    /* if stdin can not be redirected */
+    if (redirect_fd(STDIN_FILENO, in, &saved_in) == -1)
+    {
+        perror("redirect");
+        if (out != -1)
+        {
+            close(out);
+        }
+    }
+    /* if stdout can not be redirected */
+    else if (redirect_fd(STDOUT_FILENO, out, &saved_out) == -1)
+    {
+        perror("redirect");
+    }
+    else
+    {
+        /* output to a file is not captured */
+        if (out != -1 && capture_current != NULL)
+        {
+            while (capture_current->outer != NULL)
+            {
+                capture_current = capture_current->outer;
+            }
+            stdout = capture_current->saved;
+            capture_current = NULL;
+        }
+        status = def != NULL ? function(def, argv) : b != NULL ? b->fn(argv) : run_node(plan, node);
+        fflush(stdout);
+        stdout = stream;
+        capture_current = capture;
+    }
+    if (in != -1)
+    {
+        input_pop(STDIN_FILENO, ahead);
+    }
+    redirect_fd(STDIN_FILENO, saved_in, NULL);
+    redirect_fd(STDOUT_FILENO, saved_out, NULL);
+    free(argv);
+    return status;
+}
+
+/*
+ * Function: redirect_fd
+ * Moves target, if it is not -1, onto fd. If saved is not NULL, fd is
+ * first kept aside in it with F_DUPFD_CLOEXEC, -2 if fd was closed;
+ * restoring a -2 closes fd. Returns 0 on success, -1 on failure.
+ *
+ * fd : file descriptor to redirect
+ * target : file descriptor to move onto it, closed once moved
+ * saved : pointer to where fd is kept aside, NULL to restore
+ */
+int redirect_fd(int fd, int target, int *saved)
+{
+    int r;
+
+    if (target == -1)
+    {
+        return 0;
+    }
+    /* if fd can not be kept aside, other than for being closed */
+    if (saved != NULL && (*saved = fcntl(fd, F_DUPFD_CLOEXEC, 10)) == -1 && errno != EBADF)
+    {
+        close(target);
+        return -1;
+    }
+    if (saved != NULL && *saved == -1)
+    {
+        *saved = -2;
+    }
+    if (target == -2)
+    {
+        return close(fd) == -1 && errno != EBADF ? -1 : 0;
+    }
+    r = dup2(target, fd) == -1 ? -1 : 0;
+    close(target);
+    return r;
+}
+
+/*
+ * Function: mapfile
+ * Reads lines into an indexed array: mapfile [-t] [-d delim] [-n count]
+ * [-s skip] [-u fd] [array] [file]. The input is read in one go into one
+ * buffer, which the array keeps; with -t the lines are cut in place,
+ * otherwise they are copied once to make room for their terminators.
+ * The array is MAPFILE unless named.
+ *
+ * toks : pointer to tokens array
+ */
+int mapfile(char *toks[])
+{
+    char delim = '\n';
+    int trim = 0;
+    long count = 0; /* lines to read, 0 for all */
+    long skip = 0;  /* lines to discard first */
+    int fd = STDIN_FILENO;
+    const char *name = "MAPFILE";
+    const char *path = NULL;
+    char *buf;
+    char *arena;
+    char **items;
+    size_t len;
+    size_t n = 0;
+    size_t k = 0;
+    var_t *var;
+    int i = 1;
+
+    for (; toks[i] != NULL && toks[i][0] == '-' && toks[i][1]; i++)
+    {
+        char opt = toks[i][1];
+        char *arg = toks[i][2] ? toks[i] + 2 : toks[i + 1];
+
+        if (opt == 't' && !toks[i][2])
+        {
+            trim = 1;
+            continue;
+        }
+        /* if option is not known, or lacks its argument */
+        if (!strchr("dnsu", opt) || arg == NULL)
+        {
+            fprintf(stderr, "%s\n", "usage: mapfile [-t] [-d delim] [-n count] [-s skip] [-u fd] [array] [file]");
+            return 2;
+        }
+        if (!toks[i][2])
+        {
+            i++;
+        }
+        if (opt == 'd')
+        {
+            delim = arg[0];
+        }
+        else if (opt == 'n')
+        {
+            count = atol(arg);
+        }
+        else if (opt == 's')
+        {
+            skip = atol(arg);
+        }
+        else
+        {
+            fd = atoi(arg);
+        }
+    }
+    if (toks[i] != NULL)
+    {
+        name = toks[i++];
+    }
+    if (toks[i] != NULL)
+    {
+        path = toks[i];
+    }
+    /* if name is not valid */
+    if (!var_name_ok(name, strlen(name)))
+    {
+        fprintf(stderr, "ERROR : mapfile: %s: not a valid name.\n", name);
+        return 1;
+    }
+    /* if variable can not be interned */
+    if ((var = var_intern(name, strlen(name))) == NULL)
+    {
+        perror("mapfile");
+        return 1;
+    }
+    /* if it is an associative array */
+    if (var->flags & VAR_ASSOC)
+    {
+        fprintf(stderr, "ERROR : mapfile: %s: not an indexed array.\n", name);
+        return 1;
+    }
+    /* if file can not be opened */
+    if (path != NULL && (fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        perror(path);
+        return 1;
+    }
+    input_sync(); /* what the read builtin read ahead of a file is given back first */
+    buf = read_all(fd, &len);
+    if (path != NULL)
+    {
+        close(fd);
+    }
+    /* if input can not be read */
+    if (buf == NULL)
+    {
+        perror("mapfile");
+        return 1;
+    }
+
+    /* count the lines, the last one may lack its delimiter */
+    for (char *p = buf; p < buf + len; n++)
+    {
+        char *e = memchr(p, delim, (size_t)(buf + len - p));
+
+        p = e != NULL ? e + 1 : buf + len;
+    }
+    n = (size_t)skip < n ? n - (size_t)skip : 0;
+    if (count > 0 && (size_t)count < n)
+    {
+        n = (size_t)count;
+    }
+    arena = trim ? buf : malloc(len + n + 1);
+    /* if the lines can not be held */
+    if (arena == NULL || (items = malloc((n ? n : 1) * sizeof(char *))) == NULL)
+    {
+        perror("mapfile");
+        free(buf);
+        if (arena != buf)
+        {
+            free(arena);
+        }
+        return 1;
+    }
+    {
+        char *p = buf;
+        char *out = arena;
+
+        for (long line = 0; k < n; line++)
+        {
+            char *e = memchr(p, delim, (size_t)(buf + len - p));
+            char *next = e != NULL ? e + 1 : buf + len;
+
+            /* with -t the delimiter is overwritten; otherwise the line is copied with it */
+            if (line >= skip && trim)
+            {
+                *(e != NULL ? e : buf + len) = '\0';
+                items[k++] = p;
+            }
+            else if (line >= skip)
+            {
+                memcpy(out, p, (size_t)(next - p));
+                out[next - p] = '\0';
+                items[k++] = out;
+                out += next - p + 1;
+            }
+            p = next;
+        }
+    }
+    if (!trim)
+    {
+        free(buf);
+    }
+    var_unset(var);
+    /* if the array can not be made */
+    if (var_make_array(var, 0) == -1)
+    {
+        perror("mapfile");
+        free(items);
+        free(arena);
+        return 1;
+    }
+    array_adopt(var->array, arena, trim ? len + 1 : len + n + 1, items, n);
+    return 0;
+}
+
+/* 
+ * Function: cd
+ * Handles changing directory, if possible.
+ * 
+ * toks : pointer to tokens array
+ */
+int cd(char *toks[])
+{
+    struct stat st;
+
+    /* if second token is null (NO directory given) */
+    if (toks[1] == NULL)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Change Directory (cd) failed.");
+        /* if fflush fails */
+        if (fflush(stdout) < 0) {
+            perror("fflush");
+            cleanup_job_list(j_list);
+            exit(EXIT_FAILURE); /* exit(1) */
+        } 
+        return 2;
+    }
+    /* if in a command substitution, keep the directory to go back to */
+    if (subst_depth && subst_cwd == -1 && (subst_cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        perror("cd");
+        return 1;
+    }
+    /* if the directory is missing, as the metadata cache may already know */
+    if (meta_stat(toks[1], &st, 1) == -1)
+    {
+        perror("cd");
+        return 1;
+    }
+    /* if it is not a directory */
+    if (!S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "cd: %s\n", strerror(ENOTDIR));
+        return 1;
+    }
+    /* if chdir fails */
+    if (chdir(toks[1]) == -1)
+    {
+        perror("cd");
+        return 1;
+    }
+    meta_cwd();
+    return 0;
+}
+
+/* 
+ * Function: ln
+ * Handles linking, if possible. ln target link makes one link; with more
+ * targets, the last argument is a directory to link them into. The links
+ * are made in one batch and errors reported in argument order.
+ * 
+ * toks : pointer to tokens array
+ */
+int ln(char *toks[])
+{
+    size_t n = 0;    /* number of targets */
+    ring_op_t *ops;  /* one link per target */
+    char *dir;       /* directory linked into */
+    int status = 0;  /* exit status */
+
+    while (toks[n + 1] != NULL)
+    {
+        n++;
+    }
+    /* if the second or third token is null */
+    if (n < 2)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Link (ln) failed.");
+        /* if fflush fails */
+        if (fflush(stdout) < 0) {
+            perror("fflush");
+            cleanup_job_list(j_list);
+            exit(EXIT_FAILURE); /* exit(1) */
+        }
+        return 2;
+    }
+    dir = toks[n--];
+    /* if calloc fails */
+    if ((ops = calloc(n, sizeof(ring_op_t))) == NULL)
+    {
+        perror("ln");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        char *base = strrchr(toks[i + 1], '/');
+
+        ops[i].op = RING_LINK;
+        ops[i].target = toks[i + 1];
+        ops[i].path = dir;
+        /* if there are more targets, each link is named as its target in dir */
+        if (n > 1)
+        {
+            char *path = malloc(strlen(dir) + strlen(base != NULL ? base : toks[i + 1]) + 2);
+
+            /* if malloc fails */
+            if (path == NULL)
+            {
+                perror("ln");
+                while (i--)
+                {
+                    free(ops[i].path);
+                }
+                free(ops);
+                return 1;
+            }
+            sprintf(path, "%s/%s", dir, base != NULL ? base + 1 : toks[i + 1]);
+            ops[i].path = path;
+        }
+    }
+    ring_run(ops, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        /* if link fails */
+        if (ops[i].err)
+        {
+            fprintf(stderr, "ln: %s: %s\n", ops[i].path, strerror(ops[i].err));
+            status = 1;
+        }
+        else
+        {
+            meta_bump(ops[i].path);
+        }
+        if (n > 1)
+        {
+            free(ops[i].path);
+        }
+    }
+    free(ops);
+    return status;
+}
+
+/* 
+ * Function: rm
+ * Handles removing, if possible. Takes any number of paths; -r (or -R)
+ * removes directories with their contents, -f passes over missing paths.
+ * 
+ * toks : pointer to tokens array
+ */
+int rm(char *toks[])
+{
+    int recursive = 0; /* set by -r or -R */
+    int force = 0;     /* set by -f */
+    int i = 1;         /* index of first path */
+
+    for (; toks[i] != NULL && toks[i][0] == '-' && toks[i][1] != '\0'; i++)
+    {
+        /* if options end */
+        if (!strcmp(toks[i], "--"))
+        {
+            i++;
+            break;
+        }
+        /* if option is unknown */
+        if (toks[i][1 + strspn(toks[i] + 1, "rRf")] != '\0')
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : rm: Unknown option.");
+            return 2;
+        }
+        recursive |= strpbrk(toks[i] + 1, "rR") != NULL;
+        force |= strchr(toks[i] + 1, 'f') != NULL;
+    }
+    /* if no path follows */
+    if (toks[i] == NULL)
+    {
+        if (force)
+        {
+            return 0;
+        }
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Remove (rm) failed.");
+        /* if fflush fails */
+        if (fflush(stdout) < 0) {
+            perror("fflush");
+            cleanup_job_list(j_list);
+            exit(EXIT_FAILURE); /* exit(1) */
+        }
+        return 2;
+    }
+    return rmtree_paths(toks + i, recursive, force);
+}
+
+/* 
+ * Function: cp
+ * Handles copying: cp [-r] [-p] source dest, or cp [-r] [-p] source...
+ * directory. -r (or -R) copies directories, -p keeps modes and times.
+ * 
+ * toks : pointer to tokens array
+ */
+int cp(char *toks[])
+{
+    int recursive = 0; /* set by -r or -R */
+    int preserve = 0;  /* set by -p */
+    size_t i = 1;      /* index of first source */
+    size_t n = 0;      /* number of sources */
+
+    for (; toks[i] != NULL && toks[i][0] == '-' && toks[i][1] != '\0'; i++)
+    {
+        /* if options end */
+        if (!strcmp(toks[i], "--"))
+        {
+            i++;
+            break;
+        }
+        /* if option is unknown */
+        if (toks[i][1 + strspn(toks[i] + 1, "rRp")] != '\0')
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : cp: Unknown option.");
+            return 2;
+        }
+        recursive |= strpbrk(toks[i] + 1, "rR") != NULL;
+        preserve |= strchr(toks[i] + 1, 'p') != NULL;
+    }
+    while (toks[i + n] != NULL)
+    {
+        n++;
+    }
+    /* if there is no source and destination */
+    if (n < 2)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : Copy (cp) failed.");
+        return 2;
+    }
+    return copy_paths(toks + i, n - 1, toks[i + n - 1], recursive, preserve);
+}
+
+/* 
+ * Function: memo
+ * Handles memo [-c] [-i input]... [-e name]... [--] command [args ...].
+ * Replays the stdout, stderr and status of an earlier run of the same
+ * command on the same inputs, or runs it and records them, its output
+ * shown as it comes. -i declares a file the command reads, -e a variable
+ * it depends on, and -c hashes the inputs by their bytes instead of their
+ * size and time. A command run in the background is refused, as its
+ * result is not known when memo returns.
+ * 
+ * toks : pointer to tokens array
+ */
+int memo(char *toks[])
+{
+    memo_t m;                       /* result looked up */
+    char **inputs;                  /* files declared with -i */
+    char **names;                   /* variables named with -e */
+    size_t n_inputs = 0;
+    size_t n_names = 0;
+    size_t n = 0;                   /* number of tokens */
+    size_t i = 1;                   /* index of the command */
+    int content = 0;                /* set by -c */
+    int saved_out = -1;             /* stdout of the shell while recorded */
+    int saved_err = -1;
+    FILE *stream = stdout;
+    capture_t *capture = capture_current;
+    int status = 2;
+
+    while (toks[n] != NULL)
+    {
+        n++;
+    }
+    inputs = calloc(n, sizeof(char *));
+    names = calloc(n, sizeof(char *));
+    /* if calloc fails */
+    if (inputs == NULL || names == NULL)
+    {
+        perror("calloc");
+        free(inputs);
+        free(names);
+        return 1;
+    }
+    for (; toks[i] != NULL && toks[i][0] == '-'; i++)
+    {
+        /* if options end */
+        if (!strcmp(toks[i], "--"))
+        {
+            i++;
+            break;
+        }
+        if (!strcmp(toks[i], "-c"))
+        {
+            content = 1;
+        }
+        else if (!strcmp(toks[i], "-i") && toks[i + 1] != NULL)
+        {
+            inputs[n_inputs++] = toks[++i];
+        }
+        else if (!strcmp(toks[i], "-e") && toks[i + 1] != NULL)
+        {
+            names[n_names++] = toks[++i];
+        }
+        /* if option is unknown */
+        else
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : memo: Unknown option.");
+            free(inputs);
+            free(names);
+            return 2;
+        }
+    }
+    /* if there is no command */
+    if (toks[i] == NULL)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : memo: Missing command.");
+    }
+    /* if the command would run in the background */
+    else if (toks[n - 1] == op_bg)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : memo: Background commands can not be memoised.");
+    }
+    /* if the result is replayed, or an input can not be read */
+    else if ((status = memo_lookup(&m, toks + i, inputs, n_inputs, names, n_names, content)) != MEMO_MISS)
+    {
+        status = status == -1 ? 1 : status;
+    }
+    /* if the run can not be recorded */
+    else if (m.fd == -1 || memo_record(&m, capture != NULL ? stream : NULL) == -1)
+    {
+        status = commands(toks + i);
+    }
+    else
+    {
+        /* if stdout and stderr can not be redirected to the record */
+        if (redirect_fd(STDOUT_FILENO, fcntl(m.out, F_DUPFD_CLOEXEC, 0), &saved_out) == -1 ||
+            redirect_fd(STDERR_FILENO, fcntl(m.err, F_DUPFD_CLOEXEC, 0), &saved_err) == -1)
+        {
+            perror("redirect");
+            status = 1;
+        }
+        else
+        {
+            /* the pipes are not captured; what the record passes on is */
+            if (capture_current != NULL)
+            {
+                while (capture_current->outer != NULL)
+                {
+                    capture_current = capture_current->outer;
+                }
+                stdout = capture_current->saved;
+                capture_current = NULL;
+            }
+            status = commands(toks + i);
+            fflush(stdout);
+            stdout = stream;
+            capture_current = capture;
+        }
+        redirect_fd(STDOUT_FILENO, saved_out, NULL);
+        redirect_fd(STDERR_FILENO, saved_err, NULL);
+        status = memo_store(&m, status);
+    }
+    free(inputs);
+    free(names);
+    return status;
+}
+
+/* 
+ * Function: watch
+ * Handles watch [-c] [-d ms] -f path... [--] command [args ...]. Starts a
+ * job that runs the command, then again whenever a path changes, until
+ * it is stopped like any other job. -d sets how long the paths must be
+ * quiet before a run (100 ms), -c ends a run that a change overlaps.
+ * 
+ * toks : pointer to tokens array
+ */
+int watch(char *toks[])
+{
+    char **paths;      /* paths given with -f */
+    size_t n_paths = 0;
+    size_t n = 0;      /* number of tokens */
+    size_t i = 1;      /* index of the command */
+    int quiet = 100;   /* milliseconds of quiet before a run */
+    int cancel = 0;    /* set by -c */
+    int is_bg = 0;     /* background flag */
+    pid_t f;           /* fork return value */
+
+    while (toks[n] != NULL)
+    {
+        n++;
+    }
+    /* if last token is "&" */
+    if (n && toks[n - 1] == op_bg)
+    {
+        is_bg = 1;
+        toks[--n] = NULL;
+    }
+    /* if calloc fails */
+    if ((paths = calloc(n, sizeof(char *))) == NULL)
+    {
+        perror("calloc");
+        return 1;
+    }
+    for (; toks[i] != NULL && toks[i][0] == '-'; i++)
+    {
+        /* if options end */
+        if (!strcmp(toks[i], "--"))
+        {
+            i++;
+            break;
+        }
+        if (!strcmp(toks[i], "-c"))
+        {
+            cancel = 1;
+        }
+        else if (!strcmp(toks[i], "-f") && toks[i + 1] != NULL)
+        {
+            paths[n_paths++] = toks[++i];
+        }
+        else if (!strcmp(toks[i], "-d") && toks[i + 1] != NULL && (quiet = atoi(toks[i + 1])) >= 0)
+        {
+            i++;
+        }
+        /* if option is unknown */
+        else
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : watch: Unknown option.");
+            free(paths);
+            return 2;
+        }
+    }
+    /* if there is nothing to watch or run */
+    if (!n_paths || toks[i] == NULL)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : watch: Missing path or command.");
+        free(paths);
+        return 2;
+    }
+    fflush(stdout); /* builtin output so far comes before the job's */
+    meta_ran();     /* the command may change files */
+    input_sync();   /* and may read what the read builtin has read ahead */
+    /* if fork fails */
+    if ((f = fork()) == -1)
+    {
+        perror("fork");
+        free(paths);
+        return 1;
+    }
+    /* if child process is created */
+    if (!f)
+    {
+        /* if setpgid fails */
+        if (setpgid(0, 0) == -1)
+        {
+            perror("setpgid");
+            _exit(EXIT_FAILURE); /* _exit(1) */
+        }
+        /* if tcsetpgrp fails */
+        if (!is_bg && job_control && tcsetpgrp(STDIN_FILENO, getpgid(0)) == -1)
+        {
+            perror("tcsetpgrp");
+            _exit(EXIT_FAILURE); /* _exit(1) */
+        }
+        restore_signals(); /* restore signals in child */
+        job_control = 0;   /* runs stay in the job's process group */
+        _exit(watch_run(paths, n_paths, toks + i, quiet, cancel, commands));
+    }
+    setpgid(f, f); /* so the group exists before the terminal is handed to it */
+    free(paths);
+    return track_job(f, is_bg, "watch");
 }
 
-/*
- * Function: parse
- * Parses input given by user
+/* 
+ * Function: sleep_cmd
+ * Handles sleep duration..., waiting in the shell for the sum of the
+ * durations. Ctrl-C or Ctrl-Z ends the sleep early.
  * 
- * buff : pointer to buffer
+ * toks : pointer to tokens array
  */
-void parse(char *buff)
+int sleep_cmd(char *toks[])
 {
-    char *toks[MAX_SIZE / 2];          /* array of tokens of size 512 */
-    char *delim = " \t\n";             /* spaces, tabs and line breaks */
-    char *token = strtok(buff, delim); /* first token (if any) in the buffer */
-    int i = 0;
+    struct timespec total = {0, 0}; /* time to sleep */
+    struct timespec ts;             /* one duration */
 
-    memset(toks, '\0', sizeof(toks)); /* instantiate tokens */
-    toks[i++] = token;
-    /* if buffer is empty */
-    if (token == NULL)
+    /* if there is no duration */
+    if (toks[1] == NULL)
     {
-        return;
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : sleep: Missing duration.");
+        return 2;
     }
-
-    while (1)
+    for (int i = 1; toks[i] != NULL; i++)
     {
-        token = strtok(NULL, delim);
-        /* if there are NO more tokens left */
-        if (token == NULL)
+        /* if the duration is malformed */
+        if (timer_parse(toks[i], &ts) == -1)
         {
-            break;
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : sleep: Bad duration.");
+            return 2;
         }
-        toks[i++] = token;
+        total.tv_sec += ts.tv_sec + (total.tv_nsec + ts.tv_nsec) / 1000000000;
+        total.tv_nsec = (total.tv_nsec + ts.tv_nsec) % 1000000000;
     }
-
-    toks[i] = NULL; /* set last element in tokens to null */
-    
-    /* check for commands */
-    commands(toks);
-    return;
+    return timer_sleep(&total);
 }
 
 /* 
- * Function: commands
- * Checks if first token is a command. If it is not, calls fork_and_exec.
+ * Function: timeout_cmd
+ * Handles timeout [-s signal] [-k duration] duration command [args ...].
+ * Runs the command with a time limit, after which every job it started
+ * gets the signal (TERM), then KILL once the -k duration passes, and any
+ * job it starts later gets them at once. A builtin or function runs in
+ * the shell, not forked, so it keeps its effects; sleep and read in it
+ * end when the limit passes. Returns 124 if
+ * the limit was hit, the command's status otherwise.
  * 
  * toks : pointer to tokens array
  */
-void commands(char *toks[])
+int timeout_cmd(char *toks[])
 {
-    /* BUILT IN COMMANDS */
-    /* if command is change directory (cd) */
-    if (!strcmp(toks[0], "cd"))
-    {
-        cd(toks);
-        return;
-    }
-    /* if command is link (ln) */
-    else if (!strcmp(toks[0], "ln"))
-    {
-        ln(toks);
-        return;
-    }
+    struct timespec limit;              /* time the command may run */
+    struct timespec grace = {0, 0};     /* time from the signal to KILL */
+    int sig = SIGTERM;                  /* signal sent at the limit */
+    int i = 1;                          /* index of the duration */
+    int status;
 
-    /* if command is remove (rm) */
-    else if (!strcmp(toks[0], "rm"))
-    {
-        rm(toks);
-        return;
-    }
-    /* if command is exit */
-    else if (!strcmp(toks[0], "exit"))
+    for (; toks[i] != NULL && toks[i][0] == '-' && toks[i][1] != '\0'; i += 2)
     {
-        cleanup_job_list(j_list);
-        exit(EXIT_SUCCESS); /* exit(0) */
+        /* if options end */
+        if (!strcmp(toks[i], "--"))
+        {
+            i++;
+            break;
+        }
+        /* if an option is unknown or malformed */
+        if (toks[i + 1] == NULL || (strcmp(toks[i], "-s") && strcmp(toks[i], "-k")) ||
+            (!strcmp(toks[i], "-s") && (sig = timer_signal(toks[i + 1])) == -1) ||
+            (!strcmp(toks[i], "-k") && timer_parse(toks[i + 1], &grace) == -1))
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : timeout: Bad option.");
+            return 2;
+        }
     }
-
-    /* NON BUILT IN COMMANDS */
-    /* if command is jobs */ 
-    else if (!strcmp(toks[0], "jobs"))
+    /* if there is no duration and command */
+    if (toks[i] == NULL || toks[i + 1] == NULL || timer_parse(toks[i], &limit) == -1)
     {
-        jobs(j_list);
-        return;
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : timeout: Missing duration or command.");
+        return 2;
     }
-    /* if command is bg */
-    else if (!strcmp(toks[0], "bg"))
+    /* if the limit can not be armed */
+    if (timer_arm(&limit, sig, &grace) == -1)
     {
-        bg(toks); 
-        return;
+        perror("timeout");
+        return 125;
     }
-    /* if command is fg  */
-    else if (!strcmp(toks[0], "fg"))
-    {
-        fg(toks); 
-        return;
-    } 
-    redirection(toks);
-    return;
+    status = commands(toks + i + 1);
+    return timer_disarm() ? 124 : status;
 }
 
 /* 
- * Function: cd
- * Handles changing directory, if possible.
+ * Function: make_dirs
+ * Makes n directories in one batch. With parents, missing parents are
+ * made first, in a batch of their own, and a directory that exists already
+ * is no error.
  * 
- * toks : pointer to tokens array
+ * paths : directories to make
+ * n : number of directories
+ * parents : set to make parents and allow existing directories
+ * errs : given the errno value of each path, 0 on success
  */
-void cd(char *toks[])
+void make_dirs(char *paths[], size_t n, int parents, int errs[])
 {
-    /* if second token is null (NO directory given) */
-    if (toks[1] == NULL)
+    ring_op_t *ops = calloc(n, sizeof(ring_op_t)); /* one mkdir per path */
+    char **ups = NULL;                             /* parents to make */
+    size_t *of = NULL;                             /* index of the path of each parent */
+    size_t n_up = 0;                               /* number of parents */
+    struct stat st;                                /* what an existing path is */
+
+    /* if calloc fails */
+    if (ops == NULL)
     {
-        fprintf(stderr, "%s\n", "SYNTAX ERROR : Change Directory (cd) failed.");
-        /* if fflush fails */
-        if (fflush(stdout) < 0) {
-            perror("fflush");
-            cleanup_job_list(j_list);
-            exit(EXIT_FAILURE); /* exit(1) */
-        } 
+        for (size_t i = 0; i < n; i++)
+        {
+            errs[i] = ENOMEM;
+        }
+        return;
     }
-    /* if chdir fails */
-    else if (chdir(toks[1]) == -1)
+    for (size_t i = 0; i < n; i++)
     {
-        perror("cd");
+        ops[i].op = RING_MKDIR;
+        ops[i].path = paths[i];
+        ops[i].mode = 0777;
     }
-    return;
-}
-
-/* 
- * Function: ln
- * Handles linking, if possible.
- * 
- * toks : pointer to tokens array
- */
-void ln(char *toks[])
-{
-    /* if the second or third token is null */
-    if (toks[1] == NULL || toks[2] == NULL)
+    ring_run(ops, n);
+    /* if parents are missing, and there is room to list them */
+    if (parents && (ups = malloc(n * sizeof(char *))) != NULL && (of = malloc(n * sizeof(size_t))) != NULL)
     {
-        fprintf(stderr, "%s\n", "SYNTAX ERROR : Link (ln) failed.");
-        /* if fflush fails */
-        if (fflush(stdout) < 0) {
-            perror("fflush");
-            cleanup_job_list(j_list);
-            exit(EXIT_FAILURE); /* exit(1) */
+        for (size_t i = 0; i < n; i++)
+        {
+            char *up;
+            size_t len = strlen(paths[i]);
+
+            if (ops[i].err != ENOENT)
+            {
+                continue;
+            }
+            while (len > 1 && paths[i][len - 1] == '/')
+            {
+                len--;
+            }
+            while (len && paths[i][len - 1] != '/')
+            {
+                len--;
+            }
+            while (len > 1 && paths[i][len - 1] == '/')
+            {
+                len--;
+            }
+            /* siblings share a parent, which is listed once */
+            if (!len || (n_up && !strncmp(ups[n_up - 1], paths[i], len) && ups[n_up - 1][len] == '\0'))
+            {
+                continue;
+            }
+            /* if strndup fails, the path keeps its error */
+            if ((up = strndup(paths[i], len)) != NULL)
+            {
+                of[n_up] = i;
+                ups[n_up++] = up;
+            }
+        }
+        if (n_up)
+        {
+            int *up_errs = malloc(n_up * sizeof(int));
+
+            if (up_errs != NULL)
+            {
+                make_dirs(ups, n_up, 1, up_errs);
+                free(up_errs);
+            }
+            for (size_t i = 0; i < n_up; i++)
+            {
+                free(ups[i]);
+            }
+            /* the paths from the first that needed a parent are tried again */
+            for (size_t i = of[0], k = of[0]; i <= n; i++)
+            {
+                if (i == n || ops[i].err != ENOENT)
+                {
+                    ring_run(ops + k, i - k);
+                    k = i + 1;
+                }
+            }
         }
     }
-    /* if link fails */
-    else if (link(toks[1], toks[2]) == -1)
+    free(ups);
+    free(of);
+    for (size_t i = 0; i < n; i++)
     {
-        perror("ln");
+        errs[i] = ops[i].err;
+        if (parents && errs[i] == EEXIST && meta_stat(paths[i], &st, 1) == 0 && S_ISDIR(st.st_mode))
+        {
+            errs[i] = 0;
+        }
     }
-    return;
+    free(ops);
 }
 
 /* 
- * Function: rm
- * Handles removing, if possible.
+ * Function: mkdir_cmd
+ * Handles making directories: mkdir [-p] path...
  * 
  * toks : pointer to tokens array
  */
-void rm(char *toks[])
+int mkdir_cmd(char *toks[])
 {
-    /* if second token is null */
-    if (toks[1] == NULL)
+    int parents = 0; /* set by -p */
+    size_t i = 1;    /* index of first path */
+    size_t n = 0;    /* number of paths */
+    int *errs;       /* error of each path */
+    int status = 0;  /* exit status */
+
+    for (; toks[i] != NULL && toks[i][0] == '-' && toks[i][1] != '\0'; i++)
     {
-        fprintf(stderr, "%s\n", "SYNTAX ERROR : Remove (rm) failed.");
-        /* if fflush fails */
-        if (fflush(stdout) < 0) {
-            perror("fflush");
-            cleanup_job_list(j_list);
-            exit(EXIT_FAILURE); /* exit(1) */
+        /* if options end */
+        if (!strcmp(toks[i], "--"))
+        {
+            i++;
+            break;
+        }
+        /* if option is unknown */
+        if (toks[i][1 + strspn(toks[i] + 1, "p")] != '\0')
+        {
+            fprintf(stderr, "%s\n", "SYNTAX ERROR : mkdir: Unknown option.");
+            return 2;
         }
+        parents = 1;
     }
-    /* if unlink fails */
-    else if (unlink(toks[1]) == -1)
+    while (toks[i + n] != NULL)
     {
-        perror("rm");
+        n++;
     }
-    return;
+    /* if no path follows */
+    if (!n)
+    {
+        fprintf(stderr, "%s\n", "SYNTAX ERROR : mkdir: Missing path.");
+        return 2;
+    }
+    /* if malloc fails */
+    if ((errs = malloc(n * sizeof(int))) == NULL)
+    {
+        perror("mkdir");
+        return 1;
+    }
+    make_dirs(toks + i, n, parents, errs);
+    for (size_t k = 0; k < n; k++)
+    {
+        if (errs[k])
+        {
+            fprintf(stderr, "mkdir: %s: %s\n", toks[i + k], strerror(errs[k]));
+            status = 1;
+        }
+        else
+        {
+            meta_bump(toks[i + k]);
+        }
+    }
+    free(errs);
+    return status;
 }
 
 /* 
@@ -381,7 +3196,7 @@ void rm(char *toks[])
  * 
  * toks[] : pointer to toks array
  */
-void bg(char *toks[])
+int bg(char *toks[])
 {
     pid_t child_pid;
     int child_jid;
@@ -395,7 +3210,7 @@ void bg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 2;
     }
     /* if the second element in toks does NOT start with "%" */
     if (strncmp(toks[1], "%", 1))
@@ -407,7 +3222,7 @@ void bg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 1;
     }
 
     child_jid = atoi(toks[1] + 1); /* converts ptr to int */
@@ -421,7 +3236,7 @@ void bg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 1;
     }
     /* if kill fails */
     if (kill(-child_pid, SIGCONT) == -1)
@@ -433,7 +3248,7 @@ void bg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 1;
     }
     /* if update_job_jid fails */
     if (update_job_jid(j_list, child_jid, RUNNING) == -1)
@@ -445,9 +3260,9 @@ void bg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 1;
     }
-    return;
+    return 0;
 }
 
 /* 
@@ -456,7 +3271,7 @@ void bg(char *toks[])
  * 
  * toks[] : pointer to toks array
  */
-void fg(char *toks[])
+int fg(char *toks[])
 {
     int w; /* waitpid return value */
     int status;
@@ -473,7 +3288,7 @@ void fg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 2;
     }
     /* if second element in toks does NOT start with "%" */
     if (strncmp(toks[1], "%", 1))
@@ -485,7 +3300,7 @@ void fg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 1;
     }
 
     child_jid = atoi(strrchr(toks[1], '%') + 1); /* converts ptr to int */ 
@@ -499,28 +3314,30 @@ void fg(char *toks[])
             cleanup_job_list(j_list);
             exit(EXIT_FAILURE); /* exit(1) */
         }
-        return;
+        return 1;
     }
     /* if tcsetpgrp fails */
-    if (tcsetpgrp(STDIN_FILENO, child_pid) == -1)
+    if (job_control && tcsetpgrp(STDIN_FILENO, child_pid) == -1)
     {
         perror("tcsetpgrp");
-        return;
+        return 1;
     }
+    meta_ran();
+    input_sync();
     /* if kill to restart in fg fails */
     if (kill(-child_pid, SIGCONT) == -1)
     {
         perror("kill");
-        return;
+        return 1;
     }
 
     update_job_jid(j_list, child_jid, RUNNING);
 
     /* if waitpid fails to return process ID of the terminated child */
-    if ((w = waitpid(child_pid, &status, WUNTRACED)) == -1)
+    if ((w = timer_wait(child_pid, &status)) == -1)
     {
         perror("waitpid");
-        return;
+        return 1;
     }
     // /* if child process has no status to report */ // ???
     // if (!w)
@@ -543,7 +3360,7 @@ void fg(char *toks[])
                 cleanup_job_list(j_list);
                 exit(EXIT_FAILURE); /* exit(1) */
             }
-            return;
+            return 1;
         }
     }
     /* if child process is exited */
@@ -560,7 +3377,7 @@ void fg(char *toks[])
                 cleanup_job_list(j_list);
                 exit(EXIT_FAILURE); /* exit(1) */
             }
-            return;
+            return 1;
         }
     }
     /* if child process is stopped */
@@ -578,49 +3395,48 @@ void fg(char *toks[])
                 cleanup_job_list(j_list);
                 exit(EXIT_FAILURE); /* exit(1) */
             }
-            return;
+            return 1;
         }
     }
     /* if tcsetpgrp fails */
-    if (tcsetpgrp(STDIN_FILENO, getpgid(0)) == -1)
+    if (job_control && tcsetpgrp(STDIN_FILENO, getpgid(0)) == -1)
     {
         perror("tcsetpgrp");
     }
-    return;
+    return wait_status(status);
 }
 
-/* 
- * Function: redirection
- * 
+/*
+ * Function: parse_redirects
+ * Sorts the tokens of a command into its arguments and its redirections.
+ * argv gets a slot per token, left empty for redirection tokens.
+ * Returns the number of slots, -1 after reporting a syntax error.
+ *
  * toks : pointer to tokens array
+ * n : number of tokens
+ * argv : pointer to arguments array, n + 1 long and zeroed
+ * in_symbol : pointer to input symbol, left alone if there is none
+ * in_path : pointer to input path
+ * out_symbol : pointer to output symbol, left alone if there is none
+ * out_path : pointer to output path
  */
-void redirection(char *toks[])
+int parse_redirects(char *toks[], int n, char *argv[], char **in_symbol, char **in_path, char **out_symbol,
+                    char **out_path)
 {
-    const char *input = "<";
-    const char *output = ">";
-    const char *append = ">>";
+    char *input = op_in;     /* operators, compared by address so quoted ones are arguments */
+    char *output = op_out;
+    char *append = op_append;
+    char *here = op_here;
     int in_flag = 0;   /* input flag */
     int out_flag = 0;  /* output flag */
     int argv_flag = 0; /* file after redirection symbol flag */
     int argv_index = 0;
-    char *in_symbol = "\0";   /* input symbol */
-    char *out_symbol = "\0";  /* output symbol */
-    char *in_path = "\0";     /* input path */
-    char *out_path = "\0";    /* output path */
-    char *argv[MAX_SIZE / 2]; /* array of size 512 */
-
-    memset(argv, '\0', sizeof(argv)); /* instantiate argv */
 
     /* loop through tokens */
-    for (int i = 0; i < (MAX_SIZE / 2); i++)
+    for (int i = 0; i < n; i++)
     {
-        /* if toks[i] is NULL */
-        if (toks[i] == NULL)
-        {
-            break;
-        }
         /* if toks[i] is NOT a redirection */
-        if ((strcmp(toks[i], input) != 0) && (strcmp(toks[i], output) != 0) && (strcmp(toks[i], append) != 0))
+        if (toks[i] != input && toks[i] != output && toks[i] != append && toks[i] != here)
         {
             /* argv did NOT raise flag */
             if (!argv_flag)
@@ -633,8 +3449,8 @@ void redirection(char *toks[])
         else
         {
             argv_flag = 1;
-            /* if toks[i] is input symbol */
-            if (!strcmp(toks[i], input))
+            /* if toks[i] is input symbol, or a here-document or here-string */
+            if (toks[i] == input || toks[i] == here)
             {
                 /* if toks[i] is the input symbol */
                 if (in_flag)
@@ -647,7 +3463,7 @@ void redirection(char *toks[])
                         cleanup_job_list(j_list);
                         exit(EXIT_FAILURE); /* exit(1) */
                     }
-                    return;
+                    return -1;
                 }
                 /* if the next token is NULL (NO input file) */
                 else if (toks[i + 1] == NULL)
@@ -660,10 +3476,10 @@ void redirection(char *toks[])
                         cleanup_job_list(j_list);
                         exit(EXIT_FAILURE); /* exit(1) */
                     }
-                    return;
+                    return -1;
                 }
                 /* if next file is the input, output or append symbol (two consecutive redirection symbols) */
-                else if (!strcmp(toks[i + 1], input) || !strcmp(toks[i + 1], output) || !strcmp(toks[i + 1], append))
+                else if (toks[i + 1] == input || toks[i + 1] == output || toks[i + 1] == append || toks[i + 1] == here)
                 {
                     fprintf(stderr, "%s\n", "SYNTAX ERROR : Input file is a redirection symbol.");
                     /* if fflush fails */
@@ -673,15 +3489,15 @@ void redirection(char *toks[])
                         cleanup_job_list(j_list);
                         exit(EXIT_FAILURE); /* exit(1) */
                     }
-                    return;
+                    return -1;
                 }
 
                 in_flag = 1;
-                in_symbol = toks[i];
-                in_path = toks[i + 1];
+                *in_symbol = toks[i];
+                *in_path = toks[i + 1];
             }
             /* if toks[i] is output or append symbol */
-            else if (!strcmp(toks[i], output) || !strcmp(toks[i], append))
+            else if (toks[i] == output || toks[i] == append)
             {
                 /* if toks[i] is output symbol */
                 if (out_flag)
@@ -694,7 +3510,7 @@ void redirection(char *toks[])
                         cleanup_job_list(j_list);
                         exit(EXIT_FAILURE); /* exit(1) */
                     }
-                    return;
+                    return -1;
                 }
                 /* if the next token is NULL (NO output file) */
                 else if (toks[i + 1] == NULL)
@@ -707,10 +3523,10 @@ void redirection(char *toks[])
                         cleanup_job_list(j_list);
                         exit(EXIT_FAILURE); /* exit(1) */
                     }
-                    return;
+                    return -1;
                 }
                 /* if next file is the input, output or append symbol (two consecutive redirection symbols) */
-                else if (!strcmp(toks[i + 1], input) || !strcmp(toks[i + 1], output) || !strcmp(toks[i + 1], append))
+                else if (toks[i + 1] == input || toks[i + 1] == output || toks[i + 1] == append || toks[i + 1] == here)
                 {
                     fprintf(stderr, "%s\n", "SYNTAX ERROR : Output file is a redirection symbol.");
                     /* if fflush fails */
@@ -720,31 +3536,70 @@ void redirection(char *toks[])
                         cleanup_job_list(j_list);
                         exit(EXIT_FAILURE); /* exit(1) */
                     }
-                    return;
+                    return -1;
                 }
 
                 out_flag = 1;
-                out_symbol = toks[i];
-                out_path = toks[i + 1];
+                *out_symbol = toks[i];
+                *out_path = toks[i + 1];
             }
         }
         argv_index++;
     }
 
+    return argv_index;
+}
+
+/* 
+ * Function: redirection
+ * 
+ * toks : pointer to tokens array
+ */
+int redirection(char *toks[])
+{
+    int argv_index;
+    char *in_symbol = "\0";   /* input symbol */
+    char *out_symbol = "\0";  /* output symbol */
+    char *in_path = "\0";     /* input path */
+    char *out_path = "\0";    /* output path */
+    char **argv;      /* as long as toks, a command line has no fixed limit */
+    struct stat st;
+    int n = 0;
+    int status;
+
+    while (toks[n] != NULL)
+    {
+        n++;
+    }
+    /* if calloc fails */
+    if ((argv = calloc((size_t)n + 1, sizeof(char *))) == NULL)
+    {
+        perror("calloc");
+        return 1;
+    }
+    /* if the redirections are malformed */
+    if ((argv_index = parse_redirects(toks, n, argv, &in_symbol, &in_path, &out_symbol, &out_path)) == -1)
+    {
+        free(argv);
+        return 2;
+    }
     argv[argv_index] = '\0';
 
-    if (open(argv[0], O_RDONLY) == -1) {
-        perror("open");\
-        return;
+    /* if command does not exist, as the metadata cache may already know */
+    if (meta_stat(argv[0], &st, 1) == -1) {
+        perror("open");
+        free(argv);
+        return 127;
     }
 
-    fork_and_exec(argv, argv_index, in_symbol, out_symbol, in_path, out_path);
-    return;
+    status = fork_and_exec(argv, argv_index, in_symbol, out_symbol, in_path, out_path);
+    free(argv);
+    return status;
 }
 
 /* 
  * Function: fork_and_exec
- * Handles forking, calls execv and checks if process is bg or fg
+ * Handles forking, calls execve and checks if process is bg or fg
  * 
  * argv[] : pointer to argv array
  * argv_len : length of argv
@@ -754,27 +3609,65 @@ void redirection(char *toks[])
  * out_path : pointer to output path
  * args : pointer to arguments
  */
-void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol, char *in_path, char *out_path)
+int fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol, char *in_path, char *out_path)
 {
     int f;         /* fork return value */
-    int w;         /* waitpid return value */
-    int status;
     int is_bg = 0; /* background flag */
+    char **envp;   /* environment of exported variables */
+    int out[2] = {-1, -1}; /* pipe to a command substitution capturing the output */
+    int in = -1;           /* text of a here-document or here-string for stdin */
 
     /* if last element in argv is "&" */
-    if (!strcmp(argv[argv_len - 1], "&"))
+    if (argv[argv_len - 1] == op_bg)
     {
         is_bg = 1;
         argv[argv_len - 1] = '\0';
     }
 
-    char path[strlen(argv[0])];
+    char path[strlen(argv[0]) + 1];
+
+    strcpy(path, argv[0]); /* keep full path for execve and the job list */
+    fflush(stdout); /* builtin output so far comes before the child's */
+
+    /* if environment can not be built */
+    if ((envp = var_environ()) == NULL)
+    {
+        perror("environ");
+        return 1;
+    }
 
+    /* if stdin is a here-document or here-string and its text can not be staged */
+    if (in_symbol == op_here && (in = here_open(in_path, strlen(in_path))) == -1)
+    {
+        perror("here-document");
+        return 1;
+    }
+    /* if output is captured and pipe fails */
+    if (capture_current != NULL && pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        if (in != -1)
+        {
+            close(in);
+        }
+        return 1;
+    }
+    meta_ran(); /* the program may change files, so the metadata cache rereads changes */
+    input_sync(); /* and may read what the read builtin has read ahead */
     /* if fork fails */
     if ((f = fork()) == -1)
     {
         perror("fork");
-        return;
+        if (out[0] != -1)
+        {
+            close(out[0]);
+            close(out[1]);
+        }
+        if (in != -1)
+        {
+            close(in);
+        }
+        return 1;
     }
     /* if child process is created */
     else if (!f)
@@ -783,7 +3676,19 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
         if (setpgid(f, 0) == -1)
         {
             perror("setpgid");
-            return;
+            _exit(EXIT_FAILURE); /* _exit(1) */
+        }
+        /* if output goes to a substitution and dup2 fails */
+        if (out[1] != -1 && dup2(out[1], STDOUT_FILENO) == -1)
+        {
+            perror("dup2");
+            _exit(EXIT_FAILURE); /* _exit(1) */
+        }
+        /* if stdin is a here-document and dup2 fails */
+        if (in != -1 && dup2(in, STDIN_FILENO) == -1)
+        {
+            perror("dup2");
+            _exit(EXIT_FAILURE); /* _exit(1) */
         }
         
         if (!strcmp(in_symbol, "<"))
@@ -792,13 +3697,13 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
             if (close(STDIN_FILENO) == -1)
             {
                 perror("close");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
             /* if open fails */
             if (open(in_path, O_RDONLY, 0600) == -1)
             {
                 perror("open");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
         }
         /* if redirection is output */
@@ -808,13 +3713,13 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
             if (close(STDOUT_FILENO) == -1)
             {
                 perror("close");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
             /* if open fails */
             if (open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0600) == -1)
             {
                 perror("open");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
         }
         /* if redirection is append */
@@ -824,36 +3729,74 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
             if (close(STDOUT_FILENO) == -1)
             {
                 perror("close");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
             /* if close fails */
             if (open(out_path, O_RDWR | O_CREAT | O_APPEND, 0600) == -1)
             {
                 perror("open");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
         }
 
-        if (!is_bg) {
+        if (!is_bg && job_control) {
             /* if tcsetpgrp fails */
             if (tcsetpgrp(STDIN_FILENO, getpgid(0)) == -1)
             {
                 perror("tcsetpgrp");
-                return;
+                _exit(EXIT_FAILURE); /* _exit(1) */
             }
         }
         restore_signals(); /* restore signals in child */
 
         /* find pointer to first non "/" character after the last "/" and store as first element of argv */ 
-        strcpy(path, argv[0]);
         argv[0] = strrchr(argv[0], '/') + 1;
-        /* if execv fails */
-        if (execv(path, argv) == -1)
+        /* if execve fails */
+        if (execve(path, argv, envp) == -1)
         {
-            perror("execv");
-            return;
+            int err = errno;
+
+            perror("execve");
+            /* if the arguments are too long */
+            if (err == E2BIG)
+            {
+                fprintf(stderr, "%s\n", "ERROR : Put ...+ after the longest word to run the command in batches.");
+            }
+            _exit(EXIT_FAILURE); /* _exit(1) */
+        }
+    }
+    if (in != -1)
+    {
+        close(in);
+    }
+    /* if output is captured, read it all before waiting, so the child never blocks on a full pipe */
+    if (out[0] != -1)
+    {
+        close(out[1]);
+        if (capture_read(capture_current, out[0]) == -1)
+        {
+            perror("read");
         }
+        close(out[0]);
     }
+    return track_job(f, is_bg, path);
+}
+
+/*
+ * Function: track_job
+ * Adds a background child to the job list, or waits for a foreground one,
+ * adding it if it stops, and takes the terminal back.
+ * 
+ * f : process ID of the child, the leader of its process group
+ * is_bg : set if the child runs in the background
+ * path : name of the job
+ */
+int track_job(pid_t f, int is_bg, char *path)
+{
+    int w;         /* waitpid return value */
+    int status;
+
+    timer_attach(f); /* a job forked under timeout is under its limit */
     /* if child is background process */
     if (is_bg)
     {
@@ -863,7 +3806,7 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
             if (fflush(stdout) < 0) 
             {
                 perror("fflush");
-                return;
+                return 1;
             }
         }
         printf("[%d] (%d)\n", j_cnt, f);
@@ -872,9 +3815,9 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
     else 
     { 
         /* if waitpid fails */
-        if ((w = waitpid(f, &status, WUNTRACED)) == -1) {
+        if ((w = timer_wait(f, &status)) == -1) {
             perror("waitpid");
-            return;
+            return 1;
         }
         /* if process is terminated by unhandled signal */
         if (WIFSIGNALED(status))
@@ -892,19 +3835,44 @@ void fork_and_exec(char *argv[], int argv_len, char *in_symbol, char *out_symbol
                 /* if fflush fails */
                 if (fflush(stdout) < 0) {
                     perror("fflush");
-                    return;
+                    return 1;
                 }
             }
             j_cnt++;
         }
         /* if tcsetpgrp fails */
-        if (tcsetpgrp(STDIN_FILENO, getpgid(0)) == -1) 
+        if (job_control && tcsetpgrp(STDIN_FILENO, getpgid(0)) == -1) 
         {
             perror("tcsetpgrp");
-            return;
+            return 1;
         }
     }
-    return;
+    return is_bg ? 0 : wait_status(status);
+}
+
+/*
+ * Function: wait_status
+ * Converts a status from waitpid into the exit status of a command.
+ * 
+ * status : waitpid status
+ */
+int wait_status(int status)
+{
+    /* if process exited normally */
+    if (WIFEXITED(status))
+    {
+        return WEXITSTATUS(status);
+    }
+    /* if process was terminated or stopped by a signal */
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status))
+    {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
 }
 
 /* 
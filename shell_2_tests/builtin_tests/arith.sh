@@ -0,0 +1,9 @@
+# arith - arithmetic expansion, (( )) and while, until and if
+echo $((2 + 3 * 4)) $(( (7 - 1) / 4 )) $((9223372036854775807 + 1 > 0))
+i=0
+while (( i < 3 )); do echo loop $i; i=$((i + 1)); done
+until [ $i -eq 0 ]; do i=$((i - 1)); done
+echo $i
+if (( 5 > 3 )); then echo yes; else echo no; fi
+(( 0 ))
+echo status $?
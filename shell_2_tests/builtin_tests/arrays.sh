@@ -0,0 +1,23 @@
+# arrays - indexed and associative arrays, declare with name=(...), mapfile
+declare -A m=([a]=1 [b]="two words")
+echo ${m[a]} ${m[b]} ${#m[@]}
+declare -a l=(x y z)
+echo ${l[1]} ${#l[@]}
+l+=(w)
+echo ${l[@]}
+declare -a l+=(v)
+echo ${l[@]}
+declare arr=(p q)
+echo ${arr[1]}
+declare -a s='(a b)'
+echo $s
+declare -A bad=(novalue)
+echo status $?
+declare -a m=(1)
+echo status $?
+v=3
+declare -a e=($v [5]=five six)
+echo ${e[0]} ${e[5]} ${e[6]}
+printf '%s\n' one two three > lines.txt
+mapfile -t got < lines.txt
+echo ${#got[@]} ${got[2]}
@@ -0,0 +1,24 @@
+# batching - ...+ splits an argument list too long for one exec into batches
+/bin/echo {1..400000} ...+ > out.txt
+echo status $?
+mapfile -t l < out.txt
+(( ${#l[@]} > 1 )) && echo batched
+/usr/bin/wc -w out.txt
+/bin/echo {1..5} ...+2 > out2.txt
+/bin/cat out2.txt
+# a builtin that leaves the shell alone runs its batches in children
+/usr/bin/touch g{1..50}
+rm g{1..50} ...+4
+echo rm $?
+/bin/ls
+# alias changes the shell, so its batches run in the shell
+alias a1=echo a2=echo ...+4
+a2 alias
+# a builtin's batches empty the file once too
+echo old > out3.txt
+echo {1..3} ...+2 > out3.txt
+/bin/cat out3.txt
+# batches are no job of their own, so they are not put in the background
+/bin/sleep 0.1 0.1 ...+1 &
+echo background $?
+jobs
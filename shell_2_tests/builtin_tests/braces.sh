@@ -0,0 +1,8 @@
+# braces - brace lists and ranges, for loops over them
+echo a{b,c,d}e
+echo {1..5} {a..c} {05..10..5}
+for i in {1..3}; do echo i$i; done
+for w in x y; do echo $w; done
+n=0
+for i in {1..100000}; do n=$((n + i)); done
+echo $n
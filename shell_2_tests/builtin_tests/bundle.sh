@@ -0,0 +1,8 @@
+# bundle - a bundled script runs without its source, with its arguments
+echo 'echo bundled $1 $#' > s.sh
+$SH --bundle s.sh -o tool
+/bin/rm s.sh
+./tool one two
+echo 'echo (' > bad.sh
+$SH --bundle bad.sh -o bad
+echo status $?
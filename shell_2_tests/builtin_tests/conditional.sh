@@ -0,0 +1,8 @@
+# conditional - [[ ]] with patterns, =~ captures, && and comparisons
+f=file.txt
+[[ $f == *.txt ]] && echo glob
+[[ $f == *.c ]] || echo noglob
+[[ abc123 =~ ^([a-z]+)([0-9]+)$ ]] && echo ${BASH_REMATCH[1]} ${BASH_REMATCH[2]}
+[[ -n $f && ! -z $f ]] && echo and
+[[ a < b ]] && echo less
+[[ 10 -gt 9 ]] && echo numeric
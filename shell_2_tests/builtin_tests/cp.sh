@@ -0,0 +1,33 @@
+# a file copied onto itself, by its name or a hard link, is left intact
+echo keep > f
+cp f f
+echo same $?
+/bin/cat f
+ln f g
+cp f g
+echo link $?
+/bin/cat f
+cp f h
+echo copy $?
+/bin/cat h
+mkdir -p d/e
+echo deep > d/e/x
+cp -r d d2
+echo tree $?
+/bin/cat d2/e/x
+/bin/chmod 600 f
+/bin/touch -d 2001-02-03 f
+cp -p f p
+echo keep $?
+/usr/bin/stat -c '%a %y' p
+# a device is written, not truncated
+cp f /dev/null
+echo device $?
+# a tree is not copied into itself, and nothing of it is made
+cp -r d d/e/y
+echo into $?
+test -e d/e/y
+echo made $?
+cp -r d/e d/e2
+echo sibling $?
+/bin/cat d/e2/x
@@ -0,0 +1,7 @@
+# dispatch - builtins are found by exact name; other names are not builtins
+cd /
+/bin/pwd
+cdx /
+echo status $?
+ech not-a-builtin
+echo status $?
@@ -0,0 +1,22 @@
+# many paths at once go through the batch; each error is reported once
+/bin/touch f1 f2 f3 f4 f5
+/bin/mkdir d1
+rm f1 f2 d1 f3 f4 missing f5
+echo rm $?
+test -e f5
+echo f5 $?
+mkdir a b c d e
+echo mkdir $?
+mkdir a b x
+echo again $?
+mkdir -p p/q/r a
+echo parents $?
+test -d p/q/r
+echo made $?
+/bin/touch t1 t2 t3 t4 t5
+ln t1 t2 t3 t4 t5 x
+echo ln $?
+ln t1 t2 t3 t4 t5 x
+echo twice $?
+test -f x/t5
+echo linked $?
@@ -0,0 +1,11 @@
+# functions - functions take arguments and return statuses; aliases expand
+greet() { echo hello $1 $2; }
+greet big world
+fail() { return 3; }
+fail
+echo status $?
+alias say='echo said'
+say it
+unalias say
+count() { echo $#; }
+count a b c
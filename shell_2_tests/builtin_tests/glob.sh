@@ -0,0 +1,8 @@
+# glob - * ? [...] and ** match paths; a pattern matching nothing stays as is
+/bin/mkdir -p d/sub/deep
+/bin/touch d/a.c d/b.c d/c.h d/sub/x.c d/sub/deep/y.c
+echo d/*.c
+echo d/?.h
+echo d/[ab].c
+echo d/**/*.c
+echo nomatch/*.z
@@ -0,0 +1,12 @@
+# heredoc - here-documents, quoted and not, and here-strings
+v=world
+/bin/cat <<EOT
+hello $v
+  indented
+EOT
+/bin/cat <<'EOT'
+literal $v
+EOT
+/bin/cat <<< "here string $v"
+read a b <<< "first second"
+echo $b $a
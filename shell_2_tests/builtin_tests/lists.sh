@@ -0,0 +1,7 @@
+# lists - ; && and || run commands by the status of the one before
+echo a; echo b
+/bin/true && echo and-ran
+/bin/false && echo and-skipped
+/bin/false || echo or-ran
+/bin/true || echo or-skipped
+/bin/false && echo no || echo chained
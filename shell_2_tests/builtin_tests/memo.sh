@@ -0,0 +1,22 @@
+# a miss runs the command and shows its output; a hit replays it without running it
+echo a > in
+memo -i in /bin/sh -c 'echo ran >> log; /bin/cat in; exit 3'
+echo miss $?
+memo -i in /bin/sh -c 'echo ran >> log; /bin/cat in; exit 3'
+echo hit $?
+/bin/cat log
+echo changed > in
+memo -i in /bin/sh -c 'echo ran >> log; /bin/cat in; exit 3'
+echo rerun $?
+/bin/cat log
+x=$(memo -e V /bin/sh -c 'echo ran >> log; echo captured')
+echo "[$x]"
+x=$(memo -e V /bin/sh -c 'echo ran >> log; echo captured')
+echo "[$x]"
+V=1
+memo -e V /bin/sh -c 'echo ran >> log; echo captured'
+/bin/cat log
+memo /bin/echo background &
+echo background $?
+memo echo builtin
+memo echo builtin
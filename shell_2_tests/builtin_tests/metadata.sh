@@ -0,0 +1,35 @@
+# metadata - cached file tests follow symbolic links that are replaced or retargeted
+/bin/mkdir x y
+/bin/touch x/f
+/bin/ln -s x L
+test -f L/f; echo $?
+rm L
+/bin/mkdir L
+test -f L/f; echo $?
+/bin/rmdir L
+/bin/ln -s x L
+test -f L/f; echo $?
+/bin/ln -sfn y L
+test -f L/f; echo $?
+/bin/ln -sfn x L
+test -f L/f; echo $?
+/bin/ln -s y M
+cd M
+cd ..
+test -f M/f; echo $?
+rm M
+/bin/ln -s x M
+test -f M/f; echo $?
+/bin/mv x z
+test -f L/f; echo $?
+/bin/mv z x
+[ -f L/f ]; echo $?
+echo L/*
+/bin/mv x z
+test -f L/f2; echo $?
+/bin/mkdir x
+/bin/touch x/f2
+test -f L/f2; echo $?
+cd L
+/bin/touch ../x/f3
+test -f f3; echo $?
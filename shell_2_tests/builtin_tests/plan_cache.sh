@@ -0,0 +1,10 @@
+# plan_cache - a script's compiled plan is cached, and a changed script is
+# compiled again rather than run from the stale plan
+echo 'echo first version' > s.sh
+$SH s.sh
+$SH s.sh
+n=0 # plans of this script and of s.sh
+for f in .cache/33sh/*; do n=$((n + 1)); done
+echo cached $n
+echo 'echo the second version' > s.sh
+$SH s.sh
@@ -0,0 +1,12 @@
+# print - echo and printf formats, and printf to a file
+echo plain words
+echo -n no-newline; echo
+echo -e 'tab\there'
+printf '%s=%d\n' a 1 b 2
+printf '%5s|%-5s|%05d\n' r l 42
+printf '%x %o %c %%\n' 255 8 xyz
+printf 'no args\n'
+printf '%s\n' "with spaces" > out.txt
+/bin/cat out.txt
+printf '%d\n' notanumber
+echo status $?
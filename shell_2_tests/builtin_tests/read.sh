@@ -0,0 +1,19 @@
+# read - read splits lines into variables; on a pipe it takes no more than
+# the line, so a program run after it reads the rest
+read a
+echo got $a
+read -n 2 b
+read c d
+echo $b $c $d
+IFS=: read x y
+echo $y $x
+read -r raw
+echo $raw
+# a loop's redirection holds for the whole loop, and stdin comes back after it
+printf '%s\n' 1 2 3 > nums
+n=0
+while read l; do n=$((n + l)); done < nums
+echo sum $n
+/bin/cat
+read last
+echo status $? [$last]
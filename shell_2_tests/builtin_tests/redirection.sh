@@ -0,0 +1,17 @@
+# redirection - builtins and functions take < > and >> in the shell
+f() { echo in f $1; /bin/echo program in f; }
+f one > o.txt
+echo after
+/bin/cat o.txt
+f two >> o.txt
+/bin/cat o.txt
+g() { read line; echo g read $line; }
+echo input-line > in.txt
+g < in.txt
+echo builtin > b.txt
+/bin/cat b.txt
+x=$(f three > c.txt; echo captured)
+echo $x
+/bin/cat c.txt
+f four < missing.txt
+echo status $?
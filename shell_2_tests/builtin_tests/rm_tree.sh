@@ -0,0 +1,20 @@
+# rm_tree - rm removes files and, with -r, trees deeper than the descriptors
+# the shell may hold, in parallel; -f passes over files already gone
+/bin/touch a b c
+rm a b
+test -e a; echo a $?
+rm missing
+echo missing $?
+rm -f missing c
+echo forced $?
+/bin/mkdir dir
+rm dir
+echo dir $?
+p=deep
+for i in {1..400}; do p=$p/d; done
+mkdir -p $p x/y/z
+/bin/touch $p/leaf x/y/z/f x/f
+rm -r deep x
+echo tree $?
+test -e deep; echo deep $?
+test -e x; echo x $?
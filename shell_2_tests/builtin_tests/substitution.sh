@@ -0,0 +1,9 @@
+# substitution - $(...) and backquotes, nested and around functions
+x=$(echo inner)
+echo [$x] [`echo back`]
+echo $(echo $(echo nested))
+f() { echo from function; }
+echo "$(f)"
+echo $(/bin/echo program)
+n=$(echo -n)
+echo [$n]
@@ -0,0 +1,17 @@
+# test - test and [ with file, string and numeric operators
+/bin/touch file
+/bin/mkdir dir
+test -f file; echo f $?
+test -d file; echo d $?
+[ -d dir ]; echo dir $?
+[ -e missing ]; echo missing $?
+[ abc = abc ]; echo eq $?
+[ abc != abc ]; echo ne $?
+test 3 -lt 10; echo lt $?
+[ -n "" ]; echo n $?
+[ -z "" ]; echo z $?
+[ ! -f file ]; echo not $?
+[ -f file -a -d dir ]; echo and $?
+[ -f missing -o -d dir ]; echo or $?
+test; echo empty $?
+[ 1 -eq 1; echo unclosed $?
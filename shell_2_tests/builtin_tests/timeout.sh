@@ -0,0 +1,42 @@
+# timeout limits programs and, in the shell, the builtins sleep and read
+t0=$(/bin/date +%s)
+timeout 1 sleep 3
+echo sleep $?
+(( $(/bin/date +%s) - t0 < 3 ))
+echo early $?
+timeout 3 sleep 0.2
+echo short $?
+timeout 0.5 sleep 0.1 0.1
+echo sum $?
+sleep 0.1
+echo plain $?
+x=kept
+timeout 1 read x
+echo eof $? "[$x]"
+# job notices, which name the pid, go to a file
+limited() {
+    timeout 1 /bin/sleep 3
+    echo program $?
+    f() { sleep 3; /bin/sleep 3; echo after; }
+    timeout 1 f
+    echo function $?
+    # the limit bounds the function as a whole, not only its first job
+    g() { /bin/true; /bin/sleep 3; /bin/sleep 3; }
+    t0=$(/bin/date +%s)
+    timeout 1 g
+    echo jobs $?
+    (( $(/bin/date +%s) - t0 < 3 ))
+    echo bounded $?
+    /usr/bin/mkfifo p
+    /bin/sleep 3 > p &
+    timeout 1 read x < p
+    echo read $?
+}
+limited > jobs.txt
+/bin/grep -v '^\[' jobs.txt
+timeout 5 memo sleep 0.2
+echo memo $?
+timeout 1 memo sleep 3
+echo memo $?
+timeout
+echo usage $?
@@ -0,0 +1,10 @@
+# variables - assignment, expansion operators, export and unset
+x=hello
+echo $x ${x} ${#x}
+echo ${unset:-default} ${x:+alt}
+y=${x%lo}; echo $y ${x#he}
+export x
+/usr/bin/printenv x
+unset x
+echo [$x]
+echo ${x:=assigned} $x
@@ -0,0 +1,54 @@
+# watch runs at start and after changes to the file, not to its neighbours,
+# within a capped wait while the file keeps changing, and ends when its
+# directory is removed
+mkdir d
+echo 0 > d/t
+# job notices, which name the pid, go to a file
+start() { watch -d 300 -f d/t -- /bin/sh -c 'echo run >> log' & }
+start > jobs.txt
+sleep 0.5
+echo 1 > d/t
+sleep 0.8
+echo other > d/u
+sleep 0.8
+/bin/cat log
+/bin/rm log
+i=0
+while (( i < 40 ))
+do
+    echo $i > d/t
+    sleep 0.1
+    (( i++ ))
+done
+test -e log
+echo burst $?
+sleep 0.8
+settle() { /bin/rm -r d; sleep 1; jobs; }
+settle > jobs.txt
+[[ $(/bin/cat jobs.txt) == *"exit status 1"* ]]
+echo ended $?
+# a directory removed and made again is still watched, until its parent goes
+mkdir -p p/w
+begin() { watch -d 200 -f p/w -- /bin/sh -c 'echo run >> wlog' & }
+begin > jobs.txt
+sleep 0.5
+/bin/rm -r p/w
+sleep 0.5
+mkdir p/w
+sleep 0.5
+/bin/rm wlog
+echo after > p/w/b
+sleep 0.6
+/bin/cat wlog
+# -c ends a run with everything it started
+mkdir c
+echo 0 > c/t
+begin() { watch -c -d 100 -f c/t -- /bin/sh -c '(/bin/sleep 1; echo done >> clog); :' & }
+begin > jobs.txt
+sleep 0.3
+echo 1 > c/t
+sleep 2
+/bin/cat clog
+settle() { /bin/rm -r c p; sleep 1; jobs; }
+settle > jobs.txt
+/bin/grep -c 'exit status 1' jobs.txt
@@ -0,0 +1,619 @@
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "./timer.h"
+
+#define TIMER_MAX 32  /* most limits, and most jobs under limits, at once */
+
+/* a time limit of timeout, on what runs while it is armed */
+typedef struct limit {
+    int used;                 /* set while the slot is taken */
+    int depth;                /* nesting of the timeout while it runs, 0 once it has returned */
+    int fd;                   /* timerfd */
+    int sig;                  /* signal sent at the limit */
+    struct timespec grace;    /* time from sig to SIGKILL, 0 for never */
+    int stage;                /* 0 before the limit, 1 in the grace period, 2 when done */
+    int fired;                /* set once the limit passes */
+} limit_t;
+
+/* a job forked while a limit was armed */
+typedef struct member {
+    pid_t pid;                /* leader of the job, -1 if the slot is free */
+    limit_t *limit;
+} member_t;
+
+/* signal names timeout takes */
+static const struct {
+    const char *name;
+    int sig;
+} signals[] = {{"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+               {"USR2", SIGUSR2}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}};
+
+static limit_t limits[TIMER_MAX];
+static member_t members[TIMER_MAX];
+static int n_members = 0;    /* member slots used so far */
+static int depth = 0;        /* timeouts running, one inside another */
+
+/* Helper Functions */
+
+/*
+ * Function: innermost
+ * Finds the limit of the timeout running innermost. Returns it, NULL if
+ * no timeout is running.
+ */
+static limit_t *innermost()
+{
+    for (int i = 0; i < TIMER_MAX; i++)
+    {
+        if (limits[i].used && limits[i].depth == depth && depth)
+        {
+            return &limits[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: drop_member
+ * Frees the slot of a job under a limit, and the limit too if its timeout
+ * has returned and no other job is under it.
+ */
+static void drop_member(member_t *m)
+{
+    limit_t *l = m->limit;
+
+    m->pid = -1;
+    if (l->depth)
+    {
+        return;
+    }
+    for (int i = 0; i < n_members; i++)
+    {
+        if (members[i].pid != -1 && members[i].limit == l)
+        {
+            return;
+        }
+    }
+    close(l->fd);
+    l->used = 0;
+}
+
+/*
+ * Function: signal_job
+ * Sends a signal to the process group of a job, or to its leader if the
+ * group is not formed yet, and continues it in case it is stopped.
+ */
+static void signal_job(pid_t pid, int sig)
+{
+    if (kill(-pid, sig) == -1 && errno == ESRCH)
+    {
+        kill(pid, sig);
+    }
+    kill(-pid, SIGCONT);
+}
+
+/*
+ * Function: fire
+ * Acts on an expiry of a limit, if there is one: sends its signal to
+ * every job under it, then at the end of the grace period SIGKILL.
+ */
+static void fire(limit_t *l)
+{
+    struct itimerspec its;
+    uint64_t expired;
+    int sig = l->stage ? SIGKILL : l->sig;
+
+    /* if the timer has not expired */
+    if (l->stage == 2 || read(l->fd, &expired, sizeof(expired)) != (ssize_t)sizeof(expired))
+    {
+        return;
+    }
+    for (int i = 0; i < n_members; i++)
+    {
+        if (members[i].pid != -1 && members[i].limit == l)
+        {
+            signal_job(members[i].pid, sig);
+        }
+    }
+    l->fired = 1;
+    l->stage = 2;
+    /* if a grace period starts */
+    if (sig != SIGKILL && (l->grace.tv_sec || l->grace.tv_nsec))
+    {
+        memset(&its, 0, sizeof(its));
+        its.it_value = l->grace;
+        l->stage = timerfd_settime(l->fd, 0, &its, NULL) == -1 ? 2 : 1;
+    }
+}
+
+/*
+ * Function: passed
+ * Checks whether the limit of a timeout still running has passed, firing
+ * the ones that are due. Returns the signal of the one that passed, 0 if
+ * none did.
+ */
+static int passed()
+{
+    for (int i = 0; i < TIMER_MAX; i++)
+    {
+        if (limits[i].used && limits[i].depth)
+        {
+            fire(&limits[i]);
+            if (limits[i].fired)
+            {
+                return limits[i].sig;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: timer_parse
+ * Parses a duration: a decimal number of seconds, which may have a
+ * fraction, and an optional unit of s, m, h or d.
+ *
+ * s : duration
+ * ts : given the duration on success
+ */
+int timer_parse(const char *s, struct timespec *ts)
+{
+    long long sec = 0;
+    long long ns = 0;
+    long long scale = 100000000;
+    long long unit = 1;
+    int digits = 0;
+
+    for (; isdigit((unsigned char)*s); s++, digits++)
+    {
+        /* if it would overflow in days */
+        if (sec > 1000000000LL)
+        {
+            return -1;
+        }
+        sec = sec * 10 + (*s - '0');
+    }
+    if (*s == '.')
+    {
+        for (s++; isdigit((unsigned char)*s); s++, digits++)
+        {
+            ns += (*s - '0') * scale;
+            scale /= 10;
+        }
+    }
+    switch (*s)
+    {
+    case 'd':
+        unit = 86400;
+        break;
+    case 'h':
+        unit = 3600;
+        break;
+    case 'm':
+        unit = 60;
+        break;
+    default:
+        break;
+    }
+    /* if there is no number or something follows the unit */
+    if (!digits || (*s && (!strchr("smhd", *s) || s[1])))
+    {
+        return -1;
+    }
+    ns *= unit;
+    ts->tv_sec = (time_t)(sec * unit + ns / 1000000000);
+    ts->tv_nsec = (long)(ns % 1000000000);
+    return 0;
+}
+
+/*
+ * Function: timer_signal
+ * Parses a signal given by name, with or without SIG, or by number.
+ *
+ * s : signal
+ */
+int timer_signal(const char *s)
+{
+    char *end;
+    long n;
+
+    if (isdigit((unsigned char)*s))
+    {
+        n = strtol(s, &end, 10);
+        return *end || n < 1 || n >= NSIG ? -1 : (int)n;
+    }
+    if (!strncasecmp(s, "SIG", 3))
+    {
+        s += 3;
+    }
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+    {
+        if (!strcasecmp(s, signals[i].name))
+        {
+            return signals[i].sig;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Function: timer_sleep
+ * Sleeps on a timerfd. SIGINT, SIGQUIT and SIGTSTP, which the shell
+ * ignores, are blocked meanwhile so a signalfd receives them and the sleep
+ * ends as a program's would. Limits fire on time while the shell sleeps,
+ * and one of a timeout running ends the sleep.
+ *
+ * ts : time to sleep
+ */
+int timer_sleep(const struct timespec *ts)
+{
+    struct itimerspec its;
+    struct signalfd_siginfo si;
+    struct pollfd fds[TIMER_MAX + 2];
+    limit_t *of[TIMER_MAX + 2];  /* limit of each descriptor polled after the first two */
+    nfds_t n = 2;
+    sigset_t set;
+    sigset_t old;
+    int status = -1;
+    int sig;
+
+    /* if the limit of a timeout has passed already */
+    if ((sig = passed()) != 0)
+    {
+        return 128 + sig;
+    }
+    /* a timerfd set to 0 is disarmed, never expiring */
+    if (!ts->tv_sec && !ts->tv_nsec)
+    {
+        return 0;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value = *ts;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    fds[0].fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    fds[1].fd = signalfd(-1, &set, SFD_CLOEXEC);
+    for (int i = 0; i < TIMER_MAX; i++)
+    {
+        if (limits[i].used && limits[i].stage < 2)
+        {
+            of[n] = &limits[i];
+            fds[n++].fd = limits[i].fd;
+        }
+    }
+    for (nfds_t i = 0; i < n; i++)
+    {
+        fds[i].events = POLLIN;
+    }
+    /* if the timer can not be set */
+    if (fds[0].fd == -1 || fds[1].fd == -1 || timerfd_settime(fds[0].fd, 0, &its, NULL) == -1)
+    {
+        perror("sleep");
+        status = 1;
+    }
+    while (status == -1)
+    {
+        if (poll(fds, n, -1) == -1)
+        {
+            status = errno == EINTR ? -1 : 1;
+            continue;
+        }
+        /* if a signal ended the sleep */
+        if (fds[1].revents && read(fds[1].fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+        {
+            status = 128 + (int)si.ssi_signo;
+        }
+        else if (fds[0].revents)
+        {
+            status = 0;
+        }
+        for (nfds_t i = 2; i < n; i++)
+        {
+            if (fds[i].revents)
+            {
+                fire(of[i]);
+            }
+            /* if the limit of a timeout running ended the sleep */
+            if (of[i]->depth && of[i]->fired && status == -1)
+            {
+                status = 128 + of[i]->sig;
+            }
+        }
+    }
+    if (fds[0].fd != -1)
+    {
+        close(fds[0].fd);
+    }
+    if (fds[1].fd != -1)
+    {
+        close(fds[1].fd);
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return status;
+}
+
+/*
+ * Function: timer_arm
+ * Arms a limit for the command a timeout runs and starts its clock. Every
+ * job forked until timer_disarm is under it, and builtins that wait poll
+ * it meanwhile. A timeout inside another arms a limit of its own; what
+ * runs inside both is under both.
+ *
+ * limit : time the command may run
+ * sig : signal sent at the limit
+ * grace : time from sig to SIGKILL, 0 for never
+ */
+int timer_arm(const struct timespec *limit, int sig, const struct timespec *grace)
+{
+    limit_t *l = NULL;
+    struct itimerspec its;
+
+    for (int i = 0; i < TIMER_MAX && l == NULL; i++)
+    {
+        l = limits[i].used ? NULL : &limits[i];
+    }
+    /* if every slot is taken */
+    if (l == NULL)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    /* if there is no timerfd */
+    if ((l->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) == -1)
+    {
+        return -1;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value = *limit;
+    /* a zero limit is due at once */
+    if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+    {
+        its.it_value.tv_nsec = 1;
+    }
+    /* if the clock can not start */
+    if (timerfd_settime(l->fd, 0, &its, NULL) == -1)
+    {
+        close(l->fd);
+        return -1;
+    }
+    l->used = 1;
+    l->depth = ++depth;
+    l->sig = sig;
+    l->grace = *grace;
+    l->stage = 0;
+    l->fired = 0;
+    return 0;
+}
+
+/*
+ * Function: timer_attach
+ * Puts a job just forked under the limits of the timeouts running. A
+ * limit that has passed already signals it at once.
+ *
+ * pid : leader of the job
+ */
+void timer_attach(pid_t pid)
+{
+    member_t *m;
+
+    for (int i = 0; i < TIMER_MAX; i++)
+    {
+        if (!limits[i].used || !limits[i].depth)
+        {
+            continue;
+        }
+        m = NULL;
+        for (int k = 0; k < n_members && m == NULL; k++)
+        {
+            m = members[k].pid == -1 ? &members[k] : NULL;
+        }
+        /* if every slot is taken, the job runs without this limit */
+        if (m == NULL && n_members == TIMER_MAX)
+        {
+            fprintf(stderr, "%s\n", "timeout: Too many jobs under time limits.");
+            continue;
+        }
+        m = m != NULL ? m : &members[n_members++];
+        fire(&limits[i]);
+        m->pid = pid;
+        m->limit = &limits[i];
+        if (limits[i].fired)
+        {
+            signal_job(pid, limits[i].stage == 2 && (limits[i].grace.tv_sec || limits[i].grace.tv_nsec)
+                                ? SIGKILL
+                                : limits[i].sig);
+        }
+    }
+}
+
+/*
+ * Function: timer_ready
+ * Waits for fd to be readable or the limit of a timeout running to pass,
+ * for a builtin that would block reading it.
+ *
+ * fd : descriptor about to be read
+ */
+int timer_ready(int fd)
+{
+    struct pollfd fds[TIMER_MAX + 1];
+    nfds_t n = 1;
+
+    fds[0].fd = fd;
+    for (int i = 0; i < TIMER_MAX; i++)
+    {
+        if (limits[i].used && limits[i].depth)
+        {
+            fds[n++].fd = limits[i].fd;
+        }
+    }
+    for (nfds_t i = 0; i < n; i++)
+    {
+        fds[i].events = POLLIN;
+    }
+    while (n > 1 && !passed())
+    {
+        /* if poll fails, the read goes ahead unlimited */
+        if (poll(fds, n, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+        if (fds[0].revents)
+        {
+            return 1;
+        }
+    }
+    return n == 1 || !passed();
+}
+
+/*
+ * Function: timer_disarm
+ * Ends the limit of the innermost timeout running. Jobs under it that are
+ * still running, in the background or stopped, stay under it. Returns
+ * whether it passed.
+ */
+int timer_disarm()
+{
+    limit_t *l = innermost();
+    int fired;
+
+    if (l == NULL)
+    {
+        return 0;
+    }
+    fire(l);
+    fired = l->fired;
+    l->depth = 0;
+    depth--;
+    for (int i = 0; i < n_members; i++)
+    {
+        if (members[i].pid != -1 && members[i].limit == l)
+        {
+            return fired;
+        }
+    }
+    close(l->fd);
+    l->used = 0;
+    return fired;
+}
+
+/*
+ * Function: timer_wait
+ * Waits for a job to end or stop. If it is under limits, the wait polls
+ * their timers and a signalfd for SIGCHLD, blocked meanwhile, and fires
+ * them on time. Returns what waitpid returned.
+ *
+ * pid : leader of the job
+ * status : given the status from waitpid
+ */
+pid_t timer_wait(pid_t pid, int *status)
+{
+    struct signalfd_siginfo si;
+    struct pollfd fds[TIMER_MAX + 1];
+    limit_t *of[TIMER_MAX + 1];
+    nfds_t n = 1;
+    sigset_t set;
+    sigset_t old;
+    pid_t w;
+
+    for (int i = 0; i < n_members; i++)
+    {
+        if (members[i].pid == pid && members[i].limit->stage < 2)
+        {
+            of[n] = members[i].limit;
+            fds[n++].fd = members[i].limit->fd;
+        }
+    }
+    if (n == 1)
+    {
+        w = waitpid(pid, status, WUNTRACED);
+    }
+    else
+    {
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &set, &old);
+        /* if there is no signalfd, the limits fire only when the shell next reaps */
+        if ((fds[0].fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK)) == -1)
+        {
+            sigprocmask(SIG_SETMASK, &old, NULL);
+            return waitpid(pid, status, WUNTRACED);
+        }
+        for (nfds_t i = 0; i < n; i++)
+        {
+            fds[i].events = POLLIN;
+        }
+        /* a child that ends between waitpid and poll leaves SIGCHLD pending for the signalfd */
+        while ((w = waitpid(pid, status, WUNTRACED | WNOHANG)) == 0)
+        {
+            if (poll(fds, n, -1) == -1 && errno != EINTR)
+            {
+                w = -1;
+                break;
+            }
+            while (read(fds[0].fd, &si, sizeof(si)) > 0)
+            {
+            }
+            for (nfds_t i = 1; i < n; i++)
+            {
+                fire(of[i]);
+            }
+        }
+        close(fds[0].fd);
+        sigprocmask(SIG_SETMASK, &old, NULL);
+    }
+    /* a stopped job stays under its limits */
+    if (w == pid && !WIFSTOPPED(*status))
+    {
+        timer_forget(pid);
+    }
+    return w;
+}
+
+/*
+ * Function: timer_check
+ * Fires the limits that are due, of jobs in the background or stopped.
+ */
+void timer_check()
+{
+    for (int i = 0; i < TIMER_MAX; i++)
+    {
+        if (limits[i].used)
+        {
+            fire(&limits[i]);
+        }
+    }
+}
+
+/*
+ * Function: timer_forget
+ * Takes a job that ended out from under its limits.
+ *
+ * pid : leader of the job
+ */
+void timer_forget(pid_t pid)
+{
+    for (int i = 0; pid > 0 && i < n_members; i++)
+    {
+        if (members[i].pid == pid)
+        {
+            drop_member(&members[i]);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Timers of the sleep and timeout builtins, on timerfd. sleep waits in the
+ * shell on a timerfd and a signalfd, so Ctrl-C or Ctrl-Z still end it. A
+ * time limit starts when timeout arms it and lasts until the command
+ * timeout runs returns: every job forked meanwhile is under it, so it
+ * bounds a function or list as a whole. Waiting for a job polls the
+ * timers of its limits along with a signalfd for SIGCHLD, so a limit needs
+ * no process of its own. On expiry the jobs under the limit get its
+ * signal, then SIGKILL after the grace period, and a job forked later
+ * gets them at once. Builtins run in the shell rather than in a child, so
+ * they keep their effects on it: sleep and read poll the limit and end
+ * when it passes. Limits of jobs in the background or stopped fire during
+ * a sleep, or else when the shell next reaps.
+ */
+
+/* parses a duration: a decimal number of seconds with an optional s, m, h or d; returns 0 on success, -1 on failure */
+int timer_parse(const char *s, struct timespec *ts);
+
+/* parses a signal name, with or without SIG, or number; returns it, -1 if unknown */
+int timer_signal(const char *s);
+
+/* sleeps for ts; returns 0, or 128 plus the signal that ended it */
+int timer_sleep(const struct timespec *ts);
+
+/* arms a limit starting now, for builtins and the jobs forked until timer_disarm, sending sig at limit and SIGKILL grace later (never if grace is 0); returns 0 on success, -1 on failure */
+int timer_arm(const struct timespec *limit, int sig, const struct timespec *grace);
+
+/* puts the job led by pid under the limits armed */
+void timer_attach(pid_t pid);
+
+/* waits for fd to be readable or a limit armed to pass; returns 1 if fd is readable, 0 if the limit passed */
+int timer_ready(int fd);
+
+/* ends the innermost limit armed, which stays on the jobs under it still running; returns whether it passed */
+int timer_disarm();
+
+/* waits for pid to end or stop like waitpid with WUNTRACED, firing its limit on time */
+pid_t timer_wait(pid_t pid, int *status);
+
+/* fires the limits that are due, of jobs not waited for */
+void timer_check();
+
+/* takes a job that ended out from under its limits */
+void timer_forget(pid_t pid);
+
+#endif  // TIMER_H_
@@ -0,0 +1,646 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./vars.h"
+
+/* Global Variables */
+static var_t **slots;     /* open-addressing table, a power of two of slots */
+static size_t n_slots;
+static size_t n_vars;     /* names interned */
+static char **env;        /* cached environment, NULL when it must be rebuilt */
+static params_t params;   /* positional parameters */
+static const char *arg0 = "33sh";
+
+/* Helper Functions */
+
+/*
+ * Function: hash
+ * FNV-1a hash of the first len bytes of name.
+ */
+static uint32_t hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Function: probe
+ * Finds the slot of a name, or the empty slot where it would go.
+ */
+static var_t **probe(const char *name, size_t len, uint32_t h)
+{
+    size_t i = h & (n_slots - 1);
+
+    /* linear probing; the table is never full, so this ends */
+    while (slots[i] != NULL &&
+           (slots[i]->hash != h || strncmp(slots[i]->name, name, len) || slots[i]->name[len] != '\0'))
+    {
+        i = (i + 1) & (n_slots - 1);
+    }
+    return &slots[i];
+}
+
+/*
+ * Function: grow
+ * Doubles the number of slots. Returns 0 on success, -1 on failure.
+ */
+static int grow()
+{
+    size_t n = n_slots ? n_slots * 2 : 64;
+    var_t **t;
+
+    /* if calloc fails */
+    if ((t = calloc(n, sizeof(var_t *))) == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        if (slots[i] != NULL)
+        {
+            size_t j = slots[i]->hash & (n - 1);
+
+            while (t[j] != NULL)
+            {
+                j = (j + 1) & (n - 1);
+            }
+            t[j] = slots[i];
+        }
+    }
+    free(slots);
+    slots = t;
+    n_slots = n;
+    return 0;
+}
+
+/*
+ * Function: env_changed
+ * Drops the cached environment if var is part of it.
+ */
+static void env_changed(const var_t *var)
+{
+    if (var->flags & VAR_EXPORT)
+    {
+        free(env);
+        env = NULL;
+    }
+}
+
+/*
+ * Function: var_name_ok
+ * Checks that the first len bytes of name are a letter or underscore
+ * followed by letters, digits and underscores.
+ *
+ * name : pointer to name
+ * len : length of name
+ */
+int var_name_ok(const char *name, size_t len)
+{
+    if (!len || (name[0] >= '0' && name[0] <= '9'))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = name[i];
+
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function: var_find
+ * Looks up a variable without interning its name.
+ *
+ * name : pointer to name
+ * len : length of name
+ */
+var_t *var_find(const char *name, size_t len)
+{
+    if (!n_slots)
+    {
+        return NULL;
+    }
+    return *probe(name, len, hash(name, len));
+}
+
+/*
+ * Function: var_intern
+ * Looks up a variable, adding an unset one if the name is new.
+ *
+ * name : pointer to name
+ * len : length of name
+ */
+var_t *var_intern(const char *name, size_t len)
+{
+    uint32_t h = hash(name, len);
+    var_t **slot;
+    var_t *var;
+
+    /* if table is more than 3/4 full and can not grow */
+    if (n_vars + 1 > n_slots / 4 * 3 && grow() == -1)
+    {
+        return NULL;
+    }
+    if (*(slot = probe(name, len, h)) != NULL)
+    {
+        return *slot;
+    }
+    /* if malloc fails */
+    if ((var = calloc(1, sizeof(var_t) + len + 1)) == NULL)
+    {
+        return NULL;
+    }
+    memcpy(var->name, name, len);
+    var->hash = h;
+    *slot = var;
+    n_vars++;
+    return var;
+}
+
+/*
+ * Function: var_get
+ * Gets the value of a variable.
+ *
+ * name : pointer to name
+ */
+const char *var_get(const char *name)
+{
+    var_t *var = var_find(name, strlen(name));
+
+    return var != NULL ? var->value : NULL;
+}
+
+/*
+ * Function: var_value
+ * Gets the value of a variable, or element 0 of an array.
+ *
+ * var : pointer to variable
+ */
+const char *var_value(const var_t *var)
+{
+    if (var->flags & VAR_ARRAY)
+    {
+        return array_get(var->array, 0);
+    }
+    if (var->flags & VAR_ASSOC)
+    {
+        return assoc_get(var->assoc, "0");
+    }
+    return var->value;
+}
+
+/*
+ * Function: var_make_array
+ * Turns a variable into an array. A value it had becomes element 0.
+ *
+ * var : pointer to variable
+ * assoc : nonzero for an associative array
+ */
+int var_make_array(var_t *var, int assoc)
+{
+    int kind = assoc ? VAR_ASSOC : VAR_ARRAY;
+
+    if (var->flags & kind)
+    {
+        return 0;
+    }
+    /* if it is already an array of the other kind */
+    if (var->flags & (VAR_ARRAY | VAR_ASSOC))
+    {
+        return -1;
+    }
+    if (assoc)
+    {
+        if ((var->assoc = calloc(1, sizeof(assoc_t))) == NULL ||
+            (var->value != NULL && assoc_set(var->assoc, "0", var->value, var->len) == -1))
+        {
+            free(var->assoc);
+            var->assoc = NULL;
+            return -1;
+        }
+    }
+    else if ((var->array = calloc(1, sizeof(array_t))) == NULL ||
+             (var->value != NULL && array_set(var->array, 0, var->value, var->len) == -1))
+    {
+        free(var->array);
+        var->array = NULL;
+        return -1;
+    }
+    /* arrays are not passed to commands */
+    env_changed(var);
+    free(var->value);
+    var->value = NULL;
+    var->len = 0;
+    var->cap = 0;
+    var->flags = (var->flags & ~(VAR_EXPORT | VAR_NUM)) | kind;
+    return 0;
+}
+
+/*
+ * Function: var_index
+ * Converts the subscript of an indexed array, as evaluated by arithmetic,
+ * to an index. Negative ones count back from the end. Returns -1 if it is
+ * out of range.
+ *
+ * var : pointer to variable
+ * sub : pointer to expanded subscript
+ */
+long var_index(const var_t *var, const char *sub)
+{
+    long k = strtol(sub, NULL, 10);
+
+    if (k < 0)
+    {
+        k += (long)(var->flags & VAR_ARRAY ? var->array->n : var->value != NULL);
+    }
+    return k < 0 ? -1 : k;
+}
+
+/*
+ * Function: var_element
+ * Gets an element of a variable. Element 0 of a variable that is not an
+ * array is its value.
+ *
+ * var : pointer to variable, may be NULL
+ * sub : pointer to expanded subscript
+ */
+const char *var_element(const var_t *var, const char *sub)
+{
+    long k;
+
+    if (var == NULL)
+    {
+        return NULL;
+    }
+    if (var->flags & VAR_ASSOC)
+    {
+        return assoc_get(var->assoc, sub);
+    }
+    if ((k = var_index(var, sub)) == -1)
+    {
+        return NULL;
+    }
+    if (var->flags & VAR_ARRAY)
+    {
+        return array_get(var->array, (size_t)k);
+    }
+    return k == 0 ? var->value : NULL;
+}
+
+/*
+ * Function: var_set_element
+ * Sets an element of a variable, making it an indexed array if it is not
+ * an array yet.
+ *
+ * var : pointer to variable
+ * sub : pointer to expanded subscript
+ * value : pointer to value
+ * len : length of value
+ */
+int var_set_element(var_t *var, const char *sub, const char *value, size_t len)
+{
+    long k;
+
+    if (var->flags & VAR_ASSOC)
+    {
+        return assoc_set(var->assoc, sub, value, len);
+    }
+    if (var_make_array(var, 0) == -1)
+    {
+        return -1;
+    }
+    /* if the subscript is before the first element */
+    if ((k = var_index(var, sub)) == -1)
+    {
+        errno = EDOM;
+        return -1;
+    }
+    return array_set(var->array, (size_t)k, value, len);
+}
+
+/*
+ * Function: var_unset_element
+ * Unsets an element of an array, or a variable for its element 0.
+ *
+ * var : pointer to variable
+ * sub : pointer to expanded subscript
+ */
+void var_unset_element(var_t *var, const char *sub)
+{
+    long k;
+
+    if (var->flags & VAR_ASSOC)
+    {
+        assoc_unset(var->assoc, sub);
+    }
+    else if ((k = var_index(var, sub)) != -1)
+    {
+        if (var->flags & VAR_ARRAY)
+        {
+            array_unset(var->array, (size_t)k);
+        }
+        else if (k == 0)
+        {
+            var_unset(var);
+        }
+    }
+}
+
+/*
+ * Function: var_set
+ * Sets the value of a variable, reusing its buffer when the value fits.
+ * Setting an array sets its element 0.
+ *
+ * var : pointer to variable
+ * value : pointer to value
+ * len : length of value
+ */
+int var_set(var_t *var, const char *value, size_t len)
+{
+    if (var->flags & VAR_ARRAY)
+    {
+        return array_set(var->array, 0, value, len);
+    }
+    if (var->flags & VAR_ASSOC)
+    {
+        return assoc_set(var->assoc, "0", value, len);
+    }
+    if (var->value == NULL || len >= var->cap)
+    {
+        size_t cap = len < 16 ? 16 : len + 1;
+        char *p;
+
+        /* if realloc fails */
+        if ((p = realloc(var->value, cap)) == NULL)
+        {
+            return -1;
+        }
+        var->value = p;
+        var->cap = cap;
+    }
+    memmove(var->value, value, len);
+    var->value[len] = '\0';
+    var->len = len;
+    var->flags &= ~VAR_NUM;
+    env_changed(var);
+    return 0;
+}
+
+/*
+ * Function: var_set_num
+ * Sets the value of a variable to the decimal form of num, and keeps num
+ * so arithmetic reads it back as is. Elements of arrays keep only text.
+ *
+ * var : pointer to variable
+ * num : value
+ */
+int var_set_num(var_t *var, int64_t num)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    uint64_t u = num < 0 ? 0 - (uint64_t)num : (uint64_t)num;
+
+    /* digits are written from the end */
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (num < 0)
+    {
+        *--p = '-';
+    }
+    if (var_set(var, p, (size_t)(buf + sizeof(buf) - p)) == -1)
+    {
+        return -1;
+    }
+    if (!(var->flags & (VAR_ARRAY | VAR_ASSOC)))
+    {
+        var->num = num;
+        var->flags |= VAR_NUM;
+    }
+    return 0;
+}
+
+/*
+ * Function: var_unset
+ * Unsets a variable. Its name stays interned.
+ *
+ * var : pointer to variable
+ */
+void var_unset(var_t *var)
+{
+    env_changed(var);
+    free(var->value);
+    var->value = NULL;
+    var->len = 0;
+    var->cap = 0;
+    if (var->array != NULL)
+    {
+        array_clear(var->array);
+        free(var->array);
+        var->array = NULL;
+    }
+    if (var->assoc != NULL)
+    {
+        assoc_clear(var->assoc);
+        free(var->assoc);
+        var->assoc = NULL;
+    }
+    var->flags = 0;
+}
+
+/*
+ * Function: var_export
+ * Adds a variable to, or takes it out of, the environment of commands.
+ *
+ * var : pointer to variable
+ * on : nonzero to export
+ */
+void var_export(var_t *var, int on)
+{
+    /* if the variable joins or leaves the environment */
+    if (!on != !(var->flags & VAR_EXPORT))
+    {
+        free(env);
+        env = NULL;
+    }
+    var->flags = on ? var->flags | VAR_EXPORT : var->flags & ~VAR_EXPORT;
+}
+
+/*
+ * Function: var_import
+ * Sets an exported variable for each NAME=value string of envp.
+ *
+ * envp : pointer to NULL terminated environment
+ */
+int var_import(char **envp)
+{
+    for (int i = 0; envp[i] != NULL; i++)
+    {
+        char *eq = strchr(envp[i], '=');
+        var_t *var;
+
+        /* if entry is not a valid NAME=value */
+        if (eq == NULL || !var_name_ok(envp[i], (size_t)(eq - envp[i])))
+        {
+            continue;
+        }
+        /* if name can not be interned or value set */
+        if ((var = var_intern(envp[i], (size_t)(eq - envp[i]))) == NULL ||
+            var_set(var, eq + 1, strlen(eq + 1)) == -1)
+        {
+            return -1;
+        }
+        var_export(var, 1);
+    }
+    return 0;
+}
+
+/*
+ * Function: var_environ
+ * Builds the environment of exported variables in one allocation, the
+ * pointer array followed by the NAME=value strings. The result is kept
+ * until an exported variable changes.
+ */
+char **var_environ()
+{
+    size_t n = 0;
+    size_t size = 0;
+    char *p;
+
+    if (env != NULL)
+    {
+        return env;
+    }
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        var_t *var = slots[i];
+
+        if (var != NULL && (var->flags & VAR_EXPORT) && var->value != NULL)
+        {
+            n++;
+            size += strlen(var->name) + var->len + 2;
+        }
+    }
+    /* if malloc fails */
+    if ((env = malloc((n + 1) * sizeof(char *) + size)) == NULL)
+    {
+        return NULL;
+    }
+    p = (char *)(env + n + 1);
+    n = 0;
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        var_t *var = slots[i];
+        size_t len;
+
+        if (var != NULL && (var->flags & VAR_EXPORT) && var->value != NULL)
+        {
+            env[n++] = p;
+            len = strlen(var->name);
+            memcpy(p, var->name, len);
+            p[len] = '=';
+            memcpy(p + len + 1, var->value, var->len + 1);
+            p += len + var->len + 2;
+        }
+    }
+    env[n] = NULL;
+    return env;
+}
+
+/*
+ * Function: by_name
+ * qsort comparator of variables by name.
+ */
+static int by_name(const void *a, const void *b)
+{
+    return strcmp((*(var_t *const *)a)->name, (*(var_t *const *)b)->name);
+}
+
+/*
+ * Function: var_list
+ * Collects the variables that are set, or are arrays, and have all of the
+ * given flags, sorted by name.
+ *
+ * flags : flags the variables must have
+ */
+var_t **var_list(int flags)
+{
+    var_t **list;
+    size_t n = 0;
+
+    /* if malloc fails */
+    if ((list = malloc((n_vars + 1) * sizeof(var_t *))) == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        if (slots[i] != NULL && (slots[i]->value != NULL || slots[i]->array != NULL || slots[i]->assoc != NULL) &&
+            (slots[i]->flags & flags) == flags)
+        {
+            list[n++] = slots[i];
+        }
+    }
+    qsort(list, n, sizeof(var_t *), by_name);
+    list[n] = NULL;
+    return list;
+}
+
+/*
+ * Function: var_params
+ * Replaces the positional parameters. The strings are not copied, so they
+ * must outlive their use.
+ *
+ * argv : pointer to parameters array
+ * argc : number of parameters
+ */
+params_t var_params(char **argv, int argc)
+{
+    params_t old = params;
+
+    params.argv = argv;
+    params.argc = argc;
+    return old;
+}
+
+/*
+ * Function: var_get_params
+ * Gets the positional parameters.
+ */
+params_t var_get_params()
+{
+    return params;
+}
+
+/*
+ * Function: var_set_arg0
+ * Sets $0. The string is not copied.
+ *
+ * name : pointer to name of shell or script
+ */
+void var_set_arg0(const char *name)
+{
+    arg0 = name;
+}
+
+/*
+ * Function: var_get_arg0
+ * Gets $0.
+ */
+const char *var_get_arg0()
+{
+    return arg0;
+}
@@ -0,0 +1,114 @@
+#ifndef VARS_H_
+#define VARS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./array.h"
+
+/*
+ * Shell variables live in one open-addressing hash table. A name is interned
+ * the first time it is seen and its slot is never freed, so the var_t of a
+ * name stays at the same address for the life of the shell; unsetting a
+ * variable only drops its value.
+ */
+
+/* variable flags */
+#define VAR_EXPORT 0x1 /* passed to the environment of commands */
+#define VAR_ARRAY 0x2  /* indexed array, elements in array */
+#define VAR_ASSOC 0x4  /* associative array, elements in assoc */
+#define VAR_NUM 0x8    /* value is the decimal form of num */
+
+typedef struct var {
+    char *value;     /* NUL terminated value, NULL if unset or an array */
+    size_t len;      /* length of value */
+    size_t cap;      /* size of the value buffer */
+    int flags;
+    uint32_t hash;
+    array_t *array;  /* elements of an indexed array */
+    assoc_t *assoc;  /* elements of an associative array */
+    int64_t num;     /* value as an integer, kept by arithmetic */
+    char name[];
+} var_t;
+
+/* positional parameters $1, $2, ... of the running script or function */
+typedef struct params {
+    char **argv;
+    int argc;
+} params_t;
+
+/* checks that the first len bytes of name make a variable name */
+int var_name_ok(const char *name, size_t len);
+
+/* gets the variable of the first len bytes of name, NULL if it was never seen */
+var_t *var_find(const char *name, size_t len);
+
+/* gets the variable of the first len bytes of name, interning it if needed, NULL on failure */
+var_t *var_intern(const char *name, size_t len);
+
+/* gets the value of name, NULL if it is unset */
+const char *var_get(const char *name);
+
+/* gets the value of a variable, element 0 of an array, NULL if unset */
+const char *var_value(const var_t *var);
+
+/*
+ * makes a variable an indexed (assoc 0) or associative (assoc 1) array,
+ * keeping a value it had as element 0; returns 0 on success, -1 on failure
+ * (an array can not change kind)
+ */
+int var_make_array(var_t *var, int assoc);
+
+/* index named by the subscript of an indexed array, -1 if before the first element */
+long var_index(const var_t *var, const char *sub);
+
+/* gets an element of a variable (NULL for none), NULL if unset */
+const char *var_element(const var_t *var, const char *sub);
+
+/*
+ * sets an element of a variable, making it an indexed array if needed,
+ * returns 0 on success, -1 on failure with errno EDOM for a bad subscript
+ */
+int var_set_element(var_t *var, const char *sub, const char *value, size_t len);
+
+/* unsets an element of a variable */
+void var_unset_element(var_t *var, const char *sub);
+
+/* sets the value of a variable, element 0 of an array, returns 0 on success, -1 on failure */
+int var_set(var_t *var, const char *value, size_t len);
+
+/* sets the value of a variable to an integer, which arithmetic can read back without parsing */
+int var_set_num(var_t *var, int64_t num);
+
+/* unsets a variable, dropping its value or elements and its flags */
+void var_unset(var_t *var);
+
+/* marks a variable as exported or not */
+void var_export(var_t *var, int on);
+
+/* imports the process environment as exported variables, returns 0 on success, -1 on failure */
+int var_import(char **envp);
+
+/*
+ * gets the environment for a new command, NAME=value for every exported
+ * variable that is set; the array is cached until an exported variable changes
+ * returns NULL on failure
+ */
+char **var_environ();
+
+/*
+ * gets the variables that are set and have all of flags, sorted by name
+ * returns a NULL terminated array to free (but not its elements), NULL on failure
+ */
+var_t **var_list(int flags);
+
+/* replaces the positional parameters, returns the previous ones to restore later */
+params_t var_params(char **argv, int argc);
+
+/* gets the positional parameters */
+params_t var_get_params();
+
+/* sets / gets $0, the name of the shell or script */
+void var_set_arg0(const char *name);
+const char *var_get_arg0();
+
+#endif  // VARS_H_
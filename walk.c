@@ -0,0 +1,553 @@
+#define _GNU_SOURCE /* SYS_getdents64 */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "./walk.h"
+
+#define DENTS_BUF 32768   /* bytes of entries asked for per getdents64 */
+#define WALK_SERIAL 64    /* directories a walk reads alone before it starts threads */
+#define WALK_THREADS 8    /* most threads walking one tree */
+#define WALK_FDS 4096     /* most directories holding descriptors at once */
+
+/* an entry as getdents64 returns it */
+typedef struct dirent64_raw {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} dirent64_raw_t;
+
+/* the tasks of one thread, which takes from the tail while others steal from the head */
+typedef struct deque {
+    walk_dir_t **tasks;
+    size_t head;
+    size_t tail;
+    size_t cap;
+    pthread_mutex_t lock;
+} deque_t;
+
+/* the threads of a walk in progress */
+typedef struct pool {
+    walk_t *walk;
+    deque_t queues[WALK_THREADS];
+    int n_queues;       /* threads taking tasks, each with its queue */
+    long outstanding;   /* directories queued or being read */
+    long held;          /* directories holding descriptors, the root aside */
+    long held_max;      /* most that may, past which directories let go once read */
+    int idle;           /* threads waiting for a task */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} pool_t;
+
+/* a thread of a pool */
+typedef struct worker {
+    pool_t *pool;
+    int id;             /* index of its queue */
+} worker_t;
+
+/* Helper Functions */
+
+/*
+ * Function: report
+ * Prints the error of an entry of directory dir, or of dir itself if name
+ * is NULL, with its path as it was given.
+ */
+static void report(const char *who, const walk_dir_t *dir, const char *name, int err)
+{
+    size_t total = name != NULL ? strlen(name) : 0;
+    size_t pieces = name != NULL;
+    size_t at;
+    char *path;
+
+    for (const walk_dir_t *d = dir; d != NULL; d = d->parent)
+    {
+        total += strlen(d->name);
+        pieces++;
+    }
+    total += pieces - 1;
+    /* if malloc fails, the name alone will do */
+    if ((path = malloc(total + 1)) == NULL)
+    {
+        fprintf(stderr, "%s: %s: %s\n", who, name != NULL ? name : dir->name, strerror(err));
+        return;
+    }
+    at = total;
+    path[at] = '\0';
+    if (name != NULL)
+    {
+        at -= strlen(name);
+        memcpy(path + at, name, strlen(name));
+    }
+    for (const walk_dir_t *d = dir; d != NULL; d = d->parent)
+    {
+        if (at < total)
+        {
+            path[--at] = '/';
+        }
+        at -= strlen(d->name);
+        memcpy(path + at, d->name, strlen(d->name));
+    }
+    fprintf(stderr, "%s: %s: %s\n", who, path, strerror(err));
+    free(path);
+}
+
+/*
+ * Function: new_dir
+ * Makes the task of a directory. Returns it, NULL if malloc fails.
+ */
+static walk_dir_t *new_dir(walk_dir_t *parent, const char *name)
+{
+    size_t n = strlen(name);
+    walk_dir_t *d;
+
+    if ((d = malloc(sizeof(walk_dir_t) + n + 1)) != NULL)
+    {
+        d->parent = parent;
+        d->next = NULL;
+        d->fd = -1;
+        d->out = -1;
+        d->let_go = 0;
+        d->pending = 1;
+        d->kept = 0;
+        memcpy(d->name, name, n + 1);
+    }
+    return d;
+}
+
+/*
+ * Function: push
+ * Queues a directory on the tail of a thread's queue, waking a thread
+ * waiting for a task. Returns 0 on success, -1 if the queue can not grow.
+ */
+static int push(pool_t *pool, int id, walk_dir_t *d)
+{
+    deque_t *q = &pool->queues[id];
+    walk_dir_t **p;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->cap)
+    {
+        /* if realloc fails */
+        if ((p = realloc(q->tasks, (q->cap ? q->cap * 2 : 64) * sizeof(walk_dir_t *))) == NULL)
+        {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        q->tasks = p;
+        q->cap = q->cap ? q->cap * 2 : 64;
+    }
+    /* counted before it can be taken, so the count never drops to 0 early */
+    __atomic_add_fetch(&pool->outstanding, 1, __ATOMIC_SEQ_CST);
+    q->tasks[q->tail++] = d;
+    pthread_mutex_unlock(&q->lock);
+    if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return 0;
+}
+
+/*
+ * Function: take
+ * Takes the newest task of a queue (steal 0) or the oldest (steal 1).
+ * Returns it, NULL if the queue is empty.
+ */
+static walk_dir_t *take(deque_t *q, int steal)
+{
+    walk_dir_t *d = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+    {
+        d = steal ? q->tasks[q->head++] : q->tasks[--q->tail];
+    }
+    if (q->head == q->tail)
+    {
+        q->head = q->tail = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return d;
+}
+
+/*
+ * Function: reopen
+ * Opens d again, or its callbacks' directory if out is set, by name from
+ * the nearest directory above it still holding its descriptor. The root
+ * never lets go. Returns the descriptor, -1 on failure.
+ */
+static int reopen(const walk_dir_t *d, int out)
+{
+    const walk_dir_t *p = d->parent;
+    int at;
+    int fd;
+
+    if (p == NULL)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    /* if the directory above can not be opened either */
+    if ((at = walk_get(p, out)) == -1)
+    {
+        return -1;
+    }
+    fd = openat(at, d->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    walk_put(p, out, at);
+    return fd;
+}
+
+/*
+ * Function: close_dir
+ * Closes the descriptors of d.
+ */
+static void close_dir(walk_dir_t *d)
+{
+    if (d->out != -1)
+    {
+        close(d->out);
+        d->out = -1;
+    }
+    if (d->fd != -1)
+    {
+        close(d->fd);
+        d->fd = -1;
+    }
+}
+
+/*
+ * Function: release
+ * Drops one of the things d waits for: its own reading or a subdirectory.
+ * Once none is left d is left and closed, and its parent released in turn.
+ */
+static void release(pool_t *pool, walk_dir_t *d)
+{
+    while (d != NULL && __atomic_sub_fetch(&d->pending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        walk_dir_t *parent = d->parent;
+
+        if (pool->walk->leave != NULL)
+        {
+            pool->walk->leave(pool->walk, d);
+        }
+        if (!d->let_go && d->fd != -1 && parent != NULL)
+        {
+            __atomic_sub_fetch(&pool->held, 1, __ATOMIC_SEQ_CST);
+        }
+        close_dir(d);
+        free(d);
+        d = parent;
+    }
+}
+
+/*
+ * Function: queue
+ * Queues a subdirectory on the queue of thread id, or reads it here if the
+ * queue can not grow.
+ */
+static void read_dir(pool_t *pool, int id, walk_dir_t *d);
+
+static void queue(pool_t *pool, int id, walk_dir_t *child)
+{
+    if (push(pool, id, child) == -1)
+    {
+        /* read it here instead, deeper on this thread's stack */
+        read_dir(pool, id, child);
+    }
+}
+
+/*
+ * Function: read_dir
+ * Reads a directory, handing its entries to the walk's callback and
+ * queueing the subdirectories it walks into on the queue of thread id.
+ */
+static void read_dir(pool_t *pool, int id, walk_dir_t *d)
+{
+    walk_t *w = pool->walk;
+    uint64_t buf[DENTS_BUF / sizeof(uint64_t)];
+    walk_dir_t *children = NULL; /* subdirectories found while d is to let go */
+    int at = d->parent != NULL ? walk_get(d->parent, 0) : AT_FDCWD;
+    long r;
+
+    /* if the directory can not be opened */
+    if (at == -1 || (d->fd = openat(at, d->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) == -1)
+    {
+        walk_fail(w, d->parent, d->name, errno);
+        walk_put(d->parent, 0, at);
+        __atomic_store_n(&d->kept, 1, __ATOMIC_RELAXED);
+        release(pool, d);
+        return;
+    }
+    if (d->parent != NULL)
+    {
+        walk_put(d->parent, 0, at);
+        /* past its share of descriptors, the walk has d let go of its own once read */
+        if (__atomic_add_fetch(&pool->held, 1, __ATOMIC_SEQ_CST) > pool->held_max)
+        {
+            __atomic_sub_fetch(&pool->held, 1, __ATOMIC_SEQ_CST);
+            d->let_go = 1;
+        }
+    }
+    /* if the callback passes over it */
+    if (w->enter != NULL && w->enter(w, d) == -1)
+    {
+        /* it is left at once, holding its descriptor until then */
+        if (d->let_go)
+        {
+            __atomic_add_fetch(&pool->held, 1, __ATOMIC_SEQ_CST);
+            d->let_go = 0;
+        }
+        release(pool, d);
+        return;
+    }
+    while ((r = syscall(SYS_getdents64, d->fd, buf, sizeof(buf))) > 0)
+    {
+        for (long off = 0; off < r;)
+        {
+            const dirent64_raw_t *e = (const void *)((const char *)buf + off);
+            const char *name = e->d_name;
+            walk_dir_t *child;
+
+            off += e->d_reclen;
+            if ((name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) || !w->entry(w, d, name, e->d_type))
+            {
+                continue;
+            }
+            /* if the subdirectory can not be queued */
+            if ((child = new_dir(d, name)) == NULL)
+            {
+                walk_fail(w, d, name, ENOMEM);
+                continue;
+            }
+            __atomic_add_fetch(&d->pending, 1, __ATOMIC_ACQ_REL);
+            /* a directory letting go queues its subdirectories only once it has */
+            if (d->let_go)
+            {
+                child->next = children;
+                children = child;
+                continue;
+            }
+            queue(pool, id, child);
+        }
+    }
+    /* if the directory could not be read whole */
+    if (r == -1)
+    {
+        walk_fail(w, d, NULL, errno);
+    }
+    if (d->let_go)
+    {
+        close_dir(d);
+    }
+    while (children != NULL)
+    {
+        walk_dir_t *child = children;
+
+        children = child->next;
+        queue(pool, id, child);
+    }
+    release(pool, d);
+}
+
+/*
+ * Function: run
+ * Reads a queued directory and, if it was the last one outstanding, wakes
+ * the threads waiting so they can end.
+ */
+static void run(pool_t *pool, int id, walk_dir_t *d)
+{
+    read_dir(pool, id, d);
+    if (__atomic_sub_fetch(&pool->outstanding, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*
+ * Function: steal
+ * Takes the oldest task of another thread, looking at the queue after its
+ * own first. Returns it, NULL if every queue is empty.
+ */
+static walk_dir_t *steal(pool_t *pool, int id)
+{
+    walk_dir_t *d = NULL;
+
+    for (int k = 1; k <= pool->n_queues && d == NULL; k++)
+    {
+        d = take(&pool->queues[(id + k) % pool->n_queues], 1);
+    }
+    return d;
+}
+
+/*
+ * Function: work
+ * Runs the tasks of a thread: its own newest first, then stolen ones,
+ * waiting while others may still queue some.
+ */
+static void *work(void *arg)
+{
+    worker_t *wk = arg;
+    pool_t *pool = wk->pool;
+    walk_dir_t *d;
+
+    for (;;)
+    {
+        if ((d = take(&pool->queues[wk->id], 0)) != NULL)
+        {
+            run(pool, wk->id, d);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        while ((d = steal(pool, wk->id)) == NULL && __atomic_load_n(&pool->outstanding, __ATOMIC_SEQ_CST) > 0)
+        {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->lock);
+        if (d == NULL)
+        {
+            return NULL;
+        }
+        run(pool, wk->id, d);
+    }
+}
+
+/*
+ * Function: walk_get
+ * Gets the descriptor of a directory, or of its callbacks' directory,
+ * opening it again if the directory let it go.
+ *
+ * d : directory of the walk
+ * out : set for the callbacks' directory
+ */
+int walk_get(const walk_dir_t *d, int out)
+{
+    int fd = out ? d->out : d->fd;
+
+    return fd != -1 || !d->let_go ? fd : reopen(d, out);
+}
+
+/*
+ * Function: walk_put
+ * Closes a descriptor got with walk_get if it was opened again for it.
+ *
+ * d : directory of the walk
+ * out : set for the callbacks' directory
+ * fd : descriptor walk_get returned
+ */
+void walk_put(const walk_dir_t *d, int out, int fd)
+{
+    if (fd >= 0 && d != NULL && fd != (out ? d->out : d->fd))
+    {
+        close(fd);
+    }
+}
+
+/*
+ * Function: walk_fail
+ * Reports the error of an entry of d, or of d itself if name is NULL,
+ * unless it is a file already gone under force, and marks d and the
+ * directories above it as kept.
+ *
+ * w : walk the error happened in
+ * d : directory holding the entry, NULL for the root
+ * name : entry, NULL for d itself
+ * err : errno value
+ */
+void walk_fail(walk_t *w, walk_dir_t *d, const char *name, int err)
+{
+    if (err == ENOENT && w->force)
+    {
+        return;
+    }
+    report(w->who, d, name, err);
+    __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+    for (; d != NULL; d = d->parent)
+    {
+        __atomic_store_n(&d->kept, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Function: walk_tree
+ * Walks a directory and everything below it. The first WALK_SERIAL
+ * directories are read by the calling thread alone; if more are queued by
+ * then, a pool of threads walks the rest.
+ *
+ * w : walk, with its callbacks
+ * path : directory walked
+ */
+int walk_tree(walk_t *w, const char *path)
+{
+    pool_t pool;
+    worker_t workers[WALK_THREADS];
+    pthread_t threads[WALK_THREADS];
+    walk_dir_t *root;
+    walk_dir_t *d;
+    struct rlimit lim;
+    long cpus;
+    int n = 1;
+
+    memset(&pool, 0, sizeof(pool_t));
+    pool.walk = w;
+    pool.n_queues = 1;
+    /* a quarter of the descriptor limit, as the callbacks may hold one per directory too */
+    pool.held_max = getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY ? (long)(lim.rlim_cur / 4) : WALK_FDS;
+    pool.held_max = pool.held_max < 16 ? 16 : pool.held_max > WALK_FDS ? WALK_FDS : pool.held_max;
+    w->failed = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    for (int k = 0; k < WALK_THREADS; k++)
+    {
+        pthread_mutex_init(&pool.queues[k].lock, NULL);
+        workers[k].pool = &pool;
+        workers[k].id = k;
+    }
+    /* if the root can not be queued */
+    if ((root = new_dir(NULL, path)) == NULL || push(&pool, 0, root) == -1)
+    {
+        free(root);
+        walk_fail(w, NULL, path, ENOMEM);
+    }
+    for (int k = 0; k < WALK_SERIAL && (d = take(&pool.queues[0], 0)) != NULL; k++)
+    {
+        run(&pool, 0, d);
+    }
+    /* if the tree is large, walk the rest in parallel */
+    if (__atomic_load_n(&pool.outstanding, __ATOMIC_SEQ_CST) > 0)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        pool.n_queues = (int)(cpus < 1 ? 1 : cpus < WALK_THREADS ? cpus : WALK_THREADS);
+        while (n < pool.n_queues && !pthread_create(&threads[n], NULL, work, &workers[n]))
+        {
+            n++;
+        }
+        /* queues of threads that failed to start stay empty, to be looked at in vain */
+        work(&workers[0]);
+        while (n > 1)
+        {
+            pthread_join(threads[--n], NULL);
+        }
+    }
+    for (int k = 0; k < WALK_THREADS; k++)
+    {
+        free(pool.queues[k].tasks);
+        pthread_mutex_destroy(&pool.queues[k].lock);
+    }
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    return w->failed ? -1 : 0;
+}
@@ -0,0 +1,54 @@
+#ifndef WALK_H_
+#define WALK_H_
+
+/*
+ * Parallel walk of a directory tree, for rm -r and cp -r. The tree is
+ * read relative to directory descriptors with openat and getdents64, and
+ * never through a symbolic link. Every directory found is a task: each
+ * thread of a small pool takes its own newest task first, and steals the
+ * oldest of another thread once it has none. A directory is left by the
+ * thread that finishes the last entry below it. Small trees are walked
+ * before any thread starts. Directories hold their descriptors until they
+ * are left, up to a share of the descriptor limit; past it, a directory
+ * lets them go once read, and walk_get opens it again when needed.
+ */
+
+/* a directory of a walk */
+typedef struct walk_dir {
+    struct walk_dir *parent;  /* NULL for the root of the tree */
+    struct walk_dir *next;    /* next subdirectory to queue once a directory letting go is read */
+    int fd;                   /* open from when it is read until it is left or lets go */
+    int out;                  /* a directory of the callbacks' own, -1 until they set it, closed with fd */
+    int let_go;               /* set if fd and out were closed once it was read */
+    int pending;              /* 1 until it is read, plus its subdirectories not yet left */
+    int kept;                 /* set if something in or below it failed */
+    char name[];              /* relative to the parent, the path as given for the root */
+} walk_dir_t;
+
+/* a walk and what it does; callbacks may be called from several threads at once */
+typedef struct walk {
+    const char *who;  /* name errors are reported under */
+    int force;        /* set if files gone already are not errors */
+    void *arg;        /* for the callbacks */
+    /* called once d is open, before its entries; returns -1 to read none */
+    int (*enter)(struct walk *w, walk_dir_t *d);
+    /* called for each entry of d; type is a DT_ value; returns 1 to walk into it as a directory */
+    int (*entry)(struct walk *w, walk_dir_t *d, const char *name, unsigned char type);
+    /* called once everything below d is done, before it is closed */
+    void (*leave)(struct walk *w, walk_dir_t *d);
+    int failed;       /* set by walk_fail */
+} walk_t;
+
+/* walks the tree at path, returns 0 on success, -1 if anything failed */
+int walk_tree(walk_t *w, const char *path);
+
+/* gets fd of d, or out if out is set, opening it again if d let it go; returns it, -1 on failure */
+int walk_get(const walk_dir_t *d, int out);
+
+/* closes a descriptor from walk_get if it was opened again */
+void walk_put(const walk_dir_t *d, int out, int fd);
+
+/* reports the error of entry name of d, or of d if name is NULL, and marks d and those above it as kept */
+void walk_fail(walk_t *w, walk_dir_t *d, const char *name, int err);
+
+#endif  // WALK_H_
@@ -0,0 +1,357 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "./vars.h"
+#include "./watch.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#define WATCH_BURST 10  /* quiet periods a burst may last before the run starts anyway */
+
+/* a path watched: a directory, or a file in its directory */
+typedef struct target {
+    int wd;             /* watch of the directory, -1 once the kernel drops it */
+    const char *name;   /* name of the file in it, NULL for any entry */
+    int dir;            /* set if the path is a directory, watched through its parent while it is gone */
+} target_t;
+
+/* Helper Functions */
+
+/*
+ * Function: add_target
+ * Watches a path: a directory itself, anything else through the directory
+ * holding it. A directory that is gone is watched through its parent
+ * until it is made again. Returns 0 on success, -1 on failure.
+ */
+static int add_target(int fd, char *path, target_t *t)
+{
+    struct stat st;
+    char dir[PATH_MAX];
+    char *slash;
+
+    t->name = NULL;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        t->dir = 1;
+        return (t->wd = inotify_add_watch(fd, path, WATCH_EVENTS)) == -1 ? -1 : 0;
+    }
+    slash = strrchr(path, '/');
+    t->name = slash != NULL ? slash + 1 : path;
+    /* the directory is the path up to its last slash, / or . */
+    if (slash == NULL)
+    {
+        strcpy(dir, ".");
+    }
+    else if ((size_t)(slash - path) >= sizeof(dir))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    else
+    {
+        memcpy(dir, path, slash == path ? 1 : (size_t)(slash - path));
+        dir[slash == path ? 1 : slash - path] = '\0';
+    }
+    return (t->wd = inotify_add_watch(fd, dir, WATCH_EVENTS)) == -1 ? -1 : 0;
+}
+
+/*
+ * Function: now_ms
+ * Milliseconds on the monotonic clock.
+ */
+static long long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Function: drain
+ * Reads the events waiting on the inotify descriptor. A target whose
+ * watch the kernel dropped, as when its directory is removed, is left
+ * with a wd of -1, and counts as changed.
+ * Returns 1 if one of them is about a target, 0 if none is, -1 on failure.
+ */
+static int drain(int fd, target_t targets[], size_t n)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *e;
+    ssize_t r;
+    int hit = 0;
+
+    /* if the events can not be read */
+    if ((r = read(fd, buf, sizeof(buf))) == -1)
+    {
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    for (char *p = buf; p < buf + r; p += sizeof(struct inotify_event) + e->len)
+    {
+        e = (const struct inotify_event *)(void *)p;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (targets[i].wd != e->wd || e->wd == -1)
+            {
+                continue;
+            }
+            if (e->mask & IN_IGNORED)
+            {
+                targets[i].wd = -1;
+                hit = 1;
+            }
+            else if (targets[i].name == NULL || (e->len && !strcmp(e->name, targets[i].name)))
+            {
+                hit = 1;
+            }
+        }
+    }
+    return hit;
+}
+
+/*
+ * Function: events
+ * Reads the events waiting and watches again the targets whose watch was
+ * dropped, and directories watched through their parent once they are
+ * back, so a directory removed and made again is still watched.
+ * Returns 1 if a target changed, 0 if none did, -1 with the error
+ * printed if the events can not be read or a target can not be watched
+ * again, as when the directory holding it is gone.
+ */
+static int events(int fd, char *paths[], target_t targets[], size_t n)
+{
+    int r;
+
+    /* if the events can not be read */
+    if ((r = drain(fd, targets, n)) == -1)
+    {
+        perror("inotify");
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        /* if a target is gone */
+        if ((targets[i].wd == -1 || (targets[i].dir && targets[i].name != NULL)) &&
+            add_target(fd, paths[i], &targets[i]) == -1)
+        {
+            fprintf(stderr, "watch: %s: %s\n", paths[i], strerror(errno));
+            return -1;
+        }
+    }
+    return r;
+}
+
+/*
+ * Function: start
+ * Starts a run of the command in a process group of its own, so the
+ * programs it starts can be stopped with it. The signals the watch job
+ * takes are unblocked again in the run.
+ * Returns the pidfd of the run, -1 on failure.
+ */
+static int start(char *argv[], int (*run)(char *argv[]), const sigset_t *mask, pid_t *pid)
+{
+    char **envp;
+    int pidfd;
+
+    fflush(stdout);
+    /* if fork fails */
+    if ((*pid = fork()) == -1)
+    {
+        perror("fork");
+        return -1;
+    }
+    if (!*pid)
+    {
+        setpgid(0, 0);
+        sigprocmask(SIG_SETMASK, mask, NULL);
+        /* a program path is run as is; a builtin or function by the shell */
+        if (strchr(argv[0], '/') != NULL && (envp = var_environ()) != NULL)
+        {
+            char *path = argv[0];
+
+            argv[0] = strrchr(argv[0], '/') + 1;
+            execve(path, argv, envp);
+            perror("execve");
+            _exit(127);
+        }
+        fflush(stdout);
+        _exit(run(argv));
+    }
+    setpgid(*pid, *pid);
+    /* if the run can not be waited for with poll */
+    if ((pidfd = (int)syscall(SYS_pidfd_open, *pid, 0)) == -1)
+    {
+        perror("pidfd_open");
+        kill(-*pid, SIGKILL);
+        waitpid(*pid, NULL, 0);
+    }
+    return pidfd;
+}
+
+/*
+ * Function: pass_signal
+ * Passes a signal the watch job took on to the run, if one is going, as
+ * the run is not in the job's process group. A signal that ends the job
+ * ends the run first; one that stops the job stops the run with it.
+ */
+static void pass_signal(int sig, pid_t pid, int running)
+{
+    sigset_t set;
+
+    if (running)
+    {
+        kill(-pid, sig);
+    }
+    if (sig == SIGCONT)
+    {
+        return;
+    }
+    if (sig == SIGTSTP)
+    {
+        raise(SIGSTOP);
+        return;
+    }
+    if (running)
+    {
+        waitpid(pid, NULL, 0);
+    }
+    signal(sig, SIG_DFL);
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    raise(sig);
+}
+
+/*
+ * Function: watch_run
+ * Runs the command, then again after each burst of changes to the paths,
+ * once quiet_ms milliseconds pass without another, or WATCH_BURST times
+ * that if the changes go on. Events about other entries of a watched
+ * directory do not prolong a burst. A run is cancelled with its whole
+ * process group, and waited for before the next starts. Returns 1 once a
+ * path can no longer be watched.
+ *
+ * paths : paths watched
+ * n : number of paths
+ * argv : command run
+ * quiet_ms : milliseconds without changes that end a burst
+ * cancel : set to end a run when a change comes during it
+ * run : runs argv when it is not a program path
+ */
+int watch_run(char *paths[], size_t n, char *argv[], int quiet_ms, int cancel, int (*run)(char *argv[]))
+{
+    target_t *targets;
+    struct pollfd fds[3];
+    struct signalfd_siginfo si;
+    sigset_t set;
+    sigset_t old;
+    pid_t pid = -1;
+    int pending = 1;  /* set if a run is due */
+    long long quiet;  /* time the burst ends unless the paths change again */
+    long long last;   /* time the burst ends regardless */
+    long long left;
+    int fd;
+    int r;
+
+    /* if inotify can not be set up */
+    if ((fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) == -1 || (targets = calloc(n, sizeof(target_t))) == NULL)
+    {
+        perror("inotify");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        /* if a path can not be watched */
+        if (add_target(fd, paths[i], &targets[i]) == -1)
+        {
+            fprintf(stderr, "watch: %s: %s\n", paths[i], strerror(errno));
+            free(targets);
+            return 1;
+        }
+    }
+    /* signals meant for the job, which the runs are apart from, come through a signalfd */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGTSTP);
+    sigaddset(&set, SIGCONT);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    /* if the signals can not be taken */
+    if ((fds[2].fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK)) == -1)
+    {
+        perror("signalfd");
+        free(targets);
+        return 1;
+    }
+    fds[0].fd = fd;
+    fds[1].fd = -1;
+    fds[0].events = fds[1].events = fds[2].events = POLLIN;
+    for (;;)
+    {
+        if (pending && fds[1].fd == -1)
+        {
+            pending = 0;
+            fds[1].fd = start(argv, run, &old, &pid);
+        }
+        /* if poll fails */
+        if (poll(fds, 3, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        while (fds[2].revents && read(fds[2].fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+        {
+            pass_signal((int)si.ssi_signo, pid, fds[1].fd != -1);
+        }
+        /* if the run ended */
+        if (fds[1].fd != -1 && fds[1].revents)
+        {
+            waitpid(pid, NULL, 0);
+            close(fds[1].fd);
+            fds[1].fd = -1;
+        }
+        if (!fds[0].revents || (r = events(fd, paths, targets, n)) == 0)
+        {
+            continue;
+        }
+        /* wait out the burst */
+        quiet = now_ms() + quiet_ms;
+        last = now_ms() + (long long)quiet_ms * WATCH_BURST;
+        while (r != -1 && (left = (quiet < last ? quiet : last) - now_ms()) > 0)
+        {
+            if (poll(fds, 1, (int)left) > 0 && (r = events(fd, paths, targets, n)) == 1)
+            {
+                quiet = now_ms() + quiet_ms;
+            }
+        }
+        if (r == -1)
+        {
+            break;
+        }
+        pending = 1;
+        /* the next run starts once this one has ended */
+        if (cancel && fds[1].fd != -1)
+        {
+            kill(-pid, SIGTERM);
+            kill(-pid, SIGCONT);
+        }
+    }
+    free(targets);
+    return 1;
+}
@@ -0,0 +1,25 @@
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include <stddef.h>
+
+/*
+ * The loop of the watch builtin, run in a child of the shell that is a job
+ * like any other, so Ctrl-C, Ctrl-Z, fg and bg act on it. The loop blocks
+ * on inotify and the pidfd of the command's run, so it takes no CPU while
+ * nothing changes. A directory is watched for changes to its entries, a
+ * file through its directory, so a file replaced by rename is still seen.
+ * Events are debounced: a run starts once the watched paths have been
+ * quiet for a while, or a burst of changes has gone on for ten times that.
+ * A change during a run queues one more run after it, or with cancel ends
+ * the run and starts again, together with everything it started, as each
+ * run has a process group of its own; signals the job gets are passed on
+ * to the run. A watched directory that is removed is watched through its
+ * parent until it is made again; the loop ends with an error once the
+ * directory holding a path is gone.
+ */
+
+/* runs argv now and after each change to paths, with run for what is not a program path; returns only on failure */
+int watch_run(char *paths[], size_t n, char *argv[], int quiet_ms, int cancel, int (*run)(char *argv[]));
+
+#endif  // WATCH_H_